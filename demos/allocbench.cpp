@@ -0,0 +1,161 @@
+#include <cassert>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <vector>
+
+#include "xoz/alloc/free_map.h"
+#include "xoz/alloc/segment_allocator.h"
+#include "xoz/blk/file_block_array.h"
+#include "xoz/err/exceptions.h"
+#include "xoz/ext/extent.h"
+#include "xoz/log/trace.h"
+
+using namespace xoz;  // NOLINT
+
+using xoz::alloc::internals::FreeMap;
+
+/*
+ * Replay an allocation trace against a SegmentAllocator once per
+ * allocation strategy and report the throughput and the fragmentation
+ * reached by each one.
+ *
+ * The trace follows the same format that allocdemo reads from its stdin
+ * (and therefore the one that dataset-xopp/simulate_alloc.py writes):
+ *
+ *  0 <sz>          alloc sz bytes; the segment gets the next id (starting from 1)
+ *  1 <segm_id>     dealloc the segment
+ *  2               release
+ *  3               stats (ignored)
+ *  4               end
+ * */
+struct op_t {
+    int cmd;
+    uint32_t arg;
+};
+
+static std::vector<struct op_t> load_trace(std::istream& in) {
+    std::vector<struct op_t> ops;
+
+    int cmd = 0;
+    while (1) {
+        in >> cmd;
+        if (in.fail() or in.eof()) {
+            break;
+        }
+
+        struct op_t op = {.cmd = cmd, .arg = 0};
+        switch (cmd) {
+            case 0:  // alloc
+            case 1:  // dealloc
+                in >> op.arg;
+                ops.push_back(op);
+                break;
+            case 2:  // release
+                ops.push_back(op);
+                break;
+            case 3:  // stats
+                break;
+            case 4:  // end
+                return ops;
+            default:
+                throw std::runtime_error((F() << "Unknown command " << cmd << " in the trace").str());
+        }
+    }
+
+    return ops;
+}
+
+static void replay(const std::vector<struct op_t>& ops, const char* name, FreeMap::alloc_strategy_t strategy,
+                   bool coalescing_enabled, uint16_t split_above_threshold, const SegmentAllocator::req_t& req) {
+    const uint32_t blk_sz = 512;  // you can change this
+
+    auto fblkarr_ptr = FileBlockArray::create_mem_based(blk_sz);
+    FileBlockArray& fblkarr = *fblkarr_ptr.get();
+    SegmentAllocator sg_alloc(coalescing_enabled, split_above_threshold);
+    sg_alloc.set_alloc_strategy(strategy);
+    sg_alloc.manage_block_array(fblkarr);
+    sg_alloc.initialize_with_nothing_allocated();
+
+    uint32_t next_segm_id = 1;
+    std::map<uint32_t, Segment> segm_by_id;
+
+    auto begin = std::chrono::steady_clock::now();
+    for (const auto& op: ops) {
+        switch (op.cmd) {
+            case 0:
+                segm_by_id.emplace(next_segm_id, sg_alloc.alloc(op.arg, req));
+                ++next_segm_id;
+                break;
+            case 1: {
+                auto it = segm_by_id.find(op.arg);
+                if (it == segm_by_id.end()) {
+                    throw std::runtime_error((F() << "Segment " << op.arg << " not found in the trace").str());
+                }
+                sg_alloc.dealloc(it->second);
+                segm_by_id.erase(it);
+                break;
+            }
+            case 2:
+                sg_alloc.release();
+                break;
+            default:
+                assert(0);
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    const double elapsed_sec = std::chrono::duration<double>(end - begin).count();
+    const auto st = sg_alloc.stats().current;
+
+    // format (one line per strategy):
+    // name ops elapsed_sec ops_per_sec blk_cnt external_frag_sz external_frag_rel in_use_ext_per_segm[0..7]
+    std::cout << std::setw(6) << name << " " << ops.size() << " " << std::fixed << std::setprecision(6)
+              << elapsed_sec << " " << std::setprecision(0) << (elapsed_sec > 0 ? double(ops.size()) / elapsed_sec : 0)
+              << " " << fblkarr.blk_cnt() << " " << st.external_frag_sz << " " << std::setprecision(4)
+              << st.external_frag_rel;
+    for (unsigned i = 0; i < SegmentAllocator::StatsExtPerSegmLen; ++i) {
+        std::cout << " " << st.in_use_ext_per_segm[i];
+    }
+    std::cout << std::endl;
+}
+
+
+int main(int argc, char* argv[]) {
+    if (argc != 8) {
+        std::cerr << "Usage: " << argv[0]
+                  << " <trace file> <coalescing_enabled> <split_above_threshold> <segm_frag_threshold>"
+                     " <allow_suballoc> <allow_inline> <inline_sz>\n";
+        return -1;
+    }
+
+    xoz::log::set_trace_mask_from_env();
+
+    std::ifstream trace_file(argv[1]);
+    if (not trace_file) {
+        std::cerr << "Trace file " << argv[1] << " could not be opened\n";
+        return -1;
+    }
+
+    bool coalescing_enabled = argv[2][0] == '1';
+    uint16_t split_above_threshold = assert_u16(atoi(argv[3]));
+    uint16_t segm_frag_threshold = assert_u16(atoi(argv[4]));
+    bool allow_suballoc = argv[5][0] == '1';
+    bool allow_inline = argv[6][0] == '1';
+    uint8_t inline_sz = assert_u8(atoi(argv[7]));
+
+    const SegmentAllocator::req_t req = {.segm_frag_threshold = segm_frag_threshold,
+                                         .max_inline_sz = allow_inline ? inline_sz : uint8_t(0),
+                                         .allow_suballoc = allow_suballoc,
+                                         .single_extent = false};
+
+    const auto ops = load_trace(trace_file);
+
+    replay(ops, "best", FreeMap::BestFit, coalescing_enabled, split_above_threshold, req);
+    replay(ops, "first", FreeMap::FirstFit, coalescing_enabled, split_above_threshold, req);
+    replay(ops, "next", FreeMap::NextFit, coalescing_enabled, split_above_threshold, req);
+    replay(ops, "buddy", FreeMap::BuddyFit, coalescing_enabled, split_above_threshold, req);
+    return 0;
+}
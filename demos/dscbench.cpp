@@ -0,0 +1,159 @@
+#include <malloc.h>
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <vector>
+
+#include "xoz/blk/vector_block_array.h"
+#include "xoz/dsc/descriptor_set.h"
+#include "xoz/dsc/opaque.h"
+#include "xoz/file/runtime_context.h"
+#include "xoz/log/trace.h"
+
+using namespace xoz;  // NOLINT
+
+/*
+ * Write a set of N small descriptors (header only, no idata nor content)
+ * and measure the time and the heap memory that takes to load it back.
+ *
+ * The heap memory is the one in use according to mallinfo2() so it
+ * accounts for the descriptors, their shared_ptr control blocks
+ * and the set's data structures but not for the blocks of the set
+ * (that were already in memory before the load).
+ *
+ * Then measure the time of the set's bookkeeping over all the descriptors:
+ * looking them up by id, iterating them, marking them as modified (and
+ * writing them) and erasing half of them (and writing the sets).
+ * */
+constexpr static uint32_t SubsetSize = 10000;
+
+static uint64_t heap_in_use() { return uint64_t(mallinfo2().uordblks); }
+
+template <typename Fn>
+static void measure(const char* name, uint32_t cnt, Fn fn) {
+    auto begin = std::chrono::steady_clock::now();
+    fn();
+    auto end = std::chrono::steady_clock::now();
+
+    const double elapsed_sec = std::chrono::duration<double>(end - begin).count();
+
+    // format:
+    // name count elapsed_sec operations_per_sec
+    std::cout << name << " " << cnt << " " << std::fixed << std::setprecision(6) << elapsed_sec << " "
+              << std::setprecision(0) << (elapsed_sec > 0 ? double(cnt) / elapsed_sec : 0) << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 2) {
+        std::cerr << "Usage: " << argv[0] << " [<descriptor count>]\n";
+        return -1;
+    }
+
+    xoz::log::set_trace_mask_from_env();
+
+    const uint32_t cnt = argc == 2 ? uint32_t(atol(argv[1])) : 1000000;
+
+    VectorBlockArray blkarr(64);
+    blkarr.allocator().initialize_from_allocated(std::list<Segment>());
+
+    Segment segm(blkarr.blk_sz_order());
+    {
+        RuntimeContext rctx({});
+        auto dset = DescriptorSet::create(segm, blkarr, rctx);
+
+        struct Descriptor::header_t hdr = {.type = 0xfa, .id = 0x0, .isize = 0, .cparts = {}};
+
+        // The descriptors are spread in subsets of up to SubsetSize descriptors each
+        // because a single set cannot hold so many of them.
+        for (uint32_t added = 0; added < cnt; added += SubsetSize) {
+            auto subset = dset->create_and_add_dset<DescriptorSet>(true);
+
+            std::vector<std::unique_ptr<Descriptor>> dscs;
+            dscs.reserve(std::min(SubsetSize, cnt - added));
+            for (uint32_t i = added; i < cnt and i < added + SubsetSize; ++i) {
+                dscs.push_back(std::make_unique<OpaqueDescriptor>(hdr, blkarr));
+            }
+
+            subset->add_many(std::move(dscs), true);
+        }
+
+        dset->full_sync(false);
+        segm = dset->segment();
+    }
+
+    RuntimeContext rctx({});
+    malloc_trim(0);
+    const uint64_t heap_before = heap_in_use();
+
+    auto begin = std::chrono::steady_clock::now();
+    auto dset = DescriptorSet::create(segm, blkarr, rctx);
+    auto end = std::chrono::steady_clock::now();
+
+    const uint64_t heap_after = heap_in_use();
+    const double elapsed_sec = std::chrono::duration<double>(end - begin).count();
+
+    uint32_t loaded_cnt = 0;
+    DescriptorSet::top_down_for_each_set(*dset, [&loaded_cnt](DescriptorSet* s, size_t) {
+        loaded_cnt += s->count() - s->count_subset();
+    });
+
+    // format:
+    // count elapsed_sec descriptors_per_sec heap_bytes heap_bytes_per_descriptor
+    std::cout << loaded_cnt << " " << std::fixed << std::setprecision(6) << elapsed_sec << " "
+              << std::setprecision(0) << (elapsed_sec > 0 ? double(cnt) / elapsed_sec : 0) << " "
+              << (heap_after - heap_before) << " " << std::setprecision(1)
+              << double(heap_after - heap_before) / double(cnt) << std::endl;
+
+    std::vector<std::shared_ptr<DescriptorSet>> subsets;
+    for (auto it = dset->begin(); it != dset->end(); ++it) {
+        subsets.push_back(it.deref_cast<DescriptorSet>());
+    }
+
+    std::vector<std::vector<uint32_t>> ids_by_subset;
+    measure("iterate", cnt, [&]() {
+        for (const auto& subset: subsets) {
+            auto& ids = ids_by_subset.emplace_back();
+            ids.reserve(subset->count());
+            for (auto it = subset->cbegin(); it != subset->cend(); ++it) {
+                ids.push_back((*it)->id());
+            }
+        }
+    });
+
+    measure("lookup", cnt, [&]() {
+        [[maybe_unused]] uint32_t found = 0;
+        for (size_t i = 0; i < subsets.size(); ++i) {
+            for (const auto id: ids_by_subset[i]) {
+                found += subsets[i]->contains(id) and subsets[i]->get<Descriptor>(id) != nullptr;
+            }
+        }
+        assert(found == cnt);
+    });
+
+    measure("modify", cnt, [&]() {
+        for (size_t i = 0; i < subsets.size(); ++i) {
+            for (const auto id: ids_by_subset[i]) {
+                subsets[i]->mark_as_modified(id);
+            }
+        }
+        dset->full_sync(false);
+    });
+
+    measure("erase", cnt / 2, [&]() {
+        for (size_t i = 0; i < subsets.size(); ++i) {
+            const auto& ids = ids_by_subset[i];
+            for (size_t j = 0; j < ids.size(); j += 2) {
+                subsets[i]->erase(ids[j]);
+            }
+        }
+        dset->full_sync(false);
+    });
+
+    return 0;
+}
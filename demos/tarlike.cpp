@@ -641,6 +641,10 @@ int main(int argc, char* argv[]) {
     // Create a xfile. Create a fresh new xoz file or open it if already exists.
     File xfile = File::create(dmap, argv[1]);
 
+    // Removing members may free many segments at once: queue the deallocations
+    // and return them to the free space in bulk on the next allocation/release.
+    xfile.expose_block_array().allocator().set_deferred_dealloc(true);
+
     // Each xfile has one root descriptor set. A set can then have more sets within (subsets)
     // but in this demo we are not exploring that.
     auto dset = xfile.root();
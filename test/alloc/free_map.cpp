@@ -1086,4 +1086,251 @@ namespace {
                     Extent(0x10001, 0xfff4, false)
                     ));
     }
+
+    TEST(FreeMapTest, AllocAtPosition) {
+        std::list<Extent> assign_extents = {
+            Extent(1, 3, false),
+            Extent(5, 1, false),
+            Extent(7, 4, false),
+        };
+
+        FreeMap fr_map(true, 1);
+        fr_map.provide(assign_extents);
+
+        // No free chunk starts at block 2 even if block 2 is free
+        auto result1 = fr_map.alloc_at(2, 1);
+        EXPECT_EQ(result1.success, (bool)false);
+        EXPECT_EQ(result1.ext, Extent(2, 0, false));
+
+        // Free chunk at 5 is too small
+        auto result2 = fr_map.alloc_at(5, 2);
+        EXPECT_EQ(result2.success, (bool)false);
+        EXPECT_EQ(result2.ext, Extent(5, 1, false));
+
+        // Free chunk at 1 is large enough but the split would leave
+        // a chunk of 1 block, below the split threshold
+        auto result3 = fr_map.alloc_at(1, 2);
+        EXPECT_EQ(result3.success, (bool)false);
+        EXPECT_EQ(result3.ext, Extent(1, 3, false));
+
+        XOZ_EXPECT_FREE_MAP_CONTENT_BY_BLK_NR(fr_map, ElementsAre(
+                    Extent(1, 3, false),
+                    Extent(5, 1, false),
+                    Extent(7, 4, false)
+                    ));
+
+        // Perfect fit
+        auto result4 = fr_map.alloc_at(5, 1);
+        EXPECT_EQ(result4.success, (bool)true);
+        EXPECT_EQ(result4.ext, Extent(5, 1, false));
+
+        // Split above the threshold
+        auto result5 = fr_map.alloc_at(7, 2);
+        EXPECT_EQ(result5.success, (bool)true);
+        EXPECT_EQ(result5.ext, Extent(7, 2, false));
+
+        XOZ_EXPECT_FREE_MAP_CONTENT_BY_BLK_NR(fr_map, ElementsAre(
+                    Extent(1, 3, false),
+                    Extent(9, 2, false)
+                    ));
+
+        XOZ_EXPECT_FREE_MAP_CONTENT_BY_BLK_CNT(fr_map, ElementsAre(
+                    Extent(9, 2, false),
+                    Extent(1, 3, false)
+                    ));
+
+        // Zero blocks is an error
+        EXPECT_THAT(
+            [&]() { fr_map.alloc_at(1, 0); },
+            ThrowsMessage<std::runtime_error>(
+                HasSubstr("cannot alloc 0 blocks")
+                )
+        );
+    }
+
+    TEST(FreeMapTest, AllocFirstFit) {
+        std::list<Extent> assign_extents = {
+            Extent(1, 2, false),
+            Extent(5, 6, false),
+            Extent(20, 3, false),
+            Extent(30, 8, false),
+        };
+
+        FreeMap fr_map(true, 0, FreeMap::FirstFit);
+        fr_map.provide(assign_extents);
+
+        // Best fit would pick the chunk at 20 but first fit
+        // picks the first chunk large enough (at 5)
+        auto result1 = fr_map.alloc(3);
+        EXPECT_EQ(result1.success, (bool)true);
+        EXPECT_EQ(result1.ext, Extent(5, 3, false));
+
+        // Again, from the begin
+        auto result2 = fr_map.alloc(2);
+        EXPECT_EQ(result2.success, (bool)true);
+        EXPECT_EQ(result2.ext, Extent(1, 2, false));
+
+        auto result3 = fr_map.alloc(2);
+        EXPECT_EQ(result3.success, (bool)true);
+        EXPECT_EQ(result3.ext, Extent(8, 2, false));
+
+        XOZ_EXPECT_FREE_MAP_CONTENT_BY_BLK_NR(fr_map, ElementsAre(
+                    Extent(10, 1, false),
+                    Extent(20, 3, false),
+                    Extent(30, 8, false)
+                    ));
+
+        XOZ_EXPECT_FREE_MAP_CONTENT_BY_BLK_CNT(fr_map, ElementsAre(
+                    Extent(10, 1, false),
+                    Extent(20, 3, false),
+                    Extent(30, 8, false)
+                    ));
+
+        // No chunk is large enough: the closest (largest) is returned
+        auto result4 = fr_map.alloc(9);
+        EXPECT_EQ(result4.success, (bool)false);
+        EXPECT_EQ(result4.ext.blk_cnt(), (uint16_t)8);
+
+        // The split threshold is honored: the chunk at 20 would leave
+        // 1 block free so the chunk at 30 is used instead
+        FreeMap fr_map2(true, 1, FreeMap::FirstFit);
+        fr_map2.provide(assign_extents);
+
+        auto result5 = fr_map2.alloc(5);
+        EXPECT_EQ(result5.success, (bool)true);
+        EXPECT_EQ(result5.ext, Extent(30, 5, false));
+    }
+
+    TEST(FreeMapTest, AllocNextFit) {
+        std::list<Extent> assign_extents = {
+            Extent(1, 4, false),
+            Extent(10, 4, false),
+            Extent(20, 4, false),
+        };
+
+        FreeMap fr_map(true, 0, FreeMap::NextFit);
+        EXPECT_EQ(fr_map.get_alloc_strategy(), FreeMap::NextFit);
+        fr_map.provide(assign_extents);
+
+        // Each search resumes where the previous allocation ended
+        auto result1 = fr_map.alloc(2);
+        EXPECT_EQ(result1.success, (bool)true);
+        EXPECT_EQ(result1.ext, Extent(1, 2, false));
+
+        auto result2 = fr_map.alloc(3);
+        EXPECT_EQ(result2.success, (bool)true);
+        EXPECT_EQ(result2.ext, Extent(10, 3, false));
+
+        auto result3 = fr_map.alloc(1);
+        EXPECT_EQ(result3.success, (bool)true);
+        EXPECT_EQ(result3.ext, Extent(13, 1, false));
+
+        auto result4 = fr_map.alloc(4);
+        EXPECT_EQ(result4.success, (bool)true);
+        EXPECT_EQ(result4.ext, Extent(20, 4, false));
+
+        // Past the last chunk, the search wraps around
+        auto result5 = fr_map.alloc(2);
+        EXPECT_EQ(result5.success, (bool)true);
+        EXPECT_EQ(result5.ext, Extent(3, 2, false));
+
+        XOZ_EXPECT_FREE_MAP_CONTENT_BY_BLK_NR(fr_map, IsEmpty());
+
+        // Setting the strategy restarts the search from the begin
+        fr_map.provide(assign_extents);
+        fr_map.alloc(2);
+        fr_map.alloc(2);
+        fr_map.set_alloc_strategy(FreeMap::NextFit);
+
+        auto result6 = fr_map.alloc(1);
+        EXPECT_EQ(result6.success, (bool)true);
+        EXPECT_EQ(result6.ext, Extent(1, 1, false));
+    }
+
+    TEST(FreeMapTest, AllocBuddyFit) {
+        std::list<Extent> assign_extents = {
+            Extent(1, 3, false),
+            Extent(6, 8, false),
+            Extent(17, 3, false),
+        };
+
+        FreeMap fr_map(true, 0, FreeMap::BuddyFit);
+        fr_map.provide(assign_extents);
+
+        // 3 blocks are aligned to 4: the chunk at 1 has no block
+        // at a multiple of 4 with room for 3 blocks so the
+        // chunk at 6 is used, keeping free the blocks before the
+        // aligned position
+        auto result1 = fr_map.alloc(3);
+        EXPECT_EQ(result1.success, (bool)true);
+        EXPECT_EQ(result1.ext, Extent(8, 3, false));
+
+        XOZ_EXPECT_FREE_MAP_CONTENT_BY_BLK_NR(fr_map, ElementsAre(
+                    Extent(1, 3, false),
+                    Extent(6, 2, false),
+                    Extent(11, 3, false),
+                    Extent(17, 3, false)
+                    ));
+
+        // 2 blocks are aligned to 2
+        auto result2 = fr_map.alloc(2);
+        EXPECT_EQ(result2.success, (bool)true);
+        EXPECT_EQ(result2.ext, Extent(2, 2, false));
+
+        // Perfect aligned fit
+        auto result3 = fr_map.alloc(2);
+        EXPECT_EQ(result3.success, (bool)true);
+        EXPECT_EQ(result3.ext, Extent(6, 2, false));
+
+        // 3 free blocks exist (at 11) but none aligned to 4: the alloc
+        // fails and a smaller chunk is suggested
+        auto result4 = fr_map.alloc(3);
+        EXPECT_EQ(result4.success, (bool)false);
+        EXPECT_EQ(result4.ext.blk_cnt(), (uint16_t)1);
+
+        XOZ_EXPECT_FREE_MAP_CONTENT_BY_BLK_NR(fr_map, ElementsAre(
+                    Extent(1, 1, false),
+                    Extent(11, 3, false),
+                    Extent(17, 3, false)
+                    ));
+    }
+
+    TEST(FreeMapTest, AllocFromChunkOf) {
+        std::list<Extent> assign_extents = {
+            Extent(1, 3, false),
+            Extent(6, 8, false),
+        };
+
+        FreeMap fr_map(true, 0, FreeMap::BuddyFit);
+        fr_map.provide(assign_extents);
+
+        // No chunk contains the block 5 nor the block 14
+        auto result1 = fr_map.alloc_from_chunk_of(5, 2);
+        EXPECT_EQ(result1.success, (bool)false);
+        EXPECT_EQ(result1.ext.blk_cnt(), (uint16_t)0);
+
+        auto result2 = fr_map.alloc_from_chunk_of(14, 2);
+        EXPECT_EQ(result2.success, (bool)false);
+        EXPECT_EQ(result2.ext.blk_cnt(), (uint16_t)0);
+
+        // The chunk is too small
+        auto result3 = fr_map.alloc_from_chunk_of(2, 4);
+        EXPECT_EQ(result3.success, (bool)false);
+        EXPECT_EQ(result3.ext, Extent(1, 3, false));
+
+        // The blocks are taken from the begin of the chunk that contains
+        // the given block even if that is not aligned as BuddyFit requires
+        auto result4 = fr_map.alloc_from_chunk_of(3, 2);
+        EXPECT_EQ(result4.success, (bool)true);
+        EXPECT_EQ(result4.ext, Extent(1, 2, false));
+
+        auto result5 = fr_map.alloc_from_chunk_of(10, 3);
+        EXPECT_EQ(result5.success, (bool)true);
+        EXPECT_EQ(result5.ext, Extent(6, 3, false));
+
+        XOZ_EXPECT_FREE_MAP_CONTENT_BY_BLK_NR(fr_map, ElementsAre(
+                    Extent(3, 1, false),
+                    Extent(9, 5, false)
+                    ));
+    }
 }
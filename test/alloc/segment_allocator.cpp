@@ -3286,6 +3286,78 @@ namespace {
         EXPECT_EQ(stats2.reset_cnt, uint64_t(0));
     }
 
+    TEST(SegmentAllocatorTest, AllocConsecutiveSingleExtents) {
+
+        auto blkarr_ptr = FileBlockArray::create_mem_based(64, 1);
+        FileBlockArray& blkarr = *blkarr_ptr.get();
+        SegmentAllocator sg_alloc;
+        sg_alloc.manage_block_array(blkarr);
+        sg_alloc.initialize_from_allocated(std::list<Segment>());
+
+        // Leave a hole of 1 block before the last allocated block
+        Extent hole = sg_alloc.alloc_single_extent(64);
+        Extent ext = sg_alloc.alloc_single_extent(64);
+        sg_alloc.dealloc_single_extent(hole);
+
+        EXPECT_EQ(hole, Extent(1, 1, false));
+        EXPECT_EQ(ext, Extent(2, 1, false));
+
+        // Each extent would fit in the hole but all of them together
+        // don't (1 + 1 + 2 blocks): they are allocated one after the other
+        // after the last allocated block.
+        auto exts = sg_alloc.alloc_consecutive_single_extents({23, 64, 100});
+        EXPECT_THAT(exts, ElementsAre(
+                    Extent(3, 1, false),
+                    Extent(4, 1, false),
+                    Extent(5, 2, false)
+                    ));
+
+        XOZ_EXPECT_FREE_MAPS_CONTENT_BY_BLK_NR(sg_alloc, ElementsAre(
+                    Extent(1, 1, false)
+                    ));
+
+        // The extents are accounted as if they were allocated one by one
+        auto stats = sg_alloc.stats();
+
+        EXPECT_EQ(stats.current.in_use_by_user_sz, uint64_t(blkarr.blk_sz() * 5));
+        EXPECT_EQ(stats.current.in_use_blk_cnt, uint64_t(5));
+        EXPECT_EQ(stats.current.in_use_ext_cnt, uint64_t(4));
+        EXPECT_EQ(stats.current.alloc_call_cnt, uint64_t(2 + 3));
+        EXPECT_EQ(stats.current.dealloc_call_cnt, uint64_t(1));
+
+        EXPECT_THAT(stats.current.in_use_ext_per_segm, ElementsAre(0,4,0,0,0,0,0,0));
+
+        // so they can be deallocated one by one
+        for (const auto& e: exts) {
+            sg_alloc.dealloc_single_extent(e);
+        }
+
+        auto stats2 = sg_alloc.stats();
+
+        EXPECT_EQ(stats2.current.in_use_by_user_sz, uint64_t(blkarr.blk_sz()));
+        EXPECT_EQ(stats2.current.in_use_blk_cnt, uint64_t(1));
+        EXPECT_EQ(stats2.current.in_use_ext_cnt, uint64_t(1));
+        EXPECT_EQ(stats2.current.alloc_call_cnt, uint64_t(2 + 3));
+        EXPECT_EQ(stats2.current.dealloc_call_cnt, uint64_t(1 + 3));
+        EXPECT_EQ(stats2.current.internal_frag_avg_sz, stats.current.internal_frag_avg_sz - 3 * 32);
+
+        EXPECT_THAT(stats2.current.in_use_ext_per_segm, ElementsAre(0,1,0,0,0,0,0,0));
+
+        // Nothing to allocate, nothing is allocated
+        EXPECT_THAT(sg_alloc.alloc_consecutive_single_extents({}), IsEmpty());
+        EXPECT_EQ(sg_alloc.stats().current.alloc_call_cnt, uint64_t(2 + 3));
+
+        // Zero sizes are not allowed, as in alloc_single_extent()
+        EXPECT_THAT(
+            [&]() { sg_alloc.alloc_consecutive_single_extents({64, 0}); },
+            ThrowsMessage<std::runtime_error>(
+                AllOf(
+                    HasSubstr("Cannot allocate a single extent of zero bytes")
+                    )
+                )
+        );
+    }
+
     TEST(SegmentAllocatorTest, BlockUnblock) {
 
         auto blkarr_ptr = FileBlockArray::create_mem_based(64, 1);
@@ -3684,6 +3756,240 @@ namespace {
         }
     }
 
+    TEST(SegmentAllocatorTest, IncreaseSizeByReallocInPlace) {
+
+        auto blkarr_ptr = FileBlockArray::create_mem_based(64, 1);
+        FileBlockArray& blkarr = *blkarr_ptr.get();
+        SegmentAllocator sg_alloc;
+        sg_alloc.manage_block_array(blkarr);
+        sg_alloc.initialize_from_allocated(std::list<Segment>());
+
+        // Initially, a segment with 1 extent of 1 block at the end of the block array
+        Segment segm = sg_alloc.alloc(64);
+        EXPECT_EQ(segm.ext_cnt(), (size_t)1);
+        EXPECT_EQ(segm.exts()[0], Extent(1, 1, false));
+
+        writeall(blkarr, segm, "AAAABBBBCCCCDDDDEEEEFFFFGGGGHHHHIIIIJJJJKKKKLLLLMMMMNNNNOOOOPPPP");
+
+        // Realloc to 3 blocks: the extent is at the end so the tail
+        // can expand it in place
+        sg_alloc.realloc(segm, 64 * 3);
+
+        EXPECT_EQ(segm.ext_cnt(), (size_t)1);
+        EXPECT_EQ(segm.inline_data_sz(), (uint8_t)(0));
+        EXPECT_EQ(segm.exts()[0], Extent(1, 3, false));
+        EXPECT_EQ(blkarr.blk_cnt(), (uint32_t)3);
+
+        EXPECT_EQ(readall(blkarr, segm, 64), "AAAABBBBCCCCDDDDEEEEFFFFGGGGHHHHIIIIJJJJKKKKLLLLMMMMNNNNOOOOPPPP");
+
+        // Realloc to 3 blocks and 1 subblock: the full extent keeps in place
+        // and a new extent for suballocation is added
+        sg_alloc.realloc(segm, 64 * 3 + 4);
+
+        EXPECT_EQ(segm.ext_cnt(), (size_t)2);
+        EXPECT_EQ(segm.exts()[0], Extent(1, 3, false));
+        EXPECT_EQ(segm.exts()[1].is_suballoc(), (bool)true);
+        EXPECT_EQ(segm.exts()[1].blk_nr(), (uint32_t)4);
+
+        EXPECT_EQ(readall(blkarr, segm, 64), "AAAABBBBCCCCDDDDEEEEFFFFGGGGHHHHIIIIJJJJKKKKLLLLMMMMNNNNOOOOPPPP");
+        writeall(blkarr, segm, std::string(64 * 3, 'X') + "ZZZZ");
+
+        // Realloc to 4 blocks and 1 subblock: the block for suballocation after
+        // the full extent is freed (its data saved) so the full extent is expanded
+        // in place over it and a new block for suballocation is allocated.
+        sg_alloc.realloc(segm, 64 * 4 + 4);
+
+        EXPECT_EQ(segm.ext_cnt(), (size_t)2);
+        EXPECT_EQ(segm.exts()[0], Extent(1, 4, false));
+        EXPECT_EQ(segm.exts()[1].is_suballoc(), (bool)true);
+        EXPECT_EQ(segm.exts()[1].blk_nr(), (uint32_t)5);
+
+        EXPECT_EQ(readall(blkarr, segm, 64 * 3 + 4), std::string(64 * 3, 'X') + "ZZZZ");
+
+        {
+            auto stats = sg_alloc.stats();
+
+            EXPECT_EQ(stats.current.in_use_by_user_sz, uint64_t(64 * 4 + 4));
+            EXPECT_EQ(stats.current.in_use_blk_cnt, uint64_t(5));
+            EXPECT_EQ(stats.current.in_use_blk_for_suballoc_cnt, uint64_t(1));
+            EXPECT_EQ(stats.current.in_use_subblk_cnt, uint64_t(1));
+
+            EXPECT_EQ(stats.current.in_use_ext_cnt, uint64_t(2));
+            EXPECT_EQ(stats.current.in_use_inlined_sz, uint64_t(0));
+
+            EXPECT_EQ(stats.current.external_frag_sz, uint64_t(0));
+
+            EXPECT_THAT(stats.current.in_use_ext_per_segm, ElementsAre(0,0,1,0,0,0,0,0));
+        }
+    }
+
+    TEST(SegmentAllocatorTest, IncreaseSizeByReallocInPlaceUsingFreeBlocks) {
+
+        auto blkarr_ptr = FileBlockArray::create_mem_based(64, 1);
+        FileBlockArray& blkarr = *blkarr_ptr.get();
+        SegmentAllocator sg_alloc;
+        sg_alloc.manage_block_array(blkarr);
+        sg_alloc.initialize_from_allocated(std::list<Segment>());
+
+        Segment segm1 = sg_alloc.alloc(64 * 2);
+        Segment segm2 = sg_alloc.alloc(64 * 3);
+        Segment segm3 = sg_alloc.alloc(64 * 1);
+
+        EXPECT_EQ(segm1.exts()[0], Extent(1, 2, false));
+        EXPECT_EQ(segm2.exts()[0], Extent(3, 3, false));
+        EXPECT_EQ(segm3.exts()[0], Extent(6, 1, false));
+
+        writeall(blkarr, segm1, std::string(64 * 2, 'A'));
+
+        // Free the blocks that follows segm1
+        sg_alloc.dealloc(segm2);
+
+        // Realloc segm1 to 4 blocks: the free blocks that follows segm1
+        // are used to expand it in place
+        sg_alloc.realloc(segm1, 64 * 4);
+
+        EXPECT_EQ(segm1.ext_cnt(), (size_t)1);
+        EXPECT_EQ(segm1.exts()[0], Extent(1, 4, false));
+        EXPECT_EQ(readall(blkarr, segm1, 64 * 2), std::string(64 * 2, 'A'));
+
+        XOZ_EXPECT_FREE_MAPS_CONTENT_BY_BLK_NR(sg_alloc, ElementsAre(
+                    Extent(5, 1, false)
+                    ));
+
+        // Realloc segm1 to 6 blocks: there is 1 free block but it is not
+        // enough and it is not at the end, so a new extent is required
+        sg_alloc.realloc(segm1, 64 * 6);
+
+        EXPECT_GE(segm1.ext_cnt(), (size_t)2);
+        EXPECT_EQ(segm1.exts()[0], Extent(1, 4, false));
+        EXPECT_EQ(segm1.calc_data_space_size(), (uint32_t)(64 * 6));
+        EXPECT_EQ(readall(blkarr, segm1, 64 * 2), std::string(64 * 2, 'A'));
+    }
+
+    TEST(SegmentAllocatorTest, IncreaseSizeByReallocInPlaceUsingFreeBlocksAndTail) {
+
+        auto blkarr_ptr = FileBlockArray::create_mem_based(64, 1);
+        FileBlockArray& blkarr = *blkarr_ptr.get();
+        SegmentAllocator sg_alloc;
+        sg_alloc.manage_block_array(blkarr);
+        sg_alloc.initialize_from_allocated(std::list<Segment>());
+
+        Segment segm1 = sg_alloc.alloc(64 * 2);
+        Segment segm2 = sg_alloc.alloc(64 * 3);
+
+        EXPECT_EQ(segm1.exts()[0], Extent(1, 2, false));
+        EXPECT_EQ(segm2.exts()[0], Extent(3, 3, false));
+
+        writeall(blkarr, segm1, std::string(64 * 2, 'A'));
+
+        // Free the blocks that follows segm1. These are at the end
+        // of the block array but they are not released yet.
+        sg_alloc.dealloc(segm2);
+        EXPECT_EQ(blkarr.blk_cnt(), (uint32_t)5);
+
+        // Realloc segm1 to 7 blocks: the free blocks are not enough
+        // but because they are at the end, the tail can provide the rest
+        sg_alloc.realloc(segm1, 64 * 7);
+
+        EXPECT_EQ(segm1.ext_cnt(), (size_t)1);
+        EXPECT_EQ(segm1.exts()[0], Extent(1, 7, false));
+        EXPECT_EQ(blkarr.blk_cnt(), (uint32_t)7);
+        EXPECT_EQ(readall(blkarr, segm1, 64 * 2), std::string(64 * 2, 'A'));
+
+        XOZ_EXPECT_FREE_MAPS_CONTENT_BY_BLK_NR(sg_alloc, IsEmpty());
+
+        {
+            auto stats = sg_alloc.stats();
+
+            EXPECT_EQ(stats.current.in_use_by_user_sz, uint64_t(64 * 7));
+            EXPECT_EQ(stats.current.in_use_blk_cnt, uint64_t(7));
+            EXPECT_EQ(stats.current.in_use_ext_cnt, uint64_t(1));
+            EXPECT_EQ(stats.current.external_frag_sz, uint64_t(0));
+
+            EXPECT_THAT(stats.current.in_use_ext_per_segm, ElementsAre(0,1,0,0,0,0,0,0));
+        }
+    }
+
+    TEST(SegmentAllocatorTest, IncreaseSizeByReallocInPlaceWithSubblockBackpressure) {
+
+        auto blkarr_ptr = FileBlockArray::create_mem_based(64, 1);
+        FileBlockArray& blkarr = *blkarr_ptr.get();
+        SegmentAllocator sg_alloc;
+        sg_alloc.manage_block_array(blkarr);
+        sg_alloc.initialize_from_allocated(std::list<Segment>());
+
+        const SegmentAllocator::req_t req = {
+            .segm_frag_threshold = 2,
+            .max_inline_sz = 0,
+            .allow_suballoc = true,
+            .single_extent = false
+        };
+
+        Segment segm = sg_alloc.alloc(64, req);
+        EXPECT_EQ(segm.ext_cnt(), (size_t)1);
+        EXPECT_EQ(segm.exts()[0], Extent(1, 1, false));
+
+        writeall(blkarr, segm, std::string(64, 'A'));
+
+        // Grow by 1 block and 63 bytes: the 63 bytes would require 15 subblocks
+        // and 3 bytes of inline data but no inline data is allowed so they go to
+        // a 16th subblock. That is a full block, so alloc() would use a full block
+        // instead and the last extent must be expanded by 2 blocks in place.
+        sg_alloc.realloc(segm, 64 * 2 + 63, req);
+
+        EXPECT_EQ(segm.ext_cnt(), (size_t)1);
+        EXPECT_EQ(segm.inline_data_sz(), (uint8_t)(0));
+        EXPECT_EQ(segm.exts()[0], Extent(1, 3, false));
+        EXPECT_EQ(blkarr.blk_cnt(), (uint32_t)3);
+
+        EXPECT_EQ(readall(blkarr, segm, 64), std::string(64, 'A'));
+
+        {
+            auto stats = sg_alloc.stats();
+
+            EXPECT_EQ(stats.current.in_use_by_user_sz, uint64_t(64 * 3));
+            EXPECT_EQ(stats.current.in_use_blk_cnt, uint64_t(3));
+            EXPECT_EQ(stats.current.in_use_blk_for_suballoc_cnt, uint64_t(0));
+            EXPECT_EQ(stats.current.in_use_ext_cnt, uint64_t(1));
+
+            EXPECT_THAT(stats.current.in_use_ext_per_segm, ElementsAre(0,1,0,0,0,0,0,0));
+        }
+    }
+
+    TEST(SegmentAllocatorTest, BuddyFitWithSpaceFromTheTail) {
+        for (const bool coalescing_enabled: {false, true}) {
+            auto blkarr_ptr = FileBlockArray::create_mem_based(64, 1);
+            FileBlockArray& blkarr = *blkarr_ptr.get();
+            SegmentAllocator sg_alloc(coalescing_enabled);
+            sg_alloc.set_alloc_strategy(FreeMap::BuddyFit);
+            sg_alloc.manage_block_array(blkarr);
+            sg_alloc.initialize_from_allocated(std::list<Segment>());
+
+            const SegmentAllocator::req_t req = {
+                .segm_frag_threshold = 1,
+                .max_inline_sz = 0,
+                .allow_suballoc = false,
+                .single_extent = false
+            };
+
+            Segment segm1 = sg_alloc.alloc(64, req);
+            Segment segm2 = sg_alloc.alloc(64, req);
+            EXPECT_EQ(segm1.exts()[0], Extent(1, 1, false));
+            EXPECT_EQ(segm2.exts()[0], Extent(2, 1, false));
+
+            // 2 blocks are aligned to 2 but the tail provides them at block 3:
+            // they are taken from there anyways instead of growing the block array
+            // until there is an aligned chunk (without coalescing that would never
+            // happen as each provided space is a chunk on its own)
+            Segment segm3 = sg_alloc.alloc(64 * 2, req);
+            EXPECT_EQ(segm3.ext_cnt(), (size_t)1);
+            EXPECT_EQ(segm3.exts()[0], Extent(3, 2, false));
+            EXPECT_EQ(blkarr.blk_cnt(), (uint32_t)4);
+
+            XOZ_EXPECT_FREE_MAPS_CONTENT_BY_BLK_NR(sg_alloc, IsEmpty());
+        }
+    }
+
     TEST(SegmentAllocatorTest, DecreaseSizeByRealloc) {
 
         auto blkarr_ptr = FileBlockArray::create_mem_based(64, 1);
@@ -3873,5 +4179,94 @@ namespace {
             EXPECT_EQ(stats.reset_cnt, uint64_t(0));
         }
     }
+
+    TEST(SegmentAllocatorTest, DeferredDealloc) {
+        auto blkarr_ptr = FileBlockArray::create_mem_based(64, 1);
+        FileBlockArray& blkarr = *blkarr_ptr.get();
+        SegmentAllocator sg_alloc;
+        sg_alloc.manage_block_array(blkarr);
+        sg_alloc.initialize_from_allocated(std::list<Segment>());
+
+        sg_alloc.set_deferred_dealloc(true);
+        EXPECT_EQ(sg_alloc.is_deferred_dealloc_enabled(), (bool)true);
+
+        const SegmentAllocator::req_t req = {
+            .segm_frag_threshold = 1,
+            .max_inline_sz = 0,
+            .allow_suballoc = true,
+            .single_extent = false
+        };
+
+        // 2 blocks each, except the last one that has also 1 subblock
+        std::vector<Segment> segms;
+        for (int i = 0; i < 4; ++i) {
+            segms.push_back(sg_alloc.alloc(blkarr.blk_sz() * 2, req));
+        }
+        segms.push_back(sg_alloc.alloc(blkarr.blk_sz() * 2 + 1, req));
+
+        XOZ_EXPECT_FREE_MAPS_CONTENT_BY_BLK_NR(sg_alloc, ElementsAre(
+                    Extent(11, 0b0111111111111111, true)
+                    ));
+
+        // Dealloc in an arbitrary order: nothing is returned to the free maps
+        // but the stats are updated
+        sg_alloc.dealloc(segms[2]);
+        sg_alloc.dealloc(segms[0]);
+        sg_alloc.dealloc(segms[1]);
+        sg_alloc.dealloc(segms[4]);
+
+        XOZ_EXPECT_FREE_MAPS_CONTENT_BY_BLK_NR(sg_alloc, ElementsAre(
+                    Extent(11, 0b0111111111111111, true)
+                    ));
+
+        auto stats = sg_alloc.stats();
+        EXPECT_EQ(stats.current.in_use_by_user_sz, uint64_t(blkarr.blk_sz() * 2));
+        EXPECT_EQ(stats.current.in_use_ext_cnt, uint64_t(1));
+        EXPECT_EQ(stats.current.dealloc_call_cnt, uint64_t(4));
+
+        // The flush coalesces the contiguous extents and the block
+        // for suballocation is returned as it is fully free
+        sg_alloc.flush_pending_deallocs();
+
+        XOZ_EXPECT_FREE_MAPS_CONTENT_BY_BLK_NR(sg_alloc, ElementsAre(
+                    Extent(1, 6, false),
+                    Extent(9, 3, false)
+                    ));
+
+        // A double free is detected on the flush; the other queued
+        // extents are freed anyway
+        sg_alloc.dealloc(segms[3]);
+        sg_alloc.dealloc(segms[0]);
+        EXPECT_THAT(
+            [&]() { sg_alloc.flush_pending_deallocs(); },
+            ThrowsMessage<ExtentOverlapError>(
+                AllOf(
+                    HasSubstr("possible double free detected")
+                    )
+                )
+        );
+
+        XOZ_EXPECT_FREE_MAPS_CONTENT_BY_BLK_NR(sg_alloc, ElementsAre(
+                    Extent(1, 11, false)
+                    ));
+
+        // The next alloc reuses the freed blocks
+        Segment segm = sg_alloc.alloc(blkarr.blk_sz() * 11, req);
+        EXPECT_THAT(segm.exts(), ElementsAre(
+                    Extent(1, 11, false)
+                    ));
+
+        // Disabling the deferred dealloc flushes any pending extent
+        sg_alloc.dealloc(segm);
+        sg_alloc.set_deferred_dealloc(false);
+
+        XOZ_EXPECT_FREE_MAPS_CONTENT_BY_BLK_NR(sg_alloc, ElementsAre(
+                    Extent(1, 11, false)
+                    ));
+
+        sg_alloc.release();
+        XOZ_EXPECT_FREE_MAPS_CONTENT_BY_BLK_NR(sg_alloc, IsEmpty());
+        EXPECT_EQ(blkarr.blk_cnt(), (uint32_t)0);
+    }
 }
 
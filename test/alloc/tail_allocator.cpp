@@ -131,6 +131,100 @@ namespace {
         EXPECT_EQ(blkarr.blk_cnt(), (uint32_t)0);
     }
 
+    TEST(TailAllocatorTest, AllocAndGrowAheadInFixedChunks) {
+        auto blkarr_ptr = FileBlockArray::create_mem_based(64);
+        FileBlockArray& blkarr = *blkarr_ptr.get();
+        TailAllocator alloc;
+        alloc.manage_block_array(blkarr);
+        alloc.set_growth_policy({.fixed_blk_cnt = 8, .geometric_div = 0, .max_reserve_blk_cnt = 8});
+
+        // The array grows by the 3 requested blocks plus 8 blocks ahead
+        auto result1 = alloc.alloc(3);
+
+        EXPECT_EQ(result1.success, (bool)true);
+        EXPECT_EQ(result1.ext, Extent(0, 3, false));
+
+        EXPECT_EQ(blkarr.past_end_blk_nr(), (uint32_t)3);
+        EXPECT_EQ(blkarr.blk_cnt(), (uint32_t)3);
+        EXPECT_EQ(blkarr.capacity(), (uint32_t)(3 + 8));
+        EXPECT_EQ(blkarr.stats().grow_expand_capacity_call_cnt, (uint64_t)1);
+
+        // These are taken from the reserve: the array's backend is not expanded
+        auto result2 = alloc.alloc(2);
+        auto result3 = alloc.alloc(6);
+
+        EXPECT_EQ(result2.ext, Extent(3, 2, false));
+        EXPECT_EQ(result3.ext, Extent(5, 6, false));
+
+        EXPECT_EQ(blkarr.blk_cnt(), (uint32_t)11);
+        EXPECT_EQ(blkarr.capacity(), (uint32_t)11);
+        EXPECT_EQ(blkarr.stats().grow_expand_capacity_call_cnt, (uint64_t)1);
+
+        // The reserve is exhausted so the array is expanded again
+        auto result4 = alloc.alloc(1);
+
+        EXPECT_EQ(result4.ext, Extent(11, 1, false));
+        EXPECT_EQ(blkarr.blk_cnt(), (uint32_t)12);
+        EXPECT_EQ(blkarr.capacity(), (uint32_t)(12 + 8));
+        EXPECT_EQ(blkarr.stats().grow_expand_capacity_call_cnt, (uint64_t)2);
+
+        // Any unused reserve is freed on release
+        alloc.release();
+
+        EXPECT_EQ(blkarr.blk_cnt(), (uint32_t)12);
+        EXPECT_EQ(blkarr.capacity(), (uint32_t)12);
+        EXPECT_EQ(blkarr.expose_mem_fp().str().size(), (size_t)(12 * 64));
+
+        alloc.reset();
+
+        EXPECT_EQ(blkarr.blk_cnt(), (uint32_t)0);
+        EXPECT_EQ(blkarr.capacity(), (uint32_t)0);
+    }
+
+    TEST(TailAllocatorTest, AllocAndGrowAheadGeometrically) {
+        auto blkarr_ptr = FileBlockArray::create_mem_based(64);
+        FileBlockArray& blkarr = *blkarr_ptr.get();
+        TailAllocator alloc;
+        alloc.manage_block_array(blkarr);
+
+        // Reserve half of the current array plus 1, capped to 16 blocks
+        alloc.set_growth_policy({.fixed_blk_cnt = 1, .geometric_div = 2, .max_reserve_blk_cnt = 16});
+
+        // Empty array: only the fixed part is reserved
+        alloc.alloc(4);
+        EXPECT_EQ(blkarr.blk_cnt(), (uint32_t)4);
+        EXPECT_EQ(blkarr.capacity(), (uint32_t)(4 + 1));
+
+        // Taken from the reserve
+        alloc.alloc(1);
+        EXPECT_EQ(blkarr.capacity(), (uint32_t)5);
+        EXPECT_EQ(blkarr.stats().grow_expand_capacity_call_cnt, (uint64_t)1);
+
+        // No reserve left: grow by 10 blocks plus 1 + 5/2 blocks
+        alloc.alloc(10);
+        EXPECT_EQ(blkarr.blk_cnt(), (uint32_t)15);
+        EXPECT_EQ(blkarr.capacity(), (uint32_t)(15 + 3));
+        EXPECT_EQ(blkarr.stats().grow_expand_capacity_call_cnt, (uint64_t)2);
+
+        // No enough reserve: grow by 40 blocks (3 from the reserve) plus the
+        // reserve of 1 + 15/2 blocks
+        alloc.alloc(40);
+        EXPECT_EQ(blkarr.blk_cnt(), (uint32_t)55);
+        EXPECT_EQ(blkarr.capacity(), (uint32_t)(55 + 8));
+        EXPECT_EQ(blkarr.stats().grow_expand_capacity_call_cnt, (uint64_t)3);
+
+        // The reserve is capped: 1 + 63/2 blocks is more than 16
+        alloc.alloc(8);
+        alloc.alloc(1);
+        EXPECT_EQ(blkarr.blk_cnt(), (uint32_t)64);
+        EXPECT_EQ(blkarr.capacity(), (uint32_t)(64 + 16));
+        EXPECT_EQ(blkarr.stats().grow_expand_capacity_call_cnt, (uint64_t)4);
+
+        alloc.release();
+        EXPECT_EQ(blkarr.blk_cnt(), (uint32_t)64);
+        EXPECT_EQ(blkarr.capacity(), (uint32_t)64);
+    }
+
     TEST(TailAllocatorTest, DeallocAndShrink) {
         std::stringstream cpy;
 
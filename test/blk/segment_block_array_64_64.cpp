@@ -748,6 +748,14 @@ namespace {
         SegmentBlockArray sg_blkarr(sg, base_blkarr, blkarr_blk_sz, GetParam());
         sg_blkarr.allocator().initialize_from_allocated(std::list<Segment>());
 
+        // Allocate a block in the base array just after the segment. This prevents
+        // the segment to be expanded in place on grow (SG_BLKARR_REALLOC_ON_GROW)
+        // so each grow adds a new extent as this test expects.
+        std::list<Segment> barriers;
+        auto block_in_place_expansion = [&]() {
+            barriers.push_back(base_blkarr.allocator().alloc(base_blkarr_blk_sz));
+        };
+
         // Grow once
         auto old_top_nr = sg_blkarr.grow_by_blocks(1);
         EXPECT_EQ(old_top_nr, (uint32_t)0);
@@ -768,6 +776,7 @@ namespace {
         EXPECT_EQ(sg_blkarr.capacity(), (uint32_t)1);
 
         // Grow again, this will add more extents to the segment
+        block_in_place_expansion();
         old_top_nr = sg_blkarr.grow_by_blocks(2);
         EXPECT_EQ(old_top_nr, (uint32_t)1);
         XOZ_EXPECT_SIZES(sg,
@@ -852,6 +861,7 @@ namespace {
         EXPECT_EQ(sg.exts().back().blk_cnt(), (uint32_t)1);
 
         // Grow again, this will add more extents to the segment
+        block_in_place_expansion();
         old_top_nr = sg_blkarr.grow_by_blocks(3);
         EXPECT_EQ(old_top_nr, (uint32_t)1);
         XOZ_EXPECT_SIZES(sg,
@@ -903,6 +913,7 @@ namespace {
         EXPECT_EQ(sg.exts().back().blk_cnt(), (uint32_t)1);
 
         // Grow know by 1 block. Notice how this add another extent to the segment
+        block_in_place_expansion();
         old_top_nr = sg_blkarr.grow_by_blocks(1);
         EXPECT_EQ(old_top_nr, (uint32_t)2);
         XOZ_EXPECT_SIZES(sg,
@@ -3,6 +3,7 @@
 #include "xoz/io/iospan.h"
 #include "xoz/dsc/descriptor.h"
 #include "xoz/dsc/descriptor_set.h"
+#include "xoz/dsc/private.h"
 #include "test/plain.h"
 #include "xoz/err/exceptions.h"
 #include "xoz/file/runtime_context.h"
@@ -2471,4 +2472,99 @@ namespace {
         dscptr->foo_flushed = dscptr->bar_flushed = false; // reset
         }
     }
+
+    TEST(DescriptorTest, CastByClassTag) {
+        RuntimeContext rctx({});
+        VectorBlockArray blkarr(32);
+        blkarr.allocator().initialize_from_allocated(std::list<Segment>());
+
+        struct Descriptor::header_t hdr = {
+            .type = 0xfa,
+
+            .id = 0x80000001,
+
+            .isize = 0,
+            .cparts = {}
+        };
+
+        static_assert(Descriptor::has_own_class_tag<DescriptorSet>);
+        static_assert(Descriptor::has_own_class_tag<const DescriptorSet>);
+        static_assert(Descriptor::has_own_class_tag<PrivateDescriptor>);
+        static_assert(not Descriptor::has_own_class_tag<PlainDescriptor>);
+
+        std::shared_ptr<Descriptor> dset = DescriptorSet::create(blkarr, rctx);
+        std::shared_ptr<Descriptor> priv = PrivateDescriptor::create(hdr, blkarr, rctx);
+        std::shared_ptr<Descriptor> plain = PlainDescriptor::create(hdr, blkarr, rctx);
+
+        EXPECT_EQ(dset->is_descriptor_set(), (bool)true);
+        EXPECT_EQ(priv->is_descriptor_set(), (bool)false);
+        EXPECT_EQ(plain->is_descriptor_set(), (bool)false);
+
+        // Tagged classes: the cast follows the chain of tags
+        EXPECT_EQ(dset->cast<DescriptorSet>(true), dset.get());
+        EXPECT_EQ(dset->cast<OpaqueDescriptor>(true), nullptr);
+        EXPECT_EQ(priv->cast<PrivateDescriptor>(true), priv.get());
+        EXPECT_EQ(priv->cast<OpaqueDescriptor>(true), priv.get());
+        EXPECT_EQ(priv->cast<DescriptorSet>(true), nullptr);
+        EXPECT_EQ(plain->cast<OpaqueDescriptor>(true), nullptr);
+
+        // Untagged classes fall back to a dynamic cast
+        EXPECT_EQ(plain->cast<PlainDescriptor>(true), plain.get());
+        EXPECT_EQ(priv->cast<PlainDescriptor>(true), nullptr);
+
+        // Same for the casts of shared pointers
+        EXPECT_EQ(Descriptor::cast<OpaqueDescriptor>(priv, true).get(), priv.get());
+        EXPECT_EQ(Descriptor::cast<DescriptorSet>(priv, true), nullptr);
+        EXPECT_EQ(Descriptor::cast<PlainDescriptor>(plain, true).get(), plain.get());
+
+        EXPECT_THAT(
+            [&]() { Descriptor::cast<DescriptorSet>(plain); },
+            ThrowsMessage<std::runtime_error>(
+                AllOf(
+                    HasSubstr("Descriptor cannot be dynamically down casted.")
+                    )
+                )
+        );
+    }
+
+    TEST(DescriptorTest, MappingLookup) {
+        DescriptorMapping dmap({{0xfa, PlainDescriptor::create}, {0x1fff, PlainDescriptor::create}});
+
+        // User defined types
+        EXPECT_EQ(dmap.descriptor_create_lookup(0xfa), descriptor_create_fn(PlainDescriptor::create));
+        EXPECT_EQ(dmap.descriptor_create_lookup(0x1fff), descriptor_create_fn(PlainDescriptor::create));
+
+        // Types defined by xoz and the defaults for unknown types
+        EXPECT_EQ(dmap.descriptor_create_lookup(DescriptorSet::TYPE), descriptor_create_fn(DescriptorSet::create));
+        EXPECT_EQ(dmap.descriptor_create_lookup(0x0002), descriptor_create_fn(PrivateDescriptor::create));
+        EXPECT_EQ(dmap.descriptor_create_lookup(0xfb), descriptor_create_fn(OpaqueDescriptor::create));
+        EXPECT_EQ(dmap.descriptor_create_lookup(0xffff), descriptor_create_fn(OpaqueDescriptor::create));
+
+        // Copies resolve the same
+        DescriptorMapping copy = dmap;
+        for (uint32_t type = 1; type < (1 << 16); ++type) {
+            EXPECT_EQ(copy.descriptor_create_lookup(uint16_t(type)), dmap.descriptor_create_lookup(uint16_t(type)));
+        }
+
+        // Other mappings do not see the types given to this one, even
+        // the ones in the same page of the table
+        DescriptorMapping other({{0xfb, PlainDescriptor::create}});
+        EXPECT_EQ(other.descriptor_create_lookup(0xfa), descriptor_create_fn(OpaqueDescriptor::create));
+        EXPECT_EQ(other.descriptor_create_lookup(0xfb), descriptor_create_fn(PlainDescriptor::create));
+        EXPECT_EQ(dmap.descriptor_create_lookup(0xfb), descriptor_create_fn(OpaqueDescriptor::create));
+
+        DescriptorMapping empty({});
+        EXPECT_EQ(empty.descriptor_create_lookup(0xfa), descriptor_create_fn(OpaqueDescriptor::create));
+        EXPECT_EQ(empty.descriptor_create_lookup(0x1fff), descriptor_create_fn(OpaqueDescriptor::create));
+        EXPECT_EQ(empty.descriptor_create_lookup(DescriptorSet::TYPE), descriptor_create_fn(DescriptorSet::create));
+
+        EXPECT_THAT(
+            [&]() { dmap.descriptor_create_lookup(0); },
+            ThrowsMessage<std::runtime_error>(
+                AllOf(
+                    HasSubstr("Descriptor mapping for type 0 is reserved and should not be present or used.")
+                    )
+                )
+        );
+    }
 }
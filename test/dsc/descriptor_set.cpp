@@ -4,6 +4,7 @@
 #include "xoz/segm/segment.h"
 #include "xoz/io/iospan.h"
 #include "xoz/dsc/descriptor.h"
+#include "xoz/dsc/opaque.h"
 #include "test/plain.h"
 #include "xoz/err/exceptions.h"
 #include "xoz/file/runtime_context.h"
@@ -881,6 +882,444 @@ namespace {
                 );
     }
 
+    TEST(DescriptorSetTest, AddManyDescriptorsContiguously) {
+        RuntimeContext rctx({});
+
+        VectorBlockArray d_blkarr(32);
+        d_blkarr.allocator().initialize_from_allocated(std::list<Segment>());
+        const auto blk_sz_order = d_blkarr.blk_sz_order();
+
+        Segment sg(blk_sz_order);
+        auto dset = DescriptorSet::create(sg, d_blkarr, rctx);
+
+        struct Descriptor::header_t hdr = {
+            .type = 0xfa,
+
+            .id = 0x0,
+
+            .isize = 0,
+            .cparts = {}
+        };
+
+        // Add a bunch of descriptors and write them all at once: the space
+        // for them is allocated in one shot so they are written one after
+        // the other, without padding between them, and the set's segment
+        // is not fragmented (one extent for the set's header, written first,
+        // other for the descriptors and the last for the remaining bytes)
+        const uint32_t dsc_cnt = 1000;
+        for (uint32_t i = 0; i < dsc_cnt; ++i) {
+            auto dscptr = std::make_unique<PlainDescriptor>(hdr, d_blkarr);
+            dscptr->set_idata({'A', 'B'});
+            dset->add(std::move(dscptr));
+        }
+        dset->full_sync(false);
+
+        EXPECT_EQ(dset->count(), dsc_cnt);
+        EXPECT_EQ(dset->does_require_write(), (bool)false);
+        EXPECT_LE(dset->segment().ext_cnt(), (size_t)3);
+
+        std::vector<char> stream;
+        auto sg2 = dset->segment();
+        IOSegment(d_blkarr, sg2).readall(stream);
+
+        // 4 bytes for the set's header, 4 bytes per descriptor
+        ASSERT_EQ(stream.size(), (size_t)(4 + 4 * dsc_cnt));
+        for (uint32_t i = 0; i < dsc_cnt; ++i) {
+            EXPECT_EQ(hexdump(stream, 4 + 4 * i, 4), "fa04 4142");
+        }
+
+        // Load the set from the same segment: all the descriptors must be there
+        auto dset2 = DescriptorSet::create(dset->segment(), d_blkarr, rctx);
+        EXPECT_EQ(dset2->count(), dsc_cnt);
+
+        // Each descriptor is allocated on its own from the stream's allocator
+        // so the stats are right after deallocating them one by one
+        auto st_stats = dset->_get_stream_allocator_stats();
+        EXPECT_EQ(st_stats.current.in_use_ext_cnt, (uint64_t)(1 + dsc_cnt));
+        EXPECT_EQ(st_stats.current.in_use_by_user_sz, (uint64_t)(4 + 4 * dsc_cnt));
+
+        std::vector<uint32_t> ids;
+        for (auto it = dset->cbegin(); it != dset->cend(); ++it) {
+            ids.push_back((*it)->id());
+        }
+        for (const auto id: ids) {
+            dset->erase(id);
+        }
+        dset->full_sync(false);
+
+        st_stats = dset->_get_stream_allocator_stats();
+        EXPECT_EQ(st_stats.current.in_use_ext_cnt, (uint64_t)1);
+        EXPECT_EQ(st_stats.current.in_use_by_user_sz, (uint64_t)4);
+    }
+
+    TEST(DescriptorSetTest, AddManyDescriptorsContiguouslyWithHolesBefore) {
+        RuntimeContext rctx({});
+
+        VectorBlockArray d_blkarr(32);
+        d_blkarr.allocator().initialize_from_allocated(std::list<Segment>());
+        const auto blk_sz_order = d_blkarr.blk_sz_order();
+
+        Segment sg(blk_sz_order);
+        auto dset = DescriptorSet::create(sg, d_blkarr, rctx);
+
+        struct Descriptor::header_t hdr = {
+            .type = 0xfa,
+
+            .id = 0x0,
+
+            .isize = 0,
+            .cparts = {}
+        };
+
+        std::vector<uint32_t> ids;
+        for (uint32_t i = 0; i < 4; ++i) {
+            auto dscptr = std::make_unique<PlainDescriptor>(hdr, d_blkarr);
+            dscptr->set_idata({'A', 'B'});
+            ids.push_back(dset->add(std::move(dscptr)));
+        }
+        dset->full_sync(false);
+
+        // Leave two holes of 4 bytes each in the stream
+        dset->erase(ids[0]);
+        dset->erase(ids[2]);
+        dset->full_sync(false);
+
+        // Each new descriptor would fit in a hole but all of them together
+        // don't: the space for them is allocated in one shot after the holes
+        // and each descriptor is carved from it, one after the other.
+        for (uint32_t i = 0; i < 3; ++i) {
+            auto dscptr = std::make_unique<PlainDescriptor>(hdr, d_blkarr);
+            dscptr->set_idata({'C', 'D'});
+            dset->add(std::move(dscptr));
+        }
+        dset->full_sync(false);
+
+        EXPECT_EQ(dset->count(), (uint32_t)5);
+
+        std::vector<char> stream;
+        auto sg2 = dset->segment();
+        IOSegment(d_blkarr, sg2).readall(stream);
+
+        // 4 bytes for the set's header, 4 bytes per descriptor and 2 holes of 4 bytes
+        ASSERT_EQ(stream.size(), (size_t)(4 + 4 * 5 + 2 * 4));
+        EXPECT_EQ(hexdump(stream, 4, 16), "0000 0000 fa04 4142 0000 0000 fa04 4142");
+        EXPECT_EQ(hexdump(stream, 20, 12), "fa04 4344 fa04 4344 fa04 4344");
+
+        // Each descriptor is accounted on its own
+        auto st_stats = dset->_get_stream_allocator_stats();
+        EXPECT_EQ(st_stats.current.in_use_ext_cnt, (uint64_t)(1 + 5));
+        EXPECT_EQ(st_stats.current.in_use_by_user_sz, (uint64_t)(4 + 4 * 5));
+
+        // Load the set from the same segment: all the descriptors must be there
+        auto dset2 = DescriptorSet::create(dset->segment(), d_blkarr, rctx);
+        EXPECT_EQ(dset2->count(), (uint32_t)5);
+    }
+
+    TEST(DescriptorSetTest, CompactStream) {
+        const struct runtime_config_t runcfg = {
+            .dset = {
+                .sg_blkarr_flags = DefaultRuntimeConfig.dset.sg_blkarr_flags,
+                .on_external_ref_action = DefaultRuntimeConfig.dset.on_external_ref_action,
+                .lazy_load_subsets = false,
+                .load_workers = 1,
+                .sync_workers = 1,
+                .compact_padding_pct = 100,
+                .max_loaded_descriptors = 0,
+            },
+            .file = DefaultRuntimeConfig.file
+        };
+        RuntimeContext rctx({}, false, runcfg);
+        RuntimeContext rctx_no_compact({});
+
+        VectorBlockArray d_blkarr(32);
+        d_blkarr.allocator().initialize_from_allocated(std::list<Segment>());
+        const auto blk_sz_order = d_blkarr.blk_sz_order();
+
+        struct Descriptor::header_t hdr = {
+            .type = 0xfa,
+
+            .id = 0x0,
+
+            .isize = 0,
+            .cparts = {}
+        };
+
+        // Same operations on both sets: add 40 descriptors, then
+        // erase 30 of them
+        Segment sg(blk_sz_order);
+        auto dset = DescriptorSet::create(sg, d_blkarr, rctx);
+
+        Segment sg2(blk_sz_order);
+        auto dset2 = DescriptorSet::create(sg2, d_blkarr, rctx_no_compact);
+
+        for (auto set: {dset.get(), dset2.get()}) {
+            std::vector<uint32_t> ids;
+            for (int i = 0; i < 40; ++i) {
+                auto dscptr = std::make_unique<PlainDescriptor>(hdr, d_blkarr);
+                dscptr->set_idata({'A', 'B'});
+                ids.push_back(set->add(std::move(dscptr)));
+            }
+            set->full_sync(false);
+
+            // 4 bytes for the set's header, 4 bytes per descriptor
+            EXPECT_EQ(set->segment().calc_data_space_size(), (uint32_t)(4 + 4 * 40));
+
+            for (int i = 0; i < 30; ++i) {
+                set->erase(ids[i]);
+            }
+            set->full_sync(false);
+        }
+
+        // Without the compaction, the erased descriptors left padding
+        // in the stream that cannot be released because there are
+        // live descriptors at its end
+        EXPECT_EQ(dset2->segment().calc_data_space_size(), (uint32_t)(4 + 4 * 40));
+        dset2->full_sync(true);
+        EXPECT_EQ(dset2->segment().calc_data_space_size(), (uint32_t)(4 + 4 * 40));
+
+        // With the compaction, the padding (120 bytes) is larger than the live
+        // bytes (44 bytes) so the stream was rewritten without padding
+        EXPECT_EQ(dset->count(), (uint32_t)10);
+        EXPECT_EQ(dset->does_require_write(), (bool)false);
+        EXPECT_EQ(dset->segment().calc_data_space_size(), (uint32_t)(4 + 4 * 10));
+
+        std::vector<char> stream;
+        auto sg3 = dset->segment();
+        IOSegment(d_blkarr, sg3).readall(stream);
+        for (uint32_t i = 0; i < 10; ++i) {
+            EXPECT_EQ(hexdump(stream, 4 + 4 * i, 4), "fa04 4142");
+        }
+
+        // Erasing one more descriptor does not trigger a compaction:
+        // the padding is smaller than a block of the block array
+        {
+            auto it = dset->begin();
+            dset->erase((*it)->id());
+            dset->full_sync(false);
+            EXPECT_EQ(dset->segment().calc_data_space_size(), (uint32_t)(4 + 4 * 10));
+        }
+
+        // Load the set from the same segment: the descriptors must be there
+        auto dset3 = DescriptorSet::create(dset->segment(), d_blkarr, rctx);
+        EXPECT_EQ(dset3->count(), (uint32_t)9);
+    }
+
+    TEST(DescriptorSetTest, LoadSkipsLargePadding) {
+        RuntimeContext rctx({});
+
+        VectorBlockArray d_blkarr(32);
+        d_blkarr.allocator().initialize_from_allocated(std::list<Segment>());
+        const auto blk_sz_order = d_blkarr.blk_sz_order();
+
+        Segment sg(blk_sz_order);
+        auto dset = DescriptorSet::create(sg, d_blkarr, rctx);
+
+        struct Descriptor::header_t hdr = {
+            .type = 0xfa,
+
+            .id = 0x0,
+
+            .isize = 0,
+            .cparts = {}
+        };
+
+        // Add a bunch of descriptors and erase most of them leaving
+        // holes of padding of different sizes (some larger than the window
+        // used to skip the padding, some of a single descriptor)
+        std::vector<uint32_t> ids;
+        for (int i = 0; i < 600; ++i) {
+            auto dscptr = std::make_unique<PlainDescriptor>(hdr, d_blkarr);
+            dscptr->set_idata({'A', char(i % 128)});
+            ids.push_back(dset->add(std::move(dscptr), true));
+        }
+        dset->full_sync(false);
+
+        const std::vector<int> kept = {0, 2, 3, 301, 598};
+        for (int i = 0; i < 600; ++i) {
+            if (std::find(kept.begin(), kept.end(), i) == kept.end()) {
+                dset->erase(ids[i]);
+            }
+        }
+        dset->full_sync(false);
+        // 4 bytes for the set's header, 8 bytes per descriptor (they have a persistent id)
+        EXPECT_EQ(dset->segment().calc_data_space_size(), (uint32_t)(4 + 8 * 600));
+
+        RuntimeContext rctx2({{0xfa, PlainDescriptor::create}});
+        auto dset2 = DescriptorSet::create(dset->segment(), d_blkarr, rctx2);
+        EXPECT_EQ(dset2->count(), (uint32_t)kept.size());
+
+        for (auto i: kept) {
+            EXPECT_EQ(dset2->get<PlainDescriptor>(ids[i])->get_idata(), std::vector<char>({'A', char(i % 128)}));
+        }
+    }
+
+    TEST(DescriptorSetTest, AddMany) {
+        RuntimeContext rctx({});
+        RuntimeContext rctx2({});
+
+        VectorBlockArray d_blkarr(32);
+        d_blkarr.allocator().initialize_from_allocated(std::list<Segment>());
+        const auto blk_sz_order = d_blkarr.blk_sz_order();
+
+        VectorBlockArray other_blkarr(32);
+
+        struct Descriptor::header_t hdr = {
+            .type = 0xfa,
+
+            .id = 0x0,
+
+            .isize = 0,
+            .cparts = {}
+        };
+
+        // Two sets, one filled with add() and the other with add_many()
+        Segment sg(blk_sz_order);
+        auto dset = DescriptorSet::create(sg, d_blkarr, rctx);
+
+        Segment sg2(blk_sz_order);
+        auto dset2 = DescriptorSet::create(sg2, d_blkarr, rctx2);
+
+        std::vector<uint32_t> ids;
+        std::vector<std::unique_ptr<Descriptor>> batch;
+        for (char c = 'A'; c < 'A' + 20; ++c) {
+            auto dscptr = std::make_unique<PlainDescriptor>(hdr, d_blkarr);
+            dscptr->set_idata({c, c});
+            ids.push_back(dset->add(std::move(dscptr), true));
+
+            auto dscptr2 = std::make_unique<PlainDescriptor>(hdr, d_blkarr);
+            dscptr2->set_idata({c, c});
+            batch.push_back(std::move(dscptr2));
+        }
+
+        auto ids2 = dset2->add_many(std::move(batch), true);
+        EXPECT_EQ(batch.size(), (size_t)0);
+
+        // The persistent ids are contiguous and the same than adding one by one
+        EXPECT_EQ(ids2, ids);
+        for (size_t i = 1; i < ids2.size(); ++i) {
+            EXPECT_EQ(ids2[i], ids2[0] + i);
+        }
+
+        EXPECT_EQ(dset2->count(), (uint32_t)20);
+        EXPECT_EQ(dset2->get(ids2[3])->get_owner(), std::addressof(*dset2));
+        EXPECT_EQ(dset2->does_require_write(), (bool)true);
+
+        dset->full_sync(false);
+        dset2->full_sync(false);
+
+        auto sg3 = dset->segment();
+        auto sg4 = dset2->segment();
+        EXPECT_EQ(hexdump(IOSegment(d_blkarr, sg3)), hexdump(IOSegment(d_blkarr, sg4)));
+
+        // Without persistent ids, temporal ones are assigned
+        std::vector<std::unique_ptr<Descriptor>> batch2;
+        batch2.push_back(std::make_unique<PlainDescriptor>(hdr, d_blkarr));
+        batch2.push_back(std::make_unique<PlainDescriptor>(hdr, d_blkarr));
+        auto ids3 = dset2->add_many(std::move(batch2));
+        EXPECT_EQ(ids3.size(), (size_t)2);
+        EXPECT_EQ(rctx2.idmgr.is_temporal(ids3[0]), (bool)true);
+        EXPECT_EQ(rctx2.idmgr.is_temporal(ids3[1]), (bool)true);
+        EXPECT_EQ(dset2->count(), (uint32_t)22);
+
+        // If any descriptor cannot be added, nothing is added
+        std::vector<std::unique_ptr<Descriptor>> batch3;
+        batch3.push_back(std::make_unique<PlainDescriptor>(hdr, d_blkarr));
+        batch3.push_back(std::make_unique<PlainDescriptor>(hdr, other_blkarr));
+        EXPECT_THAT(
+            [&]() { dset2->add_many(std::move(batch3), true); },
+            ThrowsMessage<std::runtime_error>(
+                AllOf(
+                    HasSubstr("claims to use a block array for content at")
+                    )
+                )
+        );
+
+        EXPECT_EQ(batch3.size(), (size_t)2);
+        EXPECT_EQ(batch3[0]->id(), (uint32_t)0);
+        EXPECT_EQ(dset2->count(), (uint32_t)22);
+
+        // Ids duplicated within the batch are detected too
+        hdr.id = ids2.back() + 1;
+        std::vector<std::unique_ptr<Descriptor>> batch4;
+        batch4.push_back(std::make_unique<PlainDescriptor>(hdr, d_blkarr));
+        batch4.push_back(std::make_unique<PlainDescriptor>(hdr, d_blkarr));
+        EXPECT_THAT(
+            [&]() { dset2->add_many(std::move(batch4), true); },
+            ThrowsMessage<std::invalid_argument>(
+                AllOf(
+                    HasSubstr("collides with another descriptor of the same batch")
+                    )
+                )
+        );
+        EXPECT_EQ(dset2->count(), (uint32_t)22);
+
+        // Load the set from the same segment: all the descriptors must be there
+        RuntimeContext rctx3({});
+        auto dset3 = DescriptorSet::create(dset2->segment(), d_blkarr, rctx3);
+        EXPECT_EQ(dset3->count(), (uint32_t)20);
+    }
+
+    TEST(DescriptorSetTest, EraseOrderDoesNotChangeLayout) {
+        RuntimeContext rctx({});
+
+        VectorBlockArray d_blkarr(32);
+        d_blkarr.allocator().initialize_from_allocated(std::list<Segment>());
+        const auto blk_sz_order = d_blkarr.blk_sz_order();
+
+        struct Descriptor::header_t hdr = {
+            .type = 0xfa,
+
+            .id = 0x0,
+
+            .isize = 0,
+            .cparts = {}
+        };
+
+        // Two sets with the same descriptors: erasing the same descriptors
+        // but in different order and then adding new ones must lead to the same stream
+        Segment sg(blk_sz_order);
+        auto dset = DescriptorSet::create(sg, d_blkarr, rctx);
+
+        Segment sg2(blk_sz_order);
+        auto dset2 = DescriptorSet::create(sg2, d_blkarr, rctx);
+
+        std::vector<uint32_t> ids;
+        std::vector<uint32_t> ids2;
+        for (char c = 'A'; c < 'A' + 20; ++c) {
+            auto dscptr = std::make_unique<PlainDescriptor>(hdr, d_blkarr);
+            dscptr->set_idata({c, c});
+            ids.push_back(dset->add(std::move(dscptr)));
+
+            auto dscptr2 = std::make_unique<PlainDescriptor>(hdr, d_blkarr);
+            dscptr2->set_idata({c, c});
+            ids2.push_back(dset2->add(std::move(dscptr2)));
+        }
+        dset->full_sync(false);
+        dset2->full_sync(false);
+
+        const std::vector<int> to_erase = {3, 17, 5, 6, 11, 0};
+        for (auto it = to_erase.begin(); it != to_erase.end(); ++it) {
+            dset->erase(ids[*it]);
+        }
+        for (auto it = to_erase.rbegin(); it != to_erase.rend(); ++it) {
+            dset2->erase(ids2[*it]);
+        }
+
+        for (auto set: {dset.get(), dset2.get()}) {
+            auto dscptr = std::make_unique<PlainDescriptor>(hdr, d_blkarr);
+            dscptr->set_idata({'Z', 'Z'});
+            set->add(std::move(dscptr));
+            set->full_sync(false);
+        }
+
+        EXPECT_EQ(dset->count(), (uint32_t)15);
+        EXPECT_EQ(dset2->count(), (uint32_t)15);
+
+        auto sg3 = dset->segment();
+        auto sg4 = dset2->segment();
+        EXPECT_EQ(hexdump(IOSegment(d_blkarr, sg3)), hexdump(IOSegment(d_blkarr, sg4)));
+    }
+
     TEST(DescriptorSetTest, Iterate) {
         RuntimeContext rctx({});
 
@@ -960,6 +1399,150 @@ namespace {
                 );
     }
 
+    TEST(DescriptorSetTest, IterateInIdOrder) {
+        RuntimeContext rctx({});
+
+        VectorBlockArray d_blkarr(32);
+        d_blkarr.allocator().initialize_from_allocated(std::list<Segment>());
+        const auto blk_sz_order = d_blkarr.blk_sz_order();
+
+        Segment sg(blk_sz_order);
+        auto dset = DescriptorSet::create(sg, d_blkarr, rctx);
+
+        struct Descriptor::header_t hdr = {
+            .type = 0xfa,
+
+            .id = 0x0,
+
+            .isize = 0,
+            .cparts = {}
+        };
+
+        auto collect_ids = [](const DescriptorSet& set) {
+            std::vector<uint32_t> ids;
+            for (auto it = set.cbegin(); it != set.cend(); ++it) {
+                ids.push_back((*it)->id());
+            }
+            return ids;
+        };
+
+        // Add the descriptors out of order: the set is iterated in id order anyways
+        for (uint32_t id: {5, 2, 9, 7, 1}) {
+            hdr.id = id;
+            dset->add(std::make_unique<PlainDescriptor>(hdr, d_blkarr));
+        }
+        EXPECT_THAT(collect_ids(*dset), ElementsAre(1, 2, 5, 7, 9));
+
+        // Removing and adding descriptors keeps the order
+        dset->erase(5);
+        dset->erase(9);
+        hdr.id = 3;
+        dset->add(std::make_unique<PlainDescriptor>(hdr, d_blkarr));
+        hdr.id = 11;
+        dset->add(std::make_unique<PlainDescriptor>(hdr, d_blkarr));
+        EXPECT_THAT(collect_ids(*dset), ElementsAre(1, 2, 3, 7, 11));
+        dset->full_sync(false);
+
+        // A loaded set is iterated in id order regardless of the order
+        // of the descriptors in the stream
+        RuntimeContext rctx2({});
+        auto dset2 = DescriptorSet::create(dset->segment(), d_blkarr, rctx2);
+        EXPECT_THAT(collect_ids(*dset2), ElementsAre(1, 2, 3, 7, 11));
+    }
+
+    TEST(DescriptorSetTest, DescriptorsTakenFromGlobalPool) {
+        RuntimeContext rctx({{0xfa, OpaqueDescriptor::create}});
+
+        VectorBlockArray d_blkarr(32);
+        d_blkarr.allocator().initialize_from_allocated(std::list<Segment>());
+        const auto blk_sz_order = d_blkarr.blk_sz_order();
+
+        struct Descriptor::header_t hdr = {
+            .type = 0xfa,
+
+            .id = 0x0,
+
+            .isize = 0,
+            .cparts = {}
+        };
+
+        Segment sg(blk_sz_order);
+        auto dset = DescriptorSet::create(sg, d_blkarr, rctx);
+
+        // Each small descriptor (like the opaque ones) and the control
+        // block of its shared_ptr are taken from the pool
+        auto in_use = GlobalMemoryPool::in_use_count();
+        for (int i = 0; i < 3; ++i) {
+            dset->add(std::make_unique<OpaqueDescriptor>(hdr, d_blkarr), true);
+        }
+        EXPECT_EQ(GlobalMemoryPool::in_use_count(), in_use + 6);
+        dset->full_sync(false);
+
+        // The same on load
+        in_use = GlobalMemoryPool::in_use_count();
+        {
+            RuntimeContext rctx2({{0xfa, OpaqueDescriptor::create}});
+            auto dset2 = DescriptorSet::create(dset->segment(), d_blkarr, rctx2);
+            EXPECT_EQ(dset2->count(), (uint32_t)3);
+            EXPECT_EQ(GlobalMemoryPool::in_use_count(), in_use + 6);
+        }
+
+        // And they are returned once the set (and the weak references
+        // of the RuntimeContext's index) are gone
+        EXPECT_EQ(GlobalMemoryPool::in_use_count(), in_use);
+    }
+
+    TEST(DescriptorSetTest, LoadedDescriptorNotifiesItsChanges) {
+        RuntimeContext rctx(DescriptorMapping({{0xfa, PlainDescriptor::create}}));
+
+        VectorBlockArray d_blkarr(32);
+        d_blkarr.allocator().initialize_from_allocated(std::list<Segment>());
+        const auto blk_sz_order = d_blkarr.blk_sz_order();
+
+        Segment sg(blk_sz_order);
+        auto dset = DescriptorSet::create(sg, d_blkarr, rctx);
+
+        struct Descriptor::header_t hdr = {
+            .type = 0xfa,
+
+            .id = 0x0,
+
+            .isize = 0,
+            .cparts = {}
+        };
+
+        uint32_t id1 = dset->add(std::make_unique<PlainDescriptor>(hdr, d_blkarr), true);
+        dset->full_sync(false);
+        XOZ_EXPECT_SET_SERIALIZATION(d_blkarr, dset,
+                "0000 fb02 fa02 0100 0000"
+                );
+
+        // Load the set: the loaded descriptor is in sync with the disk
+        RuntimeContext rctx2(DescriptorMapping({{0xfa, PlainDescriptor::create}}));
+        auto dset2 = DescriptorSet::create(dset->segment(), d_blkarr, rctx2);
+        EXPECT_EQ(dset2->does_require_write(), (bool)false);
+
+        // Change the loaded descriptor without calling mark_as_modified():
+        // the descriptor must notify the change to its set by itself
+        auto dscptr2 = dset2->get<PlainDescriptor>(id1);
+        dscptr2->set_idata({'A', 'B'});
+        EXPECT_EQ(dset2->does_require_write(), (bool)true);
+
+        dset2->full_sync(false);
+        XOZ_EXPECT_SET_SERIALIZATION(d_blkarr, dset2,
+                "0000 3c49 fa06 0100 0000 4142"
+                );
+
+        // And the next change is notified too
+        dscptr2->set_idata({'C', 'D'});
+        EXPECT_EQ(dset2->does_require_write(), (bool)true);
+
+        dset2->full_sync(false);
+        XOZ_EXPECT_SET_SERIALIZATION(d_blkarr, dset2,
+                "0000 3e4b fa06 0100 0000 4344"
+                );
+    }
+
     TEST(DescriptorSetTest, AssignPersistentId) {
         RuntimeContext rctx({});
 
@@ -3316,4 +3899,504 @@ namespace {
                 ""
                 );
     }
+
+    TEST(DescriptorSetTest, FullSyncVisitsOnlyDirtySubsets) {
+        RuntimeContext rctx({});
+
+        VectorBlockArray d_blkarr(32);
+        d_blkarr.allocator().initialize_from_allocated(std::list<Segment>());
+        const auto blk_sz_order = d_blkarr.blk_sz_order();
+
+        struct Descriptor::header_t hdr = {
+            .type = 0xfa,
+
+            .id = 0x0,
+
+            .isize = 0,
+            .cparts = {}
+        };
+
+        // Tree: dset -> subA, dset -> subB -> subC
+        Segment sg(blk_sz_order);
+        auto dset = DescriptorSet::create(sg, d_blkarr, rctx);
+
+        uint32_t idA = dset->add(DescriptorSet::create(d_blkarr, rctx));
+        uint32_t idB = dset->add(DescriptorSet::create(d_blkarr, rctx));
+        auto subA = dset->get<DescriptorSet>(idA);
+        auto subB = dset->get<DescriptorSet>(idB);
+
+        uint32_t idC = subB->add(DescriptorSet::create(d_blkarr, rctx));
+        auto subC = subB->get<DescriptorSet>(idC);
+
+        subA->add(std::make_unique<PlainDescriptor>(hdr, d_blkarr));
+
+        // Everything is new, everything is dirty
+        for (auto s: {dset.get(), subA.get(), subB.get(), subC.get()}) {
+            EXPECT_EQ(s->_is_subtree_dirty(), (bool)true);
+        }
+
+        dset->full_sync(false);
+        for (auto s: {dset.get(), subA.get(), subB.get(), subC.get()}) {
+            EXPECT_EQ(s->_is_subtree_dirty(), (bool)false);
+            EXPECT_EQ(s->does_require_write(), (bool)false);
+        }
+
+        // Nothing changed: a second sync does nothing
+        auto sg_before = dset->segment();
+        dset->full_sync(false);
+        EXPECT_EQ(dset->segment(), sg_before);
+
+        // Modify the deepest set: only its path up to the root is dirty
+        subC->add(std::make_unique<PlainDescriptor>(hdr, d_blkarr));
+        EXPECT_EQ(subC->_is_subtree_dirty(), (bool)true);
+        EXPECT_EQ(subB->_is_subtree_dirty(), (bool)true);
+        EXPECT_EQ(dset->_is_subtree_dirty(), (bool)true);
+        EXPECT_EQ(subA->_is_subtree_dirty(), (bool)false);
+
+        // The sync writes the dirty path
+        dset->full_sync(false);
+        for (auto s: {dset.get(), subA.get(), subB.get(), subC.get()}) {
+            EXPECT_EQ(s->_is_subtree_dirty(), (bool)false);
+            EXPECT_EQ(s->does_require_write(), (bool)false);
+        }
+
+        XOZ_EXPECT_SET_SERIALIZATION(d_blkarr, subC, "0000 fa00 fa00");
+        XOZ_EXPECT_SET_SERIALIZATION(d_blkarr, subA, "0000 fa00 fa00");
+
+        // Modifying a descriptor of a subset dirties the path too
+        subA->mark_as_modified((*subA->begin())->id());
+        EXPECT_EQ(subA->_is_subtree_dirty(), (bool)true);
+        EXPECT_EQ(dset->_is_subtree_dirty(), (bool)true);
+        EXPECT_EQ(subB->_is_subtree_dirty(), (bool)false);
+
+        dset->full_sync(false);
+        EXPECT_EQ(dset->_is_subtree_dirty(), (bool)false);
+
+        // Load the whole tree from scratch and check that it is the same
+        auto dset2 = DescriptorSet::create(dset->segment(), d_blkarr, rctx);
+        uint32_t set_cnt = 0;
+        uint32_t dsc_cnt = 0;
+        DescriptorSet::bottom_up_for_each_set(*dset2, [&](DescriptorSet* s, [[maybe_unused]] size_t l) {
+            ++set_cnt;
+            dsc_cnt += s->count();
+        });
+        EXPECT_EQ(set_cnt, (uint32_t)4);
+        EXPECT_EQ(dsc_cnt, (uint32_t)5);
+    }
+
+    TEST(DescriptorSetTest, UnloadLeastRecentlyUsedSubsets) {
+        const struct runtime_config_t runcfg = {
+            .dset = {
+                .sg_blkarr_flags = DefaultRuntimeConfig.dset.sg_blkarr_flags,
+                .on_external_ref_action = DefaultRuntimeConfig.dset.on_external_ref_action,
+                .lazy_load_subsets = false,
+                .load_workers = 1,
+                .sync_workers = 1,
+                .compact_padding_pct = 0,
+                .max_loaded_descriptors = 5,
+            },
+            .file = DefaultRuntimeConfig.file
+        };
+        RuntimeContext rctx({{0xfa, PlainDescriptor::create}}, false, runcfg);
+
+        VectorBlockArray d_blkarr(32);
+        d_blkarr.allocator().initialize_from_allocated(std::list<Segment>());
+        const auto blk_sz_order = d_blkarr.blk_sz_order();
+
+        struct Descriptor::header_t hdr = {
+            .type = 0xfa,
+
+            .id = 0x0,
+
+            .isize = 0,
+            .cparts = {}
+        };
+
+        // Root with 3 subsets, each with 2 descriptors: 9 descriptors loaded
+        Segment sg(blk_sz_order);
+        auto dset = DescriptorSet::create(sg, d_blkarr, rctx);
+
+        std::vector<std::shared_ptr<DescriptorSet>> subsets;
+        std::vector<std::vector<uint32_t>> ids(3);
+        for (int i = 0; i < 3; ++i) {
+            auto id = dset->add(DescriptorSet::create(d_blkarr, rctx), true);
+            subsets.push_back(dset->get<DescriptorSet>(id));
+
+            for (char c = 'A'; c < 'A' + 2; ++c) {
+                auto dscptr = std::make_unique<PlainDescriptor>(hdr, d_blkarr);
+                dscptr->set_idata({char(c + i), char(c + i)});
+                ids[i].push_back(subsets[i]->add(std::move(dscptr), true));
+            }
+        }
+
+        // Use the subsets 0, 2 and 1 in that order: on the sync, the subsets
+        // 0 and 2 are unloaded to fit in the budget of 5 (3 in the root + 2 in the subset 1)
+        subsets[0]->count();
+        subsets[2]->count();
+        subsets[1]->count();
+        dset->full_sync(false);
+
+        EXPECT_EQ(subsets[0]->is_set_loaded(), (bool)false);
+        EXPECT_EQ(subsets[1]->is_set_loaded(), (bool)true);
+        EXPECT_EQ(subsets[2]->is_set_loaded(), (bool)false);
+        EXPECT_EQ(dset->is_set_loaded(), (bool)true);
+
+        // An unloaded subset is loaded back on its use with the same ids and data
+        EXPECT_EQ(subsets[0]->count(), (uint32_t)2);
+        EXPECT_EQ(subsets[0]->is_set_loaded(), (bool)true);
+        for (int j = 0; j < 2; ++j) {
+            auto dsc = subsets[0]->get<PlainDescriptor>(ids[0][j]);
+            EXPECT_EQ(dsc->get_idata(), std::vector<char>({char('A' + j), char('A' + j)}));
+        }
+
+        // The ids of the unloaded descriptors are not handed out again
+        auto id = subsets[1]->add(std::make_unique<PlainDescriptor>(hdr, d_blkarr), true);
+        EXPECT_GT(id, ids[2][1]);
+        subsets[1]->erase(id);
+
+        // Only the ids of the descriptors still unloaded are reserved so
+        // any other free id can be reused (see IDManager::set_reuse_freed_ids)
+        EXPECT_EQ(rctx.idmgr.is_reserved(ids[2][0]), (bool)true);
+        EXPECT_EQ(rctx.idmgr.is_reserved(ids[2][1]), (bool)true);
+        EXPECT_EQ(rctx.idmgr.is_reserved(ids[0][0]), (bool)false);
+        EXPECT_EQ(rctx.idmgr.is_reserved(ids[1][0]), (bool)false);
+        EXPECT_EQ(rctx.idmgr.is_reserved(id), (bool)false);
+
+        // A subset with a descriptor referenced outside is not unloaded,
+        // the next least recently used is unloaded instead.
+        auto held = subsets[0]->get<PlainDescriptor>(ids[0][0]);
+        subsets[1]->count();
+        dset->full_sync(false);
+
+        EXPECT_EQ(subsets[0]->is_set_loaded(), (bool)true);
+        EXPECT_EQ(subsets[1]->is_set_loaded(), (bool)false);
+        EXPECT_EQ(subsets[2]->is_set_loaded(), (bool)false);
+
+        // Write everything and load it from scratch
+        held.reset();
+        dset->full_sync(true);
+
+        RuntimeContext rctx2({{0xfa, PlainDescriptor::create}});
+        auto dset2 = DescriptorSet::create(dset->segment(), d_blkarr, rctx2);
+        for (int i = 0; i < 3; ++i) {
+            auto subset = dset2->get<DescriptorSet>(subsets[i]->id());
+            for (int j = 0; j < 2; ++j) {
+                auto dsc = subset->get<PlainDescriptor>(ids[i][j]);
+                EXPECT_EQ(dsc->get_idata(), std::vector<char>({char('A' + i + j), char('A' + i + j)}));
+            }
+        }
+    }
+
+    TEST(DescriptorSetTest, ForEachOfType) {
+        RuntimeContext rctx({{0xfa, PlainDescriptor::create}, {0xfb, PlainDescriptor::create}});
+
+        VectorBlockArray d_blkarr(32);
+        d_blkarr.allocator().initialize_from_allocated(std::list<Segment>());
+        const auto blk_sz_order = d_blkarr.blk_sz_order();
+
+        struct Descriptor::header_t hdr = {
+            .type = 0xfa,
+
+            .id = 0x0,
+
+            .isize = 0,
+            .cparts = {}
+        };
+
+        Segment sg(blk_sz_order);
+        auto dset = DescriptorSet::create(sg, d_blkarr, rctx);
+
+        // Root: 3 of type 0xfa, 2 of type 0xfb and a subset with 2 of type 0xfa
+        std::vector<uint32_t> fa_ids;
+        std::vector<uint32_t> fb_ids;
+        for (int i = 0; i < 3; ++i) {
+            fa_ids.push_back(dset->add(std::make_unique<PlainDescriptor>(hdr, d_blkarr), true));
+        }
+
+        hdr.type = 0xfb;
+        for (int i = 0; i < 2; ++i) {
+            fb_ids.push_back(dset->add(std::make_unique<PlainDescriptor>(hdr, d_blkarr), true));
+        }
+
+        auto subset_id = dset->add(DescriptorSet::create(d_blkarr, rctx), true);
+        auto subset = dset->get<DescriptorSet>(subset_id);
+
+        hdr.type = 0xfa;
+        std::vector<uint32_t> sub_fa_ids;
+        for (int i = 0; i < 2; ++i) {
+            sub_fa_ids.push_back(subset->add(std::make_unique<PlainDescriptor>(hdr, d_blkarr), true));
+        }
+
+        EXPECT_EQ(dset->count_of_type(0xfa), (uint32_t)3);
+        EXPECT_EQ(dset->count_of_type(0xfb), (uint32_t)2);
+        EXPECT_EQ(dset->count_of_type(DescriptorSet::TYPE), (uint32_t)1);
+        EXPECT_EQ(dset->count_of_type(0xfc), (uint32_t)0);
+
+        // The iteration is in id order and it is not recursive
+        std::vector<uint32_t> found;
+        dset->for_each_of_type<PlainDescriptor>(0xfa, [&](const std::shared_ptr<PlainDescriptor>& dsc) {
+            found.push_back(dsc->id());
+        });
+        EXPECT_EQ(found, fa_ids);
+
+        // Stop on the first
+        found.clear();
+        bool stopped = dset->for_each_of_type(0xfb, [&](const std::shared_ptr<Descriptor>& dsc) {
+            found.push_back(dsc->id());
+            return true;
+        });
+        EXPECT_EQ(stopped, (bool)true);
+        EXPECT_EQ(found, std::vector<uint32_t>({fb_ids[0]}));
+
+        // Typed version (T::TYPE)
+        found.clear();
+        dset->for_each_of_type<DescriptorSet>([&](const std::shared_ptr<DescriptorSet>& dsc) {
+            found.push_back(dsc->id());
+        });
+        EXPECT_EQ(found, std::vector<uint32_t>({subset_id}));
+
+        // Recursive version
+        found.clear();
+        DescriptorSet::for_each_of_type_in_tree(*dset, 0xfa, [&](const std::shared_ptr<Descriptor>& dsc) {
+            found.push_back(dsc->id());
+        });
+        EXPECT_EQ(found, std::vector<uint32_t>({fa_ids[0], fa_ids[1], fa_ids[2], sub_fa_ids[0], sub_fa_ids[1]}));
+
+        // The index follows the erase, move and the assignation of a persistent id
+        dset->erase(fa_ids[1]);
+        dset->move_out(fa_ids[2], *subset);
+        auto tmp_id = dset->add(std::make_unique<PlainDescriptor>(hdr, d_blkarr));
+        auto new_id = dset->assign_persistent_id(tmp_id);
+        EXPECT_NE(tmp_id, new_id);
+
+        EXPECT_EQ(dset->count_of_type(0xfa), (uint32_t)2);
+        EXPECT_EQ(subset->count_of_type(0xfa), (uint32_t)3);
+
+        found.clear();
+        dset->for_each_of_type(0xfa, [&](const std::shared_ptr<Descriptor>& dsc) { found.push_back(dsc->id()); });
+        EXPECT_EQ(found, std::vector<uint32_t>({fa_ids[0], new_id}));
+
+        // The index is rebuilt on load
+        dset->full_sync(false);
+
+        RuntimeContext rctx2({{0xfa, PlainDescriptor::create}, {0xfb, PlainDescriptor::create}});
+        auto dset2 = DescriptorSet::create(dset->segment(), d_blkarr, rctx2);
+
+        EXPECT_EQ(dset2->count_of_type(0xfa), (uint32_t)2);
+        EXPECT_EQ(dset2->count_of_type(0xfb), (uint32_t)2);
+
+        found.clear();
+        DescriptorSet::for_each_of_type_in_tree(*dset2, 0xfa, [&](const std::shared_ptr<Descriptor>& dsc) {
+            found.push_back(dsc->id());
+        });
+        EXPECT_EQ(found, std::vector<uint32_t>({fa_ids[0], new_id, fa_ids[2], sub_fa_ids[0], sub_fa_ids[1]}));
+
+        // Clearing the set clears the index too
+        subset->clear_set();
+        EXPECT_EQ(subset->count_of_type(0xfa), (uint32_t)0);
+    }
+
+    TEST(DescriptorSetTest, ChurnKeepsIdOrderAndTypeIndex) {
+        RuntimeContext rctx({{0xfa, PlainDescriptor::create}, {0xfb, PlainDescriptor::create}});
+
+        VectorBlockArray d_blkarr(32);
+        d_blkarr.allocator().initialize_from_allocated(std::list<Segment>());
+        const auto blk_sz_order = d_blkarr.blk_sz_order();
+
+        struct Descriptor::header_t hdr = {
+            .type = 0xfa,
+
+            .id = 0x0,
+
+            .isize = 0,
+            .cparts = {}
+        };
+
+        Segment sg(blk_sz_order);
+        auto dset = DescriptorSet::create(sg, d_blkarr, rctx);
+
+        // Add and erase a lot of descriptors (in and out of order), re-adding
+        // some ids with another type, so the removed ones leave holes and stale
+        // ids in the type index that are dropped later.
+        std::map<uint32_t, uint16_t> expected;
+        for (uint32_t round = 0; round < 20; ++round) {
+            for (uint32_t i = 0; i < 50; ++i) {
+                hdr.id = ((i * 37 + round * 11) % 400) + 1;
+                hdr.type = (i + round) % 3 == 0 ? 0xfb : 0xfa;
+                if (expected.contains(hdr.id)) {
+                    dset->erase(hdr.id);
+                    expected.erase(hdr.id);
+                } else {
+                    dset->add(std::make_unique<PlainDescriptor>(hdr, d_blkarr));
+                    expected[hdr.id] = hdr.type;
+                }
+            }
+
+            // Iterate only on some rounds so the holes accumulate
+            if (round % 7 == 0) {
+                std::vector<uint32_t> ids;
+                for (auto it = dset->begin(); it != dset->end(); ++it) {
+                    ids.push_back((*it)->id());
+                }
+                EXPECT_EQ(ids.size(), expected.size());
+                EXPECT_TRUE(std::is_sorted(ids.begin(), ids.end()));
+            }
+        }
+
+        std::vector<uint32_t> expected_ids;
+        std::vector<uint32_t> expected_fa_ids;
+        for (const auto& [id, type]: expected) {
+            expected_ids.push_back(id);
+            if (type == 0xfa) {
+                expected_fa_ids.push_back(id);
+            }
+        }
+
+        EXPECT_EQ(dset->count(), (uint32_t)expected_ids.size());
+        EXPECT_EQ(dset->count_of_type(0xfa), (uint32_t)expected_fa_ids.size());
+        EXPECT_EQ(dset->count_of_type(0xfb), (uint32_t)(expected_ids.size() - expected_fa_ids.size()));
+
+        std::vector<uint32_t> found;
+        for (auto it = dset->begin(); it != dset->end(); ++it) {
+            found.push_back((*it)->id());
+            EXPECT_EQ(dset->get((*it)->id()), *it);
+        }
+        EXPECT_EQ(found, expected_ids);
+
+        found.clear();
+        dset->for_each_of_type(0xfa, [&](const std::shared_ptr<Descriptor>& dsc) { found.push_back(dsc->id()); });
+        EXPECT_EQ(found, expected_fa_ids);
+
+        // A subset with a temporal id is still found among the subsets (in id order)
+        // once it gets a persistent id
+        auto sub1 = dset->add(DescriptorSet::create(d_blkarr, rctx), true);
+        auto sub2_tmp = dset->add(DescriptorSet::create(d_blkarr, rctx));
+        auto sub2 = dset->assign_persistent_id(sub2_tmp);
+        EXPECT_EQ(dset->count_subset(), (uint32_t)2);
+
+        found.clear();
+        DescriptorSet::top_down_for_each_set(*dset, [&](DescriptorSet* s, [[maybe_unused]] size_t l) {
+            found.push_back(s->id());
+        });
+        EXPECT_EQ(found, std::vector<uint32_t>({dset->id(), sub1, sub2}));
+
+        dset->erase(sub2);
+        EXPECT_EQ(dset->count_subset(), (uint32_t)1);
+
+        // Everything is written and loaded back
+        dset->full_sync(false);
+
+        RuntimeContext rctx2({{0xfa, PlainDescriptor::create}, {0xfb, PlainDescriptor::create}});
+        auto dset2 = DescriptorSet::create(dset->segment(), d_blkarr, rctx2);
+        EXPECT_EQ(dset2->count(), (uint32_t)(expected_ids.size() + 1));
+        EXPECT_EQ(dset2->count_of_type(0xfa), (uint32_t)expected_fa_ids.size());
+    }
+
+    class LazyPlainDescriptor: public PlainDescriptor {
+    public:
+        LazyPlainDescriptor(const struct Descriptor::header_t& hdr, BlockArray& cblkarr): PlainDescriptor(hdr, cblkarr) {
+            lazy_struct_specifics = true;
+        }
+
+        static std::unique_ptr<Descriptor> create(const struct Descriptor::header_t& hdr, BlockArray& cblkarr,
+                                                  [[maybe_unused]] RuntimeContext& rctx) {
+            return std::make_unique<LazyPlainDescriptor>(hdr, cblkarr);
+        }
+
+        const std::vector<char>& get_idata_lazily() {
+            load_struct_specifics_if_deferred();
+            return get_idata();
+        }
+
+        int read_cnt = 0;
+
+    protected:
+        void read_struct_specifics_from(IOBase& io) override {
+            ++read_cnt;
+            PlainDescriptor::read_struct_specifics_from(io);
+        }
+    };
+
+    TEST(DescriptorSetTest, LazyStructSpecifics) {
+        RuntimeContext rctx({{0xfa, LazyPlainDescriptor::create}});
+
+        VectorBlockArray d_blkarr(32);
+        d_blkarr.allocator().initialize_from_allocated(std::list<Segment>());
+        const auto blk_sz_order = d_blkarr.blk_sz_order();
+
+        struct Descriptor::header_t hdr = {
+            .type = 0xfa,
+
+            .id = 0x0,
+
+            .isize = 0,
+            .cparts = {}
+        };
+
+        Segment sg(blk_sz_order);
+        auto dset = DescriptorSet::create(sg, d_blkarr, rctx);
+
+        auto dscptr1 = std::make_unique<LazyPlainDescriptor>(hdr, d_blkarr);
+        dscptr1->set_idata({'A', 'B', 'C', 'D'});
+        auto id1 = dset->add(std::move(dscptr1), true);
+
+        auto dscptr2 = std::make_unique<LazyPlainDescriptor>(hdr, d_blkarr);
+        dscptr2->set_idata({'E', 'F'});
+        auto id2 = dset->add(std::move(dscptr2), true);
+
+        dset->full_sync(false);
+
+        // On load, the specifics are not parsed
+        RuntimeContext rctx2({{0xfa, LazyPlainDescriptor::create}});
+        auto dset2 = DescriptorSet::create(dset->segment(), d_blkarr, rctx2);
+
+        auto dsc1 = dset2->get<LazyPlainDescriptor>(id1);
+        auto dsc2 = dset2->get<LazyPlainDescriptor>(id2);
+        EXPECT_EQ(dsc1->is_struct_specifics_loaded(), (bool)false);
+        EXPECT_EQ(dsc1->read_cnt, 0);
+        EXPECT_EQ(dsc2->is_struct_specifics_loaded(), (bool)false);
+
+        // Writing a descriptor not parsed writes the same data
+        std::vector<char> before(DSpy(*dsc2).calc_struct_footprint_size());
+        dsc2->write_struct_into(IOSpan(before), rctx2);
+        EXPECT_EQ(dsc2->is_struct_specifics_loaded(), (bool)false);
+
+        // ...than the one written after parsing it
+        EXPECT_EQ(dsc2->get_idata_lazily(), std::vector<char>({'E', 'F'}));
+        EXPECT_EQ(dsc2->is_struct_specifics_loaded(), (bool)true);
+
+        std::vector<char> after(DSpy(*dsc2).calc_struct_footprint_size());
+        dsc2->write_struct_into(IOSpan(after), rctx2);
+        EXPECT_EQ(before, after);
+
+        // They are parsed on the first use, once
+        EXPECT_EQ(dsc1->get_idata_lazily(), std::vector<char>({'A', 'B', 'C', 'D'}));
+        EXPECT_EQ(dsc1->get_idata_lazily(), std::vector<char>({'A', 'B', 'C', 'D'}));
+        EXPECT_EQ(dsc1->is_struct_specifics_loaded(), (bool)true);
+        EXPECT_EQ(dsc1->read_cnt, 1);
+
+        // A sync parses the descriptor (it may need to update its header)
+        dsc1.reset();
+        dsc2.reset();
+        RuntimeContext rctx3({{0xfa, LazyPlainDescriptor::create}});
+        auto dset3 = DescriptorSet::create(dset->segment(), d_blkarr, rctx3);
+        dset3->mark_as_modified(id1);
+        dset3->full_sync(false);
+
+        dsc1 = dset3->get<LazyPlainDescriptor>(id1);
+        EXPECT_EQ(dsc1->is_struct_specifics_loaded(), (bool)true);
+        EXPECT_EQ(dsc1->read_cnt, 1);
+        EXPECT_EQ(dsc1->get_idata(), std::vector<char>({'A', 'B', 'C', 'D'}));
+
+        dsc2 = dset3->get<LazyPlainDescriptor>(id2);
+        EXPECT_EQ(dsc2->is_struct_specifics_loaded(), (bool)false);
+
+        // The data survives another load
+        dsc1.reset();
+        dsc2.reset();
+        RuntimeContext rctx4({{0xfa, LazyPlainDescriptor::create}});
+        auto dset4 = DescriptorSet::create(dset3->segment(), d_blkarr, rctx4);
+        EXPECT_EQ(dset4->get<LazyPlainDescriptor>(id1)->get_idata_lazily(), std::vector<char>({'A', 'B', 'C', 'D'}));
+        EXPECT_EQ(dset4->get<LazyPlainDescriptor>(id2)->get_idata_lazily(), std::vector<char>({'E', 'F'}));
+    }
 }
@@ -39,6 +39,8 @@ namespace {
             .dset = DefaultRuntimeConfig.dset,
             .file = {
                 .keep_index_updated = false,
+                .free_space_snapshot = false,
+                .paged_name_index = false,
             }
         };
 
@@ -108,6 +110,8 @@ namespace {
             .dset = DefaultRuntimeConfig.dset,
             .file = {
                 .keep_index_updated = false,
+                .free_space_snapshot = false,
+                .paged_name_index = false,
             }
         };
 
@@ -185,6 +189,8 @@ namespace {
             .dset = DefaultRuntimeConfig.dset,
             .file = {
                 .keep_index_updated = false,
+                .free_space_snapshot = false,
+                .paged_name_index = false,
             }
         };
 
@@ -272,6 +278,8 @@ namespace {
             .dset = DefaultRuntimeConfig.dset,
             .file = {
                 .keep_index_updated = false,
+                .free_space_snapshot = false,
+                .paged_name_index = false,
             }
         };
 
@@ -357,6 +365,8 @@ namespace {
             .dset = DefaultRuntimeConfig.dset,
             .file = {
                 .keep_index_updated = false,
+                .free_space_snapshot = false,
+                .paged_name_index = false,
             }
         };
 
@@ -447,6 +457,8 @@ namespace {
             .dset = DefaultRuntimeConfig.dset,
             .file = {
                 .keep_index_updated = false,
+                .free_space_snapshot = false,
+                .paged_name_index = false,
             }
         };
 
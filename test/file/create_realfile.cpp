@@ -8,6 +8,8 @@
 #include "test/testing_xoz.h"
 
 #include <cstdlib>
+#include <filesystem>
+#include <map>
 
 #define SCRATCH_HOME "./scratch/mem/"
 
@@ -18,6 +20,7 @@ using ::testing::AllOf;
 #define DELETE(X) std::remove( SCRATCH_HOME X )
 
 using ::testing_xoz::PlainDescriptor;
+using ::testing_xoz::PlainWithImplContentDescriptor;
 
 using ::testing_xoz::helpers::hexdump;
 using ::testing_xoz::helpers::file2mem;
@@ -47,6 +50,8 @@ namespace {
             .dset = DefaultRuntimeConfig.dset,
             .file = {
                 .keep_index_updated = false,
+                .free_space_snapshot = false,
+                .paged_name_index = false,
             }
         };
 
@@ -119,6 +124,8 @@ namespace {
             .dset = DefaultRuntimeConfig.dset,
             .file = {
                 .keep_index_updated = false,
+                .free_space_snapshot = false,
+                .paged_name_index = false,
             }
         };
 
@@ -203,6 +210,8 @@ namespace {
             .dset = DefaultRuntimeConfig.dset,
             .file = {
                 .keep_index_updated = false,
+                .free_space_snapshot = false,
+                .paged_name_index = false,
             }
         };
 
@@ -280,6 +289,8 @@ namespace {
             .dset = DefaultRuntimeConfig.dset,
             .file = {
                 .keep_index_updated = false,
+                .free_space_snapshot = false,
+                .paged_name_index = false,
             }
         };
 
@@ -424,6 +435,8 @@ namespace {
             .dset = DefaultRuntimeConfig.dset,
             .file = {
                 .keep_index_updated = false,
+                .free_space_snapshot = false,
+                .paged_name_index = false,
             }
         };
 
@@ -515,6 +528,8 @@ namespace {
             .dset = DefaultRuntimeConfig.dset,
             .file = {
                 .keep_index_updated = false,
+                .free_space_snapshot = false,
+                .paged_name_index = false,
             }
         };
 
@@ -604,6 +619,8 @@ namespace {
             .dset = DefaultRuntimeConfig.dset,
             .file = {
                 .keep_index_updated = false,
+                .free_space_snapshot = false,
+                .paged_name_index = false,
             }
         };
 
@@ -705,6 +722,8 @@ namespace {
             .dset = DefaultRuntimeConfig.dset,
             .file = {
                 .keep_index_updated = false,
+                .free_space_snapshot = false,
+                .paged_name_index = false,
             }
         };
 
@@ -876,6 +895,8 @@ namespace {
             .dset = DefaultRuntimeConfig.dset,
             .file = {
                 .keep_index_updated = false,
+                .free_space_snapshot = false,
+                .paged_name_index = false,
             }
         };
 
@@ -1045,6 +1066,8 @@ namespace {
             .dset = DefaultRuntimeConfig.dset,
             .file = {
                 .keep_index_updated = false,
+                .free_space_snapshot = false,
+                .paged_name_index = false,
             }
         };
 
@@ -1167,6 +1190,8 @@ namespace {
             .dset = DefaultRuntimeConfig.dset,
             .file = {
                 .keep_index_updated = false,
+                .free_space_snapshot = false,
+                .paged_name_index = false,
             }
         };
 
@@ -1283,6 +1308,8 @@ namespace {
             .dset = DefaultRuntimeConfig.dset,
             .file = {
                 .keep_index_updated = false,
+                .free_space_snapshot = false,
+                .paged_name_index = false,
             }
         };
 
@@ -1489,6 +1516,8 @@ namespace {
             .dset = DefaultRuntimeConfig.dset,
             .file = {
                 .keep_index_updated = false,
+                .free_space_snapshot = false,
+                .paged_name_index = false,
             }
         };
 
@@ -1516,6 +1545,8 @@ namespace {
             .dset = DefaultRuntimeConfig.dset,
             .file = {
                 .keep_index_updated = false,
+                .free_space_snapshot = false,
+                .paged_name_index = false,
             }
         };
 
@@ -1635,9 +1666,20 @@ namespace {
                 .sg_blkarr_flags = 0,
 
                 .on_external_ref_action = 0,
+
+                .lazy_load_subsets = false,
+                .load_workers = 1,
+
+                .sync_workers = 1,
+
+                .compact_padding_pct = 0,
+
+                .max_loaded_descriptors = 0,
             },
             .file = {
                 .keep_index_updated = false,
+                .free_space_snapshot = false,
+                .paged_name_index = false,
             }
         };
         File xfile = File::create(dmap, fpath, true, File::DefaultsParameters, runcfg);
@@ -1905,6 +1947,8 @@ namespace {
             .dset = DefaultRuntimeConfig.dset,
             .file = {
                 .keep_index_updated = false,
+                .free_space_snapshot = false,
+                .paged_name_index = false,
             }
         };
 
@@ -2238,9 +2282,20 @@ namespace {
                 .sg_blkarr_flags = 0,
 
                 .on_external_ref_action = 0,
+
+                .lazy_load_subsets = false,
+                .load_workers = 1,
+
+                .sync_workers = 1,
+
+                .compact_padding_pct = 0,
+
+                .max_loaded_descriptors = 0,
             },
             .file = {
                 .keep_index_updated = false,
+                .free_space_snapshot = false,
+                .paged_name_index = false,
             }
         };
         File xfile = File::create(dmap, fpath, true, File::DefaultsParameters, runcfg);
@@ -2618,9 +2673,20 @@ namespace {
                 .sg_blkarr_flags = 0,
 
                 .on_external_ref_action = 0,
+
+                .lazy_load_subsets = false,
+                .load_workers = 1,
+
+                .sync_workers = 1,
+
+                .compact_padding_pct = 0,
+
+                .max_loaded_descriptors = 0,
             },
             .file = {
                 .keep_index_updated = false,
+                .free_space_snapshot = false,
+                .paged_name_index = false,
             }
         };
         File xfile = File::create(dmap, fpath, true, File::DefaultsParameters, runcfg);
@@ -2743,9 +2809,20 @@ namespace {
                 .sg_blkarr_flags = 0,
 
                 .on_external_ref_action = 0,
+
+                .lazy_load_subsets = false,
+                .load_workers = 1,
+
+                .sync_workers = 1,
+
+                .compact_padding_pct = 0,
+
+                .max_loaded_descriptors = 0,
             },
             .file = {
                 .keep_index_updated = false,
+                .free_space_snapshot = false,
+                .paged_name_index = false,
             }
         };
         File xfile = File::create(dmap, fpath, true, File::DefaultsParameters, runcfg);
@@ -3063,9 +3140,20 @@ namespace {
                 .sg_blkarr_flags = 0,
 
                 .on_external_ref_action = 0,
+
+                .lazy_load_subsets = false,
+                .load_workers = 1,
+
+                .sync_workers = 1,
+
+                .compact_padding_pct = 0,
+
+                .max_loaded_descriptors = 0,
             },
             .file = {
                 .keep_index_updated = false,
+                .free_space_snapshot = false,
+                .paged_name_index = false,
             }
         };
         File xfile = File::create(dmap, fpath, true, File::DefaultsParameters, runcfg);
@@ -3508,9 +3596,20 @@ namespace {
                 .sg_blkarr_flags = 0,
 
                 .on_external_ref_action = 0,
+
+                .lazy_load_subsets = false,
+                .load_workers = 1,
+
+                .sync_workers = 1,
+
+                .compact_padding_pct = 0,
+
+                .max_loaded_descriptors = 0,
             },
             .file = {
                 .keep_index_updated = false,
+                .free_space_snapshot = false,
+                .paged_name_index = false,
             }
         };
         File xfile = File::create(dmap, fpath, true, File::DefaultsParameters, runcfg);
@@ -3895,9 +3994,20 @@ namespace {
                 .sg_blkarr_flags = 0,
 
                 .on_external_ref_action = 0,
+
+                .lazy_load_subsets = false,
+                .load_workers = 1,
+
+                .sync_workers = 1,
+
+                .compact_padding_pct = 0,
+
+                .max_loaded_descriptors = 0,
             },
             .file = {
                 .keep_index_updated = false,
+                .free_space_snapshot = false,
+                .paged_name_index = false,
             }
         };
         File xfile = File::create(dmap, fpath, true, File::DefaultsParameters, runcfg);
@@ -4365,5 +4475,825 @@ namespace {
                 "454f 4600"
                 );
     }
-}
 
+    std::vector<Extent> collect_free_extents(File& xfile) {
+        const auto& sg_alloc = xfile.expose_block_array().allocator();
+        return std::vector<Extent>(sg_alloc.cbegin_by_blk_nr(), sg_alloc.cend_by_blk_nr());
+    }
+
+    // Close a xoz file with the free space snapshot enabled and reopen it:
+    // the allocator must be initialized from the snapshot and end up
+    // with the same state than the one initialized scanning the descriptors.
+    TEST(FileTest, FreeSpaceSnapshot) {
+        DescriptorMapping dmap({{0xfa, PlainWithImplContentDescriptor::create}});
+
+        DELETE("FreeSpaceSnapshot.xoz");
+        DELETE("FreeSpaceSnapshotCopy.xoz");
+
+        const char* fpath = SCRATCH_HOME "FreeSpaceSnapshot.xoz";
+        const char* fpath_copy = SCRATCH_HOME "FreeSpaceSnapshotCopy.xoz";
+        const struct runtime_config_t runcfg = {
+            .dset = DefaultRuntimeConfig.dset,
+            .file = {
+                .keep_index_updated = true,
+                .free_space_snapshot = true,
+                .paged_name_index = false,
+            }
+        };
+        const struct runtime_config_t no_snapshot_runcfg = {
+            .dset = DefaultRuntimeConfig.dset,
+            .file = {
+                .keep_index_updated = true,
+                .free_space_snapshot = false,
+                .paged_name_index = false,
+            }
+        };
+
+        File xfile = File::create(dmap, fpath, true, File::DefaultsParameters, runcfg);
+        EXPECT_EQ(xfile.was_loaded_from_snapshot(), (bool)false);
+
+        // Add descriptors with content of different sizes and erase
+        // a few of them so the free space is fragmented.
+        std::vector<uint32_t> ids;
+        for (uint32_t i = 0; i < 8; ++i) {
+            const uint32_t csize = 100 + i * 150;
+            struct Descriptor::header_t hdr = {
+                .type = 0xfa,
+
+                .id = 0x0,
+
+                .isize = 0,
+                .cparts = {
+                    {
+                        .s = {
+                            .pending = false,
+                            .future_csize = 0,
+                        },
+                        .csize = csize,
+                        .segm = xfile.expose_block_array().allocator().alloc(csize).add_end_of_segment(),
+                    }
+                }
+            };
+
+            auto dscptr = std::make_unique<PlainWithImplContentDescriptor>(hdr, xfile.expose_block_array());
+            dscptr->set_content(std::vector<char>(csize, char('A' + i)));
+            ids.push_back(xfile.root()->add(std::move(dscptr), true));
+        }
+        xfile.full_sync(false);
+
+        xfile.root()->erase(ids[1]);
+        xfile.root()->erase(ids[4]);
+        xfile.full_sync(false);
+
+        xfile.close();
+
+        // The snapshot is flagged as a compatible feature
+        XOZ_EXPECT_FILE_SERIALIZATION(fpath, 32, 4,
+                "0100 0000"                      // feature_flags_compat
+                );
+
+        // Keep a copy to be loaded without the snapshot
+        std::filesystem::copy_file(fpath, fpath_copy, std::filesystem::copy_options::overwrite_existing);
+
+        File xfile2(dmap, fpath, runcfg);
+        File xfile3(dmap, fpath_copy, no_snapshot_runcfg);
+
+        EXPECT_EQ(xfile2.was_loaded_from_snapshot(), (bool)true);
+        EXPECT_EQ(xfile3.was_loaded_from_snapshot(), (bool)false);
+
+        // 6 descriptors plus the private id mapping descriptor
+        EXPECT_EQ(xfile2.root()->count(), (uint32_t)7);
+        EXPECT_EQ(xfile3.root()->count(), (uint32_t)7);
+
+        EXPECT_EQ(xfile2.expose_block_array().blk_cnt(), xfile3.expose_block_array().blk_cnt());
+        EXPECT_EQ(collect_free_extents(xfile2), collect_free_extents(xfile3));
+
+        auto al_stats2 = xfile2.expose_block_array().allocator().stats();
+        auto al_stats3 = xfile3.expose_block_array().allocator().stats();
+
+        EXPECT_EQ(al_stats2.current.in_use_by_user_sz, al_stats3.current.in_use_by_user_sz);
+        EXPECT_EQ(al_stats2.current.in_use_blk_cnt, al_stats3.current.in_use_blk_cnt);
+        EXPECT_EQ(al_stats2.current.in_use_blk_for_suballoc_cnt, al_stats3.current.in_use_blk_for_suballoc_cnt);
+        EXPECT_EQ(al_stats2.current.in_use_subblk_cnt, al_stats3.current.in_use_subblk_cnt);
+        EXPECT_EQ(al_stats2.current.in_use_ext_cnt, al_stats3.current.in_use_ext_cnt);
+        EXPECT_EQ(al_stats2.current.in_use_inlined_sz, al_stats3.current.in_use_inlined_sz);
+        EXPECT_EQ(al_stats2.current.external_frag_sz, al_stats3.current.external_frag_sz);
+        for (unsigned i = 0; i < SegmentAllocator::StatsExtPerSegmLen; ++i) {
+            EXPECT_EQ(al_stats2.current.in_use_ext_per_segm[i], al_stats3.current.in_use_ext_per_segm[i]);
+        }
+
+        // The file loaded from the snapshot is fully operational: the new
+        // content must be allocated in free space only (including the space
+        // that the snapshot used)
+        {
+            struct Descriptor::header_t hdr = {
+                .type = 0xfa,
+
+                .id = 0x0,
+
+                .isize = 0,
+                .cparts = {
+                    {
+                        .s = {
+                            .pending = false,
+                            .future_csize = 0,
+                        },
+                        .csize = 3000,
+                        .segm = xfile2.expose_block_array().allocator().alloc(3000).add_end_of_segment(),
+                    }
+                }
+            };
+
+            auto dscptr = std::make_unique<PlainWithImplContentDescriptor>(hdr, xfile2.expose_block_array());
+            dscptr->set_content(std::vector<char>(3000, 'Z'));
+            xfile2.root()->add(std::move(dscptr), true);
+        }
+        xfile2.close();
+        xfile3.close();
+
+        // Without the snapshot enabled, the feature flag is cleared on close
+        XOZ_EXPECT_FILE_SERIALIZATION(fpath_copy, 32, 4,
+                "0000 0000"                      // feature_flags_compat
+                );
+
+        // A file closed without the snapshot enabled has no snapshot to load
+        File xfile4(dmap, fpath_copy, runcfg);
+        EXPECT_EQ(xfile4.was_loaded_from_snapshot(), (bool)false);
+        xfile4.close();
+
+        File xfile5(dmap, fpath, runcfg);
+        EXPECT_EQ(xfile5.was_loaded_from_snapshot(), (bool)true);
+        EXPECT_EQ(xfile5.root()->count(), (uint32_t)8);
+        for (auto it = xfile5.root()->begin(); it != xfile5.root()->end(); ++it) {
+            auto dsc = (*it)->cast<PlainWithImplContentDescriptor>(true);
+            if (dsc) {
+                auto content = dsc->get_content();
+                ASSERT_NE(content.size(), (size_t)0);
+                EXPECT_EQ(content, std::vector<char>(content.size(), content[0]));
+            }
+        }
+        xfile5.close();
+
+        // Once opened, the snapshot is invalidated on disk: if the file
+        // is not closed properly, the next open must not trust the snapshot
+        // because the file may had been modified.
+        File xfile6(dmap, fpath, runcfg);
+        EXPECT_EQ(xfile6.was_loaded_from_snapshot(), (bool)true);
+        xfile6.panic_close();
+
+        XOZ_EXPECT_FILE_SERIALIZATION(fpath, 32, 4,
+                "0000 0000"                      // feature_flags_compat
+                );
+    }
+
+    // A snapshot of a block array of another size (the file was extended
+    // or truncated after the close) is ignored and the descriptors are scanned
+    TEST(FileTest, FreeSpaceSnapshotOfAnotherSize) {
+        DescriptorMapping dmap({{0xfa, PlainDescriptor::create}});
+
+        DELETE("FreeSpaceSnapshotOfAnotherSize.xoz");
+
+        const char* fpath = SCRATCH_HOME "FreeSpaceSnapshotOfAnotherSize.xoz";
+        const struct runtime_config_t runcfg = {
+            .dset = DefaultRuntimeConfig.dset,
+            .file = {
+                .keep_index_updated = true,
+                .free_space_snapshot = true,
+                .paged_name_index = false,
+            }
+        };
+
+        struct Descriptor::header_t hdr = {
+            .type = 0xfa,
+
+            .id = 0x0,
+
+            .isize = 0,
+            .cparts = {}
+        };
+
+        uint32_t blk_cnt = 0;
+        {
+            File xfile = File::create(dmap, fpath, true, File::DefaultsParameters, runcfg);
+            for (int i = 0; i < 4; ++i) {
+                xfile.root()->add(std::make_unique<PlainDescriptor>(hdr, xfile.expose_block_array()), true);
+            }
+            xfile.close();
+        }
+
+        {
+            File xfile(dmap, fpath, runcfg);
+            EXPECT_EQ(xfile.was_loaded_from_snapshot(), (bool)true);
+            blk_cnt = xfile.expose_block_array().blk_cnt();
+            xfile.close();
+        }
+
+        // Extend the file by one block, inserted before the trailer, and patch
+        // the header to declare it (file_sz at 16, trailer_sz at 24, blk_total_cnt
+        // at 26 and the checksum at 30 + 46). The file is consistent but the snapshot is for
+        // a block array with one block less.
+        {
+            const std::string content = file2mem(fpath).str();
+            std::vector<char> buf(content.begin(), content.end());
+            const uint32_t blk_sz = uint32_t(1) << uint8_t(buf[30]);
+            auto read_u16 = [&](size_t off) { return uint16_t(uint8_t(buf[off]) | (uint8_t(buf[off + 1]) << 8)); };
+            auto write_u16 = [&](size_t off, uint16_t val) {
+                buf[off] = char(val & 0xff);
+                buf[off + 1] = char(val >> 8);
+            };
+
+            // Replace a 16 bits word fixing the checksum (a ones' complement sum)
+            auto patch_u16 = [&](size_t off, uint16_t val) {
+                uint32_t checksum = read_u16(30 + 46);
+                checksum += uint32_t(0xffff - read_u16(off)) + val;
+                checksum = (checksum & 0xffff) + (checksum >> 16);
+                checksum = (checksum & 0xffff) + (checksum >> 16);
+                write_u16(30 + 46, uint16_t(checksum));
+                write_u16(off, val);
+            };
+
+            const uint16_t trailer_sz = read_u16(24);
+
+            uint64_t file_sz = 0;
+            for (int i = 3; i >= 0; --i) {
+                file_sz = (file_sz << 16) | read_u16(16 + size_t(i) * 2);
+            }
+            file_sz += blk_sz;
+            for (size_t i = 0; i < 4; ++i) {
+                patch_u16(16 + i * 2, uint16_t(file_sz >> (i * 16)));
+            }
+
+            const uint32_t blk_total_cnt = uint32_t(file_sz / blk_sz);
+            patch_u16(26, uint16_t(blk_total_cnt & 0xffff));
+            patch_u16(28, uint16_t(blk_total_cnt >> 16));
+
+            buf.insert(buf.end() - trailer_sz, blk_sz, char(0));
+
+            std::ofstream f(fpath, std::ios::binary | std::ios::trunc);
+            f.write(buf.data(), std::streamsize(buf.size()));
+        }
+
+        {
+            File xfile(dmap, fpath, runcfg);
+            EXPECT_EQ(xfile.was_loaded_from_snapshot(), (bool)false);
+            EXPECT_EQ(xfile.expose_block_array().blk_cnt(), blk_cnt + 1);
+            EXPECT_EQ(xfile.root()->count(), (uint32_t)(4 + 1));
+            xfile.close();
+        }
+
+        // The file was closed properly so the new snapshot is trusted again
+        {
+            File xfile(dmap, fpath, runcfg);
+            EXPECT_EQ(xfile.was_loaded_from_snapshot(), (bool)true);
+            EXPECT_EQ(xfile.root()->count(), (uint32_t)(4 + 1));
+            xfile.close();
+        }
+    }
+
+    // With the lazy load enabled, the subsets are loaded on their first use
+    // if the file has a free space snapshot; otherwise everything is loaded.
+    TEST(FileTest, LazyLoadSubsets) {
+        DescriptorMapping dmap({{0xfa, PlainDescriptor::create}});
+
+        DELETE("LazyLoadSubsets.xoz");
+
+        const char* fpath = SCRATCH_HOME "LazyLoadSubsets.xoz";
+        const struct runtime_config_t runcfg = {
+            .dset = {
+                .sg_blkarr_flags = 0,
+
+                .on_external_ref_action = 0,
+
+                .lazy_load_subsets = true,
+                .load_workers = 1,
+
+                .sync_workers = 1,
+
+                .compact_padding_pct = 0,
+
+                .max_loaded_descriptors = 0,
+            },
+            .file = {
+                .keep_index_updated = true,
+                .free_space_snapshot = true,
+                .paged_name_index = false,
+            }
+        };
+        const struct runtime_config_t no_snapshot_runcfg = {
+            .dset = runcfg.dset,
+            .file = {
+                .keep_index_updated = true,
+                .free_space_snapshot = false,
+                .paged_name_index = false,
+            }
+        };
+
+        struct Descriptor::header_t hdr = {
+            .type = 0xfa,
+
+            .id = 0x0,
+
+            .isize = 0,
+            .cparts = {}
+        };
+
+        File xfile = File::create(dmap, fpath, true, File::DefaultsParameters, runcfg);
+
+        uint32_t dset_id = 0;
+        uint32_t l2dset_id = 0;
+        std::vector<uint32_t> ids;
+        {
+            auto dset = DescriptorSet::create(xfile.expose_block_array(), xfile.expose_runtime_context());
+            dset_id = xfile.root()->add(std::move(dset), true);
+
+            auto l2dset = DescriptorSet::create(xfile.expose_block_array(), xfile.expose_runtime_context());
+            l2dset_id = xfile.root()->get<DescriptorSet>(dset_id)->add(std::move(l2dset), true);
+
+            auto l2 = xfile.root()->get<DescriptorSet>(dset_id)->get<DescriptorSet>(l2dset_id);
+            for (char c = 'A'; c <= 'D'; ++c) {
+                auto dscptr = std::make_unique<PlainDescriptor>(hdr, xfile.expose_block_array());
+                dscptr->set_idata({c, c});
+                ids.push_back(l2->add(std::move(dscptr), true));
+            }
+        }
+        xfile.close();
+
+        // Reopen: only the root set is loaded
+        File xfile2(dmap, fpath, runcfg);
+        EXPECT_EQ(xfile2.was_loaded_from_snapshot(), (bool)true);
+        EXPECT_EQ(xfile2.root()->is_set_loaded(), (bool)true);
+
+        // The subset's descriptor is there but its content was not loaded
+        auto dset = xfile2.root()->get<DescriptorSet>(dset_id);
+        EXPECT_EQ(dset->is_set_loaded(), (bool)false);
+
+        // New persistent ids must not collide with the ones of the
+        // descriptors in the sets not loaded yet
+        {
+            auto dscptr = std::make_unique<PlainDescriptor>(hdr, xfile2.expose_block_array());
+            dscptr->set_idata({'E', 'E'});
+            uint32_t id = xfile2.root()->add(std::move(dscptr), true);
+            EXPECT_EQ(id > ids.back(), (bool)true);
+            ids.push_back(id);
+        }
+
+        // Any access loads the set (but not its subsets)
+        EXPECT_EQ(dset->count(), (uint32_t)1);
+        EXPECT_EQ(dset->is_set_loaded(), (bool)true);
+
+        auto l2dset = dset->get<DescriptorSet>(l2dset_id);
+        EXPECT_EQ(l2dset->is_set_loaded(), (bool)false);
+
+        // Searching by id loads what is needed to find it
+        auto dsc = xfile2.expose_runtime_context().index.find<PlainDescriptor>(ids[2]);
+        EXPECT_EQ(l2dset->is_set_loaded(), (bool)true);
+        EXPECT_EQ(dsc->get_idata(), std::vector<char>({'C', 'C'}));
+        EXPECT_EQ(l2dset->count(), (uint32_t)4);
+
+        xfile2.close();
+
+        // Without the snapshot, the lazy load is not possible and everything is loaded
+        File xfile3(dmap, fpath, no_snapshot_runcfg);
+        EXPECT_EQ(xfile3.was_loaded_from_snapshot(), (bool)false);
+        DescriptorSet::top_down_for_each_set(*xfile3.root(), [](const DescriptorSet* s, [[maybe_unused]] size_t l) {
+            EXPECT_EQ(s->is_set_loaded(), (bool)true);
+        });
+        EXPECT_EQ(xfile3.root()->count(), (uint32_t)3);
+        EXPECT_EQ(xfile3.root()->get<DescriptorSet>(dset_id)->get<DescriptorSet>(l2dset_id)->count(), (uint32_t)4);
+        xfile3.close();
+
+        // The file closed without the snapshot cannot be loaded lazily either
+        File xfile4(dmap, fpath, runcfg);
+        EXPECT_EQ(xfile4.was_loaded_from_snapshot(), (bool)false);
+        EXPECT_EQ(xfile4.root()->get<DescriptorSet>(dset_id)->is_set_loaded(), (bool)true);
+        xfile4.close();
+    }
+
+    // Sync a tree of sets serializing their descriptors in parallel:
+    // the file must be loadable as if it was synced serially.
+    TEST(FileTest, ParallelSync) {
+        DescriptorMapping dmap({{0xfa, PlainDescriptor::create}});
+
+        DELETE("ParallelSync.xoz");
+
+        const char* fpath = SCRATCH_HOME "ParallelSync.xoz";
+        const struct runtime_config_t runcfg = {
+            .dset = {
+                .sg_blkarr_flags = 0,
+
+                .on_external_ref_action = 0,
+
+                .lazy_load_subsets = false,
+                .load_workers = 1,
+                .sync_workers = 4,
+                .compact_padding_pct = 0,
+
+                .max_loaded_descriptors = 0,
+            },
+            .file = {
+                .keep_index_updated = true,
+                .free_space_snapshot = false,
+                .paged_name_index = false,
+            }
+        };
+
+        struct Descriptor::header_t hdr = {
+            .type = 0xfa,
+
+            .id = 0x0,
+
+            .isize = 0,
+            .cparts = {}
+        };
+
+        File xfile = File::create(dmap, fpath, true, File::DefaultsParameters, runcfg);
+
+        // 6 subsets, each with 2 subsets of its own; every set has a few descriptors
+        std::vector<uint32_t> dset_ids;
+        std::map<uint32_t, std::vector<char>> idata_by_id;
+        for (char c = 'A'; c < 'A' + 6; ++c) {
+            auto dset_id = xfile.root()->add(
+                    DescriptorSet::create(xfile.expose_block_array(), xfile.expose_runtime_context()), true);
+            dset_ids.push_back(dset_id);
+            auto dset = xfile.root()->get<DescriptorSet>(dset_id);
+
+            for (char d = 'a'; d < 'a' + 2; ++d) {
+                auto l2dset_id = dset->add(
+                        DescriptorSet::create(xfile.expose_block_array(), xfile.expose_runtime_context()), true);
+                auto l2dset = dset->get<DescriptorSet>(l2dset_id);
+
+                for (int i = 0; i < 3; ++i) {
+                    auto dscptr = std::make_unique<PlainDescriptor>(hdr, xfile.expose_block_array());
+                    dscptr->set_idata({c, d, char('0' + i), 0});
+                    auto id = l2dset->add(std::move(dscptr), true);
+                    idata_by_id[id] = {c, d, char('0' + i), 0};
+                }
+            }
+
+            auto dscptr = std::make_unique<PlainDescriptor>(hdr, xfile.expose_block_array());
+            dscptr->set_idata({c, c});
+            auto id = dset->add(std::move(dscptr), true);
+            idata_by_id[id] = {c, c};
+        }
+        xfile.full_sync(false);
+
+        // Modify a few descriptors (one grows) and sync again
+        for (auto dset_id: {dset_ids[1], dset_ids[4]}) {
+            auto dset = xfile.root()->get<DescriptorSet>(dset_id);
+            for (auto it = dset->begin(); it != dset->end(); ++it) {
+                if ((*it)->is_descriptor_set()) {
+                    continue;
+                }
+
+                auto dsc = (*it)->cast<PlainDescriptor>();
+                dsc->set_idata({'x', 'y', 'z', 'w'});
+                dset->mark_as_modified(dsc->id());
+                idata_by_id[dsc->id()] = {'x', 'y', 'z', 'w'};
+            }
+        }
+        xfile.close();
+
+        File xfile2(dmap, fpath);
+
+        // 6 subsets plus the private id mapping descriptor
+        EXPECT_EQ(xfile2.root()->count(), (uint32_t)7);
+
+        uint32_t sets_cnt = 0;
+        DescriptorSet::top_down_for_each_set(*xfile2.root(), [&](const DescriptorSet* s, [[maybe_unused]] size_t l) {
+            EXPECT_EQ(s->does_require_write(), (bool)false);
+            ++sets_cnt;
+        });
+        EXPECT_EQ(sets_cnt, (uint32_t)(1 + 6 + 6 * 2));
+
+        for (const auto& [id, idata]: idata_by_id) {
+            auto dsc = xfile2.expose_runtime_context().index.find<PlainDescriptor>(id);
+            EXPECT_EQ(dsc->get_idata(), idata);
+        }
+
+        xfile2.close();
+    }
+
+    // Load a tree of sets parsing the sets of each level in parallel:
+    // the result must be the same than loading it serially, including
+    // the temporal ids assigned.
+    TEST(FileTest, ParallelLoad) {
+        DescriptorMapping dmap({{0xfa, PlainDescriptor::create}});
+
+        DELETE("ParallelLoad.xoz");
+
+        const char* fpath = SCRATCH_HOME "ParallelLoad.xoz";
+        const struct runtime_config_t runcfg = {
+            .dset = {
+                .sg_blkarr_flags = 0,
+
+                .on_external_ref_action = 0,
+
+                .lazy_load_subsets = false,
+                .load_workers = 4,
+                .sync_workers = 1,
+                .compact_padding_pct = 0,
+
+                .max_loaded_descriptors = 0,
+            },
+            .file = {
+                .keep_index_updated = true,
+                .free_space_snapshot = false,
+                .paged_name_index = false,
+            }
+        };
+
+        struct Descriptor::header_t hdr = {
+            .type = 0xfa,
+
+            .id = 0x0,
+
+            .isize = 0,
+            .cparts = {}
+        };
+
+        File xfile = File::create(dmap, fpath, true);
+
+        // 6 subsets, each with 2 subsets of its own; every set has a few descriptors,
+        // some of them without a persistent id
+        std::vector<uint32_t> dset_ids;
+        std::map<uint32_t, std::vector<char>> idata_by_id;
+        for (char c = 'A'; c < 'A' + 6; ++c) {
+            auto dset_id = xfile.root()->add(
+                    DescriptorSet::create(xfile.expose_block_array(), xfile.expose_runtime_context()), true);
+            dset_ids.push_back(dset_id);
+            auto dset = xfile.root()->get<DescriptorSet>(dset_id);
+
+            for (char d = 'a'; d < 'a' + 2; ++d) {
+                auto l2dset_id = dset->add(
+                        DescriptorSet::create(xfile.expose_block_array(), xfile.expose_runtime_context()), true);
+                auto l2dset = dset->get<DescriptorSet>(l2dset_id);
+
+                for (int i = 0; i < 3; ++i) {
+                    auto dscptr = std::make_unique<PlainDescriptor>(hdr, xfile.expose_block_array());
+                    dscptr->set_idata({c, d, char('0' + i), 0});
+                    auto id = l2dset->add(std::move(dscptr), true);
+                    idata_by_id[id] = {c, d, char('0' + i), 0};
+                }
+
+                auto dscptr = std::make_unique<PlainDescriptor>(hdr, xfile.expose_block_array());
+                dscptr->set_idata({c, d, 't', 0});
+                l2dset->add(std::move(dscptr));
+            }
+
+            auto dscptr = std::make_unique<PlainDescriptor>(hdr, xfile.expose_block_array());
+            dscptr->set_idata({c, c});
+            auto id = dset->add(std::move(dscptr), true);
+            idata_by_id[id] = {c, c};
+        }
+        xfile.close();
+
+        // Collect the idata of all the descriptors (but the sets) by their id,
+        // persistent or temporal.
+        auto collect = [](File& f) {
+            std::map<uint32_t, std::vector<char>> loaded;
+            DescriptorSet::top_down_for_each_set(*f.root(), [&](DescriptorSet* s, [[maybe_unused]] size_t l) {
+                EXPECT_EQ(s->is_set_loaded(), (bool)true);
+                for (auto it = s->begin(); it != s->end(); ++it) {
+                    auto dsc = (*it)->cast<PlainDescriptor>(true);
+                    if (dsc) {
+                        loaded[dsc->id()] = dsc->get_idata();
+                    }
+                }
+            });
+            return loaded;
+        };
+
+        File xfile2(dmap, fpath, runcfg);
+        auto loaded_in_parallel = collect(xfile2);
+
+        // 6 subsets plus the private id mapping descriptor
+        EXPECT_EQ(xfile2.root()->count(), (uint32_t)7);
+
+        uint32_t sets_cnt = 0;
+        DescriptorSet::top_down_for_each_set(*xfile2.root(), [&]([[maybe_unused]] const DescriptorSet* s, [[maybe_unused]] size_t l) {
+            ++sets_cnt;
+        });
+        EXPECT_EQ(sets_cnt, (uint32_t)(1 + 6 + 6 * 2));
+
+        for (const auto& [id, idata]: idata_by_id) {
+            auto dsc = xfile2.expose_runtime_context().index.find<PlainDescriptor>(id);
+            EXPECT_EQ(dsc->get_idata(), idata);
+        }
+
+        for (auto dset_id: dset_ids) {
+            EXPECT_EQ(xfile2.root()->get<DescriptorSet>(dset_id)->count(), (uint32_t)3);
+        }
+
+        xfile2.close();
+
+        // The persistent descriptors and the 12 temporal ones
+        EXPECT_EQ(loaded_in_parallel.size(), idata_by_id.size() + 12);
+
+        File xfile3(dmap, fpath);
+        auto loaded_serially = collect(xfile3);
+        xfile3.close();
+
+        EXPECT_EQ(loaded_in_parallel, loaded_serially);
+    }
+
+    TEST(FileTest, PagedNameIndex) {
+        DescriptorMapping dmap({{0xfa, PlainDescriptor::create}});
+
+        DELETE("PagedNameIndex.xoz");
+
+        const char* fpath = SCRATCH_HOME "PagedNameIndex.xoz";
+        const struct runtime_config_t runcfg = {
+            .dset = {
+                .sg_blkarr_flags = 0,
+
+                .on_external_ref_action = 0,
+
+                .lazy_load_subsets = false,
+                .load_workers = 1,
+                .sync_workers = 1,
+                .compact_padding_pct = 0,
+
+                .max_loaded_descriptors = 0,
+            },
+            .file = {
+                .keep_index_updated = true,
+                .free_space_snapshot = false,
+                .paged_name_index = true,
+            }
+        };
+
+        struct Descriptor::header_t hdr = {
+            .type = 0xfa,
+
+            .id = 0x0,
+
+            .isize = 0,
+            .cparts = {}
+        };
+
+        // A xoz file without the paged name index: the names go to the IDMappingDescriptor
+        std::map<std::string, uint32_t> id_by_name;
+        {
+            File xfile = File::create(dmap, fpath, true);
+            for (int i = 0; i < 2; ++i) {
+                auto id = xfile.root()->add(std::make_unique<PlainDescriptor>(hdr, xfile.expose_block_array()), true);
+                const std::string name = "old-" + std::to_string(i);
+                xfile.expose_runtime_context().index.add_name(name, id);
+                id_by_name[name] = id;
+            }
+
+            // the descriptors and the IDMappingDescriptor
+            EXPECT_EQ(xfile.root()->count(), (uint32_t)3);
+            xfile.close();
+        }
+
+        // No name index, no incompat flag
+        XOZ_EXPECT_FILE_SERIALIZATION(fpath, 36, 4, "0000 0000");
+
+        // Open it with the paged name index: the names are moved there
+        // and new ones are added to it too, enough to have more than one level of pages
+        {
+            File xfile(dmap, fpath, runcfg);
+            auto& index = xfile.expose_runtime_context().index;
+            for (const auto& [name, id]: id_by_name) {
+                EXPECT_EQ(index.find(name)->id(), id);
+            }
+
+            for (int i = 0; i < 400; ++i) {
+                auto id = xfile.root()->add(std::make_unique<PlainDescriptor>(hdr, xfile.expose_block_array()), true);
+                const std::string name = "dsc-" + std::to_string(i);
+                index.add_name(name, id);
+                id_by_name[name] = id;
+            }
+
+            // the descriptors, the IDMappingDescriptor and the NameIndexDescriptor
+            EXPECT_EQ(xfile.root()->count(), (uint32_t)(2 + 400 + 2));
+            xfile.close();
+        }
+
+        // The names are in the name index: the file is flagged
+        XOZ_EXPECT_FILE_SERIALIZATION(fpath, 36, 4, "0200 0000");
+
+        // The name index is used even if the runtime config does not ask for it
+        {
+            File xfile(dmap, fpath);
+            auto& index = xfile.expose_runtime_context().index;
+            for (const auto& [name, id]: id_by_name) {
+                EXPECT_EQ(index.find(name)->id(), id);
+            }
+            EXPECT_EQ(xfile.root()->count(), (uint32_t)(2 + 400 + 2));
+
+            uint32_t nameidx_cnt = 0;
+            for (auto it = xfile.root()->begin(); it != xfile.root()->end(); ++it) {
+                auto nameidx = (*it)->cast<NameIndexDescriptor>(true);
+                if (nameidx) {
+                    ++nameidx_cnt;
+                    EXPECT_EQ(nameidx->count(), (uint32_t)(2 + 400));
+                    EXPECT_GT(nameidx->page_count(), (uint32_t)3);
+                }
+            }
+            EXPECT_EQ(nameidx_cnt, (uint32_t)1);
+
+            // Delete and reassign a few names
+            index.delete_name("old-0");
+            index.delete_name("dsc-10");
+            index.add_name("dsc-11", id_by_name["dsc-12"], true);
+            id_by_name.erase("old-0");
+            id_by_name.erase("dsc-10");
+            id_by_name["dsc-11"] = id_by_name["dsc-12"];
+
+            EXPECT_EQ(index.contains("dsc-10"), (bool)false);
+            xfile.close();
+        }
+
+        {
+            File xfile(dmap, fpath);
+            auto& index = xfile.expose_runtime_context().index;
+            for (const auto& [name, id]: id_by_name) {
+                EXPECT_EQ(index.find(name)->id(), id);
+            }
+
+            EXPECT_EQ(index.contains("old-0"), (bool)false);
+            EXPECT_EQ(index.contains("dsc-10"), (bool)false);
+            xfile.close();
+        }
+    }
+
+    TEST(FileTest, IDMappingLogFeatureFlag) {
+        DescriptorMapping dmap({{0xfa, PlainDescriptor::create}});
+
+        DELETE("IDMappingLogFeatureFlag.xoz");
+
+        const char* fpath = SCRATCH_HOME "IDMappingLogFeatureFlag.xoz";
+
+        struct Descriptor::header_t hdr = {
+            .type = 0xfa,
+
+            .id = 0x0,
+
+            .isize = 0,
+            .cparts = {}
+        };
+
+        // The first flush stores the whole mapping: no log, no incompat flag
+        uint32_t id1 = 0, id2 = 0;
+        {
+            File xfile = File::create(dmap, fpath, true);
+            id1 = xfile.root()->add(std::make_unique<PlainDescriptor>(hdr, xfile.expose_block_array()), true);
+            id2 = xfile.root()->add(std::make_unique<PlainDescriptor>(hdr, xfile.expose_block_array()), true);
+            xfile.expose_runtime_context().index.add_name("foo", id1);
+            xfile.close();
+        }
+
+        XOZ_EXPECT_FILE_SERIALIZATION(fpath, 36, 4, "0000 0000");
+
+        // Overriding the name appends a record: the mapping is a log now
+        {
+            File xfile(dmap, fpath);
+            xfile.expose_runtime_context().index.add_name("foo", id2, true);
+            xfile.close();
+        }
+
+        XOZ_EXPECT_FILE_SERIALIZATION(fpath, 36, 4, "0100 0000");
+
+        {
+            File xfile(dmap, fpath);
+            EXPECT_EQ(xfile.expose_runtime_context().index.find("foo")->id(), id2);
+            xfile.close();
+        }
+
+        // The flag is still there because the log was not compacted
+        XOZ_EXPECT_FILE_SERIALIZATION(fpath, 36, 4, "0100 0000");
+
+        // Patch the file to set an unknown incompat flag at the 36th byte
+        // and fix the checksum at (30 + 46) adding the same value
+        {
+            std::fstream f(fpath, std::fstream::in | std::fstream::out | std::fstream::binary);
+            f.seekp(36);
+            char patch = 0x05;
+            f.write(&patch, 1);
+
+            unsigned char chk[2];
+            f.seekg(30 + 46);
+            f.read(reinterpret_cast<char*>(chk), 2);
+
+            uint32_t checksum = uint32_t(chk[0] | (chk[1] << 8)) + 0x04;
+            checksum = (checksum & 0xffff) + (checksum >> 16);
+            chk[0] = uint8_t(checksum & 0xff);
+            chk[1] = uint8_t(checksum >> 8);
+
+            f.seekp(30 + 46);
+            f.write(reinterpret_cast<char*>(chk), 2);
+            f.close();
+        }
+
+        EXPECT_THAT(
+            [&]() { File xfile(dmap, fpath); },
+            ThrowsMessage<InconsistentXOZ>(
+                AllOf(
+                    HasSubstr("the xoz file has incompatible features.")
+                    )
+                )
+        );
+    }
+}
@@ -0,0 +1,151 @@
+#include "xoz/file/id_manager.h"
+
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"
+
+using ::testing::HasSubstr;
+using ::testing::ThrowsMessage;
+using ::testing::AllOf;
+
+using namespace ::xoz;
+
+namespace {
+    TEST(IDManagerTest, RegisterAndUnregister) {
+        IDManager idmgr;
+
+        // Sequential registrations (like the ones on a load) take a single interval
+        for (uint32_t id = 1; id <= 1000; ++id) {
+            EXPECT_EQ(idmgr.register_persistent_id(id), (bool)true);
+        }
+        EXPECT_EQ(idmgr.registered_count(), (uint32_t)1000);
+        EXPECT_EQ(idmgr.registered_interval_count(), (uint32_t)1);
+        EXPECT_EQ(idmgr.max_persistent_id(), (uint32_t)1000);
+
+        // Registering twice is not an error but it is reported
+        EXPECT_EQ(idmgr.register_persistent_id(1), (bool)false);
+        EXPECT_EQ(idmgr.register_persistent_id(500), (bool)false);
+        EXPECT_EQ(idmgr.register_persistent_id(1000), (bool)false);
+        EXPECT_EQ(idmgr.registered_count(), (uint32_t)1000);
+
+        // Unregister at the begin, the end and the middle (splitting the interval)
+        idmgr.unregister_persistent_id(1);
+        idmgr.unregister_persistent_id(1000);
+        idmgr.unregister_persistent_id(500);
+        EXPECT_EQ(idmgr.registered_count(), (uint32_t)997);
+        EXPECT_EQ(idmgr.registered_interval_count(), (uint32_t)2);
+
+        EXPECT_EQ(idmgr.is_registered(1), (bool)false);
+        EXPECT_EQ(idmgr.is_registered(2), (bool)true);
+        EXPECT_EQ(idmgr.is_registered(499), (bool)true);
+        EXPECT_EQ(idmgr.is_registered(500), (bool)false);
+        EXPECT_EQ(idmgr.is_registered(501), (bool)true);
+        EXPECT_EQ(idmgr.is_registered(999), (bool)true);
+        EXPECT_EQ(idmgr.is_registered(1000), (bool)false);
+        EXPECT_EQ(idmgr.max_persistent_id(), (uint32_t)999);
+
+        EXPECT_THAT(
+            [&]() { idmgr.unregister_persistent_id(500); },
+            ThrowsMessage<std::runtime_error>(
+                AllOf(
+                    HasSubstr("Persistent id was never registered.")
+                    )
+                )
+        );
+
+        // Registering the gap joins back the intervals
+        EXPECT_EQ(idmgr.register_persistent_id(500), (bool)true);
+        EXPECT_EQ(idmgr.registered_interval_count(), (uint32_t)1);
+
+        // Out of order registrations: isolated ids and ids adjacent to an interval
+        // (before and after)
+        EXPECT_EQ(idmgr.register_persistent_id(2000), (bool)true);
+        EXPECT_EQ(idmgr.register_persistent_id(1500), (bool)true);
+        EXPECT_EQ(idmgr.registered_interval_count(), (uint32_t)3);
+        EXPECT_EQ(idmgr.register_persistent_id(1499), (bool)true);
+        EXPECT_EQ(idmgr.register_persistent_id(1501), (bool)true);
+        EXPECT_EQ(idmgr.register_persistent_id(1), (bool)true);
+        EXPECT_EQ(idmgr.registered_interval_count(), (uint32_t)3);
+        EXPECT_EQ(idmgr.registered_count(), (uint32_t)(998 + 5));
+
+        for (uint32_t id = 1001; id < 1499; ++id) {
+            EXPECT_EQ(idmgr.register_persistent_id(id), (bool)true);
+        }
+        EXPECT_EQ(idmgr.register_persistent_id(1000), (bool)true);
+        EXPECT_EQ(idmgr.registered_interval_count(), (uint32_t)2);
+
+        EXPECT_THAT(
+            [&]() { idmgr.register_persistent_id(0x80000001); },
+            ThrowsMessage<std::runtime_error>(
+                AllOf(
+                    HasSubstr("Temporal ids cannot be registered.")
+                    )
+                )
+        );
+    }
+
+    TEST(IDManagerTest, RequestPersistentIds) {
+        IDManager idmgr;
+
+        EXPECT_EQ(idmgr.request_persistent_id(), (uint32_t)1);
+        EXPECT_EQ(idmgr.request_persistent_id(), (uint32_t)2);
+        EXPECT_EQ(idmgr.request_persistent_ids(10), (uint32_t)3);
+        EXPECT_EQ(idmgr.registered_count(), (uint32_t)12);
+        EXPECT_EQ(idmgr.registered_interval_count(), (uint32_t)1);
+
+        // Freed ids are not reused by default
+        idmgr.unregister_persistent_id(4);
+        idmgr.unregister_persistent_id(7);
+        EXPECT_EQ(idmgr.request_persistent_id(), (uint32_t)13);
+
+        // but they are if enabled, lowest first
+        idmgr.set_reuse_freed_ids(true);
+        EXPECT_EQ(idmgr.request_persistent_id(), (uint32_t)4);
+        EXPECT_EQ(idmgr.request_persistent_id(), (uint32_t)7);
+        EXPECT_EQ(idmgr.request_persistent_id(), (uint32_t)14);
+        EXPECT_EQ(idmgr.registered_interval_count(), (uint32_t)1);
+
+        // Contiguous ids are always after the largest
+        idmgr.unregister_persistent_id(5);
+        EXPECT_EQ(idmgr.request_persistent_ids(2), (uint32_t)15);
+
+        // Reserved ids are never reused (they may belong to descriptors
+        // not loaded yet)
+        idmgr.reserve_persistent_ids_up_to(20);
+        EXPECT_EQ(idmgr.request_persistent_id(), (uint32_t)21);
+
+        idmgr.unregister_persistent_id(21);
+        EXPECT_EQ(idmgr.request_persistent_id(), (uint32_t)21);
+
+        // Exact ids can be reserved too: only them are skipped
+        EXPECT_EQ(idmgr.request_persistent_ids(3), (uint32_t)22);
+        idmgr.unregister_persistent_id(22);
+        idmgr.unregister_persistent_id(23);
+        idmgr.unregister_persistent_id(24);
+        idmgr.reserve_persistent_id(23);
+        EXPECT_EQ(idmgr.is_reserved(22), (bool)false);
+        EXPECT_EQ(idmgr.is_reserved(23), (bool)true);
+        EXPECT_EQ(idmgr.is_reserved(24), (bool)false);
+
+        EXPECT_EQ(idmgr.request_persistent_id(), (uint32_t)22);
+        EXPECT_EQ(idmgr.request_persistent_id(), (uint32_t)24);
+
+        // Registering a reserved id releases the reservation
+        EXPECT_EQ(idmgr.register_persistent_id(23), (bool)true);
+        EXPECT_EQ(idmgr.is_reserved(23), (bool)false);
+        EXPECT_EQ(idmgr.is_registered(23), (bool)true);
+
+        // The reserved ids count for the largest id
+        idmgr.reserve_persistent_id(40);
+        EXPECT_EQ(idmgr.max_persistent_id(), (uint32_t)40);
+        EXPECT_EQ(idmgr.request_persistent_ids(1), (uint32_t)41);
+
+        EXPECT_THAT(
+            [&]() { idmgr.reserve_persistent_id(23); },
+            ThrowsMessage<std::runtime_error>(
+                AllOf(
+                    HasSubstr("Registered ids cannot be reserved.")
+                    )
+                )
+        );
+    }
+}
@@ -4,6 +4,7 @@
 #include "xoz/segm/segment.h"
 #include "xoz/io/iospan.h"
 #include "xoz/dsc/descriptor.h"
+#include "xoz/dsc/spy.h"
 #include "test/plain.h"
 #include "xoz/err/exceptions.h"
 #include "xoz/file/runtime_context.h"
@@ -122,6 +123,69 @@ namespace {
         );
     }
 
+    TEST(DescriptorFinderTest, FindAfterMoveAndErase) {
+        RuntimeContext rctx({});
+
+        VectorBlockArray d_blkarr(32);
+        d_blkarr.allocator().initialize_from_allocated(std::list<Segment>());
+        const auto blk_sz_order = d_blkarr.blk_sz_order();
+
+        struct Descriptor::header_t hdr = {
+            .type = 0xfa,
+
+            .id = 0x0,
+
+            .isize = 0,
+            .cparts = {}
+        };
+
+        Segment sg(blk_sz_order);
+        auto dset = DescriptorSet::create(sg, d_blkarr, rctx);
+        auto subdset1 = dset->get<DescriptorSet>(dset->add(DescriptorSet::create(d_blkarr, rctx)));
+        auto subdset2 = dset->get<DescriptorSet>(dset->add(DescriptorSet::create(d_blkarr, rctx)));
+
+        auto idmap = dset->create_and_add<IDMappingDescriptor>(false);
+        rctx.index.init_index(*dset, idmap);
+
+        // Added after the index was initialized: found without any search
+        uint32_t id1 = subdset1->add(std::make_unique<PlainDescriptor>(hdr, d_blkarr));
+        EXPECT_EQ(rctx.index.find(id1)->get_owner(), std::addressof(*subdset1));
+
+        // The index does not keep the descriptor alive
+        EXPECT_EQ(subdset1->get(id1).use_count(), (long)2);
+
+        // Moved: found in its new home
+        subdset1->move_out(id1, *subdset2);
+        EXPECT_EQ(rctx.index.find(id1)->get_owner(), std::addressof(*subdset2));
+
+        // A temporal id that becomes persistent is found by the new id only
+        uint32_t id2 = subdset2->assign_persistent_id(id1);
+        EXPECT_EQ(rctx.index.find(id2)->get_owner(), std::addressof(*subdset2));
+        EXPECT_THAT(
+            ensure_called_once([&]() { rctx.index.find(id1); }),
+            ThrowsMessage<std::invalid_argument>(AllOf(HasSubstr("does not belong to any set.")))
+        );
+
+        // Erased: not found anymore
+        subdset2->erase(id2);
+        EXPECT_THAT(
+            ensure_called_once([&]() { rctx.index.find(id2); }),
+            ThrowsMessage<std::invalid_argument>(AllOf(HasSubstr("does not belong to any set.")))
+        );
+
+        // A descriptor in a set that is not in the set tree is not found
+        auto detached = DescriptorSet::create(d_blkarr, rctx);
+        uint32_t id3 = detached->add(std::make_unique<PlainDescriptor>(hdr, d_blkarr));
+        EXPECT_THAT(
+            ensure_called_once([&]() { rctx.index.find(id3); }),
+            ThrowsMessage<std::invalid_argument>(AllOf(HasSubstr("does not belong to any set.")))
+        );
+
+        // But it is once the set is added to the tree
+        uint32_t detached_id = subdset1->add(std::move(detached));
+        EXPECT_EQ(rctx.index.find(id3)->get_owner(), std::addressof(*subdset1->get<DescriptorSet>(detached_id)));
+    }
+
     TEST(DescriptorFinderTest, ManageNames) {
         RuntimeContext rctx({});
 
@@ -227,7 +291,7 @@ namespace {
                 )
         );
 
-        // this calls to idmap->store() under the hood
+        // this calls to idmap->append() under the hood
         rctx.index.flush(idmap);
 
         auto mapping = idmap->load();
@@ -240,7 +304,7 @@ namespace {
         rctx.index.add_temporal_name("~zap", id2, true);
         EXPECT_EQ(std::addressof(*rctx.index.find("~zap")), std::addressof(*dsc2));
 
-        // this calls to idmap->store() under the hood, ~zap however should not be stored
+        // nothing is appended as ~zap should not be stored
         rctx.index.flush(idmap);
 
         auto mapping2 = idmap->load();
@@ -248,4 +312,240 @@ namespace {
         EXPECT_EQ(mapping2["foo"], (uint32_t)id2);
         EXPECT_EQ(mapping2["baz"], (uint32_t)id3);
     }
+
+    TEST(DescriptorFinderTest, NamesAreAppendedToTheLog) {
+        RuntimeContext rctx({});
+
+        VectorBlockArray d_blkarr(32);
+        d_blkarr.allocator().initialize_from_allocated(std::list<Segment>());
+        const auto blk_sz_order = d_blkarr.blk_sz_order();
+
+        Segment sg(blk_sz_order);
+        auto dset = DescriptorSet::create(sg, d_blkarr, rctx);
+
+        struct Descriptor::header_t hdr = {
+            .type = 0xfa,
+
+            .id = 0x0,
+
+            .isize = 0,
+            .cparts = {}
+        };
+
+        std::vector<uint32_t> ids;
+        for (int i = 0; i < 4; ++i) {
+            ids.push_back(dset->add(std::make_unique<PlainDescriptor>(hdr, d_blkarr), true));
+        }
+
+        auto idmap = dset->create_and_add<IDMappingDescriptor>(false);
+        rctx.index.init_index(*dset, idmap);
+
+        // Nothing stored yet: the first flush stores the whole mapping
+        rctx.index.add_name("foo", ids[0]);
+        rctx.index.add_name("bar", ids[1]);
+        rctx.index.flush(idmap);
+        EXPECT_EQ(idmap->stored_record_count(), (uint32_t)2);
+
+        // Flushing without changes does not write anything
+        rctx.index.flush(idmap);
+        EXPECT_EQ(idmap->stored_record_count(), (uint32_t)2);
+
+        // Reassigning a name to the same descriptor is not a change either
+        rctx.index.add_name("foo", ids[0]);
+        rctx.index.flush(idmap);
+        EXPECT_EQ(idmap->stored_record_count(), (uint32_t)2);
+
+        // Only the changed names are appended: an override, a deletion and
+        // a new name (added and overridden before the flush so it is appended once)
+        rctx.index.add_name("foo", ids[2], true);
+        rctx.index.delete_name("bar");
+        rctx.index.add_name("baz", ids[1]);
+        rctx.index.add_name("baz", ids[3], true);
+        rctx.index.flush(idmap);
+        EXPECT_EQ(idmap->stored_record_count(), (uint32_t)5);
+
+        // The log is replayed on load: later records win and deletions are honored
+        auto mapping = idmap->load();
+        EXPECT_EQ(mapping.size(), (size_t)2);
+        EXPECT_EQ(mapping["foo"], (uint32_t)ids[2]);
+        EXPECT_EQ(mapping["baz"], (uint32_t)ids[3]);
+        EXPECT_EQ(idmap->stored_record_count(), (uint32_t)5);
+
+        // Keep changing the same name: once the log is too large compared
+        // with the live names, it is compacted
+        uint32_t prev_record_cnt = idmap->stored_record_count();
+        bool compacted = false;
+        for (uint32_t i = 0; i < Index::LogCompactionSlack + 8; ++i) {
+            rctx.index.add_name("foo", ids[i % 2], true);
+            rctx.index.flush(idmap);
+
+            if (idmap->stored_record_count() < prev_record_cnt) {
+                compacted = true;
+                EXPECT_EQ(idmap->stored_record_count(), (uint32_t)2);
+                break;
+            }
+
+            EXPECT_EQ(idmap->stored_record_count(), prev_record_cnt + 1);
+            prev_record_cnt = idmap->stored_record_count();
+        }
+        EXPECT_EQ(compacted, (bool)true);
+
+        auto mapping2 = idmap->load();
+        EXPECT_EQ(mapping2.size(), (size_t)2);
+        EXPECT_EQ(mapping2["baz"], (uint32_t)ids[3]);
+        EXPECT_EQ(mapping2["foo"], rctx.index.find("foo")->id());
+    }
+
+    TEST(DescriptorFinderTest, NameIndexPages) {
+        RuntimeContext rctx({});
+
+        VectorBlockArray d_blkarr(32);
+        d_blkarr.allocator().initialize_from_allocated(std::list<Segment>());
+        const auto blk_sz_order = d_blkarr.blk_sz_order();
+
+        Segment sg(blk_sz_order);
+        auto dset = DescriptorSet::create(sg, d_blkarr, rctx);
+
+        auto nameidx = dset->create_and_add<NameIndexDescriptor>(false);
+        nameidx->set_max_cached_pages(4);
+
+        EXPECT_EQ(nameidx->lookup("foo"), (uint32_t)0);
+        EXPECT_EQ(nameidx->erase("foo"), (bool)false);
+
+        // Insert names in a non-sorted order, enough to split the pages
+        // a few times (and keep more pages than the ones that can be cached)
+        std::map<std::string, uint32_t> expected;
+        for (uint32_t i = 0; i < 1000; ++i) {
+            const uint32_t k = (i * 7919) % 1000;
+            const std::string name = "name-" + std::to_string(k) + std::string(k % 50, 'x');
+            EXPECT_EQ(nameidx->insert(name, k + 1), (bool)true);
+            expected[name] = k + 1;
+        }
+
+        EXPECT_EQ(nameidx->count(), (uint32_t)1000);
+        EXPECT_GT(nameidx->page_count(), (uint32_t)4);
+        EXPECT_EQ(nameidx->cached_page_count(), (uint32_t)4);
+
+        // Reinserting with the same id is not a change, with another id it is
+        EXPECT_EQ(nameidx->insert("name-1x", 2), (bool)false);
+        EXPECT_EQ(nameidx->insert("name-1x", 5000), (bool)true);
+        expected["name-1x"] = 5000;
+
+        EXPECT_EQ(nameidx->erase("name-2xx"), (bool)true);
+        EXPECT_EQ(nameidx->erase("name-2xx"), (bool)false);
+        expected.erase("name-2xx");
+
+        EXPECT_EQ(nameidx->count(), (uint32_t)999);
+        for (const auto& [name, id]: expected) {
+            EXPECT_EQ(nameidx->lookup(name), id);
+        }
+
+        // The scan visits the names in order
+        std::vector<std::pair<std::string, uint32_t>> scanned;
+        nameidx->scan_from("", [&](const std::string& name, uint32_t id) {
+            scanned.emplace_back(name, id);
+            return true;
+        });
+        EXPECT_EQ(scanned, (std::vector<std::pair<std::string, uint32_t>>(expected.begin(), expected.end())));
+
+        // ... and it can start from any name and stop at any time
+        scanned.clear();
+        nameidx->scan_from("name-5", [&](const std::string& name, uint32_t id) {
+            scanned.emplace_back(name, id);
+            return scanned.size() < 3;
+        });
+
+        auto it = expected.lower_bound("name-5");
+        EXPECT_EQ(scanned, (std::vector<std::pair<std::string, uint32_t>>(it, std::next(it, 3))));
+
+        // Write the descriptor and load it back: the pages are read from the content
+        dset->full_sync(false);
+
+        std::vector<char> buf(::xoz::dsc::internals::DescriptorInnerSpyForTesting(*nameidx).calc_struct_footprint_size());
+        nameidx->write_struct_into(IOSpan(buf), rctx);
+
+        auto dsc2 = Descriptor::load_struct_from(IOSpan(buf), rctx, d_blkarr);
+        auto nameidx2 = dsc2->cast<NameIndexDescriptor>();
+
+        EXPECT_EQ(nameidx2->count(), (uint32_t)999);
+        EXPECT_EQ(nameidx2->cached_page_count(), (uint32_t)0);
+        for (const auto& [name, id]: expected) {
+            EXPECT_EQ(nameidx2->lookup(name), id);
+        }
+    }
+
+    TEST(DescriptorFinderTest, FindByPrefix) {
+        for (bool paged: {false, true}) {
+            RuntimeContext rctx({});
+
+            VectorBlockArray d_blkarr(32);
+            d_blkarr.allocator().initialize_from_allocated(std::list<Segment>());
+            const auto blk_sz_order = d_blkarr.blk_sz_order();
+
+            Segment sg(blk_sz_order);
+            auto dset = DescriptorSet::create(sg, d_blkarr, rctx);
+
+            struct Descriptor::header_t hdr = {
+                .type = 0xfa,
+
+                .id = 0x0,
+
+                .isize = 0,
+                .cparts = {}
+            };
+
+            auto idmap = dset->create_and_add<IDMappingDescriptor>(false);
+            std::shared_ptr<NameIndexDescriptor> nameidx;
+            if (paged) {
+                nameidx = dset->create_and_add<NameIndexDescriptor>(false);
+            }
+            rctx.index.init_index(*dset, idmap, nameidx);
+
+            // Names given in a hierarchical fashion (plus a few temporal names)
+            std::map<std::string, uint32_t> expected;
+            for (int layer = 0; layer < 12; ++layer) {
+                for (int obj = 0; obj < 3; ++obj) {
+                    const std::string name = "layer/" + std::to_string(layer) + "/" + std::to_string(obj);
+                    auto id = dset->add(std::make_unique<PlainDescriptor>(hdr, d_blkarr), true);
+                    rctx.index.add_name(name, id);
+                    expected[name] = id;
+                }
+            }
+            rctx.index.add_temporal_name("~layer/3", expected["layer/3/0"]);
+            rctx.index.add_temporal_name("~tmp", expected["layer/3/1"]);
+            expected["~layer/3"] = expected["layer/3/0"];
+            expected["~tmp"] = expected["layer/3/1"];
+
+            EXPECT_THAT(rctx.index.find_prefix("layer/3/"),
+                        ElementsAre(std::make_pair(std::string("layer/3/0"), expected["layer/3/0"]),
+                                    std::make_pair(std::string("layer/3/1"), expected["layer/3/1"]),
+                                    std::make_pair(std::string("layer/3/2"), expected["layer/3/2"])));
+
+            // "layer/1" is a prefix of "layer/10" and "layer/11" too
+            EXPECT_EQ(rctx.index.find_prefix("layer/1").size(), (size_t)9);
+            EXPECT_EQ(rctx.index.find_prefix("layer/1/").size(), (size_t)3);
+            EXPECT_EQ(rctx.index.find_prefix("layer/99").size(), (size_t)0);
+            EXPECT_EQ(rctx.index.find_prefix("~").size(), (size_t)2);
+
+            // The empty prefix matches all the names, in order
+            auto all = rctx.index.find_prefix("");
+            EXPECT_EQ(all, (std::vector<std::pair<std::string, uint32_t>>(expected.begin(), expected.end())));
+
+            // Range [layer/2, layer/4)
+            std::vector<std::string> names;
+            rctx.index.for_each_name("layer/2", [&](const std::string& name, [[maybe_unused]] uint32_t id) {
+                if (name >= "layer/4") {
+                    return false;
+                }
+                names.push_back(name);
+                return true;
+            });
+            EXPECT_THAT(names, ElementsAre("layer/2/0", "layer/2/1", "layer/2/2", "layer/3/0", "layer/3/1",
+                                           "layer/3/2"));
+
+            // Deleted names are not found
+            rctx.index.delete_name("layer/3/1");
+            EXPECT_EQ(rctx.index.find_prefix("layer/3/").size(), (size_t)2);
+        }
+    }
 }
@@ -0,0 +1,153 @@
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"
+
+#include "xoz/mem/flat_hash.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <random>
+#include <set>
+#include <vector>
+
+using namespace ::xoz;
+
+namespace {
+    TEST(FlatHashTest, SetInsertEraseContains) {
+        FlatHashSet<uint32_t> set;
+        EXPECT_EQ(set.size(), (size_t)0);
+        EXPECT_EQ(set.capacity(), (size_t)0);
+        EXPECT_FALSE(set.contains(1));
+        EXPECT_FALSE(set.erase(1));
+
+        // The empty key is never present
+        EXPECT_FALSE(set.contains(0));
+
+        EXPECT_TRUE(set.insert(1));
+        EXPECT_TRUE(set.insert(2));
+        EXPECT_FALSE(set.insert(1));
+        EXPECT_EQ(set.size(), (size_t)2);
+        EXPECT_EQ(set.capacity(), (size_t)8);
+
+        EXPECT_TRUE(set.contains(1));
+        EXPECT_TRUE(set.contains(2));
+        EXPECT_FALSE(set.contains(3));
+
+        std::vector<uint32_t> keys(set.begin(), set.end());
+        std::sort(keys.begin(), keys.end());
+        EXPECT_THAT(keys, ::testing::ElementsAre(1, 2));
+
+        EXPECT_TRUE(set.erase(1));
+        EXPECT_FALSE(set.erase(1));
+        EXPECT_FALSE(set.contains(1));
+        EXPECT_TRUE(set.contains(2));
+        EXPECT_EQ(set.size(), (size_t)1);
+
+        set.clear();
+        EXPECT_EQ(set.size(), (size_t)0);
+        EXPECT_FALSE(set.contains(2));
+        EXPECT_EQ(set.begin(), set.end());
+    }
+
+    TEST(FlatHashTest, SetGrowsAtThreeQuarters) {
+        FlatHashSet<uint32_t> set;
+        for (uint32_t k = 1; k <= 6; ++k) {
+            set.insert(k);
+        }
+        EXPECT_EQ(set.capacity(), (size_t)8);
+
+        set.insert(7);
+        EXPECT_EQ(set.capacity(), (size_t)16);
+
+        // Reserving makes room for all of them at once
+        FlatHashSet<uint32_t> other;
+        other.reserve(100);
+        EXPECT_EQ(other.capacity(), (size_t)256);
+        for (uint32_t k = 1; k <= 100; ++k) {
+            other.insert(k);
+        }
+        EXPECT_EQ(other.capacity(), (size_t)256);
+    }
+
+    TEST(FlatHashTest, SetOfPointers) {
+        std::vector<int> objs(50);
+        FlatHashSet<int*> set;
+        for (auto& obj: objs) {
+            EXPECT_TRUE(set.insert(&obj));
+        }
+
+        for (size_t i = 0; i < objs.size(); i += 2) {
+            EXPECT_TRUE(set.erase(&objs[i]));
+        }
+
+        EXPECT_EQ(set.size(), (size_t)25);
+        for (size_t i = 0; i < objs.size(); ++i) {
+            EXPECT_EQ(set.contains(&objs[i]), i % 2 == 1);
+        }
+    }
+
+    TEST(FlatHashTest, MapFindAndUpdate) {
+        FlatHashMap<uint32_t, uint32_t> map;
+        EXPECT_EQ(map.find(1), nullptr);
+
+        map[1] = 10;
+        map[2] = 20;
+        EXPECT_EQ(*map.find(1), (uint32_t)10);
+        EXPECT_EQ(*map.find(2), (uint32_t)20);
+
+        // The values are updated in place
+        *map.find(1) = 11;
+        map[2] += 1;
+        EXPECT_EQ(*map.find(1), (uint32_t)11);
+        EXPECT_EQ(*map.find(2), (uint32_t)21);
+
+        // A missing key gets a value-initialized value
+        EXPECT_EQ(map[3], (uint32_t)0);
+        EXPECT_EQ(map.size(), (size_t)3);
+
+        std::map<uint32_t, uint32_t> entries;
+        for (const auto& [k, v]: map) {
+            entries[k] = v;
+        }
+        EXPECT_EQ(entries, (std::map<uint32_t, uint32_t>{{1, 11}, {2, 21}, {3, 0}}));
+    }
+
+    TEST(FlatHashTest, EraseKeepsTheOthersReachable) {
+        // Erasing shifts back the entries of the same probe sequence:
+        // compare against a std::map after a lot of random inserts and erases
+        // on a small range of keys so the probe sequences are long and wrap around.
+        std::mt19937 rng(42);
+        std::uniform_int_distribution<uint32_t> key_dist(1, 300);
+
+        FlatHashMap<uint32_t, uint32_t> map;
+        std::map<uint32_t, uint32_t> expected;
+
+        for (uint32_t i = 0; i < 20000; ++i) {
+            const uint32_t k = key_dist(rng);
+            if (rng() % 3 == 0) {
+                EXPECT_EQ(map.erase(k), expected.erase(k) == 1);
+            } else {
+                map[k] = i;
+                expected[k] = i;
+            }
+        }
+
+        EXPECT_EQ(map.size(), expected.size());
+        for (uint32_t k = 1; k <= 300; ++k) {
+            auto it = expected.find(k);
+            if (it == expected.end()) {
+                EXPECT_EQ(map.find(k), nullptr);
+            } else {
+                ASSERT_NE(map.find(k), nullptr);
+                EXPECT_EQ(*map.find(k), it->second);
+            }
+        }
+
+        // Erase all
+        for (uint32_t k = 1; k <= 300; ++k) {
+            map.erase(k);
+        }
+        EXPECT_EQ(map.size(), (size_t)0);
+        EXPECT_EQ(map.begin(), map.end());
+    }
+}  // namespace
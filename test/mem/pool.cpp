@@ -0,0 +1,191 @@
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"
+
+#include "xoz/mem/pool.h"
+
+#include <map>
+#include <memory>
+#include <set>
+#include <vector>
+
+using namespace ::xoz;
+
+namespace {
+    TEST(PoolTest, FixedSizeReusesFreedChunks) {
+        // The slab header takes 3 chunks of 16 bytes: with 5 chunks more
+        // the slab is exactly of 128 bytes
+        FixedSizePool pool(16, 5);
+        EXPECT_EQ(pool.slab_capacity(), (uint32_t)5);
+        EXPECT_EQ(pool.slab_size(), (uint32_t)128);
+
+        std::vector<void*> chunks;
+        for (int i = 0; i < 5; ++i) {
+            chunks.push_back(pool.alloc());
+        }
+
+        EXPECT_EQ(pool.in_use_count(), (uint64_t)5);
+        EXPECT_EQ(pool.slab_count(), (uint64_t)1);
+
+        // The chunks are carved from the same slab, one after the other
+        for (int i = 1; i < 5; ++i) {
+            EXPECT_EQ(static_cast<char*>(chunks[i]) - static_cast<char*>(chunks[i - 1]), 16);
+        }
+
+        // The slab is full: a new one is needed
+        void* p = pool.alloc();
+        EXPECT_EQ(pool.slab_count(), (uint64_t)2);
+
+        // Freed chunks are reused (last freed, first reused) before
+        // taking more chunks from the slab
+        pool.dealloc(chunks[1]);
+        pool.dealloc(chunks[2]);
+        EXPECT_EQ(pool.in_use_count(), (uint64_t)4);
+
+        EXPECT_EQ(pool.alloc(), chunks[2]);
+        EXPECT_EQ(pool.alloc(), chunks[1]);
+        EXPECT_EQ(pool.in_use_count(), (uint64_t)6);
+        EXPECT_EQ(pool.slab_count(), (uint64_t)2);
+
+        // The second slab is empty now but it is kept
+        pool.dealloc(p);
+        EXPECT_EQ(pool.slab_count(), (uint64_t)2);
+
+        // The first slab is empty too: there is no need of a second empty slab
+        for (auto chunk: chunks) {
+            pool.dealloc(chunk);
+        }
+        EXPECT_EQ(pool.in_use_count(), (uint64_t)0);
+        EXPECT_EQ(pool.slab_count(), (uint64_t)1);
+    }
+
+    TEST(PoolTest, FixedSizeFreesEmptySlabs) {
+        FixedSizePool pool(16, 5);
+
+        std::vector<void*> chunks;
+        for (int i = 0; i < 5 * 10; ++i) {
+            chunks.push_back(pool.alloc());
+        }
+        EXPECT_EQ(pool.slab_count(), (uint64_t)10);
+
+        // Free one chunk of each slab: the slabs are not empty so they are kept
+        for (int i = 0; i < 5 * 10; i += 5) {
+            pool.dealloc(chunks[i]);
+        }
+        EXPECT_EQ(pool.in_use_count(), (uint64_t)(4 * 10));
+        EXPECT_EQ(pool.slab_count(), (uint64_t)10);
+
+        // The freed chunks are reused before allocating a new slab
+        // (the slab with the last freed chunk is used first)
+        for (int i = 5 * 9; i >= 0; i -= 5) {
+            void* chunk = pool.alloc();
+            EXPECT_EQ(chunk, chunks[i]);
+        }
+        EXPECT_EQ(pool.slab_count(), (uint64_t)10);
+
+        // Free all the chunks of the first 8 slabs: all but one of them are freed
+        for (int i = 0; i < 5 * 8; ++i) {
+            pool.dealloc(chunks[i]);
+        }
+        EXPECT_EQ(pool.in_use_count(), (uint64_t)(5 * 2));
+        EXPECT_EQ(pool.slab_count(), (uint64_t)3);
+
+        // The empty slab is used first
+        for (int i = 0; i < 5; ++i) {
+            chunks[i] = pool.alloc();
+        }
+        EXPECT_EQ(pool.slab_count(), (uint64_t)3);
+
+        for (int i = 0; i < 5; ++i) {
+            pool.dealloc(chunks[i]);
+        }
+        for (int i = 5 * 8; i < 5 * 10; ++i) {
+            pool.dealloc(chunks[i]);
+        }
+        EXPECT_EQ(pool.in_use_count(), (uint64_t)0);
+        EXPECT_EQ(pool.slab_count(), (uint64_t)1);
+    }
+
+    TEST(PoolTest, SizeClasses) {
+        MemoryPool pool;
+
+        // 1 to 8 bytes are in the same size class, 9 is in the next
+        void* a = pool.alloc(1);
+        void* b = pool.alloc(8);
+        void* c = pool.alloc(9);
+        void* d = pool.alloc(MemoryPool::MaxChunkSize);
+
+        EXPECT_EQ(static_cast<char*>(b) - static_cast<char*>(a), (std::ptrdiff_t)8);
+        EXPECT_EQ(pool.in_use_count(), (uint64_t)4);
+        EXPECT_EQ(pool.slab_count(), (uint64_t)3);
+        EXPECT_GT(pool.slab_bytes(), (uint64_t)(8 + 16 + MemoryPool::MaxChunkSize) * FixedSizePool::DefaultChunksPerSlab);
+
+        pool.dealloc(a, 1);
+        pool.dealloc(b, 8);
+        pool.dealloc(c, 9);
+        pool.dealloc(d, MemoryPool::MaxChunkSize);
+        EXPECT_EQ(pool.in_use_count(), (uint64_t)0);
+    }
+
+    TEST(PoolTest, AllocatorForContainers) {
+        auto pool = std::make_shared<MemoryPool>();
+
+        {
+            std::map<int, int, std::less<int>, PoolAllocator<std::pair<const int, int>>> m(
+                    (PoolAllocator<std::pair<const int, int>>(pool)));
+            std::set<int, std::less<int>, PoolAllocator<int>> s((PoolAllocator<int>(pool)));
+
+            for (int i = 0; i < 100; ++i) {
+                m[i] = i * 2;
+                s.insert(i);
+            }
+
+            // One node per element
+            EXPECT_EQ(pool->in_use_count(), (uint64_t)200);
+
+            for (int i = 0; i < 100; i += 2) {
+                m.erase(i);
+            }
+            EXPECT_EQ(pool->in_use_count(), (uint64_t)150);
+
+            for (int i = 1; i < 100; i += 2) {
+                EXPECT_EQ(m.at(i), i * 2);
+            }
+
+            // Arrays are not taken from the pool
+            std::vector<int, PoolAllocator<int>> v((PoolAllocator<int>(pool)));
+            v.resize(10);
+            EXPECT_EQ(pool->in_use_count(), (uint64_t)150);
+        }
+
+        EXPECT_EQ(pool->in_use_count(), (uint64_t)0);
+    }
+
+    TEST(PoolTest, GlobalPoolForSharedPtrs) {
+        struct obj_t {
+            uint64_t a, b;
+        };
+
+        const auto in_use = GlobalMemoryPool::in_use_count();
+        {
+            // The control block and the object in a single chunk
+            auto p = std::allocate_shared<obj_t>(GlobalPoolAllocator<obj_t>());
+            EXPECT_EQ(GlobalMemoryPool::in_use_count(), in_use + 1);
+
+            // The object from the pool and the control block (with the
+            // deleter and the allocator, both stateless) in another chunk
+            auto q = std::shared_ptr<obj_t>(new (GlobalMemoryPool::alloc(sizeof(obj_t))) obj_t(),
+                                            [](obj_t* o) { GlobalMemoryPool::dealloc(o, sizeof(obj_t)); },
+                                            GlobalPoolAllocator<obj_t>());
+            EXPECT_EQ(GlobalMemoryPool::in_use_count(), in_use + 3);
+
+            auto r = p;
+            EXPECT_EQ(GlobalMemoryPool::in_use_count(), in_use + 3);
+        }
+        EXPECT_EQ(GlobalMemoryPool::in_use_count(), in_use);
+
+        // Large chunks are not taken from the pool
+        void* big = GlobalMemoryPool::alloc(MemoryPool::MaxChunkSize + 1);
+        EXPECT_EQ(GlobalMemoryPool::in_use_count(), in_use);
+        GlobalMemoryPool::dealloc(big, MemoryPool::MaxChunkSize + 1);
+    }
+}
@@ -1,6 +1,8 @@
 #include "xoz/alloc/free_map.h"
 
 #include <cassert>
+#include <iomanip>
+#include <iterator>
 #include <utility>
 
 #include "xoz/err/exceptions.h"
@@ -12,8 +14,11 @@
 #define TRACE_LINE TRACE << "\t\t\t\t"
 
 namespace xoz::alloc::internals {
-FreeMap::FreeMap(bool coalescing_enabled, uint16_t split_above_threshold):
-        coalescing_enabled(coalescing_enabled), split_above_threshold(split_above_threshold) {}
+FreeMap::FreeMap(bool coalescing_enabled, uint16_t split_above_threshold, alloc_strategy_t strategy):
+        coalescing_enabled(coalescing_enabled),
+        split_above_threshold(split_above_threshold),
+        strategy(strategy),
+        next_fit_blk_nr(0) {}
 
 void FreeMap::provide(const std::list<Extent>& exts) {
     TRACE_LINE << "v--- provide " << exts.size() << " exts" << TRACE_ENDL;
@@ -60,6 +65,29 @@ void FreeMap::release(const std::list<Extent>& exts) {
 
 struct FreeMap::alloc_result_t FreeMap::alloc(const uint16_t blk_cnt) {
     fail_alloc_if_empty(blk_cnt, false);
+
+    switch (strategy) {
+        case FirstFit:
+            return alloc_first_fit(blk_cnt, 0);
+
+        case NextFit: {
+            auto result = alloc_first_fit(blk_cnt, next_fit_blk_nr);
+            if (result.success) {
+                next_fit_blk_nr = result.ext.past_end_blk_nr();
+            }
+            return result;
+        }
+
+        case BuddyFit:
+            return alloc_buddy_fit(blk_cnt);
+
+        case BestFit:
+        default:
+            return alloc_best_fit(blk_cnt);
+    }
+}
+
+struct FreeMap::alloc_result_t FreeMap::alloc_best_fit(const uint16_t blk_cnt) {
     TRACE_LINE << "|" << TRACE_FLUSH;
 
     auto end_it = fr_by_cnt.end();
@@ -204,6 +232,189 @@ struct FreeMap::alloc_result_t FreeMap::alloc(const uint16_t blk_cnt) {
     };
 }
 
+struct FreeMap::alloc_result_t FreeMap::alloc_first_fit(const uint16_t blk_cnt, const uint32_t start_blk_nr) {
+    TRACE_LINE << "|" << TRACE_FLUSH;
+
+    // Search from the free chunk at (or after) start_blk_nr up to the end
+    // and then, wrapping around, from the begin up to there.
+    const auto start_it = fr_by_nr.lower_bound(start_blk_nr);
+    for (auto it = start_it; it != fr_by_nr.end(); ++it) {
+        if (is_usable(blk_cnt_of(it), blk_cnt)) {
+            TRACE << "first fit /  " << std::setw(5) << blk_cnt << " blks req -> "
+                  << Extent(blk_nr_of(it), blk_cnt_of(it), false) << TRACE_ENDL;
+            return {.ext = carve(it, blk_nr_of(it), blk_cnt), .success = true};
+        }
+    }
+
+    for (auto it = fr_by_nr.begin(); it != start_it; ++it) {
+        if (is_usable(blk_cnt_of(it), blk_cnt)) {
+            TRACE << "first fit /  " << std::setw(5) << blk_cnt << " blks req -> "
+                  << Extent(blk_nr_of(it), blk_cnt_of(it), false) << TRACE_ENDL;
+            return {.ext = carve(it, blk_nr_of(it), blk_cnt), .success = true};
+        }
+    }
+
+    return fail_with_closest(blk_cnt);
+}
+
+struct FreeMap::alloc_result_t FreeMap::alloc_buddy_fit(const uint16_t blk_cnt) {
+    TRACE_LINE << "|" << TRACE_FLUSH;
+
+    // The alignment is the requested block count rounded up to a power of 2
+    uint32_t align = 1;
+    while (align < blk_cnt) {
+        align <<= 1;
+    }
+
+    for (auto it = fr_by_nr.begin(); it != fr_by_nr.end(); ++it) {
+        const uint64_t chunk_past_end_nr = uint64_t(blk_nr_of(it)) + blk_cnt_of(it);
+        const uint64_t aligned_nr = ((uint64_t(blk_nr_of(it)) + align - 1) / align) * align;
+
+        if (aligned_nr + blk_cnt > chunk_past_end_nr) {
+            continue;
+        }
+
+        // Like in the other strategies, the remain at the end of the chunk must be above the
+        // split threshold. The blocks skipped for the alignment are not considered.
+        const uint64_t blk_cnt_remain = chunk_past_end_nr - (aligned_nr + blk_cnt);
+        if (blk_cnt_remain != 0 and blk_cnt_remain <= split_above_threshold) {
+            continue;
+        }
+
+        TRACE << "buddy fit /  " << std::setw(5) << blk_cnt << " blks req -> "
+              << Extent(blk_nr_of(it), blk_cnt_of(it), false) << TRACE_ENDL;
+        return {.ext = carve(it, uint32_t(aligned_nr), blk_cnt), .success = true};
+    }
+
+    return fail_with_closest(blk_cnt);
+}
+
+struct FreeMap::alloc_result_t FreeMap::fail_with_closest(const uint16_t blk_cnt) const {
+    // The chunk before the first that is equal or larger than blk_cnt is the closest;
+    // if all the chunks are smaller, this is the largest chunk.
+    uint16_t closest_blk_cnt = 0;
+    auto usable_it = fr_by_cnt.lower_bound(blk_cnt);
+    if (usable_it != fr_by_cnt.begin()) {
+        closest_blk_cnt = blk_cnt_of(std::prev(usable_it));
+    }
+
+    TRACE << "fail /  " << std::setw(5) << blk_cnt << " blks req -> closest " << closest_blk_cnt << TRACE_ENDL;
+    return {
+            .ext = Extent(0, closest_blk_cnt, false),
+            .success = false,
+    };
+}
+
+Extent FreeMap::carve(map_nr2cnt_t::iterator chunk_it, const uint32_t blk_nr, const uint16_t blk_cnt) {
+    const uint32_t chunk_nr = blk_nr_of(chunk_it);
+    const uint32_t chunk_past_end_nr = chunk_nr + blk_cnt_of(chunk_it);
+    assert(chunk_nr <= blk_nr);
+    assert(blk_nr + blk_cnt <= chunk_past_end_nr);
+
+    // Remove the chunk from both maps and reinsert the blocks that remain
+    // after and before the allocated extent. As in alloc_best_fit(), the erase() and
+    // insert() return hints for a O(1) insert in fr_by_nr.
+    erase_from_fr_by_cnt(chunk_it);
+    auto hint_it = fr_by_nr.erase(chunk_it);
+
+    const uint32_t past_end_nr = blk_nr + blk_cnt;
+    if (past_end_nr < chunk_past_end_nr) {
+        const uint16_t remain = uint16_t(chunk_past_end_nr - past_end_nr);
+        hint_it = fr_by_nr.insert(hint_it, pair_nr2cnt_t(past_end_nr, remain));
+        fr_by_cnt.insert({remain, past_end_nr});
+    }
+
+    if (chunk_nr < blk_nr) {
+        const uint16_t remain = uint16_t(blk_nr - chunk_nr);
+        fr_by_nr.insert(hint_it, pair_nr2cnt_t(chunk_nr, remain));
+        fr_by_cnt.insert({remain, chunk_nr});
+    }
+
+    assert(fr_by_nr.size() == fr_by_cnt.size());
+    return Extent(blk_nr, blk_cnt, false);
+}
+
+struct FreeMap::alloc_result_t FreeMap::alloc_from_chunk_of(const uint32_t blk_nr, const uint16_t blk_cnt) {
+    fail_alloc_if_empty(blk_cnt, false);
+    TRACE_LINE << "|" << TRACE_FLUSH;
+
+    // The chunk that contains blk_nr is the one that starts at or before it
+    auto chunk_it = fr_by_nr.upper_bound(blk_nr);
+    if (chunk_it == fr_by_nr.begin() or blk_nr >= blk_nr_of(std::prev(chunk_it)) + blk_cnt_of(std::prev(chunk_it))) {
+        TRACE << "chunk of " << blk_nr << " /  " << std::setw(5) << blk_cnt << " blks req -> fail: no chunk"
+              << TRACE_ENDL;
+        return {
+                .ext = Extent(blk_nr, 0, false),
+                .success = false,
+        };
+    }
+    --chunk_it;
+
+    const Extent chunk(blk_nr_of(chunk_it), blk_cnt_of(chunk_it), false);
+    if (not is_usable(chunk.blk_cnt(), blk_cnt)) {
+        TRACE << "chunk of " << blk_nr << " /  " << std::setw(5) << blk_cnt << " blks req -> fail: chunk " << chunk
+              << TRACE_ENDL;
+        return {
+                .ext = chunk,
+                .success = false,
+        };
+    }
+
+    TRACE << "chunk of " << blk_nr << " /  " << std::setw(5) << blk_cnt << " blks req -> " << chunk << TRACE_ENDL;
+    return {.ext = carve(chunk_it, chunk.blk_nr(), blk_cnt), .success = true};
+}
+
+struct FreeMap::alloc_result_t FreeMap::alloc_at(const uint32_t blk_nr, const uint16_t blk_cnt) {
+    fail_alloc_if_empty(blk_cnt, false);
+    TRACE_LINE << "|" << TRACE_FLUSH;
+
+    auto target_it = fr_by_nr.find(blk_nr);
+    if (target_it == fr_by_nr.end()) {
+        TRACE << "at " << blk_nr << " /  " << std::setw(5) << blk_cnt << " blks req -> fail: no chunk" << TRACE_ENDL;
+        return {
+                .ext = Extent(blk_nr, 0, false),
+                .success = false,
+        };
+    }
+
+    const uint16_t avail_blk_cnt = blk_cnt_of(target_it);
+    const uint16_t blk_cnt_remain = avail_blk_cnt >= blk_cnt ? uint16_t(avail_blk_cnt - blk_cnt) : 0;
+
+    if (avail_blk_cnt < blk_cnt or (blk_cnt_remain > 0 and blk_cnt_remain <= split_above_threshold)) {
+        TRACE << "at " << blk_nr << " /  " << std::setw(5) << blk_cnt << " blks req -> fail: chunk "
+              << Extent(blk_nr, avail_blk_cnt, false) << TRACE_ENDL;
+        return {
+                .ext = Extent(blk_nr, avail_blk_cnt, false),
+                .success = false,
+        };
+    }
+
+    TRACE << "at " << blk_nr << " /  " << std::setw(5) << blk_cnt << " blks req -> "
+          << Extent(blk_nr, avail_blk_cnt, false) << TRACE_FLUSH;
+
+    // Remove the chunk from both maps and if there are blocks
+    // remaining, reinsert them as a smaller chunk.
+    // As in alloc(), the erase() returns a hint for a O(1) insert
+    // in fr_by_nr.
+    erase_from_fr_by_cnt(target_it);
+    const auto hint_it = fr_by_nr.erase(target_it);
+
+    if (blk_cnt_remain) {
+        const uint32_t new_fr_nr = blk_nr + blk_cnt;
+        fr_by_nr.insert(hint_it, pair_nr2cnt_t(new_fr_nr, blk_cnt_remain));
+        fr_by_cnt.insert({blk_cnt_remain, new_fr_nr});
+        TRACE << " -> " << Extent(new_fr_nr, blk_cnt_remain, false) << TRACE_ENDL;
+    } else {
+        TRACE << " (perfect)" << TRACE_ENDL;
+    }
+
+    assert(fr_by_nr.size() == fr_by_cnt.size());
+    return {
+            .ext = Extent(blk_nr, blk_cnt, false),
+            .success = true,
+    };
+}
+
 void FreeMap::dealloc(const Extent& ext) {
     TRACE_LINE << "|" << TRACE_FLUSH;
     auto end_it = fr_by_nr.end();
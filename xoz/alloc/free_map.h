@@ -11,15 +11,43 @@ class FreeMap {
     using map_nr2cnt_t = xoz::alloc::internals::map_nr2cnt_t;
     using multimap_cnt2nr_t = xoz::alloc::internals::multimap_cnt2nr_t;
 
+public:
+    // How alloc() chooses the free chunk to allocate from:
+    //
+    //  - BestFit: the smallest free chunk that can hold the requested blocks.
+    //  - FirstFit: the free chunk with the lowest block number that can hold them.
+    //  - NextFit: like FirstFit but the search starts where the previous
+    //    allocation ended and wraps around.
+    //  - BuddyFit: like FirstFit but the allocated extent is placed at a block number
+    //    aligned to the requested block count rounded up to a power of 2 (as a buddy
+    //    allocator would do) so freed extents are more likely to coalesce with
+    //    their neighbors into larger chunks. The blocks skipped for the alignment
+    //    remain free.
+    //
+    // In all the cases, a free chunk is split only if the remaining blocks are
+    // above the split threshold.
+    enum alloc_strategy_t : uint8_t { BestFit = 0, FirstFit, NextFit, BuddyFit };
+
 private:
     bool coalescing_enabled;
     uint16_t split_above_threshold;
+    alloc_strategy_t strategy;
+
+    // Where the next search starts for the NextFit strategy
+    uint32_t next_fit_blk_nr;
 
     map_nr2cnt_t fr_by_nr;
     multimap_cnt2nr_t fr_by_cnt;
 
 public:
-    explicit FreeMap(bool coalescing_enabled = true, uint16_t split_above_threshold = 0);
+    explicit FreeMap(bool coalescing_enabled = true, uint16_t split_above_threshold = 0,
+                     alloc_strategy_t strategy = BestFit);
+
+    void set_alloc_strategy(alloc_strategy_t strategy) {
+        this->strategy = strategy;
+        next_fit_blk_nr = 0;
+    }
+    alloc_strategy_t get_alloc_strategy() const { return strategy; }
 
     // Result of an allocation.
     struct alloc_result_t {
@@ -33,8 +61,8 @@ public:
 
     void reset();
 
-    // Finds the best free chunk that can hold at least
-    // <blk_cnt> blocks
+    // Finds a free chunk that can hold at least <blk_cnt> blocks
+    // following the allocation strategy (see alloc_strategy_t)
     //
     // If success is True, the allocation took place and
     // ext is the extent allocated.
@@ -53,6 +81,33 @@ public:
     // for more about this.
     struct alloc_result_t alloc(const uint16_t blk_cnt);
 
+    // Allocate <blk_cnt> blocks exactly at <blk_nr>. This is possible
+    // only if there is a free chunk that starts at <blk_nr> and it has
+    // at least <blk_cnt> blocks (and the split, if any, is above the
+    // split threshold)
+    //
+    // If success is True, the allocation took place and ext
+    // is the extent allocated (and ext.blk_nr is blk_nr).
+    //
+    // If success is False, the allocated didn't take place and
+    // ext is the free chunk that starts at <blk_nr> (ext.blk_cnt is 0
+    // if there is no such chunk).
+    //
+    // This is useful to expand an allocated extent "in place"
+    // using the free blocks that are immediately after it.
+    struct alloc_result_t alloc_at(const uint32_t blk_nr, const uint16_t blk_cnt);
+
+    // Allocate <blk_cnt> blocks at the begin of the free chunk that
+    // contains <blk_nr>, regardless of the allocation strategy (and of the
+    // alignment of BuddyFit) but honoring the split threshold.
+    //
+    // If success is False, the allocated didn't take place and
+    // ext is the free chunk (ext.blk_cnt is 0 if there is no such chunk).
+    //
+    // This is useful when the space provided to the free map (like the space
+    // from the tail of the block array) cannot be used by the strategy.
+    struct alloc_result_t alloc_from_chunk_of(const uint32_t blk_nr, const uint16_t blk_cnt);
+
     void dealloc(const Extent& ext);
 
     // Handy typedefs iterators: by block number
@@ -90,6 +145,26 @@ public:
     inline const_iterator_by_blk_cnt_t cend_by_blk_cnt() const { return const_iterator_by_blk_cnt_t(fr_by_cnt.cend()); }
 
 private:
+    struct alloc_result_t alloc_best_fit(const uint16_t blk_cnt);
+    struct alloc_result_t alloc_first_fit(const uint16_t blk_cnt, const uint32_t start_blk_nr);
+    struct alloc_result_t alloc_buddy_fit(const uint16_t blk_cnt);
+
+    // Result of a failed allocation: the free chunk's block count closest to
+    // (and below) <blk_cnt> or the largest chunk's block count if there is no
+    // such chunk (see alloc())
+    struct alloc_result_t fail_with_closest(const uint16_t blk_cnt) const;
+
+    // Allocate <blk_cnt> blocks at <blk_nr> from the free chunk pointed by chunk_it.
+    // The blocks of the chunk before and after the allocated extent (if any) remain free.
+    Extent carve(map_nr2cnt_t::iterator chunk_it, const uint32_t blk_nr, const uint16_t blk_cnt);
+
+    // Return true if the free chunk of <chunk_blk_cnt> blocks can be used
+    // to allocate <blk_cnt> blocks without leaving a remain below the split threshold
+    bool is_usable(const uint16_t chunk_blk_cnt, const uint16_t blk_cnt) const {
+        return chunk_blk_cnt == blk_cnt or
+               (chunk_blk_cnt > blk_cnt and uint16_t(chunk_blk_cnt - blk_cnt) > split_above_threshold);
+    }
+
     // Erase from the multimap fr_by_cnt the chunk pointed by target_it
     // (coming from the fr_by_nr map)
     //
@@ -6,6 +6,7 @@
 #include <cstring>
 #include <iomanip>
 #include <iostream>
+#include <iterator>
 #include <list>
 #include <map>
 #include <vector>
@@ -16,8 +17,10 @@
 #include "xoz/blk/block_array.h"
 #include "xoz/err/exceptions.h"
 #include "xoz/ext/extent.h"
+#include "xoz/io/iobase.h"
 #include "xoz/io/iosegment.h"
 #include "xoz/log/trace.h"
+#include "xoz/mem/integer_ops.h"
 #include "xoz/segm/segment.h"
 
 #define TRACE TRACE_ON(0x01)
@@ -48,6 +51,7 @@ SegmentAllocator::SegmentAllocator(bool coalescing_enabled, uint16_t split_above
         internal_frag_avg_sz(0),
         default_req(default_req),
         ops_blocked_stack_cnt(0),
+        deferred_dealloc_enabled(false),
         reset_cnt(0) {
     memset(in_use_ext_per_segm, 0, sizeof(in_use_ext_per_segm));
     memset(&stats_before_reset, 0, sizeof(stats_before_reset));
@@ -117,8 +121,9 @@ Segment SegmentAllocator::alloc(const uint32_t sz, const struct req_t& req) {
         throw std::runtime_error("Subblock size 0 cannot be used for suballocation");
     }
 
+    flush_pending_deallocs();
+
     Segment segm(_blkarr->blk_sz_order());
-    uint32_t sz_remain = sz;
     uint32_t avail_sz = 0;
 
     if (req.single_extent) {
@@ -128,52 +133,10 @@ Segment SegmentAllocator::alloc(const uint32_t sz, const struct req_t& req) {
         }
     }
 
-    // How many blocks are needed?
-    uint32_t blk_cnt_remain = sz_remain / blk_sz;
-    sz_remain = sz_remain % blk_sz;
-
-    // How many sub blocks are needed?
-    uint32_t subblk_cnt_remain;
-    if (req.allow_suballoc) {
-        subblk_cnt_remain = sz_remain / subblk_sz;
-        sz_remain = sz_remain % subblk_sz;
-    } else {
-        subblk_cnt_remain = 0;
-    }
-
-    // How many bytes are going to be inline'd?
-    uint32_t inline_sz = sz_remain;
-    sz_remain = 0;
-
-    // Backpressure: if inline sz is greater than the limit,
-    // put it into its own subblock
-    // In this case the inline must be 0 (unused)
-    //
-    // By contruction inline_sz is less than a subblk sz, if subblk is allowed,
-    // or less than a blk sz otherwise. So if we reach the maximum inline, all
-    // the inline can be perfectly put into a new subblk/blk.
-    if (inline_sz > req.max_inline_sz) {
-        if (req.allow_suballoc) {
-            assert(inline_sz <= subblk_sz);
-            ++subblk_cnt_remain;
-        } else {
-            assert(inline_sz <= blk_sz);
-            ++blk_cnt_remain;
-        }
-        inline_sz = 0;
-    }
-
-    // Backpressure: if subblk count can fill an entire block
-    // do it
-    //
-    // The subblk_cnt_remain should be always less than SUBBLK_CNT_PER_BLK
-    // due how the count is initialized. However, a +1 may happen due
-    // the backpressure of the inline and the count may reach
-    // SUBBLK_CNT_PER_BLK. In this case we can fill an entire block
-    if (subblk_cnt_remain == Extent::SUBBLK_CNT_PER_BLK) {
-        ++blk_cnt_remain;
-        subblk_cnt_remain = 0;
-    }
+    uint32_t blk_cnt_remain = 0;
+    uint32_t subblk_cnt_remain = 0;
+    uint32_t inline_sz = 0;
+    calc_alloc_split(sz, req, blk_cnt_remain, subblk_cnt_remain, inline_sz);
 
     // sanity checks: these should hold if we didn't have a mistake
     // in the computation above.
@@ -241,7 +204,6 @@ Segment SegmentAllocator::alloc(const uint32_t sz, const struct req_t& req) {
     assert(blk_cnt_remain == 0);
     assert(subblk_cnt_remain == 0);
     assert(inline_sz == 0);
-    assert(sz_remain == 0);
 
     avail_sz = segm.calc_data_space_size();
 
@@ -302,6 +264,54 @@ Extent SegmentAllocator::alloc_single_extent(const uint32_t sz) {
     return segm.exts().front();
 }
 
+std::vector<Extent> SegmentAllocator::alloc_consecutive_single_extents(const std::vector<uint32_t>& szs) {
+    std::vector<Extent> exts;
+    if (szs.size() == 0) {
+        return exts;
+    }
+
+    uint64_t run_blk_cnt = 0;
+    for (const auto sz: szs) {
+        if (sz == 0) {
+            throw std::runtime_error("Cannot allocate a single extent of zero bytes");
+        }
+        run_blk_cnt += _blkarr->bytes2blk_cnt(sz, BlockArray::RoundMode::ceil);
+    }
+
+    if (run_blk_cnt > Extent::MAX_BLK_CNT) {
+        throw std::runtime_error("Cannot allocate consecutive extents that do not fit in a single extent");
+    }
+
+    const Extent run = alloc_single_extent(_blkarr->blk2bytes(uint32_t(run_blk_cnt)));
+    assert(run.blk_cnt() == run_blk_cnt);
+
+    // Split the run and fix the stats as if each extent was allocated on its own.
+    // The blocks and bytes in use are the same; the count of extents and
+    // the per-segment stats are not.
+    Segment run_segm(_blkarr->blk_sz_order());
+    run_segm.add_extent(run);
+    calc_ext_per_segm_stats(run_segm, false);
+    internal_frag_avg_sz -= run_segm.estimate_on_avg_internal_frag_sz();
+
+    exts.reserve(szs.size());
+    uint32_t blk_nr = run.blk_nr();
+    for (const auto sz: szs) {
+        const auto ext = Extent(blk_nr, _blkarr->bytes2blk_cnt(sz, BlockArray::RoundMode::ceil), false);
+        blk_nr += ext.blk_cnt();
+
+        Segment segm(_blkarr->blk_sz_order());
+        segm.add_extent(ext);
+        calc_ext_per_segm_stats(segm, true);
+        internal_frag_avg_sz += segm.estimate_on_avg_internal_frag_sz();
+
+        exts.push_back(ext);
+    }
+
+    in_use_ext_cnt += exts.size() - 1;
+    alloc_call_cnt += exts.size() - 1;
+    return exts;
+}
+
 void SegmentAllocator::dealloc(const Segment& segm, const bool zero_it) {
     fail_if_block_array_not_initialized();
     fail_if_allocator_not_initialized();
@@ -330,11 +340,17 @@ void SegmentAllocator::dealloc(const Segment& segm, const bool zero_it) {
     uint64_t blk_cnt = 0;
     uint64_t subblk_cnt = 0;
     for (auto const& ext: segm.exts()) {
-        if (ext.is_suballoc()) {
+        if (deferred_dealloc_enabled) {
+            pending_deallocs.push_back(ext);
+        } else if (ext.is_suballoc()) {
             subfr_map.dealloc(ext);
-            subblk_cnt += ext.subblk_cnt();
         } else {
             fr_map.dealloc(ext);
+        }
+
+        if (ext.is_suballoc()) {
+            subblk_cnt += ext.subblk_cnt();
+        } else {
             blk_cnt += ext.blk_cnt();
         }
     }
@@ -350,15 +366,149 @@ void SegmentAllocator::dealloc(const Segment& segm, const bool zero_it) {
 
     internal_frag_avg_sz -= segm.estimate_on_avg_internal_frag_sz();
 
+    if (not deferred_dealloc_enabled) {
+        reclaim_free_space_from_subfr_map();
+    }
+}
+
+void SegmentAllocator::set_deferred_dealloc(bool enabled) {
+    if (not enabled) {
+        flush_pending_deallocs();
+    }
+
+    deferred_dealloc_enabled = enabled;
+}
+
+void SegmentAllocator::flush_pending_deallocs() {
+    if (pending_deallocs.empty()) {
+        return;
+    }
+
+    TRACE_LINE << "flush " << pending_deallocs.size() << " pending deallocs -------v" << TRACE_ENDL;
+
+    // Take the ownership of the pending extents so if the free maps throw
+    // (like on a double free) the queue is not left half flushed.
+    std::vector<Extent> pending;
+    pending.swap(pending_deallocs);
+
+    std::sort(pending.begin(), pending.end(), Extent::cmp_by_blk_nr);
+
+    // Coalesce the contiguous full-block extents in runs so the free map
+    // does a single lookup per run instead of one per extent.
+    // Overlapping extents are not coalesced so the free map can detect them.
+    Extent run(0, 0, false);
+    bool run_open = false;
+    size_t run_first = 0;
+    size_t i = 0;
+    try {
+        for (; i < pending.size(); ++i) {
+            const auto& ext = pending[i];
+            if (ext.is_suballoc()) {
+                subfr_map.dealloc(ext);
+                continue;
+            }
+
+            if (run_open and coalescing_enabled and run.blk_cnt() != 0 and ext.blk_cnt() != 0 and
+                run.past_end_blk_nr() == ext.blk_nr() and is_u16_add_ok(run.blk_cnt(), ext.blk_cnt())) {
+                run.expand_by(ext.blk_cnt());
+                continue;
+            }
+
+            if (run_open) {
+                fr_map.dealloc(run);
+            }
+
+            run = ext;
+            run_first = i;
+            run_open = true;
+        }
+
+        if (run_open) {
+            fr_map.dealloc(run);
+        }
+    } catch (...) {
+        // The extents of the open run and the ones not processed yet were not
+        // freed. Free them one by one so only the offending extent is lost
+        // (its error is ignored here, the original is rethrown).
+        // The suballoc'd extents before i were freed already.
+        for (size_t j = run_open ? run_first : i; j < pending.size(); ++j) {
+            const auto& ext = pending[j];
+            try {
+                if (ext.is_suballoc()) {
+                    if (j >= i) {
+                        subfr_map.dealloc(ext);
+                    }
+                } else {
+                    fr_map.dealloc(ext);
+                }
+            } catch (...) {
+            }
+        }
+
+        reclaim_free_space_from_subfr_map();
+        throw;
+    }
+
     reclaim_free_space_from_subfr_map();
 }
 
+void SegmentAllocator::calc_alloc_split(const uint32_t sz, const struct req_t& req, uint32_t& blk_cnt_remain,
+                                        uint32_t& subblk_cnt_remain, uint32_t& inline_sz) const {
+    uint32_t sz_remain = sz;
+
+    // How many blocks are needed?
+    blk_cnt_remain = sz_remain / blk_sz;
+    sz_remain = sz_remain % blk_sz;
+
+    // How many sub blocks are needed?
+    if (req.allow_suballoc) {
+        subblk_cnt_remain = sz_remain / subblk_sz;
+        sz_remain = sz_remain % subblk_sz;
+    } else {
+        subblk_cnt_remain = 0;
+    }
+
+    // How many bytes are going to be inline'd?
+    inline_sz = sz_remain;
+
+    // Backpressure: if inline sz is greater than the limit,
+    // put it into its own subblock
+    // In this case the inline must be 0 (unused)
+    //
+    // By contruction inline_sz is less than a subblk sz, if subblk is allowed,
+    // or less than a blk sz otherwise. So if we reach the maximum inline, all
+    // the inline can be perfectly put into a new subblk/blk.
+    if (inline_sz > req.max_inline_sz) {
+        if (req.allow_suballoc) {
+            assert(inline_sz <= subblk_sz);
+            ++subblk_cnt_remain;
+        } else {
+            assert(inline_sz <= blk_sz);
+            ++blk_cnt_remain;
+        }
+        inline_sz = 0;
+    }
+
+    // Backpressure: if subblk count can fill an entire block
+    // do it
+    //
+    // The subblk_cnt_remain should be always less than SUBBLK_CNT_PER_BLK
+    // due how the count is initialized. However, a +1 may happen due
+    // the backpressure of the inline and the count may reach
+    // SUBBLK_CNT_PER_BLK. In this case we can fill an entire block
+    if (subblk_cnt_remain == Extent::SUBBLK_CNT_PER_BLK) {
+        ++blk_cnt_remain;
+        subblk_cnt_remain = 0;
+    }
+}
+
 void SegmentAllocator::realloc(Segment& segm, const uint32_t sz) { realloc(segm, sz, default_req); }
 
 void SegmentAllocator::realloc(Segment& segm, const uint32_t sz, const struct req_t& req) {
     fail_if_block_array_not_initialized();
     fail_if_allocator_not_initialized();
     fail_if_allocator_is_blocked();
+    flush_pending_deallocs();
 
     uint32_t cur_sz = segm.calc_data_space_size();
 
@@ -443,15 +593,35 @@ void SegmentAllocator::realloc(Segment& segm, const uint32_t sz, const struct re
     if (should_expand) {
         assert(sz > cur_sz);
 
-        const uint32_t extra_sz = sz - cur_sz;  // this should not overflow either
-        Segment tail = alloc(extra_sz, req);
+        uint32_t extra_sz = sz - cur_sz;  // this should not overflow either
 
-        // fake stats: drop initial segment and tail and then add the merged of those two
-        calc_ext_per_segm_stats(tail, false);
-        calc_ext_per_segm_stats(segm, false);
+        // Before adding more extents, try to expand the last extent in place:
+        // how many full blocks alloc() would allocate for extra_sz?
+        uint32_t extra_blk_cnt = 0;
+        uint32_t extra_subblk_cnt = 0;
+        uint32_t extra_inline_sz = 0;
+        calc_alloc_split(extra_sz, req, extra_blk_cnt, extra_subblk_cnt, extra_inline_sz);
 
-        segm.extend(tail);
-        calc_ext_per_segm_stats(segm, true);
+        const uint32_t grown_blk_cnt = expand_last_extent_in_place(segm, extra_blk_cnt);
+        if (grown_blk_cnt) {
+            const uint32_t grown_sz = grown_blk_cnt << blk_sz_order;
+            extra_sz = grown_sz >= extra_sz ? 0 : (extra_sz - grown_sz);
+
+            in_use_blk_cnt += grown_blk_cnt;
+            in_use_by_user_sz += grown_sz;
+        }
+
+        // Allocate the rest (if any), most likely subblocks and inline data
+        if (extra_sz) {
+            Segment tail = alloc(extra_sz, req);
+
+            // fake stats: drop initial segment and tail and then add the merged of those two
+            calc_ext_per_segm_stats(tail, false);
+            calc_ext_per_segm_stats(segm, false);
+
+            segm.extend(tail);
+            calc_ext_per_segm_stats(segm, true);
+        }
 
         assert(segm.calc_data_space_size() >= sz);
 
@@ -699,6 +869,99 @@ void SegmentAllocator::_initialize_from_allocated(std::list<Extent>& allocated)
     alloc_initialized = true;
 }
 
+uint32_t SegmentAllocator::calc_snapshot_footprint_size() const {
+    fail_if_block_array_not_initialized();
+    fail_if_allocator_not_initialized();
+    fail_if_pending_deallocs();
+
+    const uint64_t fr_cnt = uint64_t(std::distance(fr_map.cbegin_by_blk_nr(), fr_map.cend_by_blk_nr()));
+    const uint64_t subfr_cnt = uint64_t(std::distance(subfr_map.cbegin_by_blk_nr(), subfr_map.cend_by_blk_nr()));
+
+    // The block count of the array, the stats, the count of free chunks and free subblocks
+    // and then one entry per free chunk (blk nr and blk cnt) and per block with free subblocks
+    // (blk nr and bitmap)
+    const uint64_t sz = sizeof(uint32_t) + (sizeof(uint64_t) * (7 + StatsExtPerSegmLen)) + (sizeof(uint32_t) * 2) +
+                        ((fr_cnt + subfr_cnt) * (sizeof(uint32_t) + sizeof(uint16_t)));
+    return assert_u32(sz);
+}
+
+void SegmentAllocator::write_snapshot_into(IOBase& io) const {
+    fail_if_block_array_not_initialized();
+    fail_if_allocator_not_initialized();
+    fail_if_pending_deallocs();
+
+    io.write_u32_to_le(_blkarr->blk_cnt());
+
+    io.write_u64_to_le(in_use_by_user_sz);
+    io.write_u64_to_le(in_use_blk_cnt);
+    io.write_u64_to_le(in_use_blk_for_suballoc_cnt);
+    io.write_u64_to_le(in_use_subblk_cnt);
+    io.write_u64_to_le(in_use_ext_cnt);
+    io.write_u64_to_le(in_use_inlined_sz);
+    io.write_u64_to_le(internal_frag_avg_sz);
+    for (unsigned i = 0; i < StatsExtPerSegmLen; ++i) {
+        io.write_u64_to_le(in_use_ext_per_segm[i]);
+    }
+
+    io.write_u32_to_le(assert_u32(std::distance(fr_map.cbegin_by_blk_nr(), fr_map.cend_by_blk_nr())));
+    for (auto it = fr_map.cbegin_by_blk_nr(); it != fr_map.cend_by_blk_nr(); ++it) {
+        io.write_u32_to_le(it->blk_nr());
+        io.write_u16_to_le(it->blk_cnt());
+    }
+
+    io.write_u32_to_le(assert_u32(std::distance(subfr_map.cbegin_by_blk_nr(), subfr_map.cend_by_blk_nr())));
+    for (auto it = subfr_map.cbegin_by_blk_nr(); it != subfr_map.cend_by_blk_nr(); ++it) {
+        io.write_u32_to_le(it->blk_nr());
+        io.write_u16_to_le(it->blk_bitmap());
+    }
+}
+
+void SegmentAllocator::initialize_from_snapshot(IOBase& io) {
+    fail_if_block_array_not_initialized();
+
+    const uint32_t blk_cnt = io.read_u32_from_le();
+    if (blk_cnt != _blkarr->blk_cnt()) {
+        throw std::runtime_error((F() << "The snapshot is for a block array of " << blk_cnt
+                                      << " blocks but the block array has " << _blkarr->blk_cnt() << " blocks.")
+                                         .str());
+    }
+
+    in_use_by_user_sz = io.read_u64_from_le();
+    in_use_blk_cnt = io.read_u64_from_le();
+    in_use_blk_for_suballoc_cnt = io.read_u64_from_le();
+    in_use_subblk_cnt = io.read_u64_from_le();
+    in_use_ext_cnt = io.read_u64_from_le();
+    in_use_inlined_sz = io.read_u64_from_le();
+    internal_frag_avg_sz = io.read_u64_from_le();
+    for (unsigned i = 0; i < StatsExtPerSegmLen; ++i) {
+        in_use_ext_per_segm[i] = io.read_u64_from_le();
+    }
+
+    // The free maps will check for overlaps but not for out of bounds,
+    // so we do it here.
+    const uint32_t fr_cnt = io.read_u32_from_le();
+    for (uint32_t i = 0; i < fr_cnt; ++i) {
+        const uint32_t blk_nr = io.read_u32_from_le();
+        const uint16_t blk_cnt = io.read_u16_from_le();
+
+        const Extent ext(blk_nr, blk_cnt, false);
+        _blkarr->fail_if_out_of_boundaries(ext, "error found during SegmentAllocator initialization from snapshot");
+        fr_map.provide(ext);
+    }
+
+    const uint32_t subfr_cnt = io.read_u32_from_le();
+    for (uint32_t i = 0; i < subfr_cnt; ++i) {
+        const uint32_t blk_nr = io.read_u32_from_le();
+        const uint16_t bitmap = io.read_u16_from_le();
+
+        const Extent ext(blk_nr, bitmap, true);
+        _blkarr->fail_if_out_of_boundaries(ext, "error found during SegmentAllocator initialization from snapshot");
+        subfr_map.provide(ext);
+    }
+
+    alloc_initialized = true;
+}
+
 void SegmentAllocator::reset() {
     fail_if_block_array_not_initialized();
     fail_if_allocator_not_initialized();
@@ -708,6 +971,7 @@ void SegmentAllocator::reset() {
     auto st = stats();
     memcpy(&stats_before_reset, &st.current, sizeof(stats_before_reset));
 
+    pending_deallocs.clear();
     fr_map.reset();
     subfr_map.reset();
 
@@ -733,6 +997,7 @@ void SegmentAllocator::release() {
     fail_if_block_array_not_initialized();
     fail_if_allocator_not_initialized();
     fail_if_allocator_is_blocked();
+    flush_pending_deallocs();
     reclaim_free_space_from_subfr_map();
     reclaim_free_space_from_fr_map();
     tail.release();
@@ -814,6 +1079,9 @@ uint32_t SegmentAllocator::allocate_extents(Segment& segm, uint32_t blk_cnt_rema
     // Block count "probe" or "try" to allocate
     uint32_t blk_cnt_probe = uint16_t(-1);
 
+    // Space provided by the tail in the previous iteration, if any
+    Extent provided = Extent::EmptyExtent();
+
     while (blk_cnt_remain and frag_level_ok) {
         // ensure we are not trying to allocate more blocks than can fit
         // in a single Extent or that the ones required to hold sz data
@@ -823,6 +1091,16 @@ uint32_t SegmentAllocator::allocate_extents(Segment& segm, uint32_t blk_cnt_rema
         // Note: cast to uint16_t is OK as blk_cnt_probe is necessary smaller
         // than MAX UINT16 because it is smaller than Extent::MAX_BLK_CNT;
         auto result = fr_map.alloc(uint16_t(blk_cnt_probe));
+
+        // The strategy may not be able to use the space just provided by the tail:
+        // BuddyFit cannot if it starts at a misaligned block and, without coalescing,
+        // every provided space is a chunk on its own so providing more would not help.
+        // Take it from the begin of the chunk regardless of the strategy instead.
+        if (not result.success and not provided.is_empty()) {
+            result = fr_map.alloc_from_chunk_of(provided.blk_nr(), uint16_t(blk_cnt_probe));
+        }
+        provided = Extent::EmptyExtent();
+
         if (result.success) {
             assert(blk_cnt_probe == result.ext.blk_cnt());
 
@@ -833,7 +1111,7 @@ uint32_t SegmentAllocator::allocate_extents(Segment& segm, uint32_t blk_cnt_rema
 
         } else {
             if (use_parent) {
-                auto ok = provide_more_space_to_fr_map(uint16_t(blk_cnt_probe));
+                auto ok = provide_more_space_to_fr_map(uint16_t(blk_cnt_probe), provided);
                 if (not ok) {
                     // not enough free space in parent allocator
                     return blk_cnt_remain;
@@ -863,6 +1141,7 @@ uint32_t SegmentAllocator::allocate_extents(Segment& segm, uint32_t blk_cnt_rema
 
 uint8_t SegmentAllocator::allocate_subblk_extent(Segment& segm, uint8_t subblk_cnt_remain) {
     bool ok = false;
+    Extent provided = Extent::EmptyExtent();
 
 try_subfr_map_alloc:
     auto result = subfr_map.alloc(subblk_cnt_remain);
@@ -877,7 +1156,7 @@ try_fr_map_alloc:
         goto try_subfr_map_alloc;
     }
 
-    ok = provide_more_space_to_fr_map(1);
+    ok = provide_more_space_to_fr_map(1, provided);
     if (ok) {
         goto try_fr_map_alloc;
     }
@@ -885,7 +1164,72 @@ try_fr_map_alloc:
     return subblk_cnt_remain;
 }
 
-bool SegmentAllocator::provide_more_space_to_fr_map(uint16_t blk_cnt) {
+uint32_t SegmentAllocator::expand_last_extent_in_place(Segment& segm, uint32_t blk_cnt) {
+    if (blk_cnt == 0 or segm.ext_cnt() == 0 or segm.has_end_of_segment()) {
+        return 0;
+    }
+
+    const Extent last = segm.exts().back();
+    if (last.is_suballoc() or last.blk_cnt() + blk_cnt > Extent::MAX_BLK_CNT) {
+        return 0;
+    }
+
+    TRACE_LINE << "expand in place " << last << " by " << blk_cnt << " blks -----v" << TRACE_ENDL;
+
+    // Note: cast to uint16_t is OK as blk_cnt + last.blk_cnt() is smaller
+    // than Extent::MAX_BLK_CNT
+    const uint16_t req_blk_cnt = uint16_t(blk_cnt);
+    const uint32_t blk_nr = last.past_end_blk_nr();
+
+    // How many blocks we took from the free map. If the free map
+    // has not enough, we may still be able to expand using the tail
+    // if the free chunk (or the extent itself) is at the end of the
+    // block array.
+    uint16_t from_fr_map_cnt = 0;
+    if (not tail.is_at_the_end(last)) {
+        auto result = fr_map.alloc_at(blk_nr, req_blk_cnt);
+        if (result.success) {
+            from_fr_map_cnt = req_blk_cnt;
+
+        } else if (result.ext.blk_cnt() > 0 and result.ext.blk_cnt() < req_blk_cnt and
+                   tail.is_at_the_end(result.ext)) {
+            // The free chunk is too small but it is at the end
+            // so we take it entirely and let the tail to provide the rest
+            result = fr_map.alloc_at(blk_nr, result.ext.blk_cnt());
+            assert(result.success);
+            from_fr_map_cnt = result.ext.blk_cnt();
+
+        } else {
+            TRACE_LINE << " * cannot expand in place" << TRACE_ENDL;
+            return 0;
+        }
+    }
+
+    if (from_fr_map_cnt < req_blk_cnt) {
+        auto result = tail.alloc(uint16_t(req_blk_cnt - from_fr_map_cnt));
+        if (not result.success) {
+            if (from_fr_map_cnt) {
+                fr_map.dealloc(Extent(blk_nr, from_fr_map_cnt, false));
+            }
+
+            TRACE_LINE << " * tail couldn't provide" << TRACE_ENDL;
+            return 0;
+        }
+
+        assert(result.ext.blk_nr() == blk_nr + from_fr_map_cnt);
+    }
+
+    Extent expanded = last;
+    expanded.expand_by(req_blk_cnt);
+
+    segm.remove_last_extent();
+    segm.add_extent(expanded);
+
+    TRACE_LINE << " * expanded: " << expanded << TRACE_ENDL;
+    return req_blk_cnt;
+}
+
+bool SegmentAllocator::provide_more_space_to_fr_map(uint16_t blk_cnt, Extent& provided) {
     TRACE_LINE << "tail provides to freemap  " << TRACE_FLUSH;
     auto orig_blk_cnt = blk_cnt;
     if (coalescing_enabled) {
@@ -910,6 +1254,7 @@ bool SegmentAllocator::provide_more_space_to_fr_map(uint16_t blk_cnt) {
     if (result.success) {
         TRACE_LINE << " * tail provided " << result.ext.blk_cnt() << " blocks" << TRACE_ENDL;
         fr_map.provide(result.ext);
+        provided = result.ext;
         return true;
     } else {
         TRACE_LINE << " * tail couldn't provide" << TRACE_ENDL;
@@ -1096,6 +1441,13 @@ void SegmentAllocator::fail_if_allocator_not_initialized() const {
     }
 }
 
+void SegmentAllocator::fail_if_pending_deallocs() const {
+    if (not pending_deallocs.empty()) {
+        throw std::runtime_error(
+                "There are pending deallocations in the allocator. Missed call to flush_pending_deallocs()?");
+    }
+}
+
 void SegmentAllocator::fail_if_allocator_is_blocked() const {
     if (ops_blocked_stack_cnt) {
         throw std::runtime_error("SegmentAllocator is blocked: no allocation/deallocation/release is allowed.");
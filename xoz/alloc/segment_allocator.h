@@ -1,7 +1,9 @@
 #pragma once
 
+#include <atomic>
 #include <cstdint>
 #include <list>
+#include <vector>
 
 #include "xoz/alloc/free_map.h"
 #include "xoz/alloc/subblock_free_map.h"
@@ -11,6 +13,7 @@
 
 namespace xoz {
 class BlockArray;
+class IOBase;
 
 class SegmentAllocator {
 public:
@@ -85,7 +88,12 @@ private:
 
     struct req_t default_req;
 
-    uint32_t ops_blocked_stack_cnt;
+    // Atomic: the descriptor sets may block the allocator of their content
+    // from several threads while they are loaded (see DescriptorSet::load_set())
+    std::atomic<uint32_t> ops_blocked_stack_cnt;
+
+    bool deferred_dealloc_enabled;
+    std::vector<Extent> pending_deallocs;
 
 public:
     constexpr static struct req_t XOZDefaultReq = {
@@ -108,6 +116,43 @@ public:
     void set_default_alloc_requirements(const struct req_t& new_req) { default_req = new_req; }
     const struct req_t& get_default_alloc_requirements() const { return default_req; }
 
+    /*
+     * Set how the block array grows when there is no free space to allocate.
+     * See TailAllocator::growth_policy_t.
+     * */
+    void set_growth_policy(const struct xoz::alloc::internals::TailAllocator::growth_policy_t& policy) {
+        tail.set_growth_policy(policy);
+    }
+
+    /*
+     * Set how a free chunk is chosen to allocate a full-block extent.
+     * See FreeMap::alloc_strategy_t.
+     * */
+    void set_alloc_strategy(const xoz::alloc::internals::FreeMap::alloc_strategy_t strategy) {
+        fr_map.set_alloc_strategy(strategy);
+    }
+
+    /*
+     * When enabled, dealloc() does not return the extents to the free maps
+     * but it queues them instead. The queue is flushed on the next alloc()/realloc(),
+     * on release() or calling flush_pending_deallocs() explicitly: the queued
+     * extents are sorted by block number, the contiguous ones are coalesced
+     * in a single pass and then the result is handed to the free maps.
+     *
+     * This makes cheaper to deallocate a large number of segments at once
+     * (like clearing a descriptor set).
+     *
+     * While there are extents pending, the free extents (cbegin_by_blk_nr())
+     * do not include them and errors like a double free are not detected
+     * until the flush.
+     *
+     * Disabling the deferred deallocation flushes any pending extent.
+     * By default, it is disabled.
+     * */
+    void set_deferred_dealloc(bool enabled);
+    bool is_deferred_dealloc_enabled() const { return deferred_dealloc_enabled; }
+    void flush_pending_deallocs();
+
     Segment alloc(const uint32_t sz);
     Segment alloc(const uint32_t sz, const struct req_t& req);
     void dealloc(const Segment& segm, const bool zero_it = false);
@@ -115,14 +160,34 @@ public:
     Extent alloc_single_extent(const uint32_t sz);
     void dealloc_single_extent(const Extent& ext);
 
+    /*
+     * Allocate one single extent per size in <szs>, all of them consecutive.
+     * The space is looked up once, as alloc_single_extent() would do for the sum
+     * of the sizes (rounded up to blocks), and then it is split.
+     *
+     * Each extent is accounted (and it must be deallocated) as if it was
+     * allocated on its own with alloc_single_extent().
+     *
+     * The sum of the sizes, in blocks, must fit in a single extent.
+     * */
+    std::vector<Extent> alloc_consecutive_single_extents(const std::vector<uint32_t>& szs);
+
     /*
      * Resize the given segment in place deallocating parts of the segment not longer
      * needed or allocating new parts.
      *
      * The resize is "in place" in a best-effort fashion:
-     * When the size is increased, new extents (and possibly inline data) will be added to segment
-     * to reach the desired size. If on the contrary the segment shrinks, extents are
-     * removed (and possible a few are added, including, may be inline data).
+     *
+     * When the size is increased, the inline data and the last extent (if it is
+     * a suballocation) are released first (their data is saved and copied back
+     * later). Then the last full extent of the segment is expanded in place over
+     * the free blocks that follow it (or growing the block array if the extent
+     * is at its end). Only the bytes that the expansion could not cover are allocated
+     * as new extents (and possibly inline data) appended to the segment.
+     *
+     * When the size is decreased, the inline data is shrunk if that is enough;
+     * otherwise extents are removed (and possible a few are added, including,
+     * may be inline data).
      *
      * The implementation will try to avoid doing real reallocations of blocks to minimize
      * the copies and the writes, all at the expense of leaving a possibly more fragmented
@@ -148,6 +213,27 @@ public:
     void initialize_from_allocated(const std::list<Extent>& allocated_exts);
     void initialize_with_nothing_allocated();
 
+    /*
+     * Write into the io a snapshot of the free space (the free chunks of blocks and
+     * the free subblocks) and the stats about the space in use, so the allocator can be
+     * initialized later calling initialize_from_snapshot() without requiring the caller
+     * to know which segments/extents are allocated.
+     *
+     * The snapshot is valid only for the current block array's block count: if the array
+     * grows or shrinks, the snapshot is invalid and initialize_from_snapshot() will
+     * throw.
+     *
+     * calc_snapshot_footprint_size() returns how many bytes write_snapshot_into() will write.
+     * */
+    uint32_t calc_snapshot_footprint_size() const;
+    void write_snapshot_into(IOBase& io) const;
+
+    /*
+     * Initialize the allocator from a snapshot made by write_snapshot_into().
+     * Like initialize_from_allocated(), this method must be called once.
+     * */
+    void initialize_from_snapshot(IOBase& io);
+
     /*
      * Deallocate everything. This method should be called only if the caller
      * is sure that the current allocated extents/segments are not longer
@@ -334,6 +420,9 @@ public:
      * If the allocator isn't blocked (aka stack empty), an unblock call
      * will throw.
      *
+     * Blocking/unblocking can be done from several threads concurrently
+     * (no other method of the allocator can).
+     *
      * Call block_all_alloc_dealloc_guard to create an object that calls
      * block_all_alloc_dealloc on its construction and
      * and unblock_all_alloc_dealloc in its destruction.
@@ -348,7 +437,17 @@ private:
 
     uint8_t allocate_subblk_extent(Segment& segm, uint8_t subblk_cnt_remain);
 
-    bool provide_more_space_to_fr_map(uint16_t blk_cnt);
+    uint32_t expand_last_extent_in_place(Segment& segm, uint32_t blk_cnt);
+
+    /*
+     * Split sz in full blocks, subblocks and inline data as alloc() does for
+     * the given requirements, including the backpressure of the inline data
+     * into a subblock (or block) and of a full count of subblocks into a block.
+     * */
+    void calc_alloc_split(const uint32_t sz, const struct req_t& req, uint32_t& blk_cnt_remain,
+                          uint32_t& subblk_cnt_remain, uint32_t& inline_sz) const;
+
+    bool provide_more_space_to_fr_map(uint16_t blk_cnt, Extent& provided);
     bool provide_more_space_to_subfr_map();
 
     void reclaim_free_space_from_fr_map();
@@ -359,6 +458,7 @@ private:
     void fail_if_block_array_not_initialized() const;
     void fail_if_allocator_not_initialized() const;
     void fail_if_allocator_is_blocked() const;
+    void fail_if_pending_deallocs() const;
 
     void _initialize_from_allocated(std::list<Extent>& allocated);
 
@@ -1,6 +1,7 @@
 
 #include "xoz/alloc/tail_allocator.h"
 
+#include <algorithm>
 #include <cassert>
 #include <cstdint>
 
@@ -10,7 +11,7 @@
 
 
 namespace xoz::alloc::internals {
-TailAllocator::TailAllocator(): blkarr(nullptr) {}
+TailAllocator::TailAllocator(): blkarr(nullptr), growth_policy(ExactGrowth) {}
 
 void TailAllocator::manage_block_array(BlockArray& blkarr) { this->blkarr = &blkarr; }
 
@@ -18,10 +19,21 @@ struct TailAllocator::alloc_result_t TailAllocator::alloc(uint16_t blk_cnt) {
     fail_if_block_array_not_initialized();
     fail_alloc_if_empty(blk_cnt, false);
 
-    auto blk_nr = blkarr->grow_by_blocks(blk_cnt);
+    // The reserve is used only if the block array has not enough capacity
+    // and it must be expanded.
+    auto blk_nr = blkarr->grow_by_blocks(blk_cnt, calc_reserve_blk_cnt());
     return {.ext = Extent(blk_nr, blk_cnt, false), .success = true};
 }
 
+uint16_t TailAllocator::calc_reserve_blk_cnt() const {
+    uint32_t reserve_blk_cnt = growth_policy.fixed_blk_cnt;
+    if (growth_policy.geometric_div) {
+        reserve_blk_cnt += blkarr->blk_cnt() / growth_policy.geometric_div;
+    }
+
+    return uint16_t(std::min<uint32_t>(reserve_blk_cnt, growth_policy.max_reserve_blk_cnt));
+}
+
 bool TailAllocator::dealloc(const Extent& ext) {
     fail_if_block_array_not_initialized();
     if (is_at_the_end(ext)) {
@@ -10,13 +10,45 @@ class BlockArray;
 
 namespace xoz::alloc::internals {
 class TailAllocator {
+public:
+    /*
+     * When the block array must grow to satisfy an allocation, the tail allocator
+     * may grow it ahead of use reserving more blocks than the requested ones.
+     * The reserved blocks are kept as capacity of the block array and they are
+     * handed out by the next allocations without expanding the array's backend.
+     *
+     * The count of reserved blocks is fixed_blk_cnt plus the array's current block count
+     * divided by geometric_div (if non-zero), and capped to max_reserve_blk_cnt.
+     *
+     *  - exact growth (no reserve): all zeros (the default)
+     *  - fixed chunks of N blocks: fixed_blk_cnt = max_reserve_blk_cnt = N, geometric_div = 0
+     *  - geometric growth of 1/D of the array, capped to M blocks: geometric_div = D,
+     *    max_reserve_blk_cnt = M
+     *
+     * Any unused reserve is freed on release().
+     * */
+    struct growth_policy_t {
+        uint16_t fixed_blk_cnt;
+        uint16_t geometric_div;
+        uint16_t max_reserve_blk_cnt;
+    };
+
+    constexpr static struct growth_policy_t ExactGrowth = {
+            .fixed_blk_cnt = 0, .geometric_div = 0, .max_reserve_blk_cnt = 0};
+
 private:
     BlockArray* blkarr;
+    struct growth_policy_t growth_policy;
+
     void fail_if_block_array_not_initialized() const;
+    uint16_t calc_reserve_blk_cnt() const;
 
 public:
     TailAllocator();
 
+    void set_growth_policy(const struct growth_policy_t& policy) { growth_policy = policy; }
+    const struct growth_policy_t& get_growth_policy() const { return growth_policy; }
+
     void manage_block_array(BlockArray& blkarr);
 
     // Result of an allocation.
@@ -33,7 +65,7 @@ public:
 
     /*
      * Free any pending-to-free in the allocator and in the block
-     * array.
+     * array, including any block reserved ahead by the growth policy.
      * */
     void release();
 
@@ -76,7 +76,7 @@ BlockArray::BlockArray(bool coalescing_enabled, uint16_t split_above_threshold,
         _release_call_cnt(0) {}
 
 
-uint32_t BlockArray::grow_by_blocks(uint16_t blk_cnt) {
+uint32_t BlockArray::grow_by_blocks(uint16_t blk_cnt, uint16_t ahead_blk_cnt) {
     fail_if_block_array_not_initialized();
     if (blk_cnt == 0)
         throw std::runtime_error("alloc of 0 blocks is not allowed");
@@ -110,8 +110,16 @@ uint32_t BlockArray::grow_by_blocks(uint16_t blk_cnt) {
         throw WouldEndUpInconsistentXOZ("block array is too large, block numbers are exhausted.");
     }
 
+    // Grow ahead if the caller asked for it but only while the request fits in
+    // a uint16_t and the block numbers are not exhausted. The extra blocks
+    // are left as capacity.
+    uint16_t ahead_cnt = std::min(ahead_blk_cnt, uint16_t(0xffff - req_blk_cnt));
+    if (_real_past_end_blk_nr + req_blk_cnt + ahead_cnt >= BLK_NR_EXHAUST) {
+        ahead_cnt = 0;
+    }
+
     ++_grow_expand_capacity_call_cnt;
-    auto [blk_nr, real_blk_cnt] = impl_grow_by_blocks(req_blk_cnt);
+    auto [blk_nr, real_blk_cnt] = impl_grow_by_blocks(uint16_t(req_blk_cnt + ahead_cnt));
     assert(real_blk_cnt >= req_blk_cnt);
 
     xoz_assert("add overflow", is_u32_add_ok(_past_end_blk_nr, real_blk_cnt));
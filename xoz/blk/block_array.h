@@ -265,8 +265,13 @@ public:
      *
      * Callers *should* use allocator().alloc() and allocator().dealloc()
      * to reserve/release space (that may grow/shrink the array if needed).
+     *
+     * If the array must be expanded, grow_by_blocks() may expand it by ahead_blk_cnt
+     * blocks more than the requested. Those are kept as capacity (not part of the array)
+     * so the next calls to grow_by_blocks() can take them without expanding the backend
+     * again. Like any other pending block, they are freed by release_blocks().
      **/
-    uint32_t /* internal */ grow_by_blocks(uint16_t blk_cnt);
+    uint32_t /* internal */ grow_by_blocks(uint16_t blk_cnt, uint16_t ahead_blk_cnt = 0);
     void /* internal */ shrink_by_blocks(uint32_t blk_cnt);
 
     /*
@@ -4,6 +4,7 @@
 #include <cassert>
 #include <cstdint>
 #include <iomanip>
+#include <optional>
 #include <utility>
 
 #include "xoz/blk/block_array.h"
@@ -12,6 +13,7 @@
 #include "xoz/dsc/opaque.h"
 #include "xoz/err/exceptions.h"
 #include "xoz/file/runtime_context.h"
+#include "xoz/io/iospan.h"
 #include "xoz/log/format_string.h"
 #include "xoz/mem/asserts.h"
 #include "xoz/mem/inet_checksum.h"
@@ -33,7 +35,7 @@ namespace xoz {
 void Descriptor::chk_rw_specifics_on_idata(bool is_read_op, IOBase& io, uint32_t idata_begin, uint32_t subclass_end,
                                            uint32_t idata_sz) {
     uint32_t idata_end = idata_begin + idata_sz;  // descriptor truly end
-    F errmsg;
+    std::optional<F> errmsg;  // built only on failure, a F is costly to construct
 
     if (idata_begin > subclass_end) {
         errmsg =
@@ -68,10 +70,10 @@ void Descriptor::chk_rw_specifics_on_idata(bool is_read_op, IOBase& io, uint32_t
 fail:
     if (is_read_op) {
         io.seek_rd(idata_end);
-        throw InconsistentXOZ(errmsg);
+        throw InconsistentXOZ(*errmsg);
     } else {
         io.seek_wr(idata_end);
-        throw WouldEndUpInconsistentXOZ(errmsg);
+        throw WouldEndUpInconsistentXOZ(*errmsg);
     }
 }
 
@@ -85,7 +87,7 @@ void Descriptor::chk_struct_footprint(bool is_read_op, IOBase& io, uint32_t dsc_
     uint32_t calc_footprint =
             dsc->calc_struct_footprint_size();  // what the descriptor says that it should be read/write
 
-    F errmsg;
+    std::optional<F> errmsg;
 
     if (dsc_begin > dsc_end) {
         errmsg = std::move(F() << "The descriptor moved the " << (is_read_op ? "read " : "write ")
@@ -129,10 +131,10 @@ void Descriptor::chk_struct_footprint(bool is_read_op, IOBase& io, uint32_t dsc_
 fail:
     if (is_read_op) {
         io.seek_rd(dsc_end);
-        throw InconsistentXOZ(errmsg);
+        throw InconsistentXOZ(*errmsg);
     } else {
         io.seek_wr(dsc_end);
-        throw WouldEndUpInconsistentXOZ(errmsg);
+        throw WouldEndUpInconsistentXOZ(*errmsg);
     }
 }
 
@@ -147,7 +149,7 @@ void Descriptor::chk_dset_type(bool is_read_op, const Descriptor* const dsc, con
                                                                       hdr.type <= rctx.dmap.DSET_SUBCLASS_MAX_TYPE);
     const bool is_descriptor_set = dsc->is_descriptor_set();
 
-    F errmsg;
+    std::optional<F> errmsg;
 
     if (should_be_dset and not is_descriptor_set) {
         errmsg = std::move(
@@ -168,9 +170,9 @@ void Descriptor::chk_dset_type(bool is_read_op, const Descriptor* const dsc, con
 
 fail:
     if (is_read_op) {
-        throw InconsistentXOZ(errmsg);
+        throw InconsistentXOZ(*errmsg);
     } else {
-        throw WouldEndUpInconsistentXOZ(errmsg);
+        throw WouldEndUpInconsistentXOZ(*errmsg);
     }
 }
 
@@ -181,6 +183,9 @@ Descriptor::Descriptor(const struct Descriptor::header_t& hdr, BlockArray& cblka
         cblkarr(cblkarr),
         owner_raw_ptr(nullptr),
         notified(false),
+        class_tag(&Descriptor::ClassTag),
+        lazy_struct_specifics(false),
+        struct_specifics_deferred(false),
         checksum(0) {
 
     const struct content_part_t example = {
@@ -210,7 +215,7 @@ Descriptor::Descriptor(const uint16_t type, BlockArray& cblkarr, uint16_t decl_c
         Descriptor(create_header(type, cblkarr), cblkarr, decl_cpart_cnt) {}
 
 struct Descriptor::header_t Descriptor::load_header_from(IOBase& io, RuntimeContext& rctx, BlockArray& cblkarr,
-                                                         bool& ex_type_used, uint32_t* checksum) {
+                                                         bool& ex_type_used, uint32_t* checksum, bool register_id) {
     uint32_t local_checksum = 0;
 
     // Make the io read-only during the execution of this method
@@ -269,7 +274,6 @@ struct Descriptor::header_t Descriptor::load_header_from(IOBase& io, RuntimeCont
             //
             // In this context, the id should be a temporal one and not an error
             assert(hi_isize != 0);
-            id = rctx.idmgr.request_temporal_id();
         } else {
             // No ok. The has_id was set but it was not because the hi_isize was required
             // so it should because the descriptor has a persistent id but such cannot
@@ -279,20 +283,15 @@ struct Descriptor::header_t Descriptor::load_header_from(IOBase& io, RuntimeCont
             assert(hi_isize == 0);
             throw InconsistentXOZ(F() << "Descriptor id is zero, detected with partially loaded " << hdr);
         }
-    } else if (has_id and id != 0) {
-        auto ok = rctx.idmgr.register_persistent_id(id);  // TODO test
-        if (not ok) {
-            throw InconsistentXOZ(F() << "Descriptor persistent id " << id
-                                      << " already registered, a duplicated descriptor found somewhere else; " << hdr);
-        }
-
-    } else if (not has_id) {
-        assert(id == 0);
-        id = rctx.idmgr.request_temporal_id();
     }
 
-    assert(id != 0);
-    hdr.id = id;
+    // Without a persistent id, the descriptor will have a temporal one. Until it is
+    // requested (see register_loaded_id()), any temporal id works as a placeholder.
+    hdr.id = (id != 0) ? id : TEMPORAL_ID_PLACEHOLDER;
+
+    if (register_id) {
+        hdr.id = register_loaded_id(rctx, hdr);
+    }
 
     chk_content_parts_consistency(false, hdr);
     // chk_content_parts_count(....); we can't here, see caller of load_header_from
@@ -331,6 +330,20 @@ struct Descriptor::header_t Descriptor::load_header_from(IOBase& io, RuntimeCont
     return hdr;
 }
 
+uint32_t Descriptor::register_loaded_id(RuntimeContext& rctx, const struct header_t& hdr) {
+    if (is_id_temporal(hdr.id)) {
+        return rctx.idmgr.request_temporal_id();
+    }
+
+    auto ok = rctx.idmgr.register_persistent_id(hdr.id);  // TODO test
+    if (not ok) {
+        throw InconsistentXOZ(F() << "Descriptor persistent id " << hdr.id
+                                  << " already registered, a duplicated descriptor found somewhere else; " << hdr);
+    }
+
+    return hdr.id;
+}
+
 std::vector<struct Descriptor::content_part_t> Descriptor::reserve_content_part_vec(uint16_t content_part_cnt) {
     return std::vector<content_part_t>(content_part_cnt);
 }
@@ -420,14 +433,15 @@ std::unique_ptr<Descriptor> Descriptor::load_struct_from(IOBase& io, RuntimeCont
 }
 
 std::unique_ptr<Descriptor> Descriptor::begin_load_dsc_from(IOBase& io, RuntimeContext& rctx, BlockArray& cblkarr,
-                                                            uint32_t dsc_begin_pos, bool& ex_type_used) {
+                                                            uint32_t dsc_begin_pos, bool& ex_type_used,
+                                                            bool register_id) {
     // Make the io read-only during the execution of this method
     [[maybe_unused]] auto guard = io.auto_restore_limits();
     io.limit_to_read_only();
     io.seek_rd(dsc_begin_pos);
 
     uint32_t checksum = 0;
-    struct Descriptor::header_t hdr = load_header_from(io, rctx, cblkarr, ex_type_used, &checksum);
+    struct Descriptor::header_t hdr = load_header_from(io, rctx, cblkarr, ex_type_used, &checksum, register_id);
 
     descriptor_create_fn fn = rctx.dmap.descriptor_create_lookup(hdr.type);
     std::unique_ptr<Descriptor> dsc = fn(hdr, cblkarr, rctx);
@@ -451,6 +465,23 @@ void Descriptor::finish_load_dsc_from(IOBase& io, [[maybe_unused]] RuntimeContex
     io.limit_to_read_only();
     io.seek_rd(idata_begin_pos);
 
+    if (dsc.lazy_struct_specifics) {
+        // Keep the whole internal data, it will be parsed on the first use
+        // (see load_deferred_struct_specifics()).
+        // The footprint depends only on the header so it can be checked now.
+        {
+            [[maybe_unused]] auto limit_guard = io.auto_restore_limits();
+            io.limit_rd(idata_begin_pos, dsc.hdr.isize);
+
+            dsc.future_idata.clear();
+            io.readall(dsc.future_idata, dsc.hdr.isize);
+        }
+
+        dsc.struct_specifics_deferred = true;
+        chk_struct_footprint(true, io, dsc_begin_pos, io.tell_rd(), &dsc, ex_type_used);
+        return;
+    }
+
     {
         [[maybe_unused]] auto alloc_guard = cblkarr.allocator().block_all_alloc_dealloc_guard();
         [[maybe_unused]] auto limit_guard = io.auto_restore_limits();
@@ -476,6 +507,29 @@ void Descriptor::finish_load_dsc_from(IOBase& io, [[maybe_unused]] RuntimeContex
 }
 
 
+void Descriptor::load_deferred_struct_specifics() {
+    // Clear the flag first: update_sizes_of_header() below checks it
+    struct_specifics_deferred = false;
+
+    std::vector<char> idata;
+    std::swap(idata, future_idata);
+
+    IOSpan io(idata);
+    {
+        [[maybe_unused]] auto alloc_guard = cblkarr.allocator().block_all_alloc_dealloc_guard();
+
+        read_struct_specifics_from(io);
+        read_future_idata(io);
+
+        xoz_assert("load future idata odd size", future_idata_size() % 2 == 0);
+    }
+
+    chk_rw_specifics_on_idata(true, io, 0, io.tell_rd(), hdr.isize);
+
+    compute_future_content_parts_sizes();
+    update_sizes_of_header();
+}
+
 void Descriptor::write_struct_into(IOBase& io, [[maybe_unused]] RuntimeContext& rctx) {
     uint32_t dsc_begin_pos = io.tell_wr();
 
@@ -570,7 +624,11 @@ void Descriptor::write_struct_into(IOBase& io, [[maybe_unused]] RuntimeContext&
         [[maybe_unused]] auto limit_guard = io.auto_restore_limits();
         io.limit_wr(idata_begin_pos, hdr.isize);
 
-        write_struct_specifics_into(io);
+        // If the internal data was never parsed, it was never modified either:
+        // write it back as it was loaded (future_idata holds all of it)
+        if (not struct_specifics_deferred) {
+            write_struct_specifics_into(io);
+        }
         write_future_idata(io);
     }
     uint32_t dsc_end_pos = io.tell_wr();
@@ -717,7 +775,7 @@ void Descriptor::notify_descriptor_changed() {
     }
 }
 
-bool Descriptor::is_descriptor_set() const { return cast<const DescriptorSet>(true) != nullptr; }
+bool Descriptor::is_descriptor_set() const { return is_kind_of(&DescriptorSet::ClassTag); }
 
 void Descriptor::read_future_idata(IOBase& io) {
     future_idata.clear();
@@ -759,6 +817,8 @@ void Descriptor::compute_future_content_parts_sizes() {
 }
 
 void Descriptor::update_sizes_of_header() {
+    load_struct_specifics_if_deferred();
+
     // By contract (see update_isize), we need to provide to the callee what we think
     // is the current/present isize (we cannot just pass 0 or a hardcoded default.).
     // If the callee decides to no update the isize, we will keep then with the value
@@ -808,6 +868,8 @@ void Descriptor::declare_used_content_space_on_load([[maybe_unused]] std::vector
 void Descriptor::update_content_parts([[maybe_unused]] std::vector<struct Descriptor::content_part_t>& cparts) {}
 
 void Descriptor::resize_content_part(struct Descriptor::content_part_t& cpart, uint32_t content_new_sz) {
+    load_struct_specifics_if_deferred();
+
     // No previous content and nothing to grow, then skip (no change)
     if (cpart.csize == 0 and content_new_sz == 0) {
         // TODO should try to dealloc anyways???
@@ -921,6 +983,8 @@ void Descriptor::resize_content_part(struct Descriptor::content_part_t& cpart, u
 }
 
 IOSegment Descriptor::get_content_part_io(struct Descriptor::content_part_t& cpart) {
+    load_struct_specifics_if_deferred();
+
     // Hide from the caller the future content
     //
     // Note: if get_content_part_io() is called from read_struct_specifics_from,
@@ -965,7 +1029,7 @@ void Descriptor::collect_segments_into(std::list<Segment>& collection) const {
 }
 
 void Descriptor::chk_content_parts_count(bool wouldBe, const Descriptor::header_t& hdr, const uint16_t decl_cpart_cnt) {
-    F errmsg;
+    std::optional<F> errmsg;
     if (hdr.cparts.size() != decl_cpart_cnt) {
         errmsg = std::move(F() << "The descriptor code declared to use " << decl_cpart_cnt
                                << " content parts but it has " << hdr.cparts.size()
@@ -977,14 +1041,14 @@ void Descriptor::chk_content_parts_count(bool wouldBe, const Descriptor::header_
 
 fail:
     if (wouldBe) {
-        throw WouldEndUpInconsistentXOZ(errmsg);
+        throw WouldEndUpInconsistentXOZ(*errmsg);
     } else {
-        throw InconsistentXOZ(errmsg);
+        throw InconsistentXOZ(*errmsg);
     }
 }
 
 void Descriptor::chk_content_parts_consistency(bool wouldBe, const Descriptor::header_t& hdr) {
-    F errmsg;
+    std::optional<F> errmsg;
     int part_ix = 0;
 
     for (const auto& cpart: hdr.cparts) {
@@ -1018,9 +1082,9 @@ void Descriptor::chk_content_parts_consistency(bool wouldBe, const Descriptor::h
 
 fail:
     if (wouldBe) {
-        throw WouldEndUpInconsistentXOZ(errmsg);
+        throw WouldEndUpInconsistentXOZ(*errmsg);
     } else {
-        throw InconsistentXOZ(errmsg);
+        throw InconsistentXOZ(*errmsg);
     }
 }
 }  // namespace xoz
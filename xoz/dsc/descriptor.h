@@ -3,11 +3,13 @@
 #include <list>
 #include <map>
 #include <memory>
+#include <type_traits>
 #include <vector>
 
 #include "xoz/ext/extent.h"
 #include "xoz/io/iobase.h"
 #include "xoz/io/iosegment.h"
+#include "xoz/mem/pool.h"
 #include "xoz/segm/segment.h"
 
 namespace xoz {
@@ -85,15 +87,28 @@ public:
      * The computed checksum *does* include the descriptor's internal data (isize) however.
      *
      * The read pointer of io is left at the begin of the descriptor's internal data.
+     *
+     * If register_id is false, the id is not registered in the rctx.idmgr: the header has
+     * the persistent id or TEMPORAL_ID_PLACEHOLDER if the descriptor has none and
+     * register_loaded_id() must be called later. Otherwise, register_loaded_id() is called here.
      * */
     static struct header_t load_header_from(IOBase& io, RuntimeContext& rctx, BlockArray& cblkarr, bool& ex_type_used,
-                                            uint32_t* checksum);
+                                            uint32_t* checksum, bool register_id = true);
+
+    /*
+     * Register the persistent id of a loaded header in the rctx.idmgr or, if the header
+     * has a temporal id (the placeholder), request a new temporal one. Return the id.
+     * Fail if the persistent id is already registered.
+     * */
+    static uint32_t register_loaded_id(RuntimeContext& rctx, const struct header_t& hdr);
+    constexpr static uint32_t TEMPORAL_ID_PLACEHOLDER = 0x80000000;
 
     /*
      * Call the virtual method flush_writes() and update_header()
      * and optionally release_free_space().
      * */
     virtual void full_sync(const bool release) {
+        load_struct_specifics_if_deferred();
         flush_writes();
         if (release) {
             release_free_space();
@@ -111,6 +126,34 @@ private:
 public:
     virtual ~Descriptor() {}
 
+    /*
+     * The descriptors of up to MemoryPool::MaxChunkSize bytes are taken from
+     * the GlobalMemoryPool: a set creates a lot of them on its load, and they
+     * may be freed from another thread or after their RuntimeContext.
+     *
+     * The size is rounded up to a multiple of the alignment guaranteed by
+     * the global operator new. Because the destructor is virtual, operator
+     * delete receives the size of the most derived class.
+     * */
+    static void* operator new(size_t sz) { return GlobalMemoryPool::alloc(round_up_to_new_align(sz)); }
+    static void operator delete(void* p, size_t sz) { GlobalMemoryPool::dealloc(p, round_up_to_new_align(sz)); }
+
+    /*
+     * Take the ownership of the descriptor with a shared_ptr whose
+     * control block is taken from the GlobalMemoryPool too.
+     * */
+    static std::shared_ptr<Descriptor> share(std::unique_ptr<Descriptor> dsc) {
+        return std::shared_ptr<Descriptor>(dsc.release(), std::default_delete<Descriptor>(),
+                                           GlobalPoolAllocator<Descriptor>());
+    }
+
+private:
+    static constexpr size_t round_up_to_new_align(size_t sz) {
+        constexpr size_t align = __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+        return (sz + align - 1) / align * align;
+    }
+
+public:
     friend void PrintTo(const Descriptor& dsc, std::ostream* out);
     friend std::ostream& operator<<(std::ostream& out, const Descriptor& dsc);
 
@@ -119,19 +162,67 @@ public:
 
 
     /*
-     * Dynamically downcast the current Descriptor (<this> instance pointer)
+     * Class tags allow to downcast a descriptor without a dynamic_cast.
+     *
+     * A subclass X may declare its own tag, chained to the tag of its closest
+     * tagged base class:
+     *
+     *   constexpr static struct class_tag_for_t<X> ClassTag = {{.base = &Base::ClassTag}};
+     *
+     * and set it in each of its (non-delegating) constructors with
+     * this->class_tag = &ClassTag.
+     *
+     * Each descriptor points to the tag of its most derived tagged class
+     * so casting to a tagged class is a walk of a few pointers followed by
+     * a static_cast. Casting to a class without its own tag falls back
+     * to a dynamic_cast.
+     * */
+    struct class_tag_t {
+        const struct class_tag_t* base;
+    };
+
+    template <typename X>
+    struct class_tag_for_t: class_tag_t {};
+
+    constexpr static struct class_tag_for_t<Descriptor> ClassTag = {{.base = nullptr}};
+
+    template <typename T>
+    constexpr static bool has_own_class_tag =
+            std::is_same_v<std::remove_cv_t<decltype(T::ClassTag)>, class_tag_for_t<std::remove_cv_t<T>>>;
+
+    /*
+     * Return true if the descriptor is of the class with the given tag or of a subclass.
+     * */
+    bool is_kind_of(const struct class_tag_t* tag) const {
+        for (auto t = class_tag; t; t = t->base) {
+            if (t == tag) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /*
+     * Downcast the current Descriptor (<this> instance pointer)
      * to the given concrete subclass T.
      *
      * If the cast works, return a pointer to this casted to T.
      * If the cast fails, throw an exception (if ret_null is false) or return
      * nullptr (if ret_null is true).
      *
-     * While expensive, cast<T>(true) can be used to check the type of a descriptor.
+     * cast<T>(true) can be used to check the type of a descriptor; it is cheap
+     * if T has its own class tag, otherwise it is a (expensive) dynamic_cast.
      * The methods may_cast<T>() are an alias of cast<T>(true)
      * */
     template <typename T>
     T* cast(bool ret_null = false) const {
-        auto ptr = dynamic_cast<T*>(this);
+        T* ptr = nullptr;
+        if constexpr (has_own_class_tag<T>) {
+            ptr = is_kind_of(&std::remove_cv_t<T>::ClassTag) ? static_cast<T*>(this) : nullptr;
+        } else {
+            ptr = dynamic_cast<T*>(this);
+        }
+
         if (!ptr and not ret_null) {
             throw std::runtime_error("Descriptor cannot be dynamically down casted.");
         }
@@ -142,7 +233,13 @@ public:
     template <typename T>
     T* cast(bool ret_null = false) {
         // TODO implement this method in terms of its const version
-        auto ptr = dynamic_cast<T*>(this);
+        T* ptr = nullptr;
+        if constexpr (has_own_class_tag<T>) {
+            ptr = is_kind_of(&std::remove_cv_t<T>::ClassTag) ? static_cast<T*>(this) : nullptr;
+        } else {
+            ptr = dynamic_cast<T*>(this);
+        }
+
         if (!ptr and not ret_null) {
             throw std::runtime_error("Descriptor cannot be dynamically down casted.");
         }
@@ -210,10 +307,18 @@ public:
         }
 
         // To keep the shared ownership between the base_ptr and the returned pointer,
-        // we must use dynamic_pointer_cast.
+        // we must use static_pointer_cast/dynamic_pointer_cast.
         // Creating a shared_ptr<T> from the raw pointer of base_ptr will *not* make
         // the trick.
-        std::shared_ptr<T> ret = std::dynamic_pointer_cast<T, Descriptor>(base_ptr);
+        std::shared_ptr<T> ret;
+        if constexpr (has_own_class_tag<T>) {
+            if (base_ptr->is_kind_of(&std::remove_cv_t<T>::ClassTag)) {
+                ret = std::static_pointer_cast<T, Descriptor>(base_ptr);
+            }
+        } else {
+            ret = std::dynamic_pointer_cast<T, Descriptor>(base_ptr);
+        }
+
         if (not ret and not ret_null) {
             throw std::runtime_error("Descriptor cannot be dynamically down casted.");
         }
@@ -545,6 +650,39 @@ private:
     DescriptorSet* owner_raw_ptr;
     bool notified;
 
+protected:
+    // Tag of the most derived tagged class of this descriptor (see ClassTag)
+    const struct class_tag_t* class_tag;
+
+    /*
+     * Subclasses may set this to true in their constructors to defer the call
+     * to read_struct_specifics_from() from the load of the descriptor to its first use.
+     * Meanwhile, the raw internal data is kept in memory. This makes the load faster
+     * for descriptors that are expensive to parse and that are rarely used.
+     *
+     * Such subclasses *must* call load_struct_specifics_if_deferred() before accessing
+     * to anything that read_struct_specifics_from() reads (including from complete_load()
+     * and on_after_load()). Descriptor calls it before syncing the descriptor and before
+     * resizing or accessing to its content. A descriptor that was never parsed is written
+     * back (like when its set is compacted) with the same internal data it was loaded.
+     *
+     * Any inconsistency in the internal data is detected on the first use and not on the load.
+     * */
+    bool lazy_struct_specifics;
+
+    inline void load_struct_specifics_if_deferred() {
+        if (struct_specifics_deferred) {
+            load_deferred_struct_specifics();
+        }
+    }
+
+private:
+    // The descriptor was loaded but read_struct_specifics_from() was not called yet.
+    // Until then, future_idata holds the entire internal data.
+    bool struct_specifics_deferred;
+
+    void load_deferred_struct_specifics();
+
 
 public:  // Meant to be accesible from the tests and from the DescriptorSet
     /*
@@ -565,6 +703,8 @@ public:  // Meant to be accesible from the tests and from the DescriptorSet
     DescriptorSet* get_owner() const { return this->owner_raw_ptr; }
     void ack_descriptor_changed() { notified = false; }
 
+    bool is_struct_specifics_loaded() const { return not struct_specifics_deferred; }
+
 public:
     /*
      * This is the inet checksum computed during the
@@ -587,7 +727,8 @@ private:
     static struct Descriptor::header_t create_header(const uint16_t type, const BlockArray& cblkarr);
 
     static std::unique_ptr<Descriptor> begin_load_dsc_from(IOBase& io, RuntimeContext& rctx, BlockArray& cblkarr,
-                                                           uint32_t dsc_begin_pos, bool& ex_type_used);
+                                                           uint32_t dsc_begin_pos, bool& ex_type_used,
+                                                           bool register_id = true);
     static void finish_load_dsc_from(IOBase& io, RuntimeContext& rctx, BlockArray& cblkarr, Descriptor& dsc,
                                      uint32_t dsc_begin_pos, uint32_t idata_begin_pos, bool ex_type_used);
 
@@ -2,6 +2,7 @@
 
 #include "xoz/dsc/descriptor_set.h"
 #include "xoz/dsc/id_mapping.h"
+#include "xoz/dsc/name_index.h"
 #include "xoz/dsc/opaque.h"
 #include "xoz/dsc/private.h"
 #include "xoz/err/exceptions.h"
@@ -26,45 +27,94 @@ DescriptorMapping::DescriptorMapping(const std::map<uint16_t, descriptor_create_
         }
     }
 
-    mapping = descriptors_map;
+    if (descriptors_map.empty()) {
+        directory = default_directory();
+        return;
+    }
+
+    // Copy the pages of the default functions that have a type given
+    // by the user; the rest are still shared
+    auto dir = std::make_shared<directory_t>(*default_directory());
+    std::map<uint8_t, std::shared_ptr<page_t>> own_pages;
+    for (auto [type, fn]: descriptors_map) {
+        const uint8_t page_ix = uint8_t(type >> 8);
+        auto& page = own_pages[page_ix];
+        if (not page) {
+            page = std::make_shared<page_t>(*(*dir)[page_ix]);
+            (*dir)[page_ix] = page;
+        }
+
+        (*page)[size_t(type & 0xff)] = fn;
+    }
+
+    directory = dir;
 }
 
 descriptor_create_fn DescriptorMapping::descriptor_create_lookup(uint16_t type) const {
+    descriptor_create_fn fn = (*(*directory)[size_t(type >> 8)])[size_t(type & 0xff)];
+    if (!fn) {
+        xoz_assert("Only the zero type has no create function.", type == RESERVED_ZERO_TYPE);
+        throw std::runtime_error(
+                (F() << "Descriptor mapping for type " << type << " is reserved and should not be present or used.")
+                        .str());
+    }
 
-    // Is the descriptor defined by the user?
-    auto it = mapping.find(type);
-    if (it == mapping.end()) {
-        // Is the descriptor one of the defined by xoz?
-        if (RESERVED_CORE_MIN_TYPE <= type and type <= RESERVED_CORE_MAX_TYPE) {
-            switch (type) {
-                case RESERVED_ZERO_TYPE:
-                    throw std::runtime_error((F() << "Descriptor mapping for type " << type
-                                                  << " is reserved and should not be present or used.")
-                                                     .str());
-                case DescriptorSet::TYPE:
-                    return DescriptorSet::create;
-                default:
-                    return PrivateDescriptor::create;
+    return fn;
+}
+
+const std::shared_ptr<const DescriptorMapping::directory_t>& DescriptorMapping::default_directory() {
+    static const std::shared_ptr<const directory_t> dir = []() {
+        auto tmp = std::make_shared<directory_t>();
+        std::shared_ptr<const page_t> prev;
+        for (uint32_t page_ix = 0; page_ix < tmp->size(); ++page_ix) {
+            auto page = std::make_shared<page_t>();
+            for (uint32_t i = 0; i < page->size(); ++i) {
+                (*page)[i] = default_create_fn(uint16_t((page_ix << 8) | i));
             }
-        }
 
-        if (RESERVED_METADATA_MIN_TYPE <= type and type <= RESERVED_METADATA_MAX_TYPE) {
-            switch (type) {
-                case IDMappingDescriptor::TYPE:
-                    return IDMappingDescriptor::create;
-                default:
-                    return PrivateDescriptor::create;
+            // Consecutive pages with the same functions (like the ones
+            // of the types without definition) are shared
+            if (prev and *prev == *page) {
+                (*tmp)[page_ix] = prev;
+            } else {
+                (*tmp)[page_ix] = prev = page;
             }
         }
+        return tmp;
+    }();
+
+    return dir;
+}
+
+descriptor_create_fn DescriptorMapping::default_create_fn(uint16_t type) {
+    // Is the descriptor one of the defined by xoz?
+    if (RESERVED_CORE_MIN_TYPE <= type and type <= RESERVED_CORE_MAX_TYPE) {
+        switch (type) {
+            case RESERVED_ZERO_TYPE:
+                return nullptr;
+            case DescriptorSet::TYPE:
+                return DescriptorSet::create;
+            default:
+                return PrivateDescriptor::create;
+        }
+    }
 
-        // No definition for the given type, fallback to a default generic implementation
-        if (DSET_SUBCLASS_MIN_TYPE <= type and type <= DSET_SUBCLASS_MAX_TYPE) {
-            return DescriptorSet::create;
-        } else {
-            return OpaqueDescriptor::create;
+    if (RESERVED_METADATA_MIN_TYPE <= type and type <= RESERVED_METADATA_MAX_TYPE) {
+        switch (type) {
+            case IDMappingDescriptor::TYPE:
+                return IDMappingDescriptor::create;
+            case NameIndexDescriptor::TYPE:
+                return NameIndexDescriptor::create;
+            default:
+                return PrivateDescriptor::create;
         }
     }
 
-    return it->second;
+    // No definition for the given type, fallback to a default generic implementation
+    if (DSET_SUBCLASS_MIN_TYPE <= type and type <= DSET_SUBCLASS_MAX_TYPE) {
+        return DescriptorSet::create;
+    } else {
+        return OpaqueDescriptor::create;
+    }
 }
 }  // namespace xoz
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <array>
 #include <cstdint>
 #include <map>
 #include <memory>
@@ -29,6 +30,8 @@ public:
     // If not suitable function is found, return a function to create
     // a default descriptor that has the minimum logic to work
     // (this enables XOZ to be forward compatible)
+    //
+    // The lookup is an access to a two-level table indexed by the type.
     descriptor_create_fn descriptor_create_lookup(uint16_t type) const;
 
 public:
@@ -53,6 +56,20 @@ public:
     const static uint16_t DSET_SUBCLASS_MAX_TYPE = 0x01e0 + 2048;
 
 private:
-    std::map<uint16_t, descriptor_create_fn> mapping;
+    // Create function for each of the 2^16 types, either the one given
+    // by the user or the default one, in a two-level table: a directory
+    // indexed by the high byte of the type that points to pages indexed
+    // by the low byte.
+    //
+    // The pages with the default functions are built once and shared by
+    // all the mappings (and most of them are the same page). A mapping
+    // has its own copy only of the pages with a type given by the user.
+    // The directory is shared (read-only) by the copies of the mapping.
+    typedef std::array<descriptor_create_fn, 1 << 8> page_t;
+    typedef std::array<std::shared_ptr<const page_t>, 1 << 8> directory_t;
+    std::shared_ptr<const directory_t> directory;
+
+    static const std::shared_ptr<const directory_t>& default_directory();
+    static descriptor_create_fn default_create_fn(uint16_t type);
 };
 }  // namespace xoz
@@ -1,7 +1,12 @@
 #include "xoz/dsc/descriptor_set.h"
 
 #include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <exception>
 #include <list>
+#include <thread>
+#include <unordered_set>
 #include <utility>
 
 #include "xoz/blk/block_array.h"
@@ -9,15 +14,74 @@
 #include "xoz/err/exceptions.h"
 #include "xoz/file/runtime_context.h"
 #include "xoz/io/iosegment.h"
+#include "xoz/io/iospan.h"
 #include "xoz/log/format_string.h"
 #include "xoz/mem/inet_checksum.h"
 
 typedef ::xoz::dsc::internals::DescriptorInnerSpyForInternal DSpy;
 
+namespace {
+using namespace xoz;  // NOLINT
+
+const uint32_t PADDING_SCAN_WINDOW_SZ = 512;
+
+/*
+ * Skip the padding (zero'd 2-byte words) from the current reading position
+ * leaving the io at the first non-zero word (or at the end of the io).
+ *
+ * Most of the time there is no padding so the first word is peeked alone.
+ * Only if it is padding, the io is read in windows and each window is scanned
+ * 8 bytes at a time; only the last 8 bytes are scanned word by word to find
+ * where the padding ends.
+ *
+ * Only whole words are scanned: a trailing odd byte, if any, is left unread.
+ * */
+void skip_padding(IOBase& io) {
+    const uint32_t align = 2;
+    if (io.remain_rd() < align) {
+        return;
+    }
+
+    if (io.read_u16_from_le() != 0x0000) {
+        // ups, no padding, revert the reading
+        io.seek_rd(align, IOBase::Seekdir::bwd);
+        return;
+    }
+
+    char buf[PADDING_SCAN_WINDOW_SZ];
+    while (io.remain_rd() >= align) {
+        const uint32_t sz = std::min(io.remain_rd(), PADDING_SCAN_WINDOW_SZ) & ~(align - 1);
+        io.readall(buf, sz);
+
+        uint32_t i = 0;
+        for (; i + sizeof(uint64_t) <= sz; i += sizeof(uint64_t)) {
+            uint64_t w = 0;
+            memcpy(&w, &buf[i], sizeof(w));
+            if (w != 0) {
+                break;
+            }
+        }
+
+        for (; i < sz; i += align) {
+            if (buf[i] != 0 or buf[i + 1] != 0) {
+                break;
+            }
+        }
+
+        if (i < sz) {
+            io.seek_rd(sz - i, IOBase::Seekdir::bwd);
+            return;
+        }
+    }
+}
+}  // namespace
+
 namespace xoz {
 DescriptorSet::DescriptorSet(const struct Descriptor::header_t& hdr, BlockArray& blkarr, uint16_t decl_cpart_cnt,
                              RuntimeContext& rctx):
         Descriptor(hdr, blkarr, decl_cpart_cnt),
+        owned_cnt(0),
+        owned_dirty(false),
         visited(false),
         dset_segm(blkarr.create_segment_with({})),
         sg_blkarr(blkarr),
@@ -25,10 +89,16 @@ DescriptorSet::DescriptorSet(const struct Descriptor::header_t& hdr, BlockArray&
         st_blkarr(sg_blkarr, 2, rctx.runcfg.dset.sg_blkarr_flags),
         rctx(rctx),
         set_loaded(false),
+        load_deferred(false),
+        after_load_notified(false),
+        unloaded(false),
+        last_use(0),
         ireserved(0),
         creserved(0),
         current_checksum(0),
-        header_does_require_write(false) {
+        header_does_require_write(false),
+        subtree_dirty(true) {
+    class_tag = &ClassTag;
     if (decl_cpart_cnt == 0) {
         throw std::runtime_error(
                 "DescriptorSet (or subclasses of) requires at least 1 content part but 0 was declared.");
@@ -48,6 +118,8 @@ DescriptorSet::DescriptorSet(const struct Descriptor::header_t& hdr, BlockArray&
 
 DescriptorSet::DescriptorSet(const uint16_t TYPE, BlockArray& blkarr, uint16_t decl_cpart_cnt, RuntimeContext& rctx):
         Descriptor(TYPE, blkarr, decl_cpart_cnt),
+        owned_cnt(0),
+        owned_dirty(false),
         visited(false),
         dset_segm(blkarr.create_segment_with({})),
         sg_blkarr(blkarr),
@@ -55,10 +127,16 @@ DescriptorSet::DescriptorSet(const uint16_t TYPE, BlockArray& blkarr, uint16_t d
         st_blkarr(dset_segm, sg_blkarr, 2, rctx.runcfg.dset.sg_blkarr_flags),
         rctx(rctx),
         set_loaded(false),
+        load_deferred(false),
+        after_load_notified(false),
+        unloaded(false),
+        last_use(0),
         ireserved(0),
         creserved(0),
         current_checksum(0),
-        header_does_require_write(false) {
+        header_does_require_write(false),
+        subtree_dirty(true) {
+    class_tag = &ClassTag;
     if (decl_cpart_cnt == 0) {
         throw std::runtime_error(
                 "DescriptorSet (or subclasses of) requires at least 1 content part but 0 was declared.");
@@ -67,6 +145,8 @@ DescriptorSet::DescriptorSet(const uint16_t TYPE, BlockArray& blkarr, uint16_t d
 
 DescriptorSet::DescriptorSet(const Segment& segm, BlockArray& blkarr, RuntimeContext& rctx):
         Descriptor(DescriptorSet::TYPE, blkarr, DescriptorSet::Streams::END),
+        owned_cnt(0),
+        owned_dirty(false),
         visited(false),
         dset_segm(segm),
         sg_blkarr(blkarr),
@@ -74,10 +154,17 @@ DescriptorSet::DescriptorSet(const Segment& segm, BlockArray& blkarr, RuntimeCon
         st_blkarr(dset_segm, sg_blkarr, 2, rctx.runcfg.dset.sg_blkarr_flags),
         rctx(rctx),
         set_loaded(false),
+        load_deferred(false),
+        after_load_notified(false),
+        unloaded(false),
+        last_use(0),
         ireserved(0),
         creserved(0),
         current_checksum(0),
-        header_does_require_write(false) {}
+        header_does_require_write(false),
+        subtree_dirty(true) {
+    class_tag = &ClassTag;
+}
 
 DescriptorSet::DescriptorSet(const struct Descriptor::header_t& hdr, BlockArray& blkarr, RuntimeContext& rctx):
         DescriptorSet(hdr, blkarr, DescriptorSet::Streams::END, rctx) {}
@@ -110,18 +197,161 @@ std::unique_ptr<Descriptor> DescriptorSet::create(const struct Descriptor::heade
 }
 
 void DescriptorSet::load_set() {
+    if (rctx.runcfg.dset.load_workers > 1) {
+        parallel_load_set();
+        return;
+    }
+
     std::queue<DescriptorSet*> to_load;
     to_load.push(this);
 
+    // Load the set and then its subsets, level by level
     while (to_load.size() > 0) {
         auto dset = to_load.front();
         to_load.pop();
 
-        dset->load_descriptors(to_load);
+        auto io = IOSegment(dset->sg_blkarr, dset->dset_segm);
+        struct parsed_descriptors_t parsed;
+        dset->parse_descriptors(io, true, parsed);
+        dset->own_parsed_descriptors(parsed, true, to_load);
+    }
+}
+
+void DescriptorSet::parallel_load_set() {
+    // The sets of the same level are independent (they don't own each other)
+    // so their descriptors can be parsed concurrently. Their ids are registered
+    // and the descriptors owned afterwards, one set at a time and in the same
+    // order than a serial load, so the same ids are assigned.
+    std::queue<DescriptorSet*> to_load;
+    to_load.push(this);
+
+    const unsigned max_workers = rctx.runcfg.dset.load_workers;
+    while (to_load.size() > 0) {
+        // Take all the sets of the current level; their subsets
+        // will be pushed into the queue, forming the next level.
+        std::vector<DescriptorSet*> level;
+        level.reserve(to_load.size());
+        while (to_load.size() > 0) {
+            level.push_back(to_load.front());
+            to_load.pop();
+        }
+
+        if (level.size() == 1) {
+            auto dset = level[0];
+            auto io = IOSegment(dset->sg_blkarr, dset->dset_segm);
+            struct parsed_descriptors_t parsed;
+            dset->parse_descriptors(io, true, parsed);
+            dset->own_parsed_descriptors(parsed, true, to_load);
+            continue;
+        }
+
+        // The sets of the level share the underlying block array so reading
+        // their streams is done sequentially.
+        std::vector<std::vector<char>> streams(level.size());
+        for (size_t i = 0; i < level.size(); ++i) {
+            auto io = IOSegment(level[i]->sg_blkarr, level[i]->dset_segm);
+            io.readall(streams[i]);
+        }
+
+        std::vector<struct parsed_descriptors_t> parsed(level.size());
+        std::vector<std::exception_ptr> errors(level.size());
+        std::atomic<size_t> next_ix = 0;
+        auto worker = [&]() {
+            for (size_t i = next_ix++; i < level.size(); i = next_ix++) {
+                try {
+                    auto io = IOSpan(streams[i]);
+                    level[i]->parse_descriptors(io, false, parsed[i]);
+                } catch (...) {
+                    errors[i] = std::current_exception();
+                }
+            }
+        };
+
+        std::vector<std::thread> workers;
+        const size_t workers_cnt = std::min<size_t>(max_workers, level.size());
+        for (size_t i = 0; i < workers_cnt; ++i) {
+            workers.emplace_back(worker);
+        }
+        for (auto& th: workers) {
+            th.join();
+        }
+
+        // Any error is reported as if no worker was used: the sets before
+        // the failed one are loaded, the rest are not.
+        for (size_t i = 0; i < level.size(); ++i) {
+            if (errors[i]) {
+                std::rethrow_exception(errors[i]);
+            }
+
+            level[i]->own_parsed_descriptors(parsed[i], false, to_load);
+        }
     }
 }
 
-void DescriptorSet::load_descriptors(std::queue<DescriptorSet*>& to_load_dsets) {
+void DescriptorSet::load_deferred_subsets() {
+    // Going top-down, each set is loaded before its subsets are explored
+    top_down_for_each_set(*this, [](DescriptorSet* dset, [[maybe_unused]] size_t l) { dset->load_if_deferred(); });
+}
+
+void DescriptorSet::load_if_deferred() const {
+    // Loading the set (or tracking its use) does not change it from the caller's
+    // perspective: it is the same set, but loaded. Hence the const_cast.
+    auto self = const_cast<DescriptorSet*>(this);
+    self->last_use = ++rctx.dset_use_tick;
+
+    if (set_loaded or not load_deferred) {
+        return;
+    }
+
+    self->load_set();
+    self->mark_subtree_dirty();
+
+    if (rctx.root_set) {
+        self->notify_after_load(rctx.root_set);
+    }
+}
+
+void DescriptorSet::notify_after_load(std::shared_ptr<DescriptorSet> root) {
+    if (after_load_notified) {
+        return;
+    }
+
+    after_load_notified = true;
+    sort_owned_if_dirty();
+    for (const auto& [_, dscptr]: owned) {
+        dscptr->on_after_load(root);
+    }
+}
+
+void DescriptorSet::chk_stream_checksum(IOBase& io) const {
+    [[maybe_unused]] auto guard = io.auto_rewind();
+
+    const bool is_new = st_blkarr.blk_cnt() == 0;
+    uint32_t computed_checksum = 0;
+    uint16_t stored_checksum = 0;
+
+    if (not is_new) {
+        // stored_checksum is not part of the checksum
+        computed_checksum = inet_add(computed_checksum, io.read_u16_from_le());
+        stored_checksum = io.read_u16_from_le();
+    } else {
+        computed_checksum = inet_add(computed_checksum, creserved);
+        stored_checksum = inet_to_u16(computed_checksum);
+    }
+
+    uint32_t io_rd_begin = io.tell_rd();
+    computed_checksum += inet_checksum(io, io_rd_begin, io_rd_begin + io.remain_rd());
+
+    auto checksum_check = fold_inet_checksum(inet_remove(computed_checksum, stored_checksum));
+    if (not is_inet_checksum_good(checksum_check)) {
+        throw InconsistentXOZ(F() << "Mismatch checksum for descriptor set on loading. "
+                                  << "Read: 0x" << std::hex << stored_checksum << ", "
+                                  << "computed: 0x" << std::hex << computed_checksum << ", "
+                                  << "remained: 0x" << std::hex << checksum_check);
+    }
+}
+
+void DescriptorSet::parse_descriptors(IOBase& io, bool register_ids, struct parsed_descriptors_t& parsed) {
     if (set_loaded) {
         throw std::runtime_error("DescriptorSet cannot be reloaded.");
     }
@@ -139,15 +369,13 @@ void DescriptorSet::load_descriptors(std::queue<DescriptorSet*>& to_load_dsets)
     //                  dset_segm = Descriptor::get_or_allocate_content(PART=0, SIZE=0);
 
     // The segment above either is new (0 size) or it isn't (size >= 4). In any
-    // case initialize_segment should work and the rest of the load_descriptors code too
+    // case initialize_segment should work and the rest of the parse_descriptors code too
     //                  st_blkarr.initialize_segment(dset_segm);
     // ==============================================================
 
     const bool is_new = st_blkarr.blk_cnt() == 0;
     const uint32_t header_size = 4;
 
-    auto io = IOSegment(sg_blkarr, dset_segm);
-
     const uint32_t align = st_blkarr.blk_sz();  // better semantic name
     assert(align == 2);                         // pre RFC
 
@@ -164,7 +392,7 @@ void DescriptorSet::load_descriptors(std::queue<DescriptorSet*>& to_load_dsets)
     current_checksum = 0;
     uint16_t stored_checksum = 0;
 
-    std::list<Extent> allocated_exts;
+    auto& allocated_exts = parsed.allocated_exts;
     if (not is_new) {
         // read the header
         creserved = io.read_u16_from_le();
@@ -188,18 +416,8 @@ void DescriptorSet::load_descriptors(std::queue<DescriptorSet*>& to_load_dsets)
         // Check the checksum of the entire io for this descriptor set
         // before doing any real loading/parsing.
         [[maybe_unused]] auto guard = io.auto_rewind();
-        uint32_t io_rd_begin = io.tell_rd();
-
-        uint32_t computed_checksum = current_checksum;
-        computed_checksum += inet_checksum(io, io_rd_begin, io_rd_begin + io.remain_rd());
-
-        auto checksum_check = fold_inet_checksum(inet_remove(computed_checksum, stored_checksum));
-        if (not is_inet_checksum_good(checksum_check)) {
-            throw InconsistentXOZ(F() << "Mismatch checksum for descriptor set on loading. "
-                                      << "Read: 0x" << std::hex << stored_checksum << ", "
-                                      << "computed: 0x" << std::hex << computed_checksum << ", "
-                                      << "remained: 0x" << std::hex << checksum_check);
-        }
+        io.seek_rd(0);
+        chk_stream_checksum(io);
     }
 
     struct dsc_load_state_t {
@@ -213,15 +431,11 @@ void DescriptorSet::load_descriptors(std::queue<DescriptorSet*>& to_load_dsets)
     std::list<dsc_load_state_t> load_dset_states;
 
     while (io.remain_rd()) {
-        // Try to read padding and if it so, skip the descriptor load
-        if (io.remain_rd() >= align) {
-            if (io.read_u16_from_le() == 0x0000) {
-                // padding, move on, not need to checksum-them
-                continue;
-            }
-
-            // ups, no padding, revert the reading
-            io.seek_rd(2, IOBase::Seekdir::bwd);
+        // Skip any padding, not need to checksum-them. If nothing
+        // else remains, we are done.
+        skip_padding(io);
+        if (not io.remain_rd()) {
+            break;
         }
 
         assert(io.tell_rd() % align == 0);
@@ -229,7 +443,7 @@ void DescriptorSet::load_descriptors(std::queue<DescriptorSet*>& to_load_dsets)
         // Read the descriptor - Step 1, header only
         struct dsc_load_state_t p = {
                 .dsc = nullptr, .ex_type_used = false, .dsc_begin_pos = io.tell_rd(), .idata_begin_pos = 0};
-        p.dsc = begin_load_dsc_from(io, rctx, cblkarr, p.dsc_begin_pos, p.ex_type_used);
+        p.dsc = begin_load_dsc_from(io, rctx, cblkarr, p.dsc_begin_pos, p.ex_type_used, register_ids);
         p.idata_begin_pos = io.tell_rd();
 
         // Skip descriptor's idata
@@ -247,7 +461,7 @@ void DescriptorSet::load_descriptors(std::queue<DescriptorSet*>& to_load_dsets)
     }
 
     // This may sound redundant with respect the checksum verification did at the begin
-    // of the load_descriptors() method but checking again may catch bugs in
+    // of the parse_descriptors() method but checking again may catch bugs in
     // Descriptor::load_header_from()
     auto checksum_check = fold_inet_checksum(inet_remove(current_checksum, stored_checksum));
     if (not is_inet_checksum_good(checksum_check)) {
@@ -262,6 +476,7 @@ void DescriptorSet::load_descriptors(std::queue<DescriptorSet*>& to_load_dsets)
     // fail if such target is present in a subset.
     // Forcing this reading order ensures that the non-dsets are loaded completly before
     // even going deeper in the set tree.
+    parsed.dscs.reserve(load_dsc_states.size() + load_dset_states.size());
     for (auto& states_ptr: {&load_dsc_states, &load_dset_states}) {
         for (auto& p: *states_ptr) {
             // Read the descriptor - Step 2, their struct-specifics
@@ -297,52 +512,95 @@ void DescriptorSet::load_descriptors(std::queue<DescriptorSet*>& to_load_dsets)
             dsc->ext = Extent(st_blkarr.bytes2blk_nr(dsc_begin_pos), st_blkarr.bytes2blk_cnt(dsc_length), false);
             allocated_exts.push_back(dsc->ext);
 
-            uint32_t id = dsc->id();
+            parsed.dscs.push_back(std::move(dsc));
+        }
+    }
 
+    assert((is_new and allocated_exts.size() == 0) or not is_new);
+}
 
-            // Descriptors or either have a new unique temporal id from RuntimeContext or
-            // the id is loaded from the io. In this latter case, the id is registered in the RuntimeContext
-            // to ensure uniqueness. All of this happen during the load of the descriptor,
-            // not here in the set.
-            //
-            // Here we do a double check: if we detect a duplicated here, it is definitely a bug,
-            // most likely in the code, no necessary in the XOZ file
-            //
-            // Note that if no duplicated ids are found here, it does not mean that the id is
-            // not duplicated against other descriptor in other stream. That's why the real and
-            // truly useful check is performed in RuntimeContext (that has a global view) during the
-            // descriptor load..
-            if (id == 0) {
-                throw InternalError(F() << "Descriptor id " << id << " is not allowed. "
-                                        << "Mostly likely an internal bug");
-            }
+void DescriptorSet::own_parsed_descriptors(struct parsed_descriptors_t& parsed, bool ids_registered,
+                                           std::queue<DescriptorSet*>& to_load_dsets) {
+    if (not ids_registered) {
+        // Register the ids in the order of the stream, the same order in which
+        // parse_descriptors() registers them, so the same temporal ids are assigned.
+        std::vector<Descriptor*> in_stream_order;
+        in_stream_order.reserve(parsed.dscs.size());
+        for (const auto& dsc: parsed.dscs) {
+            in_stream_order.push_back(dsc.get());
+        }
+        std::sort(in_stream_order.begin(), in_stream_order.end(),
+                  [](const Descriptor* a, const Descriptor* b) { return a->ext.blk_nr() < b->ext.blk_nr(); });
 
-            if (owned.count(id) != 0) {
-                throw InternalError(F() << "Descriptor id " << id
-                                        << " found duplicated within the stream. This should never had happen. "
-                                        << "Mostly likely an internal bug");
-            }
+        for (auto dsc: in_stream_order) {
+            dsc->id(register_loaded_id(rctx, dsc->hdr));
+        }
+    }
+
+    owned.reserve(owned.size() + parsed.dscs.size());
+    owned_ix.reserve(owned_ix.size() + parsed.dscs.size());
+    for (auto& dsc: parsed.dscs) {
+        uint32_t id = dsc->id();
 
-            auto subset = dsc->cast<DescriptorSet>(true);
-            if (subset != nullptr) {
+        // Descriptors or either have a new unique temporal id from RuntimeContext or
+        // the id is loaded from the io. In this latter case, the id is registered in the RuntimeContext
+        // to ensure uniqueness. All of this happen during the load of the descriptor
+        // (or just above if it was deferred), not here in the set.
+        //
+        // Here we do a double check: if we detect a duplicated here, it is definitely a bug,
+        // most likely in the code, no necessary in the XOZ file
+        //
+        // Note that if no duplicated ids are found here, it does not mean that the id is
+        // not duplicated against other descriptor in other stream. That's why the real and
+        // truly useful check is performed in RuntimeContext (that has a global view) during the
+        // descriptor load..
+        if (id == 0) {
+            throw InternalError(F() << "Descriptor id " << id << " is not allowed. "
+                                    << "Mostly likely an internal bug");
+        }
+
+        if (find_owned(id)) {
+            throw InternalError(F() << "Descriptor id " << id
+                                    << " found duplicated within the stream. This should never had happen. "
+                                    << "Mostly likely an internal bug");
+        }
+
+        auto subset = dsc->cast<DescriptorSet>(true);
+        if (subset != nullptr) {
+            // Either load the subset later in this load_set() call or
+            // defer it until its first use.
+            if (rctx.runcfg.dset.lazy_load_subsets) {
+                subset->load_deferred = true;
+            } else {
                 to_load_dsets.push(subset);
-                children.insert(subset);
             }
+            add_child(subset);
+        }
 
-            dsc->set_owner(this);
-            dsc->complete_load();
-            owned[id] = std::move(dsc);
+        // A loaded descriptor is in sync with the disk so, unlike an added one,
+        // its next change must be notified to the set.
+        dsc->set_owner(this);
+        dsc->ack_descriptor_changed();
+        dsc->complete_load();
+        track_type_of(dsc.get());
+        auto dscptr = Descriptor::share(std::move(dsc));
+        own_entry(dscptr);
+        rctx.index.track_descriptor(dscptr);
 
-            // dsc cannot be used any longer, it was transferred/moved to the dictionaries above
-            // assert(!dsc); (ok, linter is detecting this)
-        }
+        // dsc cannot be used any longer, it was transferred/moved to the dictionaries above
+        // assert(!dsc); (ok, linter is detecting this)
     }
 
-    assert((is_new and allocated_exts.size() == 0) or not is_new);
-
     // let the allocator know which extents are allocated (contain the descriptors) and
     // which are free for further allocation (padding or space between the boundaries of the io)
-    st_blkarr.allocator().initialize_from_allocated(allocated_exts);
+    //
+    // If the set was unloaded, its allocator was kept and it already knows this
+    // (the set was not modified since then).
+    if (unloaded) {
+        unloaded = false;
+    } else {
+        st_blkarr.allocator().initialize_from_allocated(parsed.allocated_exts);
+    }
 
     // Officially loaded.
     set_loaded = true;
@@ -354,7 +612,7 @@ void DescriptorSet::zeros(IOBase& io, const Extent& ext) {
     io.fill(0, st_blkarr.blk2bytes(ext.blk_cnt()));
 }
 
-void DescriptorSet::flush_writes_no_recursive(const bool release) {
+void DescriptorSet::flush_members_no_recursive(const bool release) {
     // Full-sync the members of the set that are not set themselves first.
     // This ensures that we are not doing any recursive call and that
     // the set (this object) will have their members updated and
@@ -366,12 +624,12 @@ void DescriptorSet::flush_writes_no_recursive(const bool release) {
     //
     // TODO detect modifications to to_update/to_add during this
 
-    for (auto& dsc: to_update) {
+    for (auto& dsc: sorted_by_id(to_update)) {
         if (not dsc->is_descriptor_set()) {
             dsc->full_sync(release);
         }
     }
-    for (auto& dsc: to_add) {
+    for (auto& dsc: sorted_by_id(to_add)) {
         if (not dsc->is_descriptor_set()) {
             dsc->full_sync(release);
         }
@@ -386,9 +644,27 @@ void DescriptorSet::flush_writes_no_recursive(const bool release) {
     //
     // This "special" set should be stored somewhere else in the root set.
     // TODO
+}
 
-    auto io = IOSegment(sg_blkarr, dset_segm);
-    write_modified_descriptors(io);
+void DescriptorSet::serialize_modified_descriptors() {
+    // This may run concurrently with the same method of other sets
+    // so it must not touch anything shared (like rctx or the block arrays).
+    // Do not call does_require_write() nor count() for that reason.
+    serialized.clear();
+    for (auto& dsc_set: {&to_update, &to_add}) {
+        for (const auto& dsc: *dsc_set) {
+            if (serialized.contains(dsc)) {
+                continue;
+            }
+
+            auto& entry = serialized[dsc];
+            entry.prev_checksum = dsc->checksum;
+            entry.data.resize(DSpy(*dsc).calc_struct_footprint_size());
+
+            auto io = IOSpan(entry.data);
+            dsc->write_struct_into(io, rctx);
+        }
+    }
 }
 
 bool DescriptorSet::does_require_write() const {
@@ -399,6 +675,10 @@ bool DescriptorSet::does_require_write() const {
 // Precondition: the descriptors in to_add and to_update must be full-sync'd
 // before calling this.
 void DescriptorSet::write_modified_descriptors(IOBase& io) {
+    if (should_compact_stream()) {
+        compact_stream();
+    }
+
     if (st_blkarr.blk_cnt() == 0 and count() > 0) {
         // A hack: we are relaying in an implementation detail that ensures that
         // we are going to get the lowest extent if the allocator is empty.
@@ -419,7 +699,7 @@ void DescriptorSet::write_modified_descriptors(IOBase& io) {
     // Also, find any descriptor that grew so we remove it
     // and we re-add it later
     std::list<Extent> pending;
-    for (const auto& dsc: to_update) {
+    for (const auto& dsc: sorted_by_id(to_update)) {
         auto dsc_spy = DSpy(*dsc);
         uint32_t cur_dsc_sz = dsc_spy.calc_struct_footprint_size();
         uint32_t alloc_dsc_sz = st_blkarr.blk2bytes(dsc->ext.blk_cnt());
@@ -458,15 +738,16 @@ void DescriptorSet::write_modified_descriptors(IOBase& io) {
     // Empty extent can happen if the descriptor was never written to disk
     // (it was added to to_add) but then it was erased (so it was removed from
     // to_add and added to to_remove).
+    //
+    // The extents are processed in order (by block number) so the (de)allocations are
+    // deterministic regardless of the order of the removals.
+    std::sort(to_remove.begin(), to_remove.end(), Extent::Compare());
     std::copy_if(to_remove.begin(), to_remove.end(), std::back_inserter(pending),
                  [](const Extent& ext) { return not ext.is_empty(); });
     to_remove.clear();
 
-    // NOTE: at this moment we could compute how much was freed, how much is
-    // about to be added and how much is already present in-disk (to_update and things not in to_update).
-    // If the criteria match we could do a compaction *before* allocating new space (so it is more efficient)
-    // This however would require update the descriptors' extents to their new positions
-    // NOTE: compaction is not implemented yet
+    // NOTE: the compaction of the stream, if needed, was done at the begin
+    // of this method (see compact_stream())
 
     // The problem:
     //
@@ -516,6 +797,7 @@ void DescriptorSet::write_modified_descriptors(IOBase& io) {
     //    The "Preallocation" strategy is a sort of defragmentation strategy that
     //    applies to only the added+modified descriptors, so the penalty of writing
     //    them it is already paid.
+    //    See compact_stream() and alloc_space_for_added_descriptors().
     //
 
 
@@ -545,14 +827,7 @@ void DescriptorSet::write_modified_descriptors(IOBase& io) {
     to_destroy.clear();
 
     // Alloc space for the new descriptors but do not write anything yet
-    // TODO XXX pre-alloc the sum of the descriptors' sizes so the allocator can reserve
-    // in one shot all the required space. Then, we alloc each single extent hopefully
-    // from that pre-allocated space.
-    // This should reduce the fragmentation of the set's segment making it much smaller
-    for (const auto& dsc: to_add) {
-        auto dsc_spy = DSpy(*dsc);
-        dsc->ext = st_blkarr.allocator().alloc_single_extent(dsc_spy.calc_struct_footprint_size());
-    }
+    alloc_space_for_added_descriptors();
 
     auto new_segm_data_sz = dset_segm.calc_data_space_size();
 
@@ -567,20 +842,36 @@ void DescriptorSet::write_modified_descriptors(IOBase& io) {
     // Add all the "new" descriptors to the "to update" list now that they
     // have space allocated in the stream
     // This will remove any duplicated descriptor between the two sets.
-    to_update.insert(to_add.begin(), to_add.end());
+    for (const auto dsc: to_add) {
+        to_update.insert(dsc);
+    }
     to_add.clear();
 
-    for (const auto& dsc: to_update) {
-        auto pos = st_blkarr.blk2bytes(dsc->ext.blk_nr());
-        current_checksum = inet_remove(current_checksum, dsc->checksum);
+    // Write the descriptors in the order they are in the stream so the added
+    // ones (allocated contiguously) are written in a single forward run.
+    std::vector<Descriptor*> to_write(to_update.begin(), to_update.end());
+    std::sort(to_write.begin(), to_write.end(),
+              [](const Descriptor* a, const Descriptor* b) { return a->ext.blk_nr() < b->ext.blk_nr(); });
 
+    for (const auto& dsc: to_write) {
+        auto pos = st_blkarr.blk2bytes(dsc->ext.blk_nr());
         io2.seek_wr(pos);
-        dsc->write_struct_into(io2, rctx);
+
+        // The descriptor may be already serialized (see serialize_modified_descriptors())
+        auto it = serialized.find(dsc);
+        if (it != serialized.end()) {
+            current_checksum = inet_remove(current_checksum, it->second.prev_checksum);
+            io2.writeall(it->second.data);
+        } else {
+            current_checksum = inet_remove(current_checksum, dsc->checksum);
+            dsc->write_struct_into(io2, rctx);
+        }
         current_checksum = inet_add(current_checksum, dsc->checksum);
 
         dsc->ack_descriptor_changed();
     }
     to_update.clear();
+    serialized.clear();
 
     // note: we don't checksum this->creserved because it should had been checksum
     // earlier and in each change to this->creserved.
@@ -613,6 +904,89 @@ void DescriptorSet::write_modified_descriptors(IOBase& io) {
 #endif
 }
 
+bool DescriptorSet::should_compact_stream() const {
+    const uint32_t pct = rctx.runcfg.dset.compact_padding_pct;
+    if (pct == 0 or count() == 0 or st_blkarr.blk_cnt() == 0) {
+        return false;
+    }
+
+    // How much the stream would need if it were compacted: the header plus
+    // the descriptors (with their current sizes, even if not written yet).
+    uint64_t live_sz = 4;
+    sort_owned_if_dirty();
+    for (const auto& [_, dscptr]: owned) {
+        live_sz += DSpy(*dscptr).calc_struct_footprint_size();
+    }
+
+    const uint64_t stream_sz = st_blkarr.blk2bytes(st_blkarr.blk_cnt());
+    if (stream_sz <= live_sz) {
+        return false;
+    }
+
+    const uint64_t padding_sz = stream_sz - live_sz;
+    return padding_sz >= sg_blkarr.blk_sz() and padding_sz * 100 > live_sz * pct;
+}
+
+void DescriptorSet::compact_stream() {
+    // Drop the whole stream, deallocating and releasing its space (the set's segment
+    // becomes empty) and re-add all the descriptors so they are written again,
+    // contiguously, in a new stream.
+    //
+    // The descriptors' checksums are still accounted in current_checksum: they
+    // are removed and re-added when they are written as for any other update.
+    st_blkarr.allocator().reset();
+    assert(st_blkarr.blk_cnt() == 0);
+
+    // The extents to remove belonged to the dropped stream
+    to_remove.clear();
+
+    sort_owned_if_dirty();
+    to_add.reserve(owned_cnt);
+    for (const auto& [_, dscptr]: owned) {
+        dscptr->ext = Extent::EmptyExtent();
+        to_add.insert(dscptr.get());
+    }
+
+    // All the descriptors are in to_add, so to_update is redundant
+    // (and its descriptors' extents are not valid anymore)
+    to_update.clear();
+}
+
+void DescriptorSet::alloc_space_for_added_descriptors() {
+    // Allocate the space of the descriptors in one shot: the allocator looks for
+    // the sum of the descriptors' sizes once (growing the stream, and possibly
+    // reallocating the set's segment, at most once) and the space found is
+    // split among the descriptors, each one in its own extent (they are
+    // deallocated one by one later). The descriptors are then written contiguously
+    // and the set's segment is not fragmented by tiny allocations.
+    //
+    // An extent cannot have more than Extent::MAX_BLK_CNT blocks so the descriptors
+    // are grouped in runs, each one allocated in a single extent.
+    const auto dscs = sorted_by_id(to_add);
+    auto it = dscs.begin();
+    std::vector<uint32_t> szs;
+    while (it != dscs.end()) {
+        auto run_begin = it;
+        uint32_t run_blk_cnt = 0;
+        szs.clear();
+        for (; it != dscs.end(); ++it) {
+            auto dsc_spy = DSpy(**it);
+            uint32_t dsc_sz = dsc_spy.calc_struct_footprint_size();
+            uint32_t dsc_blk_cnt = st_blkarr.bytes2blk_cnt(dsc_sz);
+            if (run_blk_cnt + dsc_blk_cnt > Extent::MAX_BLK_CNT) {
+                break;
+            }
+            run_blk_cnt += dsc_blk_cnt;
+            szs.push_back(dsc_sz);
+        }
+
+        auto exts = st_blkarr.allocator().alloc_consecutive_single_extents(szs);
+        for (auto jt = run_begin; jt != it; ++jt) {
+            (*jt)->ext = exts[size_t(jt - run_begin)];
+        }
+    }
+}
+
 void DescriptorSet::release_free_space_no_recursive() {
     // Release any free space of the set. The release of free space on each
     // descriptor is handled during the flush_writes_no_recursive before
@@ -627,12 +1001,69 @@ uint32_t DescriptorSet::add(std::unique_ptr<Descriptor> dscptr, bool assign_pers
     fail_if_not_allowed_to_add(dscptr.get());
 
     // Grab ownership
-    auto p = std::shared_ptr<Descriptor>(dscptr.release());
+    auto p = Descriptor::share(std::move(dscptr));
     add_s(p, assign_persistent_id);
 
     return p->id();
 }
 
+std::vector<uint32_t> DescriptorSet::add_many(std::vector<std::unique_ptr<Descriptor>>&& dscptrs,
+                                              bool assign_persistent_id) {
+    fail_if_set_not_loaded();
+
+    // Validate all the descriptors before taking the ownership of any of them,
+    // including that no two of them have the same id.
+    std::unordered_set<uint32_t> batch_ids;
+    uint32_t new_persistent_id_cnt = 0;
+    for (const auto& dscptr: dscptrs) {
+        fail_if_null(dscptr.get());
+        fail_if_using_incorrect_blkarray(dscptr.get());
+        fail_if_duplicated_id(dscptr.get());
+
+        const uint32_t id = dscptr->id();
+        if (id != 0 and not batch_ids.insert(id).second) {
+            throw std::invalid_argument((F() << (*dscptr) << " has an id that collides with another descriptor"
+                                             << " of the same batch")
+                                                .str());
+        }
+
+        if (assign_persistent_id and not rctx.idmgr.is_persistent(id)) {
+            ++new_persistent_id_cnt;
+        }
+    }
+
+    // Register the already-persistent ids first so the new ones are
+    // assigned after them.
+    for (const auto& dscptr: dscptrs) {
+        if (rctx.idmgr.is_persistent(dscptr->id())) {
+            rctx.idmgr.register_persistent_id(dscptr->id());
+        }
+    }
+    uint32_t next_persistent_id = rctx.idmgr.request_persistent_ids(new_persistent_id_cnt);
+
+    std::vector<uint32_t> ids;
+    ids.reserve(dscptrs.size());
+    owned.reserve(owned.size() + dscptrs.size());
+    owned_ix.reserve(owned_ix.size() + dscptrs.size());
+    to_add.reserve(to_add.size() + dscptrs.size());
+
+    for (auto& uptr: dscptrs) {
+        auto dscptr = Descriptor::share(std::move(uptr));
+        if (assign_persistent_id and not rctx.idmgr.is_persistent(dscptr->id())) {
+            dscptr->hdr.id = next_persistent_id++;
+        } else if (dscptr->id() == 0) {
+            dscptr->hdr.id = rctx.idmgr.request_temporal_id();
+        }
+
+        own_and_track_added(dscptr);
+        ids.push_back(dscptr->id());
+    }
+
+    dscptrs.clear();
+    mark_subtree_dirty();
+    return ids;
+}
+
 void DescriptorSet::add_s(std::shared_ptr<Descriptor> dscptr, bool assign_persistent_id) {
     fail_if_not_allowed_to_add(dscptr.get());
 
@@ -650,9 +1081,16 @@ void DescriptorSet::add_s(std::shared_ptr<Descriptor> dscptr, bool assign_persis
         dscptr->hdr.id = rctx.idmgr.request_temporal_id();
     }
 
+    own_and_track_added(dscptr);
+    mark_subtree_dirty();
+}
+
+void DescriptorSet::own_and_track_added(const std::shared_ptr<Descriptor>& dscptr) {
     // own it
     dscptr->set_owner(this);
-    owned[dscptr->id()] = dscptr;
+    own_entry(dscptr);
+    track_type_of(dscptr.get());
+    rctx.index.track_descriptor(dscptr);
     dscptr->ext = Extent::EmptyExtent();
 
     auto dsc = dscptr.get();
@@ -661,7 +1099,7 @@ void DescriptorSet::add_s(std::shared_ptr<Descriptor> dscptr, bool assign_persis
     // if the added descriptor is a dset, track it in the subset list
     auto subset = dscptr->cast<DescriptorSet>(true);
     if (subset != nullptr) {
-        children.insert(subset);
+        add_child(subset);
     }
 
     current_checksum = fold_inet_checksum(inet_add(current_checksum, dsc->checksum));
@@ -714,6 +1152,7 @@ void DescriptorSet::mark_as_modified(uint32_t id) {
     if (not to_add.contains(dsc)) {
         to_update.insert(dsc);
     }
+    mark_subtree_dirty();
 }
 
 void DescriptorSet::impl_remove(std::shared_ptr<Descriptor>& dscptr, bool moved) {
@@ -726,7 +1165,8 @@ void DescriptorSet::impl_remove(std::shared_ptr<Descriptor>& dscptr, bool moved)
     to_add.erase(dsc);
     to_update.erase(dsc);
 
-    to_remove.insert(dsc->ext);
+    to_remove.push_back(dsc->ext);
+    mark_subtree_dirty();
 
     // Defer the descriptor destruction if it was removed and not moved outside
     // For that, keep a reference to the descriptor
@@ -737,26 +1177,166 @@ void DescriptorSet::impl_remove(std::shared_ptr<Descriptor>& dscptr, bool moved)
     // if the removed descriptor is a dset, remove it from the subset list
     auto subset = dscptr->cast<DescriptorSet>(true);
     if (subset != nullptr) {
-        children.erase(subset);
+        remove_child(subset);
     }
 
     dscptr->set_owner(nullptr);
-    owned.erase(dscptr->id());
+    untrack_type_of(dscptr.get());
+    disown_entry(dscptr->id());
+    rctx.index.untrack_descriptor(dscptr->id());
 
     if (dscptr->checksum != 0) {
         current_checksum = fold_inet_checksum(inet_remove(current_checksum, dscptr->checksum));
     }
 }
 
+void DescriptorSet::track_type_of(Descriptor* dsc) {
+    auto& index = owned_by_type[dsc->type()];
+
+    // Drop the ids of the removed descriptors once they are the majority.
+    // This is done before adding the new id that may not be owned yet.
+    if (index.ids.size() >= 2 * size_t(index.cnt) + 16) {
+        compact_type_index(index, dsc->type());
+    }
+
+    const uint32_t id = dsc->id();
+    if (not index.dirty and not index.ids.empty() and index.ids.back() >= id) {
+        index.dirty = true;
+    }
+    index.ids.push_back(id);
+    ++index.cnt;
+}
+
+void DescriptorSet::untrack_type_of(Descriptor* dsc) {
+    auto it = owned_by_type.find(dsc->type());
+    if (it == owned_by_type.end()) {
+        return;
+    }
+
+    auto& index = it->second;
+    if (--index.cnt == 0) {
+        owned_by_type.erase(it);
+        return;
+    }
+
+    // Removing the last one (the greatest id) keeps the ids clean
+    if (not index.dirty and index.ids.back() == dsc->id()) {
+        index.ids.pop_back();
+    } else {
+        index.dirty = true;
+    }
+}
+
+void DescriptorSet::compact_type_index(type_index_t& index, uint16_t type) const {
+    if (not index.dirty) {
+        return;
+    }
+
+    std::erase_if(index.ids, [this, type](uint32_t id) {
+        const auto dscptr = find_owned(id);
+        return not dscptr or (*dscptr)->type() != type;
+    });
+
+    // An id removed and added again is twice
+    std::sort(index.ids.begin(), index.ids.end());
+    index.ids.erase(std::unique(index.ids.begin(), index.ids.end()), index.ids.end());
+
+    assert(index.ids.size() == index.cnt);
+    index.dirty = false;
+}
+
+void DescriptorSet::own_entry(const std::shared_ptr<Descriptor>& dscptr) {
+    const uint32_t id = dscptr->id();
+    const auto pos = owned_ix.find(id);
+    if (pos) {
+        owned[*pos].second = dscptr;
+        return;
+    }
+
+    if (not owned_dirty and not owned.empty() and owned.back().first >= id) {
+        owned_dirty = true;
+    }
+
+    owned_ix[id] = assert_u32(owned.size());
+    owned.emplace_back(id, dscptr);
+    ++owned_cnt;
+}
+
+void DescriptorSet::disown_entry(uint32_t id) {
+    const auto pos = owned_ix.find(id);
+    if (not pos) {
+        return;
+    }
+
+    // Removing the last entry does not leave a hole
+    if (*pos == owned.size() - 1) {
+        owned.pop_back();
+    } else {
+        owned[*pos].second.reset();
+        owned_dirty = true;
+    }
+
+    owned_ix.erase(id);
+    --owned_cnt;
+}
+
+void DescriptorSet::clear_owned() {
+    owned.clear();
+    owned_ix.clear();
+    owned_cnt = 0;
+    owned_dirty = false;
+}
+
+void DescriptorSet::sort_owned_if_dirty() const {
+    if (not owned_dirty) {
+        return;
+    }
+
+    std::erase_if(owned, [](const auto& entry) { return not entry.second; });
+    if (not std::is_sorted(owned.begin(), owned.end(),
+                           [](const auto& a, const auto& b) { return a.first < b.first; })) {
+        std::sort(owned.begin(), owned.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+    }
+
+    // The entries moved: index them again
+    for (uint32_t pos = 0; pos < owned.size(); ++pos) {
+        *owned_ix.find(owned[pos].first) = pos;
+    }
+
+    assert(owned.size() == owned_cnt);
+    owned_dirty = false;
+}
+
+void DescriptorSet::add_child(DescriptorSet* subset) {
+    auto it = std::lower_bound(children.begin(), children.end(), subset, by_id());
+    children.insert(it, subset);
+}
+
+void DescriptorSet::remove_child(DescriptorSet* subset) {
+    auto it = std::lower_bound(children.begin(), children.end(), subset, by_id());
+    if (it != children.end() and *it == subset) {
+        children.erase(it);
+    }
+}
+
+std::vector<Descriptor*> DescriptorSet::sorted_by_id(const dsc_set_t& dscs) {
+    std::vector<Descriptor*> sorted(dscs.begin(), dscs.end());
+    std::sort(sorted.begin(), sorted.end(), by_id());
+    return sorted;
+}
+
 void DescriptorSet::clear_set_no_recursive() {
     fail_if_set_not_loaded();
     chk_if_any_descriptor_has_external_references();
+    mark_subtree_dirty();
+    sort_owned_if_dirty();
     for (const auto& p: owned) {
         auto dscptr = p.second;
         auto dsc = dscptr.get();
 
         dsc->set_owner(nullptr);
-        to_remove.insert(dsc->ext);
+        rctx.index.untrack_descriptor(dsc->id());
+        to_remove.push_back(dsc->ext);
         to_destroy.insert(dscptr);
 
         if (dscptr->checksum != 0) {
@@ -764,7 +1344,8 @@ void DescriptorSet::clear_set_no_recursive() {
         }
     }
 
-    owned.clear();
+    clear_owned();
+    owned_by_type.clear();
     to_add.clear();
     to_update.clear();
     children.clear();
@@ -807,6 +1388,7 @@ void DescriptorSet::destroy_no_recursive() {
     // The set now is officially "unloaded". The caller will have
     // to call load_set() again.
     set_loaded = false;
+    load_deferred = false;
     header_does_require_write = false;
     ireserved = 0;
     creserved = 0;
@@ -819,7 +1401,16 @@ uint32_t DescriptorSet::assign_persistent_id(uint32_t id) {
     auto dscptr = get_owned_dsc_or_fail(id);
 
     if (rctx.idmgr.is_temporal(id)) {
-        owned.erase(id);
+        // The type index and the subsets are sorted by id so the descriptor
+        // must be removed from there *before* its id changes (add_s() will
+        // add it back)
+        untrack_type_of(dscptr.get());
+        auto subset = dscptr->cast<DescriptorSet>(true);
+        if (subset != nullptr) {
+            remove_child(subset);
+        }
+        disown_entry(id);
+        rctx.index.untrack_descriptor(id);
 
         auto ext_copy = dscptr->ext;
         dscptr->ext = Extent::EmptyExtent();
@@ -844,6 +1435,10 @@ std::shared_ptr<Descriptor> DescriptorSet::get(uint32_t id) {
 }
 
 void DescriptorSet::fail_if_set_not_loaded() const {
+    // A set which load was deferred is not loaded yet
+    // but it can be (and it will be) on its first use
+    load_if_deferred();
+
     if (not set_loaded) {
         throw std::runtime_error("DescriptorSet not loaded. Missed call to load_set()?");
     }
@@ -855,7 +1450,7 @@ std::shared_ptr<Descriptor> DescriptorSet::get_owned_dsc_or_fail(uint32_t id) {
                 (F() << "Descriptor " << xoz::log::hex(id) << " does not belong to the set.").str());
     }
 
-    auto dscptr = owned[id];
+    auto dscptr = *find_owned(id);
 
     if (!dscptr) {
         throw std::runtime_error(
@@ -879,7 +1474,10 @@ std::shared_ptr<Descriptor> DescriptorSet::get_owned_dsc_or_fail(uint32_t id) {
     return dscptr;
 }
 
-bool DescriptorSet::contains(uint32_t id) const { return owned.contains(id); }
+bool DescriptorSet::contains(uint32_t id) const {
+    load_if_deferred();
+    return owned_ix.contains(id);
+}
 
 void DescriptorSet::fail_if_using_incorrect_blkarray(const Descriptor* dsc) const {
     assert(dsc != nullptr);
@@ -903,8 +1501,8 @@ void DescriptorSet::fail_if_duplicated_id(const Descriptor* dsc) const {
     // This should never happen because the caller should never have another
     // unique_ptr to the descriptor to call add() for a second time
     // (unless it is doing nasty things).
-    if (owned.contains(dsc->id())) {
-        throw std::invalid_argument((F() << (*dsc) << " has an id that collides with " << (*owned.at(dsc->id()))
+    if (auto other = find_owned(dsc->id())) {
+        throw std::invalid_argument((F() << (*dsc) << " has an id that collides with " << (**other)
                                          << " that it is already owned by the set")
                                             .str());
     }
@@ -965,11 +1563,11 @@ void DescriptorSet::write_struct_specifics_into(IOBase& io) {
     assert_write_bits_into_u16(field, ireserved, MASK_DSET_IRESERVED);
     io.write_u16_to_le(field);
 
-    if (count() == 0) {
-        assert(DSpy(*this).does_own_content() == false);
+    // Do not call count() here: if the set was not loaded (deferred), it would
+    // be loaded just to write its header. An empty set does not own content.
+    assert(not set_loaded or (owned_cnt == 0) == (DSpy(*this).does_own_content() == false));
+    if (not DSpy(*this).does_own_content()) {
         io.write_u16_to_le(creserved);
-    } else {
-        assert(DSpy(*this).does_own_content() == true);
     }
 
     if (psize) {
@@ -1022,26 +1620,259 @@ void DescriptorSet::update_isize(uint64_t& isize) {
 }
 
 void DescriptorSet::full_sync_no_recursive(const bool release) {
-    flush_writes_no_recursive(release);
+    if (not set_loaded and load_deferred) {
+        // Nothing changed if it was never loaded
+        subtree_dirty = false;
+        return;
+    }
+
+    flush_members_no_recursive(release);
+    commit_sync_no_recursive(release);
+}
+
+void DescriptorSet::commit_sync_no_recursive(const bool release) {
+    auto io = IOSegment(sg_blkarr, dset_segm);
+    write_modified_descriptors(io);
 
     if (release) {
         release_free_space_no_recursive();
     }
     update_header();
+    subtree_dirty = false;
+}
+
+void DescriptorSet::parallel_full_sync(const bool release) {
+    // Group the sets to sync by their depth: the sets of the same level are
+    // independent (they don't own each other) so their descriptors can be
+    // serialized concurrently.
+    std::vector<std::vector<DescriptorSet*>> levels;
+    std::vector<std::pair<DescriptorSet*, size_t>> to_explore;
+    to_explore.push_back({this, 0});
+    while (not to_explore.empty()) {
+        auto [dset, depth] = to_explore.back();
+        to_explore.pop_back();
+
+        if (levels.size() <= depth) {
+            levels.resize(depth + 1);
+        }
+        levels[depth].push_back(dset);
+
+        for (auto it = dset->children.rbegin(); it != dset->children.rend(); ++it) {
+            if (release or (*it)->subtree_dirty) {
+                to_explore.push_back({*it, depth + 1});
+            }
+        }
+    }
+
+    const unsigned max_workers = rctx.runcfg.dset.sync_workers;
+    for (auto lvl = levels.rbegin(); lvl != levels.rend(); ++lvl) {
+        // Sync the content of the members of each set and skip the sets
+        // that were never loaded. The content is allocated in the block array
+        // shared by all the sets so this is done sequentially.
+        std::vector<DescriptorSet*> level;
+        for (auto dset: *lvl) {
+            if (not dset->set_loaded and dset->load_deferred) {
+                dset->subtree_dirty = false;
+                continue;
+            }
+
+            dset->flush_members_no_recursive(release);
+            level.push_back(dset);
+        }
+
+        std::vector<std::exception_ptr> errors(level.size());
+        std::atomic<size_t> next_ix = 0;
+        auto worker = [&]() {
+            for (size_t i = next_ix++; i < level.size(); i = next_ix++) {
+                try {
+                    level[i]->serialize_modified_descriptors();
+                } catch (...) {
+                    errors[i] = std::current_exception();
+                }
+            }
+        };
+
+        std::vector<std::thread> workers;
+        const size_t workers_cnt = std::min<size_t>(max_workers, level.size());
+        for (size_t i = 0; i < workers_cnt; ++i) {
+            workers.emplace_back(worker);
+        }
+        for (auto& th: workers) {
+            th.join();
+        }
+
+        // Allocate and write the serialized descriptors, one set at a time.
+        // Syncing a set marks its owner (in the next level) as modified.
+        for (size_t i = 0; i < level.size(); ++i) {
+            if (errors[i]) {
+                // Drop any serialization not written: it could be stale on the next sync
+                for (auto dset: level) {
+                    dset->serialized.clear();
+                }
+                std::rethrow_exception(errors[i]);
+            }
+
+            level[i]->commit_sync_no_recursive(release);
+        }
+    }
 }
 
 void DescriptorSet::full_sync(const bool release) {
-    bottom_up_for_each_set(*this, [release](DescriptorSet* dset, [[maybe_unused]] size_t l) {
-        dset->full_sync_no_recursive(release);
-    });
+    // Syncing a set is not a use of it: save when the sets were used
+    // to restore it after the sync.
+    const bool unload = rctx.runcfg.dset.max_loaded_descriptors != 0;
+    std::vector<std::pair<DescriptorSet*, uint64_t>> last_uses;
+    if (unload) {
+        top_down_for_each_set(*this, [&last_uses](DescriptorSet* dset, [[maybe_unused]] size_t l) {
+            last_uses.push_back({dset, dset->last_use});
+        });
+    }
+
+    if (rctx.runcfg.dset.sync_workers > 1 and (release or subtree_dirty)) {
+        parallel_full_sync(release);
+    } else if (release) {
+        // Releasing the free space must be done on every set, modified or not.
+        bottom_up_for_each_set(*this, [release](DescriptorSet* dset, [[maybe_unused]] size_t l) {
+            dset->full_sync_no_recursive(release);
+        });
+    } else if (subtree_dirty) {
+        sync_dirty_subsets();
+    }
+
+    if (unload) {
+        for (const auto& [dset, use]: last_uses) {
+            dset->last_use = use;
+        }
+        unload_lru_subsets();
+    }
+}
+
+void DescriptorSet::sync_dirty_subsets() {
+    // Same post-order than bottom_up_for_each_set() but skipping the subtrees
+    // that were not modified since their last sync. The second item of each
+    // pair tells if the subsets of the set were already pushed.
+    std::vector<std::pair<DescriptorSet*, bool>> to_sync;
+    to_sync.push_back({this, false});
+    while (not to_sync.empty()) {
+        auto [dset, expanded] = to_sync.back();
+        if (expanded) {
+            dset->full_sync_no_recursive(false);
+            to_sync.pop_back();
+            continue;
+        }
+
+        to_sync.back().second = true;
+        for (auto it = dset->children.rbegin(); it != dset->children.rend(); ++it) {
+            if ((*it)->subtree_dirty) {
+                to_sync.push_back({*it, false});
+            }
+        }
+    }
+}
+
+void DescriptorSet::unload_lru_subsets() {
+    const uint64_t budget = rctx.runcfg.dset.max_loaded_descriptors;
+
+    // Only the loaded sets without loaded subsets can be unloaded so unloading
+    // a set never destroys another loaded set. Once unloaded, its owner may be
+    // unloaded in the next round.
+    while (true) {
+        uint64_t loaded_cnt = 0;
+        std::vector<DescriptorSet*> candidates;
+        top_down_for_each_set(*this, [&](DescriptorSet* dset, [[maybe_unused]] size_t l) {
+            if (not dset->set_loaded) {
+                return;
+            }
+
+            loaded_cnt += dset->owned_cnt;
+            if (dset != this and dset->is_unloadable()) {
+                candidates.push_back(dset);
+            }
+        });
+
+        if (loaded_cnt <= budget or candidates.empty()) {
+            return;
+        }
+
+        std::sort(candidates.begin(), candidates.end(),
+                  [](const DescriptorSet* a, const DescriptorSet* b) { return a->last_use < b->last_use; });
+
+        for (auto dset: candidates) {
+            if (loaded_cnt <= budget) {
+                return;
+            }
+
+            loaded_cnt -= dset->owned_cnt;
+            dset->unload_set();
+        }
+    }
+}
+
+bool DescriptorSet::is_unloadable() const {
+    // Note: does_require_write() is not called because it would count as a use of the set
+    if (not set_loaded or owned_cnt == 0 or subtree_dirty or header_does_require_write or to_add.size() != 0 or
+        to_remove.size() != 0 or to_update.size() != 0 or to_destroy.size() != 0) {
+        return false;
+    }
+
+    for (const auto subset: children) {
+        if (subset->set_loaded) {
+            return false;
+        }
+    }
+
+    // Temporal ids are not stored so the descriptors would get different ids
+    // on the reload.
+    sort_owned_if_dirty();
+    for (const auto& [id, _]: owned) {
+        if (not rctx.idmgr.is_persistent(id)) {
+            return false;
+        }
+    }
+
+    return count_descriptors_external_references() == 0;
+}
+
+void DescriptorSet::unload_set() {
+    // The ids will be registered again on the reload. Meanwhile, keep them
+    // reserved so they are not handed out to new descriptors (and so Index::find()
+    // knows that they may be in a set not loaded).
+    sort_owned_if_dirty();
+    for (const auto& [id, dscptr]: owned) {
+        if (rctx.idmgr.is_registered(id)) {
+            rctx.idmgr.unregister_persistent_id(id);
+        }
+        rctx.idmgr.reserve_persistent_id(id);
+        dscptr->set_owner(nullptr);
+        rctx.index.untrack_descriptor(id);
+    }
+
+    clear_owned();
+    owned_by_type.clear();
+    children.clear();
+
+    set_loaded = false;
+    load_deferred = true;
+    after_load_notified = false;
+    unloaded = true;
+}
+
+void DescriptorSet::mark_subtree_dirty() {
+    // A dirty set implies a dirty owner so we can stop as soon as
+    // we find a set already marked.
+    for (DescriptorSet* dset = this; dset != nullptr and not dset->subtree_dirty; dset = dset->get_owner()) {
+        dset->subtree_dirty = true;
+    }
 }
 
 void DescriptorSet::clear_set() {
+    load_deferred_subsets();
     bottom_up_for_each_set(*this,
                            [](DescriptorSet* dset, [[maybe_unused]] size_t l) { dset->clear_set_no_recursive(); });
 }
 
 void DescriptorSet::destroy() {
+    load_deferred_subsets();
     bottom_up_for_each_set(*this, [](DescriptorSet* dset, [[maybe_unused]] size_t l) { dset->destroy_no_recursive(); });
 }
 
@@ -1051,8 +1882,9 @@ void DescriptorSet::release_free_space() { xoz_assert("bad call", false); }
 
 uint64_t DescriptorSet::count_descriptors_external_references() const {
     uint64_t cnt = 0;
+    sort_owned_if_dirty();
     for (const auto& p: owned) {
-        auto dscptr = p.second;
+        const auto& dscptr = p.second;
         xoz_assert("owned descriptor has shared ptr of count 0", dscptr.use_count() >= 1);
 
         // don't count ourselves
@@ -1067,6 +1899,7 @@ void DescriptorSet::chk_if_any_descriptor_has_external_references() const {
         return;
     }
 
+    sort_owned_if_dirty();
     for (const auto& p: owned) {
         auto dscptr = p.second;
         chk_if_descriptor_has_external_references(dscptr);
@@ -1104,11 +1937,18 @@ uint16_t /* testing */ DescriptorSet::_get_ireserved() const { return ireserved;
 uint16_t /* testing */ DescriptorSet::_get_creserved() const { return creserved; }
 std::vector<char> /* testing */ DescriptorSet::_get_pdata() const { return pdata; }
 
-void /* testing */ DescriptorSet::_set_ireserved(uint16_t v) { ireserved = v; }
+void /* testing */ DescriptorSet::_set_ireserved(uint16_t v) {
+    ireserved = v;
+    mark_subtree_dirty();
+}
 void /* testing */ DescriptorSet::_set_creserved(uint16_t v) {
     current_checksum = inet_remove(current_checksum, creserved);
     creserved = v;
     current_checksum = inet_add(current_checksum, creserved);
+    mark_subtree_dirty();
+}
+void /* testing */ DescriptorSet::_set_pdata(const std::vector<char>& v) {
+    pdata = v;
+    mark_subtree_dirty();
 }
-void /* testing */ DescriptorSet::_set_pdata(const std::vector<char>& v) { pdata = v; }
 }  // namespace xoz
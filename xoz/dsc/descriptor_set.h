@@ -3,6 +3,7 @@
 #include <algorithm>
 #include <cstdint>
 #include <deque>
+#include <list>
 #include <map>
 #include <memory>
 #include <queue>
@@ -10,6 +11,7 @@
 #include <stdexcept>
 #include <tuple>
 #include <type_traits>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -18,6 +20,7 @@
 #include "xoz/dsc/descriptor.h"
 #include "xoz/dsc/internals.h"
 #include "xoz/io/iobase.h"
+#include "xoz/mem/flat_hash.h"
 
 namespace xoz {
 class RuntimeContext;
@@ -33,7 +36,23 @@ private:
     // Descriptors owned by this DescriptorSet. Owned means that the descriptors
     // belongs to this set and to no other one. They may or no be present in the XOZ
     // file at the moment.
-    std::map<uint32_t, std::shared_ptr<Descriptor>> owned;
+    //
+    // The entries (id, descriptor) are kept in a vector sorted by id, the order
+    // of the iteration. Adding descriptors in increasing id order keeps it sorted;
+    // any other addition marks it as dirty and it is sorted again on the next
+    // iteration (see sort_owned_if_dirty()). Removing a descriptor leaves a hole
+    // (an entry without descriptor) that is dropped on the next iteration too.
+    //
+    // <owned_ix> maps the ids to the position of their entries in <owned>
+    // and <owned_cnt> counts the entries that are not holes.
+    //
+    // Always modify them with own_entry()/disown_entry()/clear_owned() so
+    // they are kept in sync.
+    typedef std::vector<std::pair<uint32_t, std::shared_ptr<Descriptor>>> owned_t;
+    mutable owned_t owned;
+    mutable FlatHashMap<uint32_t, uint32_t> owned_ix;
+    uint32_t owned_cnt;
+    mutable bool owned_dirty;
 
     // The owned descriptors can be classified into 3 subsets:
     //
@@ -42,23 +61,46 @@ private:
     //               such change is not being reflected by the file and it should be
     //  - the rest: descriptors owned and present in the XOZ file that don't require an update (not changed)
     //
-    std::set<Descriptor*, by_id> to_add;
-    std::set<Descriptor*, by_id> to_update;
+    // These are hash sets: anything that requires a deterministic order (like
+    // allocating space for the descriptors) must use sorted_by_id().
+    typedef FlatHashSet<Descriptor*> dsc_set_t;
+    dsc_set_t to_add;
+    dsc_set_t to_update;
 
     // Descriptors in <to_remove> are not owned by the set (this) but they *were* moments ago.
     // The remotion could happen if the descriptor was explicitly deleted (erase) or it is was moved
     // to another set. In the first case, the current set was the last owner and the data blocks owned
     // by the removed descriptor were removed (see erase()); in the second case, the descriptor
     // is still alive (in another set) so no data block was deleted.
-    std::set<Extent, Extent::Compare> to_remove;
+    //
+    // The extents are not sorted nor deduplicated until the set is written.
+    std::vector<Extent> to_remove;
     std::set<std::shared_ptr<Descriptor>> to_destroy;
 
     /*
-     * These are the sub-descriptor-sets owned by this.
+     * These are the sub-descriptor-sets owned by this, sorted by id.
      * */
-    std::set<DescriptorSet*, by_id> children;
+    std::vector<DescriptorSet*> children;
     bool visited;
 
+    /*
+     * The ids of the owned descriptors grouped by their type (see for_each_of_type()).
+     * Like <children>, these are views of <owned>: they are updated
+     * on each addition/remotion and they don't own the descriptors.
+     *
+     * Like <owned>, the ids are sorted lazily: removing a descriptor
+     * leaves its id in <ids> and adding one out of order marks them as dirty.
+     * compact_type_index() drops the ids that are not owned anymore
+     * (or not with this type) and sorts the rest.
+     * <cnt> counts the ids that are still owned.
+     * */
+    struct type_index_t {
+        std::vector<uint32_t> ids;
+        uint32_t cnt = 0;
+        bool dirty = false;
+    };
+    std::unordered_map<uint16_t, type_index_t> owned_by_type;
+
     /*
      * <segm> is the segment that holds the descriptors of this set. The segment points to blocks
      * in the <sg_blkarr> block array that contains the header of the set and the descriptors
@@ -69,7 +111,7 @@ private:
      * descriptors. We use <st_blkarr> to track the allocated space within the space pointed
      * by the segment.
      * For reading/writing descriptors (including padding), we use <sg_blkarr> directly.
-     * See load_descriptors / write_modified_descriptors.
+     * See parse_descriptors / write_modified_descriptors.
      *
      *                                   <st_blkarr> of 2 bytes blks
      *        <segm>                     <sg_blkarr> of N bytes blks      <cblkarr> of M bytes blks
@@ -91,6 +133,25 @@ private:
 
     bool set_loaded;
 
+    /*
+     * If the set was found as a subset of another set and the runtime config
+     * asked for lazy loading, the set is not loaded with its parent but
+     * on its first use (see load_if_deferred()).
+     * */
+    bool load_deferred;
+    bool after_load_notified;
+
+    /*
+     * The set was unloaded to bound the memory used (see unload_lru_subsets()).
+     * Its allocator is kept as it was, so on the reload it is not initialized again.
+     * */
+    bool unloaded;
+
+    /*
+     * When the set was used for the last time, in ticks of RuntimeContext::dset_use_tick.
+     * */
+    uint64_t last_use;
+
     /*
      * Private data (and its size).
      * Used to preserve fields from future versions of xoz.
@@ -112,6 +173,28 @@ private:
      * */
     bool header_does_require_write;
 
+    /*
+     * Descriptors of to_add and to_update that were serialized ahead
+     * of their write (see parallel_full_sync()) with their checksum
+     * before the serialization.
+     * */
+    struct serialized_dsc_t {
+        std::vector<char> data;
+        uint16_t prev_checksum;
+    };
+    std::unordered_map<Descriptor*, struct serialized_dsc_t> serialized;
+
+    /*
+     * True if this set or any of its subsets (recursively) may have
+     * changed since the last full_sync(). A non-releasing full_sync()
+     * skips the subsets that are not dirty.
+     *
+     * Invariant: if a set is dirty, its owner set is dirty too.
+     * */
+    bool subtree_dirty;
+
+    void mark_subtree_dirty();
+
 protected:
     enum Streams : uint16_t {
         Main = 0,
@@ -120,6 +203,7 @@ protected:
 
 public:
     constexpr static uint16_t TYPE = 0x0001;
+    constexpr static struct class_tag_for_t<DescriptorSet> ClassTag = {{.base = &Descriptor::ClassTag}};
 
     /*
      * Create a descriptor set.
@@ -162,6 +246,13 @@ public:
     /*
      * Flush any pending write to disk. This can be called multiple times: the implementation
      * will try to avoid any write if there are no changes.
+     *
+     * If release is false, only the subsets modified since the last sync are visited.
+     *
+     * If runcfg.dset.sync_workers is greater than 1, the sets are synced level by level,
+     * from the deepest. The descriptors to write of the sets of a level are serialized
+     * in memory in parallel by up to that many threads; the allocation of their space
+     * and their write is still done sequentially.
      * */
     void full_sync(const bool release) override;
 
@@ -172,8 +263,7 @@ public:
      * */
     uint32_t count() const {
         fail_if_set_not_loaded();
-        auto cnt = owned.size();
-        return assert_u32(cnt);
+        return owned_cnt;
     }
 
     /*
@@ -211,6 +301,18 @@ public:
      * */
     uint32_t add(std::unique_ptr<Descriptor> dscptr, bool assign_persistent_id = false);
 
+    /*
+     * Add the given descriptors to the set, like calling add() on each but
+     * validating all of them first: if any is not allowed to be added, throw
+     * and leave both the set and the given descriptors untouched.
+     *
+     * The persistent ids that need to be assigned form a contiguous range.
+     *
+     * Return the ids of the descriptors added, in the same order.
+     * */
+    std::vector<uint32_t> add_many(std::vector<std::unique_ptr<Descriptor>>&& dscptrs,
+                                   bool assign_persistent_id = false);
+
     /*
      * Create a new descriptor of type T with the given arguments (Args) calling
      * the class method T::create. The first argument of T::create must be
@@ -307,12 +409,7 @@ public:
 
     template <typename T>
     std::shared_ptr<T> get(uint32_t id, bool ret_null = false) {
-        auto ptr = std::dynamic_pointer_cast<T>(this->get(id));
-        if (!ptr and not ret_null) {
-            throw std::runtime_error("Descriptor cannot be dynamically down casted.");
-        }
-
-        return ptr;
+        return Descriptor::cast<T>(this->get(id), ret_null);
     }
 
     /*
@@ -320,16 +417,35 @@ public:
      * */
     bool contains(uint32_t id) const;
 
-    typedef xoz::dsc::internals::DescriptorIterator<std::map<uint32_t, std::shared_ptr<Descriptor>>::iterator>
-            dsc_iterator_t;
-    typedef xoz::dsc::internals::DescriptorIterator<std::map<uint32_t, std::shared_ptr<Descriptor>>::const_iterator>
-            const_dsc_iterator_t;
+    /*
+     * Iterate over the descriptors of the set in id order.
+     *
+     * Adding or removing descriptors invalidates the iterators.
+     * */
+    typedef xoz::dsc::internals::DescriptorIterator<owned_t::iterator> dsc_iterator_t;
+    typedef xoz::dsc::internals::DescriptorIterator<owned_t::const_iterator> const_dsc_iterator_t;
 
-    inline dsc_iterator_t begin() { return xoz::dsc::internals::DescriptorIterator(owned.begin()); }
-    inline dsc_iterator_t end() { return xoz::dsc::internals::DescriptorIterator(owned.end()); }
+    inline dsc_iterator_t begin() {
+        load_if_deferred();
+        sort_owned_if_dirty();
+        return xoz::dsc::internals::DescriptorIterator(owned.begin());
+    }
+    inline dsc_iterator_t end() {
+        load_if_deferred();
+        sort_owned_if_dirty();
+        return xoz::dsc::internals::DescriptorIterator(owned.end());
+    }
 
-    inline const_dsc_iterator_t cbegin() const { return xoz::dsc::internals::DescriptorIterator(owned.cbegin()); }
-    inline const_dsc_iterator_t cend() const { return xoz::dsc::internals::DescriptorIterator(owned.cend()); }
+    inline const_dsc_iterator_t cbegin() const {
+        load_if_deferred();
+        sort_owned_if_dirty();
+        return xoz::dsc::internals::DescriptorIterator(owned.cbegin());
+    }
+    inline const_dsc_iterator_t cend() const {
+        load_if_deferred();
+        sort_owned_if_dirty();
+        return xoz::dsc::internals::DescriptorIterator(owned.cend());
+    }
 
     /*
      * Travel through the links between descriptor sets and call
@@ -344,6 +460,11 @@ public:
      *
      * top_down_for_each_set() and bottom_up_for_each_set() are the same
      * except that the first iterates in pre-order will the second in post-order.
+     *
+     * Subsets which load was deferred (lazy loading) and that are still not loaded
+     * have no subsets from the iteration's perspective. If fn loads the set
+     * (calling count() or get() for example), top_down_for_each_set() will
+     * iterate over its subsets too but bottom_up_for_each_set() will not.
      * */
     template <class Fn>
     static bool bottom_up_for_each_set(DescriptorSet& root, Fn fn) {
@@ -355,6 +476,74 @@ public:
         return _depth_first_for_each_set_adapter<Fn, false>(root, fn);
     }
 
+    /*
+     * Call fn on each descriptor of the set (not recursive) of the given type,
+     * in the order of their ids. This does not iterate over the rest of the descriptors.
+     *
+     * The function receives a std::shared_ptr<T> to the descriptor. If it
+     * returns a boolean and it returns true, the iteration stops immediately.
+     * The return value of for_each_of_type() tells if the iteration was stopped.
+     *
+     * The version without the type uses T::TYPE.
+     *
+     * The function must not add nor remove descriptors of the set.
+     * */
+    template <typename T = Descriptor, class Fn>
+    bool for_each_of_type(uint16_t type, Fn fn) {
+        fail_if_set_not_loaded();
+        auto it = owned_by_type.find(type);
+        if (it == owned_by_type.end()) {
+            return false;
+        }
+
+        compact_type_index(it->second, type);
+        for (const auto id: it->second.ids) {
+            auto dscptr = Descriptor::cast<T>(*find_owned(id));
+            using ret_type = std::invoke_result_t<decltype(fn), std::shared_ptr<T>>;
+            if constexpr (std::is_same_v<ret_type, void>) {
+                fn(dscptr);
+            } else {
+                if (fn(dscptr)) {
+                    return true;
+                }
+            }
+        }
+
+        return false;
+    }
+
+    template <typename T, class Fn>
+    bool for_each_of_type(Fn fn) {
+        return for_each_of_type<T>(T::TYPE, fn);
+    }
+
+    /*
+     * Like for_each_of_type() but on the given set and on all its subsets
+     * (recursively, in the order of top_down_for_each_set()).
+     *
+     * Subsets which load was deferred are loaded.
+     * */
+    template <typename T = Descriptor, class Fn>
+    static bool for_each_of_type_in_tree(DescriptorSet& root, uint16_t type, Fn fn) {
+        return top_down_for_each_set(root, [type, &fn](DescriptorSet* dset, size_t) -> bool {
+            return dset->for_each_of_type<T>(type, fn);
+        });
+    }
+
+    template <typename T, class Fn>
+    static bool for_each_of_type_in_tree(DescriptorSet& root, Fn fn) {
+        return for_each_of_type_in_tree<T>(root, T::TYPE, fn);
+    }
+
+    /*
+     * Count how many descriptors of the given type are owned by this set.
+     * */
+    uint32_t count_of_type(uint16_t type) const {
+        fail_if_set_not_loaded();
+        auto it = owned_by_type.find(type);
+        return it == owned_by_type.end() ? 0 : it->second.cnt;
+    }
+
     Segment segment() const { return dset_segm; }
 
 public:
@@ -378,14 +567,65 @@ private:
 
 
 private:
-    void load_descriptors(std::queue<DescriptorSet*>& to_load_dsets);
+    /*
+     * Load the descriptors of the set from io in two steps.
+     *
+     * parse_descriptors() verifies the checksum of the stream and reads and creates the
+     * descriptors. If register_ids is false, their ids are not registered (see
+     * Descriptor::load_header_from()) and nothing shared with other sets is modified
+     * so it can be called for different sets concurrently (see parallel_load_set()).
+     *
+     * own_parsed_descriptors() then registers the ids if they were not, owns and tracks
+     * the descriptors, and queues the subsets to load (unless they are loaded lazily).
+     * */
+    struct parsed_descriptors_t {
+        std::vector<std::unique_ptr<Descriptor>> dscs;
+        std::list<Extent> allocated_exts;
+    };
+    void parse_descriptors(IOBase& io, bool register_ids, struct parsed_descriptors_t& parsed);
+    void own_parsed_descriptors(struct parsed_descriptors_t& parsed, bool ids_registered,
+                                std::queue<DescriptorSet*>& to_load_dsets);
+    void parallel_load_set();
+    void chk_stream_checksum(IOBase& io) const;
     void write_modified_descriptors(IOBase& io);
+    void alloc_space_for_added_descriptors();
+    bool should_compact_stream() const;
+    void compact_stream();
 
     void add_s(std::shared_ptr<Descriptor> dscptr, bool assign_persistent_id);
+
+    /*
+     * Take the ownership of the added descriptor (that must have a valid id already)
+     * and track it in the set's bookkeeping (to_add, children, type index, Index).
+     * Shared by add_s() and add_many().
+     * */
+    void own_and_track_added(const std::shared_ptr<Descriptor>& dscptr);
     void zeros(IOBase& io, const Extent& ext);
 
     void impl_remove(std::shared_ptr<Descriptor>& dscptr, bool moved);
 
+    void track_type_of(Descriptor* dsc);
+    void untrack_type_of(Descriptor* dsc);
+    void compact_type_index(type_index_t& index, uint16_t type) const;
+
+    void own_entry(const std::shared_ptr<Descriptor>& dscptr);
+    void disown_entry(uint32_t id);
+    void clear_owned();
+    void sort_owned_if_dirty() const;
+
+    /*
+     * Return the owned descriptor of the given id or nullptr if there is none.
+     * */
+    std::shared_ptr<Descriptor>* find_owned(uint32_t id) const {
+        const auto pos = owned_ix.find(id);
+        return pos ? &owned[*pos].second : nullptr;
+    }
+
+    void add_child(DescriptorSet* subset);
+    void remove_child(DescriptorSet* subset);
+
+    static std::vector<Descriptor*> sorted_by_id(const dsc_set_t& dscs);
+
     std::shared_ptr<Descriptor> get_owned_dsc_or_fail(uint32_t id);
 
 protected:
@@ -393,12 +633,25 @@ protected:
     void update_content_parts(std::vector<struct Descriptor::content_part_t>& cparts) override;
 
 private:
-    void flush_writes_no_recursive(const bool release);
+    void flush_members_no_recursive(const bool release);
     void release_free_space_no_recursive();
     void full_sync_no_recursive(const bool release);
+    void commit_sync_no_recursive(const bool release);
+    void sync_dirty_subsets();
+    void parallel_full_sync(const bool release);
+    void serialize_modified_descriptors();
     void clear_set_no_recursive();
     void destroy_no_recursive();
 
+    /*
+     * Unload the least recently used subsets of this set (recursively) until
+     * the count of loaded descriptors fits in runcfg.dset.max_loaded_descriptors.
+     * Only the subsets for which is_unloadable() is true are unloaded.
+     * */
+    void unload_lru_subsets();
+    bool is_unloadable() const;
+    void unload_set();
+
     // Override these only to make them fail.
     // Callers (including Descriptor parent class) should not call them
     // and instead they should call full_sync().
@@ -409,8 +662,30 @@ public:
     /*
      * Load the set into memory. This must be called once to initialize the internal allocator
      * properly.
+     *
+     * The set and its subsets are loaded level by level.
      * */
     void /* internal */ load_set();
+
+    /*
+     * Load the set and all its subsets (recursively) which load were deferred.
+     * */
+    void /* internal */ load_deferred_subsets();
+
+    /*
+     * Return if the set is loaded. Unlike most of the methods of the set,
+     * this does not trigger the load of a set which load was deferred.
+     * */
+    bool /* internal */ is_set_loaded() const { return set_loaded; }
+
+    /*
+     * Call on_after_load() on the descriptors of the set (not recursive)
+     * but only once: any subsequent call does nothing.
+     *
+     * The File calls this once it is loaded. Sets loaded lazily after that
+     * call this by themselves.
+     * */
+    void /* internal */ notify_after_load(std::shared_ptr<DescriptorSet> root);
     BlockArray& /* internal - for testing */ expose_block_array() { return cblkarr; }
 
     /*
@@ -434,6 +709,11 @@ public:
     void /* testing */ _set_creserved(uint16_t v);
     void /* testing */ _set_pdata(const std::vector<char>& v);
 
+    bool /* testing */ _is_subtree_dirty() const { return subtree_dirty; }
+    struct SegmentAllocator::stats_t /* testing */ _get_stream_allocator_stats() const {
+        return st_blkarr.allocator().stats();
+    }
+
     // Internal, for sub-classing only
     DescriptorSet(const struct Descriptor::header_t& hdr, BlockArray& cblkarr, uint16_t decl_cpart_cnt,
                   RuntimeContext& rctx);
@@ -443,6 +723,7 @@ public:
     DescriptorSet(const Segment& segm, BlockArray& cblkarr, RuntimeContext& rctx);
 
 private:
+    void load_if_deferred() const;
     void fail_if_set_not_loaded() const;
     void fail_if_using_incorrect_blkarray(const Descriptor* dsc) const;
     void fail_if_null(const Descriptor* dsc) const;
@@ -1,13 +1,25 @@
 #include "xoz/dsc/id_mapping.h"
 
+#include <algorithm>
+
 namespace xoz {
 IDMappingDescriptor::IDMappingDescriptor(const struct Descriptor::header_t& hdr, BlockArray& cblkarr):
-        Descriptor(hdr, cblkarr, IDMappingDescriptor::Parts::CNT), num_entries(0), content_sz(0) {}
+        Descriptor(hdr, cblkarr, IDMappingDescriptor::Parts::CNT),
+        num_entries(0),
+        record_cnt(0),
+        content_sz(0),
+        log_format(false) {
+    class_tag = &ClassTag;
+}
 
 IDMappingDescriptor::IDMappingDescriptor(BlockArray& cblkarr):
         Descriptor(IDMappingDescriptor::TYPE, cblkarr, IDMappingDescriptor::Parts::CNT),
         num_entries(0),
-        content_sz(0) {}
+        record_cnt(0),
+        content_sz(0),
+        log_format(false) {
+    class_tag = &ClassTag;
+}
 
 void IDMappingDescriptor::read_struct_specifics_from(IOBase& io) { num_entries = io.read_u16_from_le(); }
 
@@ -60,12 +72,54 @@ void IDMappingDescriptor::store(const std::map<std::string, uint32_t>& id_by_nam
         }
 
         ++cnt;
-        io.write_u32_to_le(id);
-        io.write_u8_to_le(assert_u8(name.size()));
-        io.writeall(name.data(), assert_u8(name.size()));
+        write_record(io, name, id);
     }
 
-    num_entries = assert_u16(cnt);
+    record_cnt = cnt;
+    num_entries = uint16_t(std::min<uint32_t>(record_cnt, 0xffff));
+    log_format = record_cnt > 0xffff;
+    notify_descriptor_changed();
+}
+
+void IDMappingDescriptor::append(const std::vector<std::pair<std::string, uint32_t>>& records) {
+    uint32_t sz = 0;
+    for (auto const& [name, id]: records) {
+        if (id != 0) {
+            fail_if_bad_values(id, name);
+        }
+        xoz_assert("Temp names are not stored", name.size() > 0 and name[0] != TempNamePrefix);
+
+        sz += sizeof(id);
+        sz += sizeof(uint8_t);  // name length
+        sz += assert_u8(name.size());
+    }
+
+    if (sz == 0) {
+        return;
+    }
+
+    // Grow the content: the stored records are preserved
+    auto cpart = get_content_part(Parts::Map);
+    const uint32_t prev_content_sz = cpart.size();
+    content_sz = assert_u32_add_nowrap(prev_content_sz, sz);
+    cpart.resize(content_sz);
+
+    auto io = cpart.get_io();
+    io.seek_wr(prev_content_sz);
+    for (auto const& [name, id]: records) {
+        write_record(io, name, id);
+    }
+
+    record_cnt = assert_u32_add_nowrap(record_cnt, assert_u32(records.size()));
+    num_entries = uint16_t(std::min<uint32_t>(record_cnt, 0xffff));
+    log_format = true;
+    notify_descriptor_changed();
+}
+
+void IDMappingDescriptor::write_record(IOBase& io, const std::string& name, uint32_t id) {
+    io.write_u32_to_le(id);
+    io.write_u8_to_le(assert_u8(name.size()));
+    io.writeall(name.data(), assert_u8(name.size()));
 }
 
 std::map<std::string, uint32_t> IDMappingDescriptor::load() {
@@ -74,7 +128,10 @@ std::map<std::string, uint32_t> IDMappingDescriptor::load() {
     char buf[256];
     auto cpart = get_content_part(Parts::Map);
     auto io = cpart.get_io();
-    for (unsigned i = 0; i < num_entries; ++i) {
+
+    record_cnt = 0;
+    log_format = false;
+    while (io.remain_rd()) {
         uint32_t id = io.read_u32_from_le();
         uint8_t len = io.read_u8_from_le();
 
@@ -82,9 +139,26 @@ std::map<std::string, uint32_t> IDMappingDescriptor::load() {
 
         io.readall(buf, len);
         std::string name(buf, len);
+        ++record_cnt;
+
+        // A deletion record
+        if (id == 0) {
+            id_by_name.erase(name);
+            log_format = true;
+            continue;
+        }
 
         fail_if_bad_values(id, name);
-        id_by_name[name] = id;
+        auto [it, inserted] = id_by_name.insert({name, id});
+        if (not inserted) {
+            // An overriding record
+            it->second = id;
+            log_format = true;
+        }
+    }
+
+    if (record_cnt > 0xffff) {
+        log_format = true;
     }
 
     return id_by_name;
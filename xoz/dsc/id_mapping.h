@@ -3,6 +3,8 @@
 #include <map>
 #include <memory>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "xoz/dsc/descriptor.h"
 #include "xoz/io/iobase.h"
@@ -12,6 +14,7 @@ namespace xoz {
 class IDMappingDescriptor: public Descriptor {
 public:
     constexpr static uint16_t TYPE = 0x01bf;
+    constexpr static struct class_tag_for_t<IDMappingDescriptor> ClassTag = {{.base = &Descriptor::ClassTag}};
 
     constexpr static char TempNamePrefix = '~';
 
@@ -21,11 +24,31 @@ public:
     static std::unique_ptr<IDMappingDescriptor> create(BlockArray& cblkarr);
 
     /*
-     * Store/load the entire mapping.
+     * The mapping is stored as a log of records, each one with an id and a name.
+     * A record with an id of 0 deletes the name; otherwise it maps the name to
+     * the id, overriding any previous record of the same name.
+     *
+     * store() rewrites the entire mapping (compacting the log) while append()
+     * adds the given records at the end of the stored log.
+     * load() replays the log.
      * */
     void store(const std::map<std::string, uint32_t>& id_by_name);
+    void append(const std::vector<std::pair<std::string, uint32_t>>& records);
     std::map<std::string, uint32_t> load();
 
+    /*
+     * Count of records in the stored log (as loaded, stored or appended).
+     * */
+    uint32_t stored_record_count() const { return record_cnt; }
+
+    /*
+     * Return true if the stored content can be read only as a log: it has
+     * deletion or overriding records or more records than num_entries can count.
+     * Such content cannot be read by a library that reads exactly num_entries
+     * records so the file must be flagged as incompatible.
+     * */
+    bool is_stored_as_log() const { return log_format; }
+
 private:
     IDMappingDescriptor(const struct Descriptor::header_t& hdr, BlockArray& cblkarr);
     explicit IDMappingDescriptor(BlockArray& cblkarr);
@@ -33,9 +56,16 @@ private:
 private:
     void fail_if_bad_values(uint32_t id, const std::string& name) const;
     uint32_t calculate_store_mapping_size(const std::map<std::string, uint32_t>& id_by_name) const;
+    static void write_record(IOBase& io, const std::string& name, uint32_t id);
 
+    /*
+     * The count of records is num_entries but it is saturated at 0xffff
+     * so the log is read until the end of the content instead.
+     * */
     uint16_t num_entries;
+    uint32_t record_cnt;
     uint32_t content_sz;
+    bool log_format;
 
     enum Parts : uint16_t { Map, CNT };
 
@@ -0,0 +1,411 @@
+#include "xoz/dsc/name_index.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "xoz/err/exceptions.h"
+#include "xoz/io/iospan.h"
+#include "xoz/log/format_string.h"
+
+namespace xoz {
+NameIndexDescriptor::NameIndexDescriptor(const struct Descriptor::header_t& hdr, BlockArray& cblkarr):
+        Descriptor(hdr, cblkarr, NameIndexDescriptor::Parts::CNT),
+        root_page(0),
+        page_cnt(0),
+        name_cnt(0),
+        max_cached_pages(DefaultMaxCachedPages),
+        use_tick(0) {
+    class_tag = &ClassTag;
+}
+
+NameIndexDescriptor::NameIndexDescriptor(BlockArray& cblkarr):
+        Descriptor(NameIndexDescriptor::TYPE, cblkarr, NameIndexDescriptor::Parts::CNT),
+        root_page(0),
+        page_cnt(0),
+        name_cnt(0),
+        max_cached_pages(DefaultMaxCachedPages),
+        use_tick(0) {
+    class_tag = &ClassTag;
+}
+
+void NameIndexDescriptor::read_struct_specifics_from(IOBase& io) {
+    root_page = io.read_u32_from_le();
+    page_cnt = io.read_u32_from_le();
+    name_cnt = io.read_u32_from_le();
+
+    if (page_cnt and root_page >= page_cnt) {
+        throw InconsistentXOZ(F() << "The root page " << root_page << " of the name index is out of range (there are "
+                                  << page_cnt << " pages).");
+    }
+}
+
+void NameIndexDescriptor::write_struct_specifics_into(IOBase& io) {
+    io.write_u32_to_le(root_page);
+    io.write_u32_to_le(page_cnt);
+    io.write_u32_to_le(name_cnt);
+}
+
+void NameIndexDescriptor::update_isize(uint64_t& isize) {
+    isize = sizeof(uint32_t) * 3;  // root page, page count and name count
+}
+
+std::unique_ptr<Descriptor> NameIndexDescriptor::create(const struct Descriptor::header_t& hdr, BlockArray& cblkarr,
+                                                        [[maybe_unused]] RuntimeContext& rctx) {
+    return std::unique_ptr<NameIndexDescriptor>(new NameIndexDescriptor(hdr, cblkarr));
+}
+
+std::unique_ptr<NameIndexDescriptor> NameIndexDescriptor::create(BlockArray& cblkarr) {
+    return std::unique_ptr<NameIndexDescriptor>(new NameIndexDescriptor(cblkarr));
+}
+
+uint32_t NameIndexDescriptor::lookup(const std::string& name) {
+    if (page_cnt == 0) {
+        return 0;
+    }
+
+    uint32_t id = 0;
+    uint32_t page_nr = root_page;
+    while (true) {
+        const page_t& page = fetch_page(page_nr);
+        if (not page.leaf) {
+            page_nr = page.values[find_child_of(page, name)];
+            continue;
+        }
+
+        auto it = std::lower_bound(page.names.begin(), page.names.end(), name);
+        if (it != page.names.end() and *it == name) {
+            id = page.values[size_t(it - page.names.begin())];
+        }
+        break;
+    }
+
+    evict_pages();
+    return id;
+}
+
+bool NameIndexDescriptor::insert(const std::string& name, uint32_t id) {
+    fail_if_bad_values(id, name);
+
+    if (page_cnt == 0) {
+        root_page = alloc_page(true);
+    }
+
+    bool changed = false;
+    std::string split_name;
+    uint32_t split_page_nr = 0;
+    if (insert_into(root_page, name, id, changed, split_name, split_page_nr)) {
+        // The root was split: the tree grows one level
+        const uint32_t new_root_nr = alloc_page(false);
+        page_t& new_root = fetch_page(new_root_nr);
+        new_root.names = {"", split_name};
+        new_root.values = {root_page, split_page_nr};
+        root_page = new_root_nr;
+    }
+
+    evict_pages();
+    return changed;
+}
+
+bool NameIndexDescriptor::insert_into(uint32_t page_nr, const std::string& name, uint32_t id, bool& changed,
+                                      std::string& split_name, uint32_t& split_page_nr) {
+    // Note: the references to the cached pages are stable because no page
+    // is evicted until the insertion finishes
+    page_t& page = fetch_page(page_nr);
+    if (page.leaf) {
+        auto it = std::lower_bound(page.names.begin(), page.names.end(), name);
+        const auto pos = it - page.names.begin();
+        if (it != page.names.end() and *it == name) {
+            changed = page.values[size_t(pos)] != id;
+            if (changed) {
+                page.values[size_t(pos)] = id;
+                mark_page_dirty(page);
+            }
+
+            // Same entry size, no split is possible
+            return false;
+        }
+
+        page.names.insert(it, name);
+        page.values.insert(page.values.begin() + pos, id);
+        ++name_cnt;
+        changed = true;
+        mark_page_dirty(page);
+
+    } else {
+        const auto ix = std::ptrdiff_t(find_child_of(page, name));
+        std::string child_split_name;
+        uint32_t child_split_page_nr = 0;
+        if (not insert_into(page.values[size_t(ix)], name, id, changed, child_split_name, child_split_page_nr)) {
+            return false;
+        }
+
+        page.names.insert(page.names.begin() + ix + 1, child_split_name);
+        page.values.insert(page.values.begin() + ix + 1, child_split_page_nr);
+        mark_page_dirty(page);
+    }
+
+    const uint32_t total_sz = calc_page_size(page);
+    if (total_sz <= PageSize) {
+        return false;
+    }
+
+    // Split the page in two halves of roughly the same size. An entry takes
+    // at most 260 bytes (id, name length and up to 255 bytes of name) and the page
+    // fitted in PageSize (1024 bytes) before this insert so total_sz is at most
+    // 1024 + 260. The left half stops growing at total_sz / 2, overshooting it by
+    // less than an entry (642 + 260 bytes), and the right half takes the rest
+    // so both halves fit in a page.
+    static_assert((PageSize + 260) / 2 + 260 <= PageSize);
+    uint32_t left_sz = sizeof(uint8_t) * 2 + sizeof(uint16_t);  // page header
+    size_t mid = 0;
+    while (mid < page.names.size() and left_sz < total_sz / 2) {
+        left_sz += assert_u32(sizeof(uint32_t) + sizeof(uint8_t) + page.names[mid].size());
+        ++mid;
+    }
+    mid = std::clamp<size_t>(mid, 1, page.names.size() - 1);
+    const auto mid_off = std::ptrdiff_t(mid);
+
+    split_page_nr = alloc_page(page.leaf);
+    page_t& right = fetch_page(split_page_nr);
+
+    right.names.assign(std::make_move_iterator(page.names.begin() + mid_off), std::make_move_iterator(page.names.end()));
+    right.values.assign(page.values.begin() + mid_off, page.values.end());
+    page.names.resize(mid);
+    page.values.resize(mid);
+
+    split_name = right.names[0];
+    return true;
+}
+
+bool NameIndexDescriptor::erase(const std::string& name) {
+    if (page_cnt == 0) {
+        return false;
+    }
+
+    bool found = false;
+    uint32_t page_nr = root_page;
+    while (true) {
+        page_t& page = fetch_page(page_nr);
+        if (not page.leaf) {
+            page_nr = page.values[find_child_of(page, name)];
+            continue;
+        }
+
+        auto it = std::lower_bound(page.names.begin(), page.names.end(), name);
+        if (it != page.names.end() and *it == name) {
+            page.values.erase(page.values.begin() + (it - page.names.begin()));
+            page.names.erase(it);
+            --name_cnt;
+            mark_page_dirty(page);
+            found = true;
+        }
+        break;
+    }
+
+    evict_pages();
+    return found;
+}
+
+void NameIndexDescriptor::scan_from(const std::string& from,
+                                    const std::function<bool(const std::string&, uint32_t)>& fn) {
+    if (page_cnt == 0) {
+        return;
+    }
+
+    scan_page(root_page, from, fn);
+    evict_pages();
+}
+
+bool NameIndexDescriptor::scan_page(uint32_t page_nr, const std::string& from,
+                                    const std::function<bool(const std::string&, uint32_t)>& fn) {
+    // Copy what we need from the page: fn may do lookups that evict it
+    const page_t& page = fetch_page(page_nr);
+    if (page.leaf) {
+        auto it = std::lower_bound(page.names.begin(), page.names.end(), from);
+        const auto pos = it - page.names.begin();
+
+        std::vector<std::string> names(it, page.names.end());
+        std::vector<uint32_t> ids(page.values.begin() + pos, page.values.end());
+        for (size_t i = 0; i < names.size(); ++i) {
+            if (not fn(names[i], ids[i])) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    const auto ix = std::ptrdiff_t(find_child_of(page, from));
+    std::vector<uint32_t> children(page.values.begin() + ix, page.values.end());
+    for (const auto child_nr: children) {
+        if (not scan_page(child_nr, from, fn)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void NameIndexDescriptor::set_max_cached_pages(uint32_t max_pages) {
+    if (max_pages == 0) {
+        throw std::runtime_error("The name index requires at least 1 cached page.");
+    }
+
+    max_cached_pages = max_pages;
+    evict_pages();
+}
+
+NameIndexDescriptor::page_t& NameIndexDescriptor::fetch_page(uint32_t page_nr) {
+    auto it = cache.find(page_nr);
+    if (it != cache.end()) {
+        it->second.last_use = ++use_tick;
+        return it->second;
+    }
+
+    if (page_nr >= page_cnt) {
+        throw InconsistentXOZ(F() << "The page " << page_nr << " of the name index is out of range (there are "
+                                  << page_cnt << " pages).");
+    }
+
+    std::vector<char> buf(PageSize);
+    auto io = get_content_part(Parts::Pages).get_io();
+    io.seek_rd(page_nr * PageSize);
+    io.readall(buf.data(), PageSize);
+
+    IOSpan pio(buf.data(), PageSize);
+    const uint8_t kind = pio.read_u8_from_le();
+    pio.read_u8_from_le();  // reserved
+    const uint16_t cnt = pio.read_u16_from_le();
+
+    if (kind != PageKind::Leaf and kind != PageKind::Inner) {
+        throw InconsistentXOZ(F() << "The page " << page_nr << " of the name index has an unknown kind " << int(kind)
+                                  << ".");
+    }
+
+    if (kind == PageKind::Inner and cnt < 2) {
+        throw InconsistentXOZ(F() << "The inner page " << page_nr << " of the name index has " << cnt
+                                  << " entries but at least 2 were expected.");
+    }
+
+    page_t page = {.leaf = kind == PageKind::Leaf, .dirty = false, .last_use = ++use_tick, .names = {}, .values = {}};
+    page.names.reserve(cnt);
+    page.values.reserve(cnt);
+
+    char name_buf[256];
+    for (unsigned i = 0; i < cnt; ++i) {
+        const uint32_t value = pio.read_u32_from_le();
+        const uint8_t len = pio.read_u8_from_le();
+        pio.readall(name_buf, len);
+
+        page.values.push_back(value);
+        page.names.emplace_back(name_buf, len);
+    }
+
+    return cache.emplace(page_nr, std::move(page)).first->second;
+}
+
+uint32_t NameIndexDescriptor::alloc_page(bool leaf) {
+    const uint32_t page_nr = page_cnt;
+    ++page_cnt;
+
+    // Grow the content geometrically so adding pages one by one does not
+    // reallocate (and copy) the whole content each time
+    auto cpart = get_content_part(Parts::Pages);
+    const uint32_t required_sz = assert_u32(uint64_t(page_cnt) * PageSize);
+    if (cpart.size() < required_sz) {
+        cpart.resize(assert_u32(std::max<uint64_t>(required_sz, uint64_t(cpart.size()) * 2)));
+    }
+
+    page_t page = {.leaf = leaf, .dirty = false, .last_use = ++use_tick, .names = {}, .values = {}};
+    mark_page_dirty(cache.emplace(page_nr, std::move(page)).first->second);
+    return page_nr;
+}
+
+void NameIndexDescriptor::mark_page_dirty(page_t& page) {
+    page.dirty = true;
+    notify_descriptor_changed();
+}
+
+void NameIndexDescriptor::write_page(uint32_t page_nr, const page_t& page) {
+    std::vector<char> buf(PageSize);
+    IOSpan pio(buf.data(), PageSize);
+
+    pio.write_u8_to_le(page.leaf ? PageKind::Leaf : PageKind::Inner);
+    pio.write_u8_to_le(0);  // reserved
+    pio.write_u16_to_le(assert_u16(page.names.size()));
+    for (size_t i = 0; i < page.names.size(); ++i) {
+        pio.write_u32_to_le(page.values[i]);
+        pio.write_u8_to_le(assert_u8(page.names[i].size()));
+        pio.writeall(page.names[i].data(), assert_u8(page.names[i].size()));
+    }
+
+    auto io = get_content_part(Parts::Pages).get_io();
+    io.seek_wr(page_nr * PageSize);
+    io.writeall(buf.data(), PageSize);
+}
+
+void NameIndexDescriptor::evict_pages() {
+    while (cache.size() > max_cached_pages) {
+        auto lru = std::min_element(cache.begin(), cache.end(), [](const auto& a, const auto& b) {
+            return a.second.last_use < b.second.last_use;
+        });
+
+        if (lru->second.dirty) {
+            write_page(lru->first, lru->second);
+        }
+        cache.erase(lru);
+    }
+}
+
+void NameIndexDescriptor::flush_writes() {
+    for (auto& [page_nr, page]: cache) {
+        if (page.dirty) {
+            write_page(page_nr, page);
+            page.dirty = false;
+        }
+    }
+}
+
+void NameIndexDescriptor::release_free_space() {
+    // Drop the pages reserved ahead by alloc_page()
+    auto cpart = get_content_part(Parts::Pages);
+    const uint32_t used_sz = assert_u32(uint64_t(page_cnt) * PageSize);
+    if (cpart.size() > used_sz) {
+        cpart.resize(used_sz);
+    }
+}
+
+uint32_t NameIndexDescriptor::calc_page_size(const page_t& page) {
+    uint32_t sz = sizeof(uint8_t) * 2 + sizeof(uint16_t);  // kind, reserved and entries count
+    for (const auto& name: page.names) {
+        sz += assert_u32(sizeof(uint32_t) + sizeof(uint8_t) + name.size());
+    }
+
+    return sz;
+}
+
+size_t NameIndexDescriptor::find_child_of(const page_t& page, const std::string& name) {
+    // The name of the first entry is ignored: its child holds the names
+    // less than the name of the second entry
+    auto it = std::upper_bound(page.names.begin() + 1, page.names.end(), name);
+    return size_t(it - page.names.begin()) - 1;
+}
+
+void NameIndexDescriptor::fail_if_bad_values(uint32_t id, const std::string& name) const {
+    if (id == 0) {
+        throw std::runtime_error("Descriptor id '0' is not valid.");
+    }
+
+    if (id & 0x80000000) {
+        throw std::runtime_error("Descriptor id exceeds 2^31.");
+    }
+
+    if (name.size() > 255) {
+        throw std::runtime_error("Name for the descriptor is too large.");
+    }
+
+    if (name.size() == 0) {
+        throw std::runtime_error("Name for the descriptor cannot be empty.");
+    }
+}
+}  // namespace xoz
@@ -0,0 +1,133 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "xoz/dsc/descriptor.h"
+#include "xoz/io/iobase.h"
+
+namespace xoz {
+
+/*
+ * Persistent name to id mapping stored as a B+tree of fixed-size pages
+ * in the descriptor's content.
+ *
+ * Unlike IDMappingDescriptor, the mapping is never materialized in memory:
+ * the pages are read on demand and kept in a small cache (bounded by
+ * set_max_cached_pages()) so lookups, insertions and deletions cost
+ * a few page reads regardless of how many names there are.
+ *
+ * Each page has a 4 bytes header (u8 kind, u8 reserved, u16 entries count)
+ * followed by the entries (u32 value, u8 name length, name) sorted by name.
+ * In the leaves the value is the id of the named descriptor; in the inner
+ * pages it is the page number of the child that holds the names equal
+ * or greater than the entry's name (the name of the first entry of an inner
+ * page is ignored: its child holds all the names less than the second one).
+ *
+ * Pages are split when they overflow but they are not merged on deletions:
+ * the space is reused by later insertions of names of the same range.
+ * */
+class NameIndexDescriptor: public Descriptor {
+public:
+    constexpr static uint16_t TYPE = 0x01c0;
+    constexpr static struct class_tag_for_t<NameIndexDescriptor> ClassTag = {{.base = &Descriptor::ClassTag}};
+
+    constexpr static uint32_t PageSize = 1024;
+    constexpr static uint32_t DefaultMaxCachedPages = 32;
+
+    static std::unique_ptr<Descriptor> create(const struct Descriptor::header_t& hdr, BlockArray& cblkarr,
+                                              RuntimeContext& rctx);
+
+    static std::unique_ptr<NameIndexDescriptor> create(BlockArray& cblkarr);
+
+    /*
+     * Return the id mapped to the given name or 0 if there is none.
+     * */
+    uint32_t lookup(const std::string& name);
+
+    /*
+     * Map the name to the id, overriding any previous mapping.
+     * Return true if the name was added or remapped, false if it was already
+     * mapped to the same id.
+     * */
+    bool insert(const std::string& name, uint32_t id);
+
+    /*
+     * Remove the name. Return false if the name was not found.
+     * */
+    bool erase(const std::string& name);
+
+    /*
+     * Call fn for each (name, id) in name order starting from the first name
+     * that is equal or greater than from. The scan stops if fn returns false.
+     *
+     * fn must not modify the index.
+     * */
+    void scan_from(const std::string& from, const std::function<bool(const std::string&, uint32_t)>& fn);
+
+    [[nodiscard]] uint32_t count() const { return name_cnt; }
+    [[nodiscard]] uint32_t page_count() const { return page_cnt; }
+
+    /*
+     * Maximum count of pages kept in memory. Modified pages that are evicted
+     * are written to the content before.
+     * */
+    void set_max_cached_pages(uint32_t max_pages);
+    [[nodiscard]] uint32_t cached_page_count() const { return assert_u32(cache.size()); }
+
+private:
+    NameIndexDescriptor(const struct Descriptor::header_t& hdr, BlockArray& cblkarr);
+    explicit NameIndexDescriptor(BlockArray& cblkarr);
+
+private:
+    enum PageKind : uint8_t { Leaf = 0, Inner = 1 };
+
+    struct page_t {
+        bool leaf;
+        bool dirty;
+        uint64_t last_use;
+
+        std::vector<std::string> names;
+        std::vector<uint32_t> values;
+    };
+
+    // Root page number, count of pages in the content and count of names
+    uint32_t root_page;
+    uint32_t page_cnt;
+    uint32_t name_cnt;
+
+    // Cached pages by page number
+    std::map<uint32_t, page_t> cache;
+    uint32_t max_cached_pages;
+    uint64_t use_tick;
+
+    enum Parts : uint16_t { Pages, CNT };
+
+private:
+    page_t& fetch_page(uint32_t page_nr);
+    uint32_t alloc_page(bool leaf);
+    void mark_page_dirty(page_t& page);
+    void write_page(uint32_t page_nr, const page_t& page);
+    void evict_pages();
+
+    static uint32_t calc_page_size(const page_t& page);
+    static size_t find_child_of(const page_t& page, const std::string& name);
+
+    bool insert_into(uint32_t page_nr, const std::string& name, uint32_t id, bool& changed, std::string& split_name,
+                     uint32_t& split_page_nr);
+    bool scan_page(uint32_t page_nr, const std::string& from,
+                   const std::function<bool(const std::string&, uint32_t)>& fn);
+
+    void fail_if_bad_values(uint32_t id, const std::string& name) const;
+
+private:
+    void read_struct_specifics_from(IOBase& io) override;
+    void write_struct_specifics_into(IOBase& io) override;
+    void update_isize(uint64_t& isize) override;
+    void release_free_space() override;
+    void flush_writes() override;
+};
+}  // namespace xoz
@@ -2,7 +2,9 @@
 
 namespace xoz {
 OpaqueDescriptor::OpaqueDescriptor(const struct Descriptor::header_t& hdr, BlockArray& cblkarr):
-        Descriptor(hdr, cblkarr, 0) {}
+        Descriptor(hdr, cblkarr, 0) {
+    class_tag = &ClassTag;
+}
 
 void OpaqueDescriptor::read_struct_specifics_from([[maybe_unused]] IOBase& io) {}
 
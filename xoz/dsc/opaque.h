@@ -17,6 +17,8 @@ namespace xoz {
 
 class OpaqueDescriptor: public Descriptor {
 public:
+    constexpr static struct class_tag_for_t<OpaqueDescriptor> ClassTag = {{.base = &Descriptor::ClassTag}};
+
     OpaqueDescriptor(const struct Descriptor::header_t& hdr, BlockArray& cblkarr);
 
     static std::unique_ptr<Descriptor> create(const struct Descriptor::header_t& hdr, BlockArray& cblkarr,
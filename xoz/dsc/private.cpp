@@ -2,7 +2,9 @@
 
 namespace xoz {
 PrivateDescriptor::PrivateDescriptor(const struct Descriptor::header_t& hdr, BlockArray& cblkarr):
-        OpaqueDescriptor(hdr, cblkarr) {}
+        OpaqueDescriptor(hdr, cblkarr) {
+    class_tag = &ClassTag;
+}
 
 std::unique_ptr<Descriptor> PrivateDescriptor::create(const struct Descriptor::header_t& hdr, BlockArray& cblkarr,
                                                       [[maybe_unused]] RuntimeContext& rctx) {
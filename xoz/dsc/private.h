@@ -12,6 +12,8 @@ namespace xoz {
 
 class PrivateDescriptor: public OpaqueDescriptor {
 public:
+    constexpr static struct class_tag_for_t<PrivateDescriptor> ClassTag = {{.base = &OpaqueDescriptor::ClassTag}};
+
     PrivateDescriptor(const struct Descriptor::header_t& hdr, BlockArray& cblkarr);
 
     static std::unique_ptr<Descriptor> create(const struct Descriptor::header_t& hdr, BlockArray& cblkarr,
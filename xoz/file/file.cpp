@@ -1,5 +1,6 @@
 #include "xoz/file/file.h"
 
+#include <algorithm>
 #include <cstring>
 #include <filesystem>
 #include <utility>
@@ -22,7 +23,15 @@ File::File(const DescriptorMapping& dmap, const char* fpath, const struct runtim
         closed(true),
         closing(false),
         rctx(dmap, runcfg),
-        trampoline_segm(fblkarr->blk_sz_order()) {
+        trampoline_segm(fblkarr->blk_sz_order()),
+        feature_flags_compat(0),
+        feature_flags_incompat(0),
+        feature_flags_ro_compat(0),
+        generation(0),
+        snapshot_ext(Extent::EmptyExtent()),
+        snapshot_sz(0),
+        snapshot_checksum(0),
+        loaded_from_snapshot(false) {
     bootstrap_file();
     assert(not closed);
     assert(this->fblkarr->begin_blk_nr() >= 1);
@@ -35,7 +44,15 @@ File::File(const DescriptorMapping& dmap, std::unique_ptr<FileBlockArray>&& fblk
         closed(true),
         closing(false),
         rctx(dmap, runcfg),
-        trampoline_segm(fblkarr->blk_sz_order()) {
+        trampoline_segm(fblkarr->blk_sz_order()),
+        feature_flags_compat(0),
+        feature_flags_incompat(0),
+        feature_flags_ro_compat(0),
+        generation(0),
+        snapshot_ext(Extent::EmptyExtent()),
+        snapshot_sz(0),
+        snapshot_checksum(0),
+        loaded_from_snapshot(false) {
     if (is_a_new_file) {
         // The given file block array has a valid and open file but it is not initialized as
         // a xoz file yet. We do that here.
@@ -91,22 +108,39 @@ void File::bootstrap_file() {
     assert(not fblkarr->is_closed());
     read_and_check_header_and_trailer();
 
-    // Scan which extents/segments are allocated so we can initialize the allocator.
-    auto allocated = collect_allocated_segments_of_descriptors();
+    // With this, we can do alloc/dealloc and the File is fully operational.
+    loaded_from_snapshot = initialize_allocator_from_snapshot();
+    if (not loaded_from_snapshot) {
+        // Scan which extents/segments are allocated so we can initialize the allocator.
+        // This requires all the sets loaded, including the ones which load was deferred.
+        root_set->load_deferred_subsets();
+        auto allocated = collect_allocated_segments_of_descriptors();
+
+        // Add the trampoline segment, if any
+        if (trampoline_segm.length()) {
+            allocated.push_back(trampoline_segm);
+        }
 
-    // Add the trampoline segment, if any
-    if (trampoline_segm.length()) {
-        allocated.push_back(trampoline_segm);
+        fblkarr->allocator().initialize_from_allocated(allocated);
     }
 
-    // With this, we can do alloc/dealloc and the File is fully operational.
-    fblkarr->allocator().initialize_from_allocated(allocated);
+    // Names of a xoz file without a paged name index (or written by
+    // a version that does not support it) are moved now that we can allocate
+    rctx.index.move_names_into_name_index(idmap);
 
     // Now that the root set, its subsets and all descriptors were loaded
     // and the allocator is fully operational, let the descriptors know
     // that we are ready
     notify_load_to_all_descriptors();
 
+    // A snapshot in the header describes the free space of the file as it
+    // was on opening: the first modification makes it stale. Rewrite the header
+    // now, without the snapshot and with a new generation, so if the file is
+    // not closed properly the next open will not trust it.
+    if (snapshot_sz) {
+        full_sync(false);
+    }
+
     closed = false;
 }
 
@@ -128,9 +162,12 @@ std::list<Segment> File::collect_allocated_segments_of_descriptors() const {
 }
 
 void File::notify_load_to_all_descriptors() {
+    // The sets not loaded yet (deferred) will notify their descriptors
+    // by themselves once they are loaded.
+    rctx.root_set = root_set;
     DescriptorSet::bottom_up_for_each_set(*root_set, [this](DescriptorSet* s, [[maybe_unused]] size_t l) {
-        for (auto it = s->begin(); it != s->end(); ++it) {
-            (*it)->on_after_load(root_set);
+        if (s->is_set_loaded()) {
+            s->notify_after_load(root_set);
         }
     });
 }
@@ -243,7 +280,7 @@ void File::read_and_check_header_and_trailer() {
     feature_flags_incompat = u32_from_le(hdr.feature_flags_incompat);
     feature_flags_ro_compat = u32_from_le(hdr.feature_flags_ro_compat);
 
-    if (feature_flags_incompat) {
+    if (feature_flags_incompat & ~FEATURE_INCOMPAT_KNOWN) {
         throw InconsistentXOZ(*this, "the xoz file has incompatible features.");
     }
 
@@ -298,6 +335,20 @@ void File::read_and_check_header_and_trailer() {
     */
 
 
+    generation = u32_from_le(hdr.generation);
+    snapshot_sz = u32_from_le(hdr.snapshot_sz);
+    snapshot_checksum = u16_from_le(hdr.snapshot_checksum);
+
+    // The snapshot's extent is not checked here: if it is invalid, the snapshot
+    // will be ignored (see initialize_allocator_from_snapshot())
+    const uint32_t snapshot_blk_nr = u32_from_le(hdr.snapshot_blk_nr);
+    const uint32_t snapshot_blk_cnt = (snapshot_sz >> blk_sz_order) + ((snapshot_sz % blk_sz) ? 1 : 0);
+    if (snapshot_sz and snapshot_blk_cnt <= 0xffff) {
+        snapshot_ext = Extent(snapshot_blk_nr, uint16_t(snapshot_blk_cnt), false);
+    } else {
+        snapshot_ext = Extent::EmptyExtent();
+    }
+
     load_root_set(hdr);
 
     // TODO this *may* still be useful: assert(phy_file_end_pos > 0);
@@ -364,6 +415,20 @@ void File::write_header() {
         fblkarr->allocator().release();
     }
 
+    // Any previous snapshot was either consumed on open or it was never written:
+    // only a snapshot taken right now, on closing, can be valid.
+    snapshot_ext = Extent::EmptyExtent();
+    snapshot_sz = 0;
+    snapshot_checksum = 0;
+
+    if (rctx.runcfg.file.free_space_snapshot) {
+        ++generation;
+
+        if (closing) {
+            write_free_space_snapshot();
+        }
+    }
+
     // Note: currently the trailer size is fixed but we may decide
     // to make it variable later.
     //
@@ -394,11 +459,17 @@ void File::write_header() {
                                 .blk_total_cnt = u32_to_le(blk_total_cnt),
                                 .blk_sz_order = u8_to_le(fblkarr->blk_sz_order()),
                                 .flags = 0,  // to override
-                                .feature_flags_compat = u32_to_le(0),
-                                .feature_flags_incompat = u32_to_le(0),
+                                .feature_flags_compat =
+                                        u32_to_le(snapshot_sz ? FEATURE_COMPAT_FREE_SPACE_SNAPSHOT : 0),
+                                .feature_flags_incompat = u32_to_le(calc_feature_flags_incompat()),
                                 .feature_flags_ro_compat = u32_to_le(0),
                                 .root = {0},  // to override
                                 .checksum = u16_to_le(0),
+                                .generation = u32_to_le(generation),
+                                .snapshot_blk_nr = u32_to_le(snapshot_ext.blk_nr()),
+                                .snapshot_sz = u32_to_le(snapshot_sz),
+                                .snapshot_checksum = u16_to_le(snapshot_checksum),
+                                .persistent_id_hwm = u32_to_le(snapshot_sz ? rctx.idmgr.max_persistent_id() : 0),
                                 .padding = {0}};
 
 
@@ -424,6 +495,93 @@ void File::write_panic_trailer() {
     fblkarr->write_trailer(reinterpret_cast<const char*>(&eof), sizeof(eof));
 }
 
+bool File::initialize_allocator_from_snapshot() {
+    if (not rctx.runcfg.file.free_space_snapshot) {
+        return false;
+    }
+
+    if (not(feature_flags_compat & FEATURE_COMPAT_FREE_SPACE_SNAPSHOT) or snapshot_ext.is_empty()) {
+        return false;
+    }
+
+    if (snapshot_sz % 2 != 0 or not fblkarr->is_extent_within_boundaries(snapshot_ext)) {
+        return false;
+    }
+
+    std::vector<char> buf;
+    fblkarr->read_extent(snapshot_ext, buf, snapshot_sz);
+    if (buf.size() != snapshot_sz or compute_snapshot_checksum(buf, snapshot_sz) != snapshot_checksum) {
+        return false;
+    }
+
+    // A snapshot of another generation is stale: the xoz file was modified
+    // after the snapshot was written.
+    IOSpan io(buf);
+    if (io.read_u32_from_le() != generation) {
+        return false;
+    }
+
+    // A snapshot of a block array of another size is stale too: the xoz file
+    // was truncated or extended. Check it here (peeking the count) so the
+    // allocator is not touched and the descriptors are scanned instead.
+    const uint32_t snapshot_blk_cnt = io.read_u32_from_le();
+    if (snapshot_blk_cnt != fblkarr->blk_cnt()) {
+        return false;
+    }
+    io.seek_rd(sizeof(uint32_t), IOBase::Seekdir::bwd);
+
+    // The snapshot extent is already free in the snapshot so nothing else
+    // needs to be done (see write_free_space_snapshot())
+    fblkarr->allocator().initialize_from_snapshot(io);
+    return true;
+}
+
+void File::write_free_space_snapshot() {
+    auto& sg_alloc = fblkarr->allocator();
+    sg_alloc.flush_pending_deallocs();
+
+    // Reserve the space for the snapshot and release it immediately: the snapshot
+    // is then taken with its own blocks as free so on open they are reusable as any
+    // other free block.
+    // Nothing else is allocated until the header is written so the snapshot will
+    // not be overwritten.
+    //
+    // The reserve + release may split or merge one free chunk, hence the room
+    // for one additional entry in the computed size.
+    const uint32_t reserved_sz = assert_u32(sizeof(uint32_t) + sg_alloc.calc_snapshot_footprint_size() +
+                                            sizeof(uint32_t) + sizeof(uint16_t));
+    const Extent ext = sg_alloc.alloc_single_extent(reserved_sz);
+    sg_alloc.dealloc_single_extent(ext);
+    sg_alloc.flush_pending_deallocs();
+
+    std::vector<char> buf(reserved_sz);
+    IOSpan io(buf);
+    io.write_u32_to_le(generation);
+    sg_alloc.write_snapshot_into(io);
+
+    snapshot_ext = ext;
+    snapshot_sz = io.tell_wr();
+    snapshot_checksum = compute_snapshot_checksum(buf, snapshot_sz);
+
+    fblkarr->write_extent(snapshot_ext, buf, snapshot_sz);
+}
+
+uint16_t File::compute_snapshot_checksum(const std::vector<char>& buf, const uint32_t sz) {
+    assert(sz <= buf.size());
+
+    // inet_checksum() can work up to 0xffff words at once
+    const uint32_t chunk_sz = 0xffff << 1;
+
+    uint32_t checksum = 0;
+    for (uint32_t offset = 0; offset < sz; offset += chunk_sz) {
+        const uint32_t len = std::min(chunk_sz, sz - offset);
+        checksum = inet_add(checksum, inet_to_u16(inet_checksum(
+                                              reinterpret_cast<const uint8_t*>(buf.data()) + offset, len)));
+    }
+
+    return inet_to_u16(checksum);
+}
+
 void File::init_new_file(const struct default_parameters_t& defaults) {
     fblkarr->fail_if_bad_blk_sz(defaults.blk_sz, 0, MIN_BLK_SZ);
 
@@ -544,7 +702,20 @@ void File::load_root_set(struct file_header_t& hdr) {
         root_set = Descriptor::cast<DescriptorSet>(dsc);
     }
 
+    // The subsets can be loaded lazily only if we know which persistent ids
+    // their descriptors have so we don't assign them to new descriptors.
+    // That is stored in the header along with the free space snapshot.
+    const bool can_defer_load = rctx.runcfg.dset.lazy_load_subsets and
+                                (feature_flags_compat & FEATURE_COMPAT_FREE_SPACE_SNAPSHOT);
+    if (can_defer_load) {
+        rctx.idmgr.reserve_persistent_ids_up_to(u32_from_le(hdr.persistent_id_hwm));
+    }
+
     root_set->load_set();
+    if (not can_defer_load) {
+        root_set->load_deferred_subsets();
+    }
+
     load_private_metadata_from_root_set();
 }
 
@@ -631,7 +802,9 @@ void File::update_trampoline_space() {
 
 void File::load_private_metadata_from_root_set() {
     xoz_assert("IDMappingDescriptor already loaded", not idmap);
+    xoz_assert("NameIndexDescriptor already loaded", not nameidx);
     std::shared_ptr<IDMappingDescriptor> idmap_tmp;
+    std::shared_ptr<NameIndexDescriptor> nameidx_tmp;
 
     // Search for the private descriptors that contain xoz-specific metadata
     for (auto it = root_set->begin(); it != root_set->end(); ++it) {
@@ -643,6 +816,19 @@ void File::load_private_metadata_from_root_set() {
                 throw InconsistentXOZ("IDMappingDescriptor (index data) found duplicated.");
             }
         }
+
+        nameidx_tmp = Descriptor::cast<NameIndexDescriptor>(*it, true);
+        if (nameidx_tmp) {
+            if (not nameidx) {
+                nameidx = nameidx_tmp;
+            } else {
+                throw InconsistentXOZ("NameIndexDescriptor (index data) found duplicated.");
+            }
+        }
+    }
+
+    if (bool(nameidx) != bool(feature_flags_incompat & FEATURE_INCOMPAT_NAME_INDEX)) {
+        throw InconsistentXOZ(*this, "the presence of the name index does not match the xoz file features.");
     }
 
     // Create default descriptors if they were not found earlier
@@ -656,8 +842,30 @@ void File::load_private_metadata_from_root_set() {
         }
     }
 
+    if (not nameidx and rctx.runcfg.file.paged_name_index and rctx.runcfg.file.keep_index_updated) {
+        auto id = root_set->add(NameIndexDescriptor::create(*fblkarr));
+        nameidx = root_set->get<NameIndexDescriptor>(id);
+    }
+
     // Initialize the index
-    rctx.index.init_index(*root_set, idmap);
+    rctx.index.init_index(*root_set, idmap, nameidx);
+
+    if (idmap->is_stored_as_log() and not(feature_flags_incompat & FEATURE_INCOMPAT_ID_MAPPING_LOG)) {
+        throw InconsistentXOZ(*this, "the id mapping is stored as a log but the xoz file does not flag it.");
+    }
+}
+
+uint32_t File::calc_feature_flags_incompat() const {
+    uint32_t flags = 0;
+    if (idmap and idmap->is_stored_as_log()) {
+        flags |= FEATURE_INCOMPAT_ID_MAPPING_LOG;
+    }
+
+    if (nameidx) {
+        flags |= FEATURE_INCOMPAT_NAME_INDEX;
+    }
+
+    return flags;
 }
 
 void File::check_header_magic(struct file_header_t& hdr) {
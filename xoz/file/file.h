@@ -42,6 +42,30 @@ public:
     constexpr static uint32_t MAX_BLK_SZ = (1 << MAX_BLK_SZ_ORDER);
     constexpr static uint32_t HEADER_BLK_CNT = 1;
 
+    /*
+     * Compatible feature: the header points to a snapshot of the allocator's free space
+     * written on close() so the next open can initialize the allocator without scanning
+     * all the descriptors. A library that does not know this feature can ignore it safely.
+     * */
+    constexpr static uint32_t FEATURE_COMPAT_FREE_SPACE_SNAPSHOT = 0x00000001;
+
+    /*
+     * Incompatible feature: the IDMappingDescriptor stores its names as a log
+     * (with deletion and overriding records, read until the end of its content)
+     * instead of exactly num_entries records. A library that does not know
+     * this feature would read a wrong mapping so it must not open the file.
+     * */
+    constexpr static uint32_t FEATURE_INCOMPAT_ID_MAPPING_LOG = 0x00000001;
+
+    /*
+     * Incompatible feature: the names are kept in a NameIndexDescriptor instead
+     * of in the IDMappingDescriptor. A library that does not know this feature
+     * would see no names at all so it must not open the file.
+     * */
+    constexpr static uint32_t FEATURE_INCOMPAT_NAME_INDEX = 0x00000002;
+
+    constexpr static uint32_t FEATURE_INCOMPAT_KNOWN = FEATURE_INCOMPAT_ID_MAPPING_LOG | FEATURE_INCOMPAT_NAME_INDEX;
+
 private:
     std::string fpath;
 
@@ -56,11 +80,19 @@ private:
     std::shared_ptr<DescriptorSet> root_set;
 
     std::shared_ptr<IDMappingDescriptor> idmap;
+    std::shared_ptr<NameIndexDescriptor> nameidx;
 
     uint32_t feature_flags_compat;
     uint32_t feature_flags_incompat;
     uint32_t feature_flags_ro_compat;
 
+    uint32_t generation;
+
+    Extent snapshot_ext;
+    uint32_t snapshot_sz;
+    uint16_t snapshot_checksum;
+    bool loaded_from_snapshot;
+
 public:
     // Open a physical file and read/load the xoz file.
     //
@@ -162,6 +194,28 @@ private:
      * */
     std::list<Segment> collect_allocated_segments_of_descriptors() const;
 
+    /*
+     * If the xoz file has a free space snapshot and it is valid (its checksum is good
+     * and its generation and block count match the header's), initialize the allocator
+     * from it and return true. Otherwise, return false and the caller must initialize
+     * the allocator scanning the descriptors.
+     *
+     * The snapshot is used only if runcfg.file.free_space_snapshot is set.
+     * */
+    bool initialize_allocator_from_snapshot();
+
+    /*
+     * Write the free space snapshot into a newly allocated extent and record it
+     * in snapshot_ext/sz/checksum so write_header() can point to it.
+     *
+     * The extent is deallocated before taking the snapshot so the snapshot
+     * describes its own blocks as free: once loaded they are reusable
+     * without any further deallocation.
+     * This must be the last thing done before writing the header on close.
+     * */
+    void write_free_space_snapshot();
+    static uint16_t compute_snapshot_checksum(const std::vector<char>& buf, const uint32_t sz);
+
     /*
      * Call on_after_load to all the descriptors.
      * */
@@ -308,8 +362,25 @@ private:
         // Inet checksum of the header, including the padding.
         uint16_t checksum;
 
+        // Incremented on each write of the header if the free space snapshot
+        // is enabled (see runtime_config_t). The snapshot stores the generation
+        // of the header written with it so a stale snapshot can be detected.
+        uint32_t generation;
+
+        // Where the free space snapshot lives (if the FEATURE_COMPAT_FREE_SPACE_SNAPSHOT
+        // bit is set), its size in bytes and its inet checksum.
+        // See write_free_space_snapshot() and initialize_allocator_from_snapshot().
+        uint32_t snapshot_blk_nr;
+        uint32_t snapshot_sz;
+        uint16_t snapshot_checksum;
+
+        // The highest persistent id in use when the snapshot was written (0 if there
+        // is no snapshot). With it, the subsets can be loaded lazily: new persistent
+        // ids will not collide with the ones of the descriptors not loaded yet.
+        uint32_t persistent_id_hwm;
+
         // TODO ensure that the read and write preserves this "padding" for backward/forward compat
-        uint8_t padding[50];
+        uint8_t padding[32];
     } __attribute__((packed));
 
     // In-disk xoz file's trailer
@@ -346,6 +417,12 @@ private:
      * */
     void load_private_metadata_from_root_set();
 
+    /*
+     * Incompat feature flags required by the private metadata
+     * as it is going to be written.
+     * */
+    uint32_t calc_feature_flags_incompat() const;
+
 private:
     static void check_header_magic(struct file_header_t& hdr);
     static uint16_t compute_header_checksum(struct file_header_t& hdr);
@@ -357,5 +434,6 @@ public:
     static_assert(HEADER_ROOT_SET_SZ >= 32);
 
     Segment /* testing */ trampoline_segment() const { return trampoline_segm; }
+    bool /* testing */ was_loaded_from_snapshot() const { return loaded_from_snapshot; }
 };
 }  // namespace xoz
@@ -2,33 +2,134 @@
 
 #include <cassert>
 #include <cstdint>
-#include <set>
+#include <iterator>
+#include <map>
 
 #include "xoz/err/exceptions.h"
 
 namespace xoz {
 class IDManager {
 public:
-    IDManager() { reset(); }
+    IDManager(): reuse_freed_ids(false) { reset(); }
 
     uint32_t request_temporal_id() { return next_temporal_id++; }
     uint32_t request_persistent_id() {
-        uint32_t id = 1;
-        if (persistent_ids.size() > 0) {
-            id = (*persistent_ids.rbegin()) + 1;
+        uint32_t id = max_persistent_id() + 1;
+        if (reuse_freed_ids) {
+            id = lowest_free_persistent_id();
+        }
+
+        if (not is_persistent(id)) {
+            throw std::runtime_error("No more persistent ids available.");
         }
 
         register_persistent_id(id);
         return id;
     }
 
+    /*
+     * Request cnt persistent ids, all of them contiguous, and return
+     * the first one (or 0 if cnt is 0).
+     *
+     * The ids are always after the largest one, even if freed ids
+     * are reused (see set_reuse_freed_ids()).
+     * */
+    uint32_t request_persistent_ids(uint32_t cnt) {
+        if (cnt == 0) {
+            return 0;
+        }
+
+        uint32_t first_id = max_persistent_id() + 1;
+        uint32_t last_id = first_id + (cnt - 1);
+        if (is_temporal(last_id) or last_id < first_id) {
+            throw std::runtime_error("No more persistent ids available.");
+        }
+
+        // The ids are larger than any registered so they extend the last interval
+        // or they are a new interval at the end
+        if (persistent_ids.size() > 0 and persistent_ids.rbegin()->second + 1 == first_id) {
+            persistent_ids.rbegin()->second = last_id;
+        } else {
+            persistent_ids.emplace_hint(persistent_ids.end(), first_id, last_id);
+        }
+        registered_cnt += cnt;
+        return first_id;
+    }
+
     // This makes sense only very special cases or for testing.
     void reset(uint32_t init = 0x80000000) {
         assert(init >= 0x80000000);
         next_temporal_id = init;
         persistent_ids.clear();
+        registered_cnt = 0;
+        reserved_up_to_id = 0;
+        reserved_ids.clear();
     }
 
+    /*
+     * Reserve all the persistent ids up to the given one (inclusive) so
+     * request_persistent_id() will not return any of them.
+     *
+     * This is for descriptors that were not loaded yet (like the ones of subsets
+     * loaded lazily) and that will register their persistent ids later.
+     * */
+    void reserve_persistent_ids_up_to(uint32_t id) {
+        if (is_temporal(id)) {
+            throw std::runtime_error("Temporal ids cannot be reserved.");
+        }
+
+        if (id > reserved_up_to_id) {
+            reserved_up_to_id = id;
+        }
+    }
+
+    /*
+     * Reserve the given persistent id so request_persistent_id() will not
+     * return it, even if freed ids are reused.
+     *
+     * Unlike reserve_persistent_ids_up_to(), this is for a known id: the one
+     * of a descriptor that was unloaded and it will register its id again
+     * when it is loaded back. Registering the id releases the reservation.
+     * */
+    void reserve_persistent_id(uint32_t id) {
+        if (not is_persistent(id)) {
+            throw std::runtime_error("Only persistent ids can be reserved.");
+        }
+        if (find_interval_of(persistent_ids, id) != persistent_ids.end()) {
+            throw std::runtime_error("Registered ids cannot be reserved.");
+        }
+
+        insert_into(reserved_ids, id);
+    }
+
+    bool is_reserved(uint32_t id) const {
+        return is_persistent(id) and
+               (id <= reserved_up_to_id or find_interval_of(reserved_ids, id) != reserved_ids.end());
+    }
+
+    // The largest persistent id either registered or reserved (0 if none).
+    uint32_t max_persistent_id() const {
+        uint32_t id = reserved_up_to_id;
+        if (persistent_ids.size() > 0 and persistent_ids.rbegin()->second > id) {
+            id = persistent_ids.rbegin()->second;
+        }
+        if (reserved_ids.size() > 0 and reserved_ids.rbegin()->second > id) {
+            id = reserved_ids.rbegin()->second;
+        }
+
+        return id;
+    }
+
+    /*
+     * If enabled, request_persistent_id() returns the lowest persistent id
+     * that is neither registered nor reserved instead of the one after the largest.
+     *
+     * Note: any reference to a removed descriptor by its id (like a name
+     * in the Index) will refer to the new descriptor with the same id.
+     * */
+    void set_reuse_freed_ids(bool enabled) { reuse_freed_ids = enabled; }
+    bool is_reuse_freed_ids_enabled() const { return reuse_freed_ids; }
+
     bool register_persistent_id(uint32_t id) {
         if (is_undefined(id)) {
             throw std::runtime_error("ID 0 cannot be registered.");
@@ -37,8 +138,16 @@ public:
             throw std::runtime_error("Temporal ids cannot be registered.");
         }
 
-        auto [_, ok] = persistent_ids.insert(id);
-        return ok;
+        if (not insert_into(persistent_ids, id)) {
+            return false;  // already registered
+        }
+
+        if (reserved_ids.size() > 0) {
+            erase_from(reserved_ids, id);
+        }
+
+        ++registered_cnt;
+        return true;
     }
 
     static bool is_temporal(uint32_t id) { return not is_undefined(id) and (id & 0x80000000); }
@@ -55,7 +164,7 @@ public:
             throw std::runtime_error("Temporal ids cannot be registered.");
         }
 
-        return persistent_ids.contains(id);
+        return find_interval_of(persistent_ids, id) != persistent_ids.end();
     }
 
     void unregister_persistent_id(uint32_t id) {
@@ -63,13 +172,149 @@ public:
             throw std::runtime_error("Persistent id was never registered.");
         }
 
-        persistent_ids.erase(id);
+        erase_from(persistent_ids, id);
+        --registered_cnt;
     }
 
+    uint32_t registered_count() const { return registered_cnt; }
+
+    // Count of intervals of contiguous registered ids (for testing and stats)
+    uint32_t registered_interval_count() const { return uint32_t(persistent_ids.size()); }
+
 private:
     uint32_t next_temporal_id;
 
-    std::set<uint32_t> persistent_ids;
+    /*
+     * Registered persistent ids as disjoint and non-adjacent intervals
+     * [first, last] keyed by their first id.
+     *
+     * A run of contiguous ids takes a single node and registering ids
+     * in increasing order (as it happens on a load) is O(1).
+     * */
+    typedef std::map<uint32_t, uint32_t> intervals_t;
+    intervals_t persistent_ids;
+    uint32_t registered_cnt;
+
+    /*
+     * Reserved persistent ids: all the ids up to <reserved_up_to_id> (for
+     * descriptors not loaded yet, see reserve_persistent_ids_up_to()) and
+     * the exact ids in <reserved_ids> (for descriptors unloaded, see
+     * reserve_persistent_id()), the latter as intervals like <persistent_ids>.
+     * */
+    uint32_t reserved_up_to_id;
+    intervals_t reserved_ids;
+
+    bool reuse_freed_ids;
+
+    static intervals_t::const_iterator find_interval_of(const intervals_t& intervals, uint32_t id) {
+        auto next = intervals.upper_bound(id);
+        if (next == intervals.begin()) {
+            return intervals.end();
+        }
+
+        auto prev = std::prev(next);
+        return prev->second >= id ? prev : intervals.end();
+    }
+
+    /*
+     * Add the id to the intervals, extending and joining them if needed.
+     * Return false if the id was already there.
+     * */
+    static bool insert_into(intervals_t& intervals, uint32_t id) {
+        // Fast path: ids added in increasing order (like during a load)
+        // extend the last interval or add a new one at the end
+        if (intervals.size() > 0 and intervals.rbegin()->second < id) {
+            if (intervals.rbegin()->second + 1 == id) {
+                intervals.rbegin()->second = id;
+            } else {
+                intervals.emplace_hint(intervals.end(), id, id);
+            }
+            return true;
+        }
+
+        auto next = intervals.upper_bound(id);
+        if (next != intervals.begin()) {
+            auto prev = std::prev(next);
+            if (prev->second >= id) {
+                return false;
+            }
+
+            if (prev->second + 1 == id) {
+                prev->second = id;
+
+                // Join the previous and the next intervals if now they are adjacent
+                if (next != intervals.end() and next->first == id + 1) {
+                    prev->second = next->second;
+                    intervals.erase(next);
+                }
+
+                return true;
+            }
+        }
+
+        if (next != intervals.end() and next->first == id + 1) {
+            const uint32_t last_id = next->second;
+            auto hint = intervals.erase(next);
+            intervals.emplace_hint(hint, id, last_id);
+        } else {
+            intervals.emplace_hint(next, id, id);
+        }
+
+        return true;
+    }
+
+    /*
+     * Remove the id from the intervals, shrinking or splitting them if needed.
+     * Return false if the id was not there.
+     * */
+    static bool erase_from(intervals_t& intervals, uint32_t id) {
+        auto it = intervals.upper_bound(id);
+        if (it == intervals.begin()) {
+            return false;
+        }
+
+        it = std::prev(it);
+        const uint32_t first_id = it->first;
+        const uint32_t last_id = it->second;
+        if (last_id < id) {
+            return false;
+        }
+
+        if (first_id == last_id) {
+            intervals.erase(it);
+        } else if (id == first_id) {
+            auto hint = intervals.erase(it);
+            intervals.emplace_hint(hint, id + 1, last_id);
+        } else if (id == last_id) {
+            it->second = id - 1;
+        } else {
+            // Split the interval in two
+            it->second = id - 1;
+            intervals.emplace_hint(std::next(it), id + 1, last_id);
+        }
+
+        return true;
+    }
+
+    // The reserved ids may belong to descriptors not loaded yet so they are skipped
+    uint32_t lowest_free_persistent_id() const {
+        uint32_t id = reserved_up_to_id + 1;
+        while (true) {
+            // The intervals of each map are not adjacent but an interval of
+            // one map may be adjacent to an interval of the other
+            auto it = find_interval_of(persistent_ids, id);
+            if (it == persistent_ids.end()) {
+                it = find_interval_of(reserved_ids, id);
+                if (it == reserved_ids.end()) {
+                    break;
+                }
+            }
+
+            id = it->second + 1;
+        }
+
+        return id;
+    }
 
     enum Parts : uint16_t { Map, CNT };
 };
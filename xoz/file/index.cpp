@@ -5,9 +5,11 @@
 #include "xoz/log/format_string.h"
 
 namespace xoz {
-Index::Index(const IDManager& idmgr): dset(nullptr), idmgr(idmgr) {}
+Index::Index(const IDManager& idmgr, const std::shared_ptr<MemoryPool>& mempool):
+        dset(nullptr), idmgr(idmgr), dsc_by_id(decltype(dsc_by_id)::allocator_type(mempool)) {}
 
-void Index::init_index(DescriptorSet& dset, std::shared_ptr<IDMappingDescriptor>& idmap) {
+void Index::init_index(DescriptorSet& dset, std::shared_ptr<IDMappingDescriptor>& idmap,
+                       const std::shared_ptr<NameIndexDescriptor>& nameidx) {
     if (this->dset) {
         throw std::runtime_error("The index is already initialized");
     }
@@ -17,15 +19,27 @@ void Index::init_index(DescriptorSet& dset, std::shared_ptr<IDMappingDescriptor>
     }
 
     this->id_by_name = idmap->load();
+    this->modified_names.clear();
     for (auto& [name, id]: id_by_name) {
         fail_if_bad_values(name, id, false);
     }
 
+    this->nameidx = nameidx;
+
     this->dset = &dset;
 }
 
 std::shared_ptr<Descriptor> Index::find(const std::string& name) {
     fail_if_not_initialized();
+    if (is_in_name_index(name)) {
+        const uint32_t id = nameidx->lookup(name);
+        if (id == 0) {
+            throw std::invalid_argument((F() << "No descriptor with name '" << name << "' was found.").str());
+        }
+
+        return find(id);
+    }
+
     if (not id_by_name.contains(name)) {
         throw std::invalid_argument((F() << "No descriptor with name '" << name << "' was found.").str());
     }
@@ -35,30 +49,56 @@ std::shared_ptr<Descriptor> Index::find(const std::string& name) {
 
 std::shared_ptr<Descriptor> Index::find(uint32_t id) {
     fail_if_not_initialized();
-    if (dsc_by_id_cache.contains(id)) {
-        return dsc_by_id_cache[id];
-    }
 
-    std::shared_ptr<Descriptor> dsc;
-    DescriptorSet::bottom_up_for_each_set(*dset, [&dsc, id](DescriptorSet* s, [[maybe_unused]] size_t l) {
-        if (not s->contains(id)) {
-            return false;
+    auto it = dsc_by_id.find(id);
+    if (it != dsc_by_id.end()) {
+        auto dsc = it->second.lock();
+        if (dsc and dsc->id() == id and is_reachable_from_root(*dsc)) {
+            return dsc;
         }
+    }
 
-        dsc = s->get(id);
-        xoz_assert("Descriptor pointer found null in a set.", dsc);
-        return true;
-    });
+    // The descriptor may live in a set not loaded yet: its id is reserved
+    // but not registered (see IDManager::reserve_persistent_ids_up_to and
+    // IDManager::reserve_persistent_id).
+    // Search top-down: contains() loads the set if its load was deferred
+    // so its subsets are known before exploring them.
+    std::shared_ptr<Descriptor> dsc;
+    if (idmgr.is_persistent(id) and idmgr.is_reserved(id) and not idmgr.is_registered(id)) {
+        DescriptorSet::top_down_for_each_set(*dset, [&dsc, id](DescriptorSet* s, [[maybe_unused]] size_t l) {
+            if (not s->contains(id)) {
+                return false;
+            }
+
+            dsc = s->get(id);
+            xoz_assert("Descriptor pointer found null in a set.", dsc);
+            return true;
+        });
+    }
 
     if (not dsc) {
         throw std::invalid_argument(
                 (F() << "Descriptor " << xoz::log::hex(id) << " does not belong to any set.").str());
     }
 
-    dsc_by_id_cache[id] = dsc;
     return dsc;
 }
 
+void Index::track_descriptor(const std::shared_ptr<Descriptor>& dsc) { dsc_by_id[dsc->id()] = dsc; }
+
+void Index::untrack_descriptor(uint32_t id) { dsc_by_id.erase(id); }
+
+bool Index::is_reachable_from_root(const Descriptor& dsc) const {
+    // Descriptors of sets that were removed (or never added) to the
+    // set tree are not reachable.
+    DescriptorSet* owner = dsc.get_owner();
+    while (owner != nullptr and owner != dset) {
+        owner = owner->get_owner();
+    }
+
+    return owner == dset;
+}
+
 void Index::add_name(const std::string& name, const std::shared_ptr<Descriptor>& dsc, bool override_if_exists) {
     return _add_name(name, dsc, override_if_exists, false);
 }
@@ -91,6 +131,19 @@ void Index::_add_name(const std::string& name, uint32_t id, bool override_if_exi
     fail_if_not_initialized();
     fail_if_bad_values(name, id, is_temporal_name);
 
+    if (is_in_name_index(name)) {
+        const uint32_t other_id = nameidx->lookup(name);
+        if (other_id != 0 and other_id != id and not override_if_exists) {
+            throw std::runtime_error((F() << "The name '" << name << "' is already in use by another descriptor ("
+                                          << xoz::log::hex(other_id) << ") and cannot be assigned to descriptor "
+                                          << xoz::log::hex(id) << ".")
+                                             .str());
+        }
+
+        nameidx->insert(name, id);
+        return;
+    }
+
     if (id_by_name.contains(name) and not override_if_exists) {
         uint32_t other_id = id_by_name[name];
         if (other_id != id) {
@@ -101,25 +154,134 @@ void Index::_add_name(const std::string& name, uint32_t id, bool override_if_exi
         }
     }
 
+    if (not is_temporal_name) {
+        auto it = id_by_name.find(name);
+        if (it == id_by_name.end() or it->second != id) {
+            modified_names.insert(name);
+        }
+    }
+
     id_by_name[name] = id;
 }
 
 
 void Index::delete_name(const std::string& name) {
     fail_if_not_initialized();
+    if (is_in_name_index(name)) {
+        if (not nameidx->erase(name)) {
+            throw std::runtime_error((F() << "The name '" << name << "' was not found.").str());
+        }
+        return;
+    }
+
     if (not id_by_name.contains(name)) {
         throw std::runtime_error((F() << "The name '" << name << "' was not found.").str());
     }
 
     id_by_name.erase(name);
+    if (name[0] != TempNamePrefix) {
+        modified_names.insert(name);
+    }
+}
+
+void Index::move_names_into_name_index(std::shared_ptr<IDMappingDescriptor>& idmap) {
+    fail_if_not_initialized();
+    if (not nameidx or id_by_name.empty()) {
+        return;
+    }
+
+    for (auto& [name, id]: id_by_name) {
+        nameidx->insert(name, id);
+    }
+
+    // Leave the IDMappingDescriptor empty so the names are not moved again
+    // on the next load
+    id_by_name.clear();
+    idmap->store(id_by_name);
 }
 
 bool Index::contains(const std::string& name) const {
     fail_if_not_initialized();
+    if (is_in_name_index(name)) {
+        return nameidx->lookup(name) != 0;
+    }
+
     return id_by_name.contains(name);
 }
 
-void Index::flush(std::shared_ptr<IDMappingDescriptor>& idmap) { idmap->store(id_by_name); }
+void Index::for_each_name(const std::string& from,
+                          const std::function<bool(const std::string&, uint32_t)>& fn) const {
+    fail_if_not_initialized();
+    if (not nameidx) {
+        for (auto it = id_by_name.lower_bound(from); it != id_by_name.end(); ++it) {
+            if (not fn(it->first, it->second)) {
+                return;
+            }
+        }
+        return;
+    }
+
+    // The names are split: the temporal ones are in id_by_name and the rest
+    // in the name index. Merge both in name order.
+    auto tmp_it = id_by_name.lower_bound(from);
+    bool stopped = false;
+    nameidx->scan_from(from, [&](const std::string& name, uint32_t id) {
+        for (; tmp_it != id_by_name.end() and tmp_it->first < name; ++tmp_it) {
+            if (not fn(tmp_it->first, tmp_it->second)) {
+                stopped = true;
+                return false;
+            }
+        }
+
+        stopped = not fn(name, id);
+        return not stopped;
+    });
+
+    for (; not stopped and tmp_it != id_by_name.end(); ++tmp_it) {
+        if (not fn(tmp_it->first, tmp_it->second)) {
+            return;
+        }
+    }
+}
+
+std::vector<std::pair<std::string, uint32_t>> Index::find_prefix(const std::string& prefix) const {
+    std::vector<std::pair<std::string, uint32_t>> found;
+    for_each_name(prefix, [&](const std::string& name, uint32_t id) {
+        if (name.compare(0, prefix.size(), prefix) != 0) {
+            return false;
+        }
+
+        found.emplace_back(name, id);
+        return true;
+    });
+
+    return found;
+}
+
+void Index::flush(std::shared_ptr<IDMappingDescriptor>& idmap) {
+    if (modified_names.empty()) {
+        return;
+    }
+
+    // Rewrite the entire mapping if there is nothing stored yet (so there is no log to append to)
+    // or if the log would have too many records overridden or deleted.
+    const uint64_t record_cnt = uint64_t(idmap->stored_record_count()) + modified_names.size();
+    if (idmap->stored_record_count() == 0 or record_cnt > uint64_t(id_by_name.size()) * 2 + LogCompactionSlack) {
+        idmap->store(id_by_name);
+
+    } else {
+        std::vector<std::pair<std::string, uint32_t>> records;
+        records.reserve(modified_names.size());
+        for (const auto& name: modified_names) {
+            auto it = id_by_name.find(name);
+            records.emplace_back(name, it == id_by_name.end() ? 0 : it->second);
+        }
+
+        idmap->append(records);
+    }
+
+    modified_names.clear();
+}
 
 void Index::fail_if_bad_values(const std::string& name, uint32_t id, bool is_temporal_name) const {
     if (name.size() > 255) {
@@ -133,7 +295,10 @@ void Index::fail_if_bad_values(const std::string& name, uint32_t id, bool is_tem
         throw std::runtime_error((F() << "Name for the descriptor " << xoz::log::hex(id) << " cannot be empty.").str());
     }
 
-    if (not idmgr.is_registered(id)) {
+    // A reserved id is not registered yet because its descriptor lives
+    // in a set not loaded yet (see IDManager::reserve_persistent_ids_up_to and
+    // IDManager::reserve_persistent_id)
+    if (not idmgr.is_registered(id) and not idmgr.is_reserved(id)) {
         throw std::runtime_error((F() << "The descriptor id " << xoz::log::hex(id)
                                       << " is not registered so we cannot assign it the name '" << name << "'.")
                                          .str());
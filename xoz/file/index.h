@@ -1,13 +1,20 @@
 #pragma once
 
 #include <cstdint>
+#include <functional>
 #include <map>
 #include <memory>
+#include <set>
 #include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "xoz/dsc/descriptor.h"
 #include "xoz/dsc/descriptor_set.h"
 #include "xoz/dsc/id_mapping.h"
+#include "xoz/dsc/name_index.h"
+#include "xoz/mem/pool.h"
 
 namespace xoz {
 class IDManager;
@@ -29,8 +36,27 @@ class IDManager;
  * */
 class Index {
 public:
-    explicit Index(const IDManager& idmgr);
-    void init_index(DescriptorSet& dset, std::shared_ptr<IDMappingDescriptor>& idmap);
+    explicit Index(const IDManager& idmgr,
+                   const std::shared_ptr<MemoryPool>& mempool = std::make_shared<MemoryPool>());
+
+    /*
+     * Initialize the index loading the names from the IDMappingDescriptor.
+     *
+     * If a NameIndexDescriptor is given, the (non-temporal) names are looked
+     * up, added and deleted directly in it instead and they are not loaded
+     * in memory.
+     * */
+    void init_index(DescriptorSet& dset, std::shared_ptr<IDMappingDescriptor>& idmap,
+                    const std::shared_ptr<NameIndexDescriptor>& nameidx = nullptr);
+
+    /*
+     * Move the names loaded from the IDMappingDescriptor into the NameIndexDescriptor
+     * (if the index has one), leaving the IDMappingDescriptor empty.
+     *
+     * This writes into the descriptors so it must be called once the allocator
+     * is ready and before any name is looked up.
+     * */
+    void /* internal */ move_names_into_name_index(std::shared_ptr<IDMappingDescriptor>& idmap);
 
     /*
      * find() searches for the descriptor in the entire xoz file
@@ -38,28 +64,24 @@ public:
      *
      * If no descriptor is found (either the name is not mapped to an id
      * or the id does not belong to any descriptor), this method throws.
+     *
+     * Finding a loaded descriptor by id is a hash lookup followed by a walk
+     * up its owner chain to check that it is still in the set tree, so its
+     * cost grows with the depth of the descriptor in the tree, not with
+     * the count of descriptors. Only ids of descriptors not loaded yet
+     * require a search in the tree (loading the sets on the way).
      * */
     std::shared_ptr<Descriptor> find(const std::string& name);
     std::shared_ptr<Descriptor> find(uint32_t id);
 
     template <typename T>
     std::shared_ptr<T> find(uint32_t id, bool ret_null = false) {
-        auto ptr = std::dynamic_pointer_cast<T>(this->find(id));
-        if (!ptr and not ret_null) {
-            throw std::runtime_error("Descriptor cannot be dynamically down casted.");
-        }
-
-        return ptr;
+        return Descriptor::cast<T>(this->find(id), ret_null);
     }
 
     template <typename T>
     std::shared_ptr<T> find(const std::string& name, bool ret_null = false) {
-        auto ptr = std::dynamic_pointer_cast<T>(this->find(name));
-        if (!ptr and not ret_null) {
-            throw std::runtime_error("Descriptor cannot be dynamically down casted.");
-        }
-
-        return ptr;
+        return Descriptor::cast<T>(this->find(name), ret_null);
     }
 
     constexpr static char TempNamePrefix = IDMappingDescriptor::TempNamePrefix;
@@ -75,8 +97,48 @@ public:
     void delete_name(const std::string& name);
     bool contains(const std::string& name) const;
 
+    /*
+     * Call fn for each name (and its id) in name order starting from the first
+     * name that is equal or greater than from. The iteration stops when fn
+     * returns false so a range [from, to) can be iterated stopping at the first
+     * name not less than to.
+     *
+     * Temporal names are included. fn must not add or delete names.
+     * */
+    void for_each_name(const std::string& from, const std::function<bool(const std::string&, uint32_t)>& fn) const;
+
+    /*
+     * Return the names (and their ids) that start with the given prefix, in name order.
+     * */
+    std::vector<std::pair<std::string, uint32_t>> find_prefix(const std::string& prefix) const;
+
+    /*
+     * Persist the names added or deleted since the last flush.
+     * The changed names are appended to the log of the IDMappingDescriptor
+     * unless the log grew too much compared with the live names; in that
+     * case the entire mapping is rewritten (compacted).
+     *
+     * If the index uses a NameIndexDescriptor, the names are already there
+     * and it is synced as any other descriptor.
+     * */
     void flush(std::shared_ptr<IDMappingDescriptor>& idmap);
 
+    /*
+     * Extra records tolerated in the log of the IDMappingDescriptor
+     * (beyond twice the count of live names) before compacting it.
+     * */
+    constexpr static uint32_t LogCompactionSlack = 64;
+
+    /*
+     * Track (or untrack) the descriptor so find() can get it by id without
+     * searching it in the set tree. DescriptorSet calls these when its
+     * descriptors are added, loaded, removed or unloaded.
+     *
+     * Tracking a descriptor does not require the index to be initialized.
+     * */
+    void /* internal */ track_descriptor(const std::shared_ptr<Descriptor>& dsc);
+    void /* internal */ untrack_descriptor(uint32_t id);
+
 private:
     void fail_if_bad_values(const std::string& name, uint32_t id, bool is_temporal_name) const;
     void fail_if_not_initialized() const;
@@ -90,6 +152,23 @@ private:
     std::map<std::string, uint32_t> id_by_name;
     const IDManager& idmgr;
 
-    std::map<uint32_t, std::shared_ptr<Descriptor>> dsc_by_id_cache;
+    // Non-temporal names added, overridden or deleted since the last flush
+    std::set<std::string> modified_names;
+
+    // If set, the non-temporal names live here and not in id_by_name
+    std::shared_ptr<NameIndexDescriptor> nameidx;
+
+    bool is_in_name_index(const std::string& name) const { return nameidx and name[0] != TempNamePrefix; }
+
+    /*
+     * All the loaded descriptors of any set by id. A descriptor may be here
+     * even if it does not belong to the indexed set (it is checked on find()
+     * walking up its owners, see is_reachable_from_root()).
+     * */
+    std::unordered_map<uint32_t, std::weak_ptr<Descriptor>, std::hash<uint32_t>, std::equal_to<uint32_t>,
+                       PoolAllocator<std::pair<const uint32_t, std::weak_ptr<Descriptor>>>>
+            dsc_by_id;
+
+    bool is_reachable_from_root(const Descriptor& dsc) const;
 };
 }  // namespace xoz
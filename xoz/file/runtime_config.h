@@ -1,4 +1,7 @@
 #pragma once
+
+#include <cstdint>
+
 #include "xoz/blk/segment_block_array_flags.h"
 #include "xoz/dsc/descriptor_set_flags.h"
 
@@ -28,6 +31,72 @@ struct runtime_config_t {
          * These flags define what to do in this case.
          * */
         const uint32_t on_external_ref_action;
+
+        /*
+         * Load the subsets of a set lazily: on loading a set, its subsets
+         * are not loaded until they are used for the first time (count(),
+         * get(), add(), iteration, ...).
+         *
+         * On File, this is effective only if the xoz file has a free space
+         * snapshot (see file.free_space_snapshot); otherwise all the sets
+         * must be loaded to initialize the allocator.
+         * */
+        const bool lazy_load_subsets;
+
+        /*
+         * Count of threads used to load the sets (see DescriptorSet::load_set()).
+         * A value of 0 or 1 means that the sets are loaded in the caller's thread,
+         * without spawning any thread.
+         *
+         * With more than 1, the descriptors of the sets of the same level are
+         * parsed concurrently: the create functions of the DescriptorMapping and
+         * the read_struct_specifics_from() of the descriptors may be called
+         * concurrently (but never for the same descriptor twice) and they must not
+         * use the RuntimeContext. The ids are registered after the parsing
+         * so until then a descriptor without a persistent id has a placeholder
+         * id (see Descriptor::TEMPORAL_ID_PLACEHOLDER).
+         * */
+        const uint16_t load_workers;
+
+        /*
+         * Count of threads used to serialize the descriptors of the sets
+         * on a full_sync (see DescriptorSet::full_sync()).
+         * A value of 0 or 1 means that the sets are synced in the caller's thread,
+         * without spawning any thread.
+         *
+         * With more than 1, the write_struct_specifics_into() of the descriptors
+         * may be called concurrently (but never for the same descriptor twice).
+         * */
+        const uint16_t sync_workers;
+
+        /*
+         * On writing a set, compact its stream if the padding (free space)
+         * in it is larger than this percentage of the live bytes (the set's
+         * header and descriptors). Compacting rewrites all the descriptors
+         * contiguously in a new stream and frees the former.
+         *
+         * The padding must be at least of one block of the set's block array
+         * (otherwise the compaction would not free anything).
+         *
+         * A value of 0 disables the compaction.
+         * */
+        const uint16_t compact_padding_pct;
+
+        /*
+         * Memory budget, in count of loaded descriptors, for the sets.
+         *
+         * On a full_sync() of a set, if the set and its subsets have more
+         * descriptors loaded than this, the subsets that are clean (fully
+         * written) and that have no descriptor referenced outside them
+         * are unloaded in least recently used order until the count fits
+         * in the budget. An unloaded subset is loaded again on its next use.
+         *
+         * Only subsets which descriptors have persistent ids are unloaded:
+         * temporal ids would change on the reload.
+         *
+         * A value of 0 disables the unloading.
+         * */
+        const uint32_t max_loaded_descriptors;
     } dset;
 
     struct {
@@ -43,11 +112,43 @@ struct runtime_config_t {
          * always an IDMappingDescriptor and an updated index.
          * */
         const bool keep_index_updated;
+
+        /*
+         * On close, write a snapshot of the allocator's free space and
+         * on open, initialize the allocator from it (if present and valid)
+         * instead of scanning all the descriptors to find which blocks are
+         * in use.
+         *
+         * The snapshot is an optimization only: if it is missing, stale or
+         * corrupted, the xoz file is loaded scanning the descriptors as usual.
+         * */
+        const bool free_space_snapshot;
+
+        /*
+         * If the private NameIndexDescriptor is missing in the root set,
+         * add a new one and move the names of the IDMappingDescriptor there.
+         * Otherwise, don't.
+         *
+         * The NameIndexDescriptor keeps the names in pages on disk, loading
+         * only the ones needed to find a name: opening a xoz file with
+         * a lot of names does not require loading all of them in memory.
+         *
+         * If the xoz file already has a NameIndexDescriptor, it is used
+         * regardless of this flag.
+         * Like the IDMappingDescriptor, it is added only if keep_index_updated
+         * is set.
+         * */
+        const bool paged_name_index;
     } file;
 };
 
 constexpr static struct runtime_config_t DefaultRuntimeConfig = {
-        .dset = {.sg_blkarr_flags = SG_BLKARR_REALLOC_ON_GROW, .on_external_ref_action = DSET_ON_EXTERNAL_REF_PASS},
-        .file = {.keep_index_updated = true}};
+        .dset = {.sg_blkarr_flags = SG_BLKARR_REALLOC_ON_GROW, .on_external_ref_action = DSET_ON_EXTERNAL_REF_PASS,
+                 .lazy_load_subsets = false,
+                 .load_workers = 1,
+                 .sync_workers = 1,
+                 .compact_padding_pct = 0,
+                 .max_loaded_descriptors = 0},
+        .file = {.keep_index_updated = true, .free_space_snapshot = false, .paged_name_index = false}};
 
 }  // namespace xoz
@@ -8,22 +8,45 @@
 #include "xoz/file/id_manager.h"
 #include "xoz/file/index.h"
 #include "xoz/file/runtime_config.h"
+#include "xoz/mem/pool.h"
 
 namespace xoz {
 class RuntimeContext {
 public:
+    /*
+     * Pool for the small and numerous objects that the sets and the index
+     * allocate for each descriptor (like the nodes of their maps).
+     * */
+    std::shared_ptr<MemoryPool> mempool;
+
     IDManager idmgr;
     DescriptorMapping dmap;
     Index index;
 
     const struct runtime_config_t runcfg;
 
+    /*
+     * The root set of the xoz file, set once the file was loaded.
+     * The sets loaded lazily after that use it to call on_after_load()
+     * on their descriptors (see DescriptorSet::notify_after_load()).
+     * */
+    std::shared_ptr<DescriptorSet> root_set;
+
+    /*
+     * Incremented on each use of a set to track which sets were used
+     * least recently (see runtime_config_t::dset.max_loaded_descriptors).
+     * */
+    uint64_t dset_use_tick = 0;
+
     explicit RuntimeContext(const DescriptorMapping& dmap,
                             const struct runtime_config_t& runcfg = DefaultRuntimeConfig):
-            dmap(dmap), index(idmgr), runcfg(runcfg) {}
+            mempool(std::make_shared<MemoryPool>()), dmap(dmap), index(idmgr, mempool), runcfg(runcfg) {}
     explicit RuntimeContext(const std::map<uint16_t, descriptor_create_fn>& descriptors_map,
                             bool override_reserved = false,
                             const struct runtime_config_t& runcfg = DefaultRuntimeConfig):
-            dmap(descriptors_map, override_reserved), index(idmgr), runcfg(runcfg) {}
+            mempool(std::make_shared<MemoryPool>()),
+            dmap(descriptors_map, override_reserved),
+            index(idmgr, mempool),
+            runcfg(runcfg) {}
 };
 }  // namespace xoz
@@ -209,6 +209,18 @@ public:
         writeall(reinterpret_cast<char*>(&num), sizeof(num));
     }
 
+    uint64_t read_u64_from_le() {
+        uint64_t num = 0;
+        readall(reinterpret_cast<char*>(&num), sizeof(num));
+
+        return u64_from_le(num);
+    }
+
+    void write_u64_to_le(uint64_t num) {
+        num = u64_to_le(num);
+        writeall(reinterpret_cast<char*>(&num), sizeof(num));
+    }
+
     char read_char() {
         char c = 0;
         readall(&c, sizeof(c));
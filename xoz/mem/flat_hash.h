@@ -0,0 +1,288 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace xoz {
+/*
+ * Hash table with open addressing and linear probing: the slots are stored
+ * in a single array (no nodes) so an entry takes exactly sizeof(Slot) bytes
+ * plus the free slots.
+ *
+ * The value-initialized key (0 or nullptr) marks the free slots so it cannot
+ * be stored. The capacity is a power of two and the table grows when it
+ * is 3/4 full. Erased entries do not leave tombstones: the entries that follow
+ * in the same probe sequence are shifted back.
+ *
+ * The keys must be integers or pointers and the slots trivially copyable.
+ * Adding or erasing entries invalidates the iterators; the iteration
+ * order is unspecified.
+ *
+ * Use FlatHashSet or FlatHashMap instead.
+ * */
+template <typename K, typename Slot>
+class FlatHashTable {
+    static_assert(std::is_integral_v<K> or std::is_pointer_v<K>);
+    static_assert(std::is_trivially_copyable_v<Slot>);
+
+public:
+    class const_iterator {
+    public:
+        using value_type = Slot;
+        using reference = const Slot&;
+        using pointer = const Slot*;
+        using difference_type = std::ptrdiff_t;
+        using iterator_category = std::forward_iterator_tag;
+
+        const_iterator(): cur(nullptr), end(nullptr) {}
+        const_iterator(const Slot* cur, const Slot* end): cur(cur), end(end) { skip_free(); }
+
+        const_iterator& operator++() {
+            ++cur;
+            skip_free();
+            return *this;
+        }
+
+        const_iterator operator++(int) {
+            const_iterator cpy(*this);
+            ++(*this);
+            return cpy;
+        }
+
+        reference operator*() const { return *cur; }
+        pointer operator->() const { return cur; }
+
+        bool operator==(const const_iterator& other) const { return cur == other.cur; }
+        bool operator!=(const const_iterator& other) const { return cur != other.cur; }
+
+    private:
+        const Slot* cur;
+        const Slot* end;
+
+        void skip_free() {
+            while (cur != end and key_of(*cur) == K{}) {
+                ++cur;
+            }
+        }
+    };
+
+    const_iterator begin() const { return const_iterator(slots.data(), slots.data() + slots.size()); }
+    const_iterator end() const {
+        return const_iterator(slots.data() + slots.size(), slots.data() + slots.size());
+    }
+
+    size_t size() const { return cnt; }
+    bool empty() const { return cnt == 0; }
+    size_t capacity() const { return slots.size(); }
+
+    bool contains(const K& key) const { return find_slot(key) != nullptr; }
+
+    /*
+     * Erase the entry of the given key, if any. Return if it was erased.
+     * */
+    bool erase(const K& key) {
+        const Slot* found = find_slot(key);
+        if (not found) {
+            return false;
+        }
+
+        size_t hole = size_t(found - slots.data());
+        size_t next = hole;
+        while (true) {
+            next = (next + 1) & mask;
+            if (key_of(slots[next]) == K{}) {
+                break;
+            }
+
+            // The entry at <next> can be moved to the hole only if its home
+            // slot is not between the hole and <next> (cyclically), otherwise
+            // it would not be found anymore.
+            const size_t home = home_of(key_of(slots[next]));
+            const bool stays = hole <= next ? (hole < home and home <= next) : (hole < home or home <= next);
+            if (not stays) {
+                slots[hole] = slots[next];
+                hole = next;
+            }
+        }
+
+        slots[hole] = Slot{};
+        --cnt;
+        return true;
+    }
+
+    void clear() {
+        slots.clear();
+        slots.shrink_to_fit();
+        cnt = 0;
+        mask = 0;
+        order = 0;
+    }
+
+    /*
+     * Make room for <n> entries without growing.
+     * */
+    void reserve(size_t n) {
+        if (n * 4 <= slots.size() * 3) {
+            return;
+        }
+
+        uint8_t new_order = MinOrder;
+        while ((size_t(1) << new_order) * 3 < n * 4) {
+            ++new_order;
+        }
+        rehash(new_order);
+    }
+
+protected:
+    FlatHashTable(): cnt(0), mask(0), order(0) {}
+
+    static const K& key_of(const Slot& slot) {
+        if constexpr (std::is_same_v<Slot, K>) {
+            return slot;
+        } else {
+            return slot.first;
+        }
+    }
+
+    const Slot* find_slot(const K& key) const {
+        if (cnt == 0 or key == K{}) {
+            return nullptr;
+        }
+
+        for (size_t i = home_of(key);; i = (i + 1) & mask) {
+            const K& cur = key_of(slots[i]);
+            if (cur == key) {
+                return &slots[i];
+            }
+            if (cur == K{}) {
+                return nullptr;
+            }
+        }
+    }
+
+    Slot* find_slot(const K& key) { return const_cast<Slot*>(std::as_const(*this).find_slot(key)); }
+
+    /*
+     * Return the slot of the given key and if it was inserted. A new slot
+     * is value-initialized except for its key and the caller must
+     * complete it.
+     * */
+    std::pair<Slot*, bool> insert_slot(const K& key) {
+        assert(key != K{});
+        if ((cnt + 1) * 4 > slots.size() * 3) {
+            rehash(slots.empty() ? MinOrder : uint8_t(order + 1));
+        }
+
+        for (size_t i = home_of(key);; i = (i + 1) & mask) {
+            const K& cur = key_of(slots[i]);
+            if (cur == key) {
+                return {&slots[i], false};
+            }
+            if (cur == K{}) {
+                if constexpr (std::is_same_v<Slot, K>) {
+                    slots[i] = key;
+                } else {
+                    slots[i] = Slot{};
+                    slots[i].first = key;
+                }
+                ++cnt;
+                return {&slots[i], true};
+            }
+        }
+    }
+
+private:
+    constexpr static uint8_t MinOrder = 3;
+
+    std::vector<Slot> slots;
+    size_t cnt;
+    size_t mask;
+    uint8_t order;
+
+    /*
+     * Fibonacci hashing: the multiplication spreads the consecutive
+     * ids and the aligned pointers over the high bits, which are
+     * the ones taken.
+     * */
+    size_t home_of(const K& key) const {
+        uint64_t h;
+        if constexpr (std::is_pointer_v<K>) {
+            h = uint64_t(reinterpret_cast<uintptr_t>(key));
+        } else {
+            h = uint64_t(key);
+        }
+        return size_t((h * 0x9e3779b97f4a7c15ULL) >> (64 - order));
+    }
+
+    void rehash(uint8_t new_order) {
+        std::vector<Slot> old(size_t(1) << new_order);
+        old.swap(slots);
+        order = new_order;
+        mask = slots.size() - 1;
+
+        for (const auto& slot: old) {
+            const K& key = key_of(slot);
+            if (key == K{}) {
+                continue;
+            }
+
+            size_t i = home_of(key);
+            while (key_of(slots[i]) != K{}) {
+                i = (i + 1) & mask;
+            }
+            slots[i] = slot;
+        }
+    }
+};
+
+/*
+ * Set of integers or pointers on a FlatHashTable.
+ * */
+template <typename K>
+class FlatHashSet: public FlatHashTable<K, K> {
+public:
+    /*
+     * Insert the key, if it is not already present. Return if it was inserted.
+     * */
+    bool insert(const K& key) { return this->insert_slot(key).second; }
+};
+
+template <typename K, typename V>
+struct flat_hash_map_entry_t {
+    K first;
+    V second;
+};
+
+/*
+ * Map of integers or pointers to trivially copyable values on a FlatHashTable.
+ * The entries are iterated as flat_hash_map_entry_t (like std::pair).
+ * */
+template <typename K, typename V>
+class FlatHashMap: public FlatHashTable<K, flat_hash_map_entry_t<K, V>> {
+public:
+    /*
+     * Return a pointer to the value of the key or nullptr if the key
+     * is not present.
+     * */
+    V* find(const K& key) {
+        auto slot = this->find_slot(key);
+        return slot ? &slot->second : nullptr;
+    }
+
+    const V* find(const K& key) const {
+        auto slot = this->find_slot(key);
+        return slot ? &slot->second : nullptr;
+    }
+
+    /*
+     * Return the value of the key, inserting a value-initialized one
+     * if the key is not present.
+     * */
+    V& operator[](const K& key) { return this->insert_slot(key).first->second; }
+};
+}  // namespace xoz
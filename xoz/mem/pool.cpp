@@ -0,0 +1,234 @@
+#include "xoz/mem/pool.h"
+
+#include <bit>
+#include <mutex>
+#include <new>
+
+#include "xoz/mem/asserts.h"
+
+namespace xoz {
+FixedSizePool::FixedSizePool(uint32_t chunk_sz, uint32_t chunks_per_slab):
+        chunk_sz(chunk_sz),
+        slab_sz(0),
+        slab_cap(0),
+        slab_hdr_sz(0),
+        partial(nullptr),
+        full(nullptr),
+        in_use_cnt(0),
+        slab_cnt(0),
+        empty_slab_cnt(0) {
+    xoz_assert("chunk too small to be linked in the free list", chunk_sz >= sizeof(struct free_chunk_t));
+    xoz_assert("chunk not aligned", chunk_sz % alignof(struct free_chunk_t) == 0);
+    xoz_assert("empty slab", chunks_per_slab > 0);
+
+    // The header of the slab takes whole chunks so the chunks are aligned
+    const uint32_t hdr_chunks = (uint32_t(sizeof(struct slab_t)) + chunk_sz - 1) / chunk_sz;
+    const uint64_t min_slab_sz = uint64_t(chunk_sz) * (uint64_t(chunks_per_slab) + hdr_chunks);
+    xoz_assert("slab too large", min_slab_sz <= (uint64_t(1) << 31));
+
+    slab_sz = std::bit_ceil(uint32_t(min_slab_sz));
+    slab_hdr_sz = hdr_chunks * chunk_sz;
+    slab_cap = (slab_sz - slab_hdr_sz) / chunk_sz;
+}
+
+FixedSizePool::~FixedSizePool() {
+    for (auto head: {partial, full}) {
+        while (head) {
+            auto next = head->next;
+            ::operator delete(head, std::align_val_t(slab_sz));
+            head = next;
+        }
+    }
+}
+
+void* FixedSizePool::alloc() {
+    if (!partial) {
+        link(partial, new_slab());
+    }
+
+    struct slab_t* slab = partial;
+    void* p = nullptr;
+    if (slab->free_list) {
+        p = slab->free_list;
+        slab->free_list = slab->free_list->next;
+    } else {
+        p = slab->bump;
+        slab->bump += chunk_sz;
+    }
+
+    if (slab->in_use_cnt == 0) {
+        --empty_slab_cnt;
+    }
+
+    ++slab->in_use_cnt;
+    if (slab->in_use_cnt == slab_cap) {
+        unlink(partial, slab);
+        link(full, slab);
+    }
+
+    ++in_use_cnt;
+    return p;
+}
+
+void FixedSizePool::dealloc(void* p) {
+    xoz_assert("dealloc without alloc", in_use_cnt > 0);
+    struct slab_t* slab = slab_of(p);
+    xoz_assert("dealloc without alloc in the slab", slab->in_use_cnt > 0);
+
+    if (slab->in_use_cnt == slab_cap) {
+        unlink(full, slab);
+        link(partial, slab);
+    }
+
+    auto chunk = static_cast<struct free_chunk_t*>(p);
+    chunk->next = slab->free_list;
+    slab->free_list = chunk;
+    --slab->in_use_cnt;
+    --in_use_cnt;
+
+    if (slab->in_use_cnt == 0) {
+        // Keep one empty slab around, free the rest
+        if (empty_slab_cnt > 0) {
+            unlink(partial, slab);
+            free_slab(slab);
+        } else {
+            reset_slab(slab);
+            ++empty_slab_cnt;
+        }
+    }
+}
+
+struct FixedSizePool::slab_t* FixedSizePool::new_slab() {
+    void* mem = ::operator new(slab_sz, std::align_val_t(slab_sz));
+    auto slab = new (mem) slab_t();
+    reset_slab(slab);
+
+    ++slab_cnt;
+    ++empty_slab_cnt;
+    return slab;
+}
+
+void FixedSizePool::free_slab(struct slab_t* slab) {
+    ::operator delete(slab, std::align_val_t(slab_sz));
+    --slab_cnt;
+}
+
+void FixedSizePool::reset_slab(struct slab_t* slab) const {
+    // Forget the freed chunks and allocate them again from the begin
+    // of the slab, in order
+    slab->free_list = nullptr;
+    slab->bump = reinterpret_cast<char*>(slab) + slab_hdr_sz;
+    slab->in_use_cnt = 0;
+}
+
+struct FixedSizePool::slab_t* FixedSizePool::slab_of(void* p) const {
+    return reinterpret_cast<struct slab_t*>(reinterpret_cast<uintptr_t>(p) & ~uintptr_t(slab_sz - 1));
+}
+
+void FixedSizePool::link(struct slab_t*& head, struct slab_t* slab) {
+    slab->prev = nullptr;
+    slab->next = head;
+    if (head) {
+        head->prev = slab;
+    }
+    head = slab;
+}
+
+void FixedSizePool::unlink(struct slab_t*& head, struct slab_t* slab) {
+    if (slab->prev) {
+        slab->prev->next = slab->next;
+    } else {
+        head = slab->next;
+    }
+
+    if (slab->next) {
+        slab->next->prev = slab->prev;
+    }
+
+    slab->prev = slab->next = nullptr;
+}
+
+void* MemoryPool::alloc(uint32_t sz) {
+    xoz_assert("chunk too large", sz <= MaxChunkSize and sz > 0);
+    auto& pool = pools[size_class_of(sz)];
+    if (!pool) {
+        pool = std::make_unique<FixedSizePool>((size_class_of(sz) + 1) * Granularity);
+    }
+    return pool->alloc();
+}
+
+void MemoryPool::dealloc(void* p, uint32_t sz) {
+    xoz_assert("chunk too large", sz <= MaxChunkSize and sz > 0);
+    auto& pool = pools[size_class_of(sz)];
+    xoz_assert("dealloc from a pool that never allocated", bool(pool));
+    pool->dealloc(p);
+}
+
+uint64_t MemoryPool::in_use_count() const {
+    uint64_t cnt = 0;
+    for (const auto& pool: pools) {
+        if (pool) {
+            cnt += pool->in_use_count();
+        }
+    }
+    return cnt;
+}
+
+uint64_t MemoryPool::slab_count() const {
+    uint64_t cnt = 0;
+    for (const auto& pool: pools) {
+        if (pool) {
+            cnt += pool->slab_count();
+        }
+    }
+    return cnt;
+}
+
+uint64_t MemoryPool::slab_bytes() const {
+    uint64_t sz = 0;
+    for (const auto& pool: pools) {
+        if (pool) {
+            sz += pool->slab_count() * pool->slab_size();
+        }
+    }
+    return sz;
+}
+namespace {
+// Never destroyed: objects taken from the pool may be freed from
+// the destructors of other static objects
+MemoryPool& global_pool() {
+    static MemoryPool* pool = new MemoryPool();
+    return *pool;
+}
+
+std::mutex& global_pool_mtx() {
+    static std::mutex* mtx = new std::mutex();
+    return *mtx;
+}
+}  // namespace
+
+void* GlobalMemoryPool::alloc(size_t sz) {
+    if (sz > MemoryPool::MaxChunkSize or sz == 0) {
+        return ::operator new(sz);
+    }
+
+    std::lock_guard<std::mutex> lock(global_pool_mtx());
+    return global_pool().alloc(uint32_t(sz));
+}
+
+void GlobalMemoryPool::dealloc(void* p, size_t sz) {
+    if (sz > MemoryPool::MaxChunkSize or sz == 0) {
+        ::operator delete(p);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(global_pool_mtx());
+    global_pool().dealloc(p, uint32_t(sz));
+}
+
+uint64_t GlobalMemoryPool::in_use_count() {
+    std::lock_guard<std::mutex> lock(global_pool_mtx());
+    return global_pool().in_use_count();
+}
+
+}  // namespace xoz
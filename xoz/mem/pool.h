@@ -0,0 +1,229 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace xoz {
+/*
+ * Allocator of chunks of a fixed size carved from larger slabs.
+ *
+ * Freed chunks are kept in the free list of their slab and reused by the
+ * next allocations. A slab is returned to the system once all its chunks
+ * are freed, except one empty slab that is kept so a pool that allocates
+ * and frees around a slab boundary does not allocate a slab each time.
+ * Unlike malloc, the chunks have no header so a chunk of N bytes takes
+ * exactly N bytes.
+ *
+ * The pool is not thread-safe.
+ * */
+class FixedSizePool {
+public:
+    constexpr static uint32_t DefaultChunksPerSlab = 1024;
+
+    /*
+     * Each slab has room for at least chunks_per_slab chunks. Its size is
+     * rounded up to a power of two and the slab is aligned to it so the slab
+     * of a chunk is found from the address of the chunk. The header of the slab
+     * takes its first chunks.
+     * */
+    explicit FixedSizePool(uint32_t chunk_sz, uint32_t chunks_per_slab = DefaultChunksPerSlab);
+    ~FixedSizePool();
+
+    void* alloc();
+    void dealloc(void* p);
+
+    uint64_t in_use_count() const { return in_use_cnt; }
+    uint64_t slab_count() const { return slab_cnt; }
+    uint32_t chunk_size() const { return chunk_sz; }
+
+    /*
+     * Count of chunks of a slab and size in bytes of a slab (including its header).
+     * */
+    uint32_t slab_capacity() const { return slab_cap; }
+    uint32_t slab_size() const { return slab_sz; }
+
+private:
+    struct free_chunk_t {
+        struct free_chunk_t* next;
+    };
+
+    struct slab_t {
+        // Freed chunks, reused first
+        struct free_chunk_t* free_list;
+
+        // Chunks of the slab never allocated
+        char* bump;
+
+        // Either in the list of slabs with free chunks or in the list of full slabs
+        struct slab_t* prev;
+        struct slab_t* next;
+
+        uint32_t in_use_cnt;
+    };
+
+    uint32_t chunk_sz;
+    uint32_t slab_sz;
+    uint32_t slab_cap;
+    uint32_t slab_hdr_sz;
+
+    // Slabs with free chunks (including the empty one, if any)
+    // and slabs without free chunks
+    struct slab_t* partial;
+    struct slab_t* full;
+
+    uint64_t in_use_cnt;
+    uint64_t slab_cnt;
+    uint64_t empty_slab_cnt;
+
+    struct slab_t* new_slab();
+    void free_slab(struct slab_t* slab);
+    void reset_slab(struct slab_t* slab) const;
+    struct slab_t* slab_of(void* p) const;
+
+    static void link(struct slab_t*& head, struct slab_t* slab);
+    static void unlink(struct slab_t*& head, struct slab_t* slab);
+
+    FixedSizePool(const FixedSizePool&) = delete;
+    FixedSizePool& operator=(const FixedSizePool&) = delete;
+};
+
+/*
+ * A FixedSizePool for each size class (multiple of Granularity bytes)
+ * up to MaxChunkSize bytes. The pools are created on demand.
+ * */
+class MemoryPool {
+public:
+    constexpr static uint32_t Granularity = alignof(void*);
+    constexpr static uint32_t MaxChunkSize = 128;
+
+    MemoryPool() = default;
+
+    void* alloc(uint32_t sz);
+    void dealloc(void* p, uint32_t sz);
+
+    /*
+     * Count of chunks in use and count of slabs among all the size classes.
+     * slab_bytes() is the memory taken by those slabs.
+     * */
+    uint64_t in_use_count() const;
+    uint64_t slab_count() const;
+    uint64_t slab_bytes() const;
+
+private:
+    std::array<std::unique_ptr<FixedSizePool>, MaxChunkSize / Granularity> pools;
+
+    static uint32_t size_class_of(uint32_t sz) { return (sz + Granularity - 1) / Granularity - 1; }
+
+    MemoryPool(const MemoryPool&) = delete;
+    MemoryPool& operator=(const MemoryPool&) = delete;
+};
+
+/*
+ * Standard allocator that takes single objects of up to MemoryPool::MaxChunkSize
+ * bytes from a MemoryPool and everything else (like the arrays of buckets of a hash map)
+ * from the std::allocator.
+ *
+ * It is meant for node-based containers (std::set, std::map, std::unordered_map)
+ * with a lot of small nodes. The allocator keeps the pool alive.
+ * */
+template <typename T>
+class PoolAllocator {
+public:
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    explicit PoolAllocator(const std::shared_ptr<MemoryPool>& pool): pool(pool) {}
+
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>& other): pool(other.pool) {}  // NOLINT
+
+    T* allocate(size_t n) {
+        if (n == 1 and is_pooled) {
+            return static_cast<T*>(pool->alloc(sizeof(T)));
+        }
+        return std::allocator<T>().allocate(n);
+    }
+
+    void deallocate(T* p, size_t n) {
+        if (n == 1 and is_pooled) {
+            pool->dealloc(p, sizeof(T));
+            return;
+        }
+        std::allocator<T>().deallocate(p, n);
+    }
+
+    template <typename U>
+    bool operator==(const PoolAllocator<U>& other) const {
+        return pool == other.pool;
+    }
+
+private:
+    constexpr static bool is_pooled = sizeof(T) <= MemoryPool::MaxChunkSize and alignof(T) <= MemoryPool::Granularity;
+
+    std::shared_ptr<MemoryPool> pool;
+
+    template <typename U>
+    friend class PoolAllocator;
+};
+
+/*
+ * A process-wide MemoryPool for the objects that may outlive the RuntimeContext
+ * that created them or that are created and freed from different threads
+ * (like the descriptors and their shared_ptr control blocks).
+ *
+ * The pool is guarded by a mutex and it is never destroyed. Chunks larger
+ * than MemoryPool::MaxChunkSize bytes are taken from the global operator new.
+ * */
+class GlobalMemoryPool {
+public:
+    static void* alloc(size_t sz);
+    static void dealloc(void* p, size_t sz);
+
+    static uint64_t in_use_count();
+};
+
+/*
+ * Like PoolAllocator but on the GlobalMemoryPool. It has no state so
+ * it takes no room in the containers (or shared_ptr control blocks)
+ * that use it.
+ * */
+template <typename T>
+class GlobalPoolAllocator {
+public:
+    typedef T value_type;
+
+    GlobalPoolAllocator() = default;
+
+    template <typename U>
+    GlobalPoolAllocator(const GlobalPoolAllocator<U>&) {}  // NOLINT
+
+    T* allocate(size_t n) {
+        if (n == 1 and is_pooled) {
+            return static_cast<T*>(GlobalMemoryPool::alloc(sizeof(T)));
+        }
+        return std::allocator<T>().allocate(n);
+    }
+
+    void deallocate(T* p, size_t n) {
+        if (n == 1 and is_pooled) {
+            GlobalMemoryPool::dealloc(p, sizeof(T));
+            return;
+        }
+        std::allocator<T>().deallocate(p, n);
+    }
+
+    template <typename U>
+    bool operator==(const GlobalPoolAllocator<U>&) const {
+        return true;
+    }
+
+private:
+    constexpr static bool is_pooled = sizeof(T) <= MemoryPool::MaxChunkSize and alignof(T) <= MemoryPool::Granularity;
+};
+}  // namespace xoz